@@ -1,35 +1,51 @@
-//
-// Copyright (C) 2011-2012 by Daniel Buckmaster (dan.buckmaster@gmail.com)
-//
-// Permission is hereby granted, free of charge, to any person obtaining a copy
-// of this software and associated documentation files (the "Software"), to deal
-// in the Software without restriction, including without limitation the rights
-// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
-// copies of the Software, and to permit persons to whom the Software is
-// furnished to do so, subject to the following conditions:
-//
-// The above copyright notice and this permission notice shall be included in
-// all copies or substantial portions of the Software.
-//
-// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
-// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
-// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
-// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
-// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
-// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
-// THE SOFTWARE.
-//
-
-/// @file Aesop.h
-/// Main file for Aesop open planning library.
-
-#ifndef _AE_AESOP_H_
-#define _AE_AESOP_H_
-
-#include "AesopTypes.h"
-#include "AesopContext.h"
-#include "AesopAction.h"
-#include "AesopWorldState.h"
-#include "AesopPlanner.h"
-
-#endif
+//
+// Copyright (C) 2011-2012 by Daniel Buckmaster (dan.buckmaster@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+/// @file Aesop.h
+/// Main file for Aesop open planning library.
+
+#ifndef _AE_AESOP_H_
+#define _AE_AESOP_H_
+
+#include "AesopTypes.h"
+#include "AesopSerialize.h"
+#include "AesopEpoch.h"
+#include "AesopThreadPool.h"
+#include "AesopContext.h"
+#include "AesopAction.h"
+#include "AesopWorldState.h"
+#include "AesopWorldStore.h"
+#include "AesopClosedSet.h"
+#include "AesopBeliefState.h"
+#include "AesopDomain.h"
+#include "AesopPlanningGraph.h"
+#include "AesopPlanner.h"
+#include "AesopBdd.h"
+#include "AesopSymbolic.h"
+#include "AesopSatSolver.h"
+#include "AesopSatPlanner.h"
+#include "AesopGraphPlanner.h"
+#include "AesopExternalPlanner.h"
+#include "AesopCooperative.h"
+#include "AesopPlanService.h"
+
+#endif
@@ -0,0 +1,106 @@
+/// @file AesopBdd.h
+/// Defines BddManager class.
+
+#ifndef _AE_BDD_H_
+#define _AE_BDD_H_
+
+#include <vector>
+
+namespace Aesop {
+   /// Handle to a node in a BddManager. Only meaningful to the BddManager
+   /// that made it.
+   typedef unsigned int BddNode;
+   /// The empty set.
+   const BddNode BddFalse(0);
+   /// The set of every assignment.
+   const BddNode BddTrue(1);
+
+   /// Builds and combines reduced, ordered binary decision diagrams over a
+   /// fixed number of boolean variables. Variables are ordered by index.
+   /// Nodes are never freed; throw the whole BddManager away when done.
+   class BddManager {
+   public:
+      /// A single variable, or its negation.
+      BddNode literal(unsigned int v, bool positive = true);
+
+      /// @name Set operations
+      /// @{
+      /// Intersection.
+      BddNode conj(BddNode a, BddNode b);
+      /// Union.
+      BddNode disj(BddNode a, BddNode b);
+      /// Everything in a and not in b.
+      BddNode minus(BddNode a, BddNode b);
+      /// Existentially quantify variables out of a.
+      /// @param[in] a    BDD to quantify.
+      /// @param[in] vars Conjunction of positive literals of the variables.
+      BddNode exists(BddNode a, BddNode vars);
+      /// Fix some variables to given values, leaving a BDD that does not
+      /// depend on them.
+      /// @param[in] a   BDD to restrict.
+      /// @param[in] lits Conjunction of literals giving each variable's value.
+      BddNode restrict(BddNode a, BddNode lits);
+      /// @}
+
+      /// Find one assignment in a set.
+      /// @param[in]  a      Non-empty BDD.
+      /// @param[out] values Value of every variable. Variables a does not
+      ///                    depend on are set to false.
+      /// @return False if a is empty.
+      bool pick(BddNode a, std::vector<bool> &values) const;
+
+      /// Number of variables.
+      unsigned int numVars() const { return mVars; }
+      /// Number of nodes made so far.
+      unsigned int numNodes() const { return mNodes.size(); }
+      /// Have we hit our node limit? Once we have, every result is
+      /// meaningless.
+      bool full() const { return mFull; }
+
+      /// Default constructor.
+      /// @param[in] vars     Number of variables.
+      /// @param[in] maxNodes Most nodes we will make before giving up.
+      BddManager(unsigned int vars, unsigned int maxNodes = 1 << 22);
+
+   private:
+      struct Node {
+         unsigned int var;
+         BddNode lo, hi;
+      };
+      /// Operation codes for the computed table.
+      enum Op { OpAnd, OpOr, OpMinus, OpRelProd, OpRestrict };
+      struct CacheEntry {
+         unsigned int op;
+         BddNode a, b, c;
+         BddNode result;
+      };
+
+      unsigned int mVars;
+      unsigned int mMaxNodes;
+      bool mFull;
+      /// Every node, including the two terminals.
+      std::vector<Node> mNodes;
+      /// Open-addressed unique table of node indices; zero marks a free slot.
+      std::vector<BddNode> mUnique;
+      /// Direct-mapped computed table.
+      std::vector<CacheEntry> mCache;
+
+      unsigned int var(BddNode n) const { return mNodes[n].var; }
+      /// Find or make the node with the given variable and children.
+      BddNode mk(unsigned int v, BddNode lo, BddNode hi);
+      /// Grow the unique table and reinsert every node.
+      void rehash();
+      static unsigned int hash(unsigned int a, unsigned int b, unsigned int c);
+      bool lookup(unsigned int op, BddNode a, BddNode b, BddNode c, BddNode &result) const;
+      void store(unsigned int op, BddNode a, BddNode b, BddNode c, BddNode result);
+      BddNode apply(Op op, BddNode a, BddNode b);
+      /// Conjoin a and b while quantifying out vars.
+      BddNode relprod(BddNode a, BddNode b, BddNode vars);
+
+      /// Not copyable.
+      BddManager(const BddManager&);
+      BddManager &operator=(const BddManager&);
+   };
+};
+
+#endif
@@ -0,0 +1,117 @@
+/// @file AesopBeliefState.h
+/// Defines BeliefState class.
+
+#ifndef _AE_BELIEFSTATE_H_
+#define _AE_BELIEFSTATE_H_
+
+#include "AesopWorldState.h"
+#include "AesopWorldStore.h"
+
+#include <set>
+
+namespace Aesop {
+   /// One agent's knowledge of the world, stored as the few ways it differs
+   /// from a WorldSnapshot shared with other agents.
+   ///
+   /// This is not a WorldState, but a Planner can start from one directly
+   /// (see Planner::setBeliefStart), looking Facts up in it without copying the
+   /// world it shares. Only the graph based heuristics need it flattened.
+   class BeliefState {
+   public:
+      /// Get the value a Fact is set to.
+      bool get(const Fact &fact, PVal &val, PVal def = 0) const;
+
+      /// Set the value of a Fact for this agent only.
+      void set(const Fact &fact, PVal val = 0);
+
+      /// Unset a Fact for this agent only.
+      void unset(const Fact &fact);
+
+      /// Do any of the Facts we know involve this predicate?
+      bool involves(PName pred) const;
+
+      /// Forget everything that differs from the base.
+      void clear();
+
+      /// Switch to a new base, such as a newer version from the same
+      /// WorldStore, keeping the Facts we have set or unset ourselves.
+      /// Changes that now agree with the base are dropped.
+      void rebase(const WorldSnapshot *base);
+
+      /// The snapshot we are based on.
+      const WorldSnapshot *getBase() const { return mBase; }
+
+      /// Number of Facts that differ from the base.
+      unsigned int deltaSize() const { return mOverlay.size() + mRemoved.size(); }
+
+      /// Changes to the base that give this BeliefState.
+      void delta(WorldPatch &patch) const;
+
+      /// Copy our full knowledge into a WorldState, for example to plan from.
+      /// Takes time linear in the size of the base.
+      void flatten(WorldState &ws) const;
+
+      /// Walks the base's Facts and ours together, in Fact order, as if
+      /// they were a single WorldState.
+      class const_iterator {
+      public:
+         const worldrep::value_type &operator*() const { return *get(); }
+         const worldrep::value_type *operator->() const { return get(); }
+         const_iterator &operator++();
+         const_iterator operator++(int);
+         bool operator==(const const_iterator &other) const
+         { return mBase == other.mBase && mOver == other.mOver; }
+         bool operator!=(const const_iterator &other) const
+         { return !operator==(other); }
+
+      private:
+         friend class BeliefState;
+         const BeliefState *mBS;
+         worldrep::const_iterator mBase, mBaseEnd, mOver, mOverEnd;
+
+         /// Do we take the next entry from the overlay?
+         bool fromOverlay() const;
+         const worldrep::value_type *get() const
+         { return fromOverlay()? &*mOver: &*mBase; }
+         /// Skip base entries we have unset or overridden.
+         void skip();
+      };
+      const_iterator begin() const;
+      const_iterator end() const;
+
+      /// Hash of our knowledge, equal to WorldState::hash of the flattened
+      /// state. Kept up to date from the base's hash and our changes.
+      unsigned int hash() const { return mHash; }
+
+      /// Equality of knowledge. BeliefStates on the same base only compare
+      /// their changes.
+      bool operator==(const BeliefState &b) const;
+      bool operator!=(const BeliefState &b) const
+      { return !operator==(b); }
+
+      /// Default constructor.
+      /// @param[in] base Snapshot to share. We take our own reference to it.
+      BeliefState(const WorldSnapshot *base);
+      BeliefState(const BeliefState &other);
+      BeliefState &operator=(const BeliefState &other);
+      ~BeliefState();
+
+   private:
+      /// Shared knowledge.
+      const WorldSnapshot *mBase;
+      /// Facts we have set to a value different from the base, or that the
+      /// base does not have.
+      worldrep mOverlay;
+      /// Facts the base has that we have unset.
+      std::set<Fact> mRemoved;
+      /// Calculated hash value.
+      unsigned int mHash;
+
+      /// Shorthand for the base state.
+      const WorldState &base() const { return mBase->state(); }
+      /// Remove a Fact's current value from our hash.
+      void unhash(const Fact &fact);
+   };
+};
+
+#endif
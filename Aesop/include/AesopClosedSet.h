@@ -0,0 +1,125 @@
+/// @file AesopClosedSet.h
+/// Defines ClosedSet class.
+
+#ifndef _AE_CLOSEDSET_H_
+#define _AE_CLOSEDSET_H_
+
+#include "AesopWorldState.h"
+
+#include <atomic>
+
+namespace Aesop {
+   /// A set of WorldStates that any number of threads may search and add to
+   /// at once, without locks, so that search threads can share the states
+   /// they have finished with.
+   ///
+   /// States are found by their 64-bit hash in a table with open addressing,
+   /// then compared in full. The set points to states owned by the user,
+   /// which must not move or change until the set is cleared. With each
+   /// state it keeps the cheapest cost the state was added at and a handle:
+   /// a number of the user's, such as the state's position in a list.
+   /// Adding a state again at a lower cost replaces both at once.
+   ///
+   /// Once the table is half full, a table twice the size is started.
+   /// Threads that add states move some of the old table's entries across
+   /// before carrying on, so nobody waits for the whole move, and searches
+   /// look in both tables until it is done. Old tables and entries are only
+   /// freed by clear or the destructor, once no thread is using the set.
+   class ClosedSet {
+   public:
+      /// What ClosedSet::insert did.
+      enum Result {
+         /// The state was new.
+         Inserted,
+         /// The state was there at a higher cost, which we replaced.
+         Improved,
+         /// The state was there at the same or a lower cost. Nothing changed.
+         Kept,
+      };
+
+      /// Add a state, unless it is there already at a cost no higher than g.
+      /// @param[in]  state  State to add. Must outlive its entry.
+      /// @param[in]  g      Cost the state was reached at.
+      /// @param[in]  handle Number to keep with the state.
+      /// @param[out] prev   If the state was there already, set to the handle
+      ///                    it had, unless NULL.
+      Result insert(const WorldState &state, float g, unsigned int handle, unsigned int *prev = NULL);
+
+      /// Look up a state.
+      /// @param[out] g      Set to the cheapest cost the state was added at,
+      ///                    unless NULL.
+      /// @param[out] handle Set to the handle that came with it, unless NULL.
+      /// @return False if the state has not been added.
+      bool find(const WorldState &state, float *g = NULL, unsigned int *handle = NULL) const;
+
+      /// Number of states added.
+      unsigned long size() const { return mSize.load(); }
+
+      /// Forget every state and free all our memory. No other thread may be
+      /// using the set.
+      void clear();
+
+      /// Default constructor.
+      /// @param[in] capacity Slots to start with, rounded up to a power of two.
+      ClosedSet(unsigned int capacity = 1024);
+      /// Default destructor.
+      ~ClosedSet();
+
+   private:
+      /// A state in the set.
+      struct Node {
+         unsigned long long hash;
+         const WorldState *state;
+         /// Cost and handle, packed together so they change at once.
+         std::atomic<unsigned long long> value;
+         /// Node added before this one, so that all can be freed.
+         Node *older;
+      };
+      /// A table of slots, each empty, holding a Node, or marking a slot
+      /// whose contents have moved to the next table.
+      struct Table {
+         unsigned int capacity;
+         std::atomic<Node*> *slots;
+         /// Nodes placed in this table, including ones moved here.
+         std::atomic<unsigned int> count;
+         /// Table we are moving to, if we have started.
+         std::atomic<Table*> next;
+         /// Slots handed out to be moved, and slots moved.
+         std::atomic<unsigned int> claimed, moved;
+
+         Table(unsigned int cap);
+         ~Table();
+      };
+      /// Marks for moved slots that were empty and that held a Node.
+      static Node MovedEmpty, MovedFull;
+
+      /// Table to start every operation in.
+      std::atomic<Table*> mTable;
+      /// Our first table. Each table links to the one after it.
+      Table *mFirst;
+      /// Most recently added Node.
+      std::atomic<Node*> mNodes;
+      std::atomic<unsigned long> mSize;
+      unsigned int mCapacity;
+
+      /// Put a Node in a table, or find the Node with the same state.
+      /// @return The Node that holds the state afterwards.
+      Node *place(Table *t, Node *n);
+      /// Move one slot of a table to the next table.
+      /// @return NULL if the slot was empty, ending every chain through it.
+      Node *move(Table *t, unsigned int i);
+      /// Start a table's next table, unless one has been started.
+      Table *grow(Table *t);
+      /// Move a share of the current table's slots, if it is being moved.
+      /// @return The table to start from.
+      Table *help();
+      /// Free every table and Node.
+      void destroy();
+
+      /// Not copyable.
+      ClosedSet(const ClosedSet&);
+      ClosedSet &operator=(const ClosedSet&);
+   };
+};
+
+#endif
@@ -1,10 +1,19 @@
-/// @file AesopConfig.h
-/// End-user configuration parameters for Aesop.
-
-#ifndef _AE_CONFIG_H_
-#define _AE_CONFIG_H_
-
-// Modify these defines to your heart's content!
-// All of them have sensible defaults if undefined.
-
-#endif
+/// @file AesopConfig.h
+/// End-user configuration parameters for Aesop.
+
+#ifndef _AE_CONFIG_H_
+#define _AE_CONFIG_H_
+
+// Modify these defines to your heart's content!
+// All of them have sensible defaults if undefined.
+
+/// Maximum number of threads that may be reading a SharedDomain at the same
+/// moment without holding each other up. Further readers still enter, but
+/// delay the release of old domains until they leave.
+//#define AESOP_MAX_READERS 64
+
+/// Most parameters an Action read by Action::deserialize may have. Each
+/// one multiplies the number of ways the Action can be grounded.
+//#define AESOP_MAX_PARAMETERS 16
+
+#endif
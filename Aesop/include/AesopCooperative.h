@@ -0,0 +1,186 @@
+/// @file AesopCooperative.h
+/// Defines ReservationTable and CooperativePlanner classes.
+
+#ifndef _AE_COOPERATIVE_H_
+#define _AE_COOPERATIVE_H_
+
+#include "AesopTypes.h"
+#include "AesopAction.h"
+#include "AesopWorldState.h"
+#include "AesopContext.h"
+#include "AesopDomain.h"
+
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace Aesop {
+   /// Records which agent holds each Fact at each time step, so that agents
+   /// planning one after another can keep out of each other's way. A claim
+   /// is exclusive: only the agent that holds a Fact at a step may use it
+   /// then. Agents are identified by number; claims made for the world
+   /// itself, such as a door that will be blocked, can use any number no
+   /// agent has.
+   class ReservationTable {
+   public:
+      /// Claim a Fact for one time step.
+      /// @return False if another agent holds it then.
+      bool reserve(const Fact &fact, unsigned int step, unsigned int agent);
+
+      /// Claim a Fact for a time step and every one after it, such as a
+      /// resource that an agent uses up.
+      /// @return False if another agent holds it at any of those steps.
+      bool reserveFrom(const Fact &fact, unsigned int step, unsigned int agent);
+
+      /// May an agent use a Fact at a time step?
+      bool isFree(const Fact &fact, unsigned int step, unsigned int agent) const;
+
+      /// May an agent use a Fact at a time step and every one after it?
+      bool isFreeFrom(const Fact &fact, unsigned int step, unsigned int agent) const;
+
+      /// Last time step with a claim that does not last forever. Time makes
+      /// no difference to which Facts are free after it.
+      unsigned int lastStep() const { return mLastStep; }
+
+      /// Has anything been claimed?
+      bool empty() const { return mClaims.empty(); }
+
+      /// Drop every claim.
+      void clear() { mClaims.clear(); mLastStep = 0; }
+
+      /// Default constructor.
+      ReservationTable() : mLastStep(0) {}
+
+   private:
+      /// Claims on one Fact.
+      struct Claims {
+         /// Agent holding the Fact at each step claimed.
+         std::map<unsigned int, unsigned int> steps;
+         /// Step from which an agent holds the Fact for good, if any.
+         bool forever;
+         unsigned int from, owner;
+
+         Claims() : forever(false), from(0), owner(0) {}
+      };
+      std::map<Fact, Claims> mClaims;
+      unsigned int mLastStep;
+   };
+
+   /// Plans for several agents that share parts of the world, one agent at
+   /// a time in order of priority, so that later agents work around the
+   /// plans of earlier ones instead of clashing with them.
+   ///
+   /// Each agent has its own start, goal and ActionOverlay. Facts whose
+   /// predicate has been shared belong to everyone: when an agent's plan
+   /// uses one at a time step it is reserved for that agent at that step,
+   /// and once the plan changes one, it is reserved for that agent from then
+   /// on, since other agents no longer know its value. Later agents search
+   /// forwards through time, and may not take an action that uses a Fact
+   /// someone else holds at that step, or changes one someone else holds
+   /// later on. They may wait a step instead, so plans are found without
+   /// searching the agents' states jointly. Other Facts are private to each
+   /// agent.
+   ///
+   /// Like GraphPlanner, each start state is read as complete, together with
+   /// its domain's constants, and every Fact in a goal must hold at the end.
+   /// Requires CompiledDomains built with EagerGrounding.
+   class CooperativePlanner {
+   public:
+      /// Add an agent. Agents added first have the highest priority.
+      /// @param[in] start   Agent's starting WorldState.
+      /// @param[in] goal    Agent's goal.
+      /// @param[in] overlay GroundActions the agent may use.
+      /// @return The agent's number, which is also its ID in the
+      ///         ReservationTable.
+      unsigned int addAgent(const WorldState *start, const WorldState *goal,
+         const ActionOverlay *overlay);
+
+      /// Forget every agent.
+      void clearAgents();
+
+      /// Make every Fact with this predicate shared between agents.
+      void share(PName pred) { mShared.insert(pred); }
+
+      /// Record reservations in a table of our own, so that they can be
+      /// combined with claims made elsewhere or kept between calls to plan.
+      /// Otherwise we use our own table, which is emptied by each plan.
+      /// @param[in] table Table to use, or NULL to use our own.
+      void setReservations(ReservationTable *table) { mTable = table; }
+
+      /// Table holding our reservations.
+      const ReservationTable &getReservations() const { return mTable? *mTable: mOwnTable; }
+
+      /// Most time steps each plan may take, including waits. Defaults
+      /// to 64.
+      void setHorizon(unsigned int steps) { mHorizon = steps; }
+
+      /// Cost of waiting for one time step. Defaults to 1.
+      void setWaitCost(float cost) { mWaitCost = cost < 0.0f? 0.0f: cost; }
+
+      /// Plan for every agent, in order of priority.
+      /// @param[in] ctx Context object to record the planner's activity.
+      /// @return True iff every agent has a plan. Agents without one make
+      ///         no reservations.
+      bool plan(Context *ctx = NULL);
+
+      /// Was a plan found for an agent?
+      bool success(unsigned int agent) const { return mAgents[agent].found; }
+
+      /// An agent's plan, without its waits.
+      const Plan &getPlan(unsigned int agent) const { return mAgents[agent].plan; }
+
+      /// Time step at which each step of an agent's plan is to be taken.
+      /// The agent waits during steps that are missing.
+      const std::vector<unsigned int> &getTimes(unsigned int agent) const { return mAgents[agent].times; }
+
+      /// Default constructor.
+      CooperativePlanner();
+
+   private:
+      /// An agent and the result of its last search.
+      struct Agent {
+         const WorldState *start, *goal;
+         const ActionOverlay *overlay;
+         bool found;
+         Plan plan;
+         std::vector<unsigned int> times;
+      };
+      /// A state reached at a time step.
+      struct Node {
+         WorldState state;
+         unsigned int step;
+         float G, F;
+         /// Node we came from, and the GroundAction taken, or NULL to wait.
+         unsigned int prev;
+         const GroundAction *op;
+      };
+      /// Orders Nodes on the open list.
+      struct NodeOrder {
+         const std::deque<Node> *nodes;
+         bool operator()(unsigned int a, unsigned int b) const;
+      };
+
+      std::vector<Agent> mAgents;
+      std::set<PName> mShared;
+      ReservationTable *mTable;
+      ReservationTable mOwnTable;
+      unsigned int mHorizon;
+      float mWaitCost;
+
+      /// Search for one agent's plan around the reservations made so far.
+      bool search(unsigned int agent, Context *ctx);
+      /// Is a GroundAction free of other agents' claims at a step?
+      bool allowed(const GroundAction &op, unsigned int step, unsigned int agent) const;
+      /// Claim the shared Facts a GroundAction uses at a step.
+      void reserve(const GroundAction &op, unsigned int step, unsigned int agent);
+      /// Does a state meet every Fact of a goal?
+      static bool reached(const WorldState &state, const WorldState &goal);
+
+      /// Not copyable.
+      CooperativePlanner(const CooperativePlanner&);
+      CooperativePlanner &operator=(const CooperativePlanner&);
+   };
+};
+
+#endif
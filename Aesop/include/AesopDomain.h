@@ -0,0 +1,426 @@
+/// @file AesopDomain.h
+/// Defines Domain and CompiledDomain classes.
+
+#ifndef _AE_DOMAIN_H_
+#define _AE_DOMAIN_H_
+
+#include "AesopTypes.h"
+#include "AesopAction.h"
+#include "AesopWorldState.h"
+#include "AesopEpoch.h"
+#include "AesopThreadPool.h"
+
+#include <list>
+#include <vector>
+#include <set>
+
+namespace Aesop {
+   class CompiledDomain;
+   class ActionOverlay;
+
+   /// How Domain::freeze grounds Actions.
+   enum GroundingMode {
+      EagerGrounding, ///< Ground every Action with every combination of objects up front.
+      LazyGrounding,  ///< Ground Actions only once a search needs them.
+   };
+
+   /// Describes a planning problem domain: the Actions that may be used, the
+   /// objects that may be passed to them as parameters, and the Facts that
+   /// hold in every WorldState.
+   class Domain {
+   public:
+      /// Add an Action to the domain. The Action must outlive any
+      /// CompiledDomain created from this Domain.
+      void addAction(const Action *ac);
+
+      /// Add an object that Actions may take as a parameter.
+      void addObject(Object obj) { mObjects.push_back(obj); }
+
+      /// Set the Facts that hold in every WorldState of this domain.
+      void setConstants(const WorldState &con) { mConstants = con; }
+
+      /// Choose how CompiledDomains are grounded. Defaults to EagerGrounding.
+      void setGrounding(GroundingMode mode) { mGrounding = mode; }
+
+      /// @name Domain definition
+      /// @{
+      unsigned int numActions() const { return mActions.size(); }
+      const Action *getAction(unsigned int i) const { return mActions[i]; }
+      const objects &getObjects() const { return mObjects; }
+      /// @}
+
+      /// Ground every Action and build the lookup tables used in planning.
+      /// The result is the same no matter how many threads are used.
+      /// @param[in] threads Number of threads to ground with. Zero means one
+      ///                    per hardware thread.
+      /// @return A new CompiledDomain holding one reference, which belongs to
+      ///         the caller. Drop it with CompiledDomain::release.
+      const CompiledDomain *freeze(unsigned int threads = 0) const;
+
+      /// Ground every Action using an existing ThreadPool.
+      /// @see Domain::freeze
+      const CompiledDomain *freeze(ThreadPool &pool) const;
+
+      /// @name Serialization
+      /// @{
+      /// Write our Actions, objects, constants and grounding mode in a form
+      /// any process can read back.
+      void serialize(ByteWriter &out) const;
+      /// Replace our definition with one written by serialize.
+      /// @param[in]     in      Data to read.
+      /// @param[in,out] actions Actions read are added to the end of this
+      ///                        list, which must outlive any CompiledDomain
+      ///                        created from us.
+      /// @return False, leaving us unchanged, if the data is not valid.
+      bool deserialize(ByteReader &in, std::list<Action> &actions);
+      /// @}
+
+      /// Default constructor.
+      Domain();
+      /// Default destructor.
+      ~Domain();
+
+   private:
+      friend class CompiledDomain;
+
+      /// Actions in the order they were added.
+      std::vector<const Action*> mActions;
+      /// Objects to ground Action parameters with.
+      objects mObjects;
+      /// Facts that are always true.
+      WorldState mConstants;
+      /// How to ground Actions.
+      GroundingMode mGrounding;
+   };
+
+   /// An immutable, grounded form of a Domain. Every method is const and
+   /// nothing is modified after construction, so any number of Planners may
+   /// share one CompiledDomain from any number of threads.
+   /// With LazyGrounding, GroundActions and Facts are added as searches need
+   /// them, behind internally synchronised tables; they are never changed or
+   /// removed once added, so references to them stay valid.
+   class CompiledDomain : public RefCounted {
+   public:
+      /// Unique number identifying this CompiledDomain. Later calls to
+      /// Domain::freeze always produce larger version numbers, so anything
+      /// cached against a CompiledDomain can be keyed on its version.
+      unsigned long version() const { return mVersion; }
+
+      /// A range of GroundActions in one of our indexes.
+      typedef std::pair<const GroundAction *const*, const GroundAction *const*> oprange;
+
+      /// @name Domain definition
+      /// @{
+      unsigned int numActions() const { return mActions.size(); }
+      const Action *getAction(unsigned int i) const { return mActions[i]; }
+      const objects &getObjects() const { return mObjects; }
+      const WorldState &getConstants() const { return mConstants; }
+      GroundingMode getGrounding() const { return mLazy? LazyGrounding: EagerGrounding; }
+      /// @}
+
+      /// @name Interned Facts
+      /// With LazyGrounding, only Facts grounded so far.
+      /// @{
+      unsigned int numFacts() const { return mLazy? lazyNumFacts(): mFacts.size(); }
+      const Fact &getFact(FactID id) const { return mLazy? lazyFact(id): mFacts[id]; }
+      /// Find the ID of a Fact.
+      /// @return The Fact's ID, or NullFact if no GroundAction refers to it.
+      FactID find(const Fact &fact) const;
+      /// @}
+
+      /// @name Grounded operators
+      /// With LazyGrounding, only GroundActions grounded so far.
+      /// @{
+      unsigned int numOperators() const { return mLazy? lazyNumOperators(): mOperators.size(); }
+      const GroundAction &getOperator(unsigned int i) const { return mLazy? lazyOperator(i): mOperators[i]; }
+      /// @}
+
+      /// @name Indexes
+      /// Only available with EagerGrounding; with LazyGrounding the ranges
+      /// are empty and no Fact has a relevant cost.
+      /// @{
+      /// GroundActions that have a condition or effect on a Fact.
+      oprange relevant(FactID id) const { return range(mRelevant, id); }
+      /// GroundActions that have an effect on a Fact.
+      oprange achievers(FactID id) const { return range(mAchievers, id); }
+      /// Is this Fact left untouched by every GroundAction's effects?
+      bool isStatic(FactID id) const { return mLazy? isStaticPredicate(getFact(id).name): mAchievers.offsets[id] == mAchievers.offsets[id+1]; }
+      /// Lowest cost of any GroundAction relevant to a Fact.
+      float relevantCost(FactID id) const { return mLazy? -1.0f: mRelevantCost[id]; }
+      /// Is this predicate left untouched by every Action's effects?
+      bool isStaticPredicate(PName pred) const { return !mFluents.count(pred); }
+      /// @}
+
+      /// @name Forward semantics
+      /// Values here are a PVal, or -1 for an unset Fact.
+      /// @{
+      /// Does a Fact with the given value meet an Operation's condition?
+      static bool holds(const Operation &op, int value);
+      /// Value of a Fact after an Operation's effect. Incrementing or
+      /// decrementing an unset Fact treats it as zero.
+      static int apply(const Operation &op, int value);
+      /// Every value each Fact can take in states reachable from a start
+      /// state, found by closing the start values under every effect.
+      /// Facts missing from both start and our constants start unset.
+      /// @param[in]  start   State to start from.
+      /// @param[in]  overlay Only use GroundActions this allows, if given.
+      /// @param[out] values  Sorted values of each FactID.
+      void reachableValues(const WorldState &start, const ActionOverlay *overlay,
+         std::vector<std::vector<int> > &values) const;
+      /// @}
+
+      /// Find every GroundAction that might result in a WorldState, i.e. all
+      /// GroundActions relevant to at least one of its Facts.
+      /// With LazyGrounding, each Fact and value is unified with the Actions'
+      /// conditions and effects the first time it is seen, and the matching
+      /// GroundActions are remembered for next time.
+      /// @param[in]  state WorldState to regress from.
+      /// @param[out] ops   GroundActions in ascending ID order.
+      void candidates(const WorldState &state, std::vector<const GroundAction*> &ops) const;
+
+      /// Find every GroundAction whose conditions might hold in a WorldState,
+      /// without checking each one. A condition other than IsUnset can only
+      /// hold if its Fact is set, so each GroundAction is indexed under one
+      /// such Fact, and under the value an Equals condition needs. Only
+      /// those indexed under a Fact and value of the state, or under none,
+      /// are returned. Callers still check preMatch.
+      /// With LazyGrounding, every GroundAction grounded so far is returned.
+      /// @param[in]  state WorldState to progress from, including any of our
+      ///                   constants that conditions rely on.
+      /// @param[out] ops   GroundActions in ascending ID order.
+      void applicable(const WorldState &state, std::vector<const GroundAction*> &ops) const;
+
+      /// Estimate the cost of regressing from one WorldState to another.
+      /// Every Fact set in both states but to different values must be
+      /// changed by some relevant GroundAction, so the most expensive such
+      /// change is a lower bound on the total cost.
+      /// @param[in] state WorldState to estimate from.
+      /// @param[in] start Starting WorldState of the plan.
+      /// @param[in] overlay Only use GroundActions this ActionOverlay allows,
+      ///                    at the costs it gives them.
+      /// @return Estimated cost, or a negative value if some Fact can never be
+      ///         changed to agree with the start.
+      float heuristic(const WorldState &state, const WorldState &start, const ActionOverlay *overlay = NULL) const;
+
+      /// Cost CompiledDomain::heuristic charges for a Fact of the state that
+      /// the start sets to a different value: that of the cheapest relevant
+      /// GroundAction. Lets the heuristic be computed against a start that
+      /// is not a WorldState.
+      /// @return The cost, or a negative value if no GroundAction can give
+      ///         the Fact that value.
+      float changeCost(const Fact &fact, PVal val, const ActionOverlay *overlay = NULL) const;
+
+   private:
+      friend class Domain;
+      friend class GroundingTask;
+      friend class InterningTask;
+      struct LazyTables;
+
+      /// Use CompiledDomain::release instead.
+      ~CompiledDomain();
+
+      /// Compressed lists of GroundActions, one per Fact.
+      struct opindex {
+         std::vector<unsigned int> offsets;
+         std::vector<const GroundAction*> ops;
+      };
+      static oprange range(const opindex &idx, FactID id)
+      {
+         if(idx.offsets.empty())
+            return oprange(NULL, NULL);
+         const GroundAction *const *base = idx.ops.empty()? NULL: &idx.ops[0];
+         return oprange(base + idx.offsets[id], base + idx.offsets[id+1]);
+      }
+
+      /// Our version number.
+      unsigned long mVersion;
+      /// Actions we were created with.
+      std::vector<const Action*> mActions;
+      /// Objects we were created with.
+      objects mObjects;
+      /// Facts that are always true.
+      WorldState mConstants;
+      /// Predicates that some Action has an effect on.
+      std::set<PName> mFluents;
+      /// Interned Facts, sorted so that a Fact's ID is its position.
+      std::vector<Fact> mFacts;
+      /// Grounded operator table.
+      std::vector<GroundAction> mOperators;
+      /// GroundActions that refer to each Fact.
+      opindex mRelevant;
+      /// GroundActions that have an effect on each Fact.
+      opindex mAchievers;
+      /// Each GroundAction under the Fact returned by anchor, if any,
+      /// sorted by the value it needs and then by ID.
+      opindex mAnchored;
+      /// Value each entry of mAnchored needs, or -1 for any value.
+      std::vector<int> mAnchorValues;
+      /// Facts with at least one entry in mAnchored, in ID order.
+      std::vector<FactID> mAnchors;
+      /// GroundActions with no condition that needs a Fact to be set.
+      std::vector<const GroundAction*> mUnanchored;
+      /// Cheapest relevant GroundAction for each Fact.
+      std::vector<float> mRelevantCost;
+      /// Memo tables for LazyGrounding, or NULL for EagerGrounding.
+      LazyTables *mLazy;
+
+      /// Build our tables from a Domain.
+      /// @param[in] pool ThreadPool to ground with, or NULL for LazyGrounding.
+      CompiledDomain(const Domain &dom, ThreadPool *pool);
+      /// Copy the parts of a Domain that every CompiledDomain needs.
+      void init(const Domain &dom);
+      /// Ground every Action with every combination of objects.
+      void groundAll(ThreadPool &pool);
+      /// Instantiate an Action with the given parameters, unless it can be
+      /// shown never to be applicable.
+      /// @param[in]     action Index of the Action to ground.
+      /// @param[in]     params Parameters to ground it with.
+      /// @param[out]    ga     GroundAction to fill in. Its GroundOperation
+      ///                       IDs are set to indices into facts.
+      /// @param[in,out] facts  Filled-in Facts waiting to be interned.
+      /// @return False if the GroundAction can never be used.
+      bool ground(unsigned int action, const objects &params, GroundAction &ga, std::vector<Fact> &facts) const;
+      /// Build indexes once every operator is grounded and interned.
+      void index();
+      /// The Fact a GroundAction's conditions need set that it is indexed
+      /// under for CompiledDomain::applicable. One that some effect changes
+      /// is preferred, since constants are set in every state, and then an
+      /// Equals condition, since it also narrows the value.
+      /// @param[in]  ga    GroundAction to index.
+      /// @param[out] value Value an Equals condition needs, or -1.
+      /// @return The Fact's ID, or NullFact if no condition needs one.
+      FactID anchor(const GroundAction &ga, int &value) const;
+      /// Add the entries of mAnchored for a Fact that need its value, or
+      /// any value, to a list.
+      void anchored(FactID id, PVal val, std::vector<const GroundAction*> &ops) const;
+
+      /// @name LazyGrounding
+      /// @{
+      unsigned int lazyNumFacts() const;
+      const Fact &lazyFact(FactID id) const;
+      unsigned int lazyNumOperators() const;
+      const GroundAction &lazyOperator(unsigned int i) const;
+      /// Intern a Fact, adding it if we have not seen it before.
+      FactID lazyIntern(const Fact &fact) const;
+      /// Get the GroundAction for an Action and parameters, grounding it if
+      /// we have not done so before.
+      /// @return The GroundAction, or NULL if it can never be used.
+      const GroundAction *lazyGround(unsigned int action, const objects &params) const;
+      /// Get every GroundAction that a Fact with a given value is consistent
+      /// with, unifying it with our Actions if we have not done so before.
+      const std::vector<const GroundAction*> &lazyRelevant(const Fact &fact, PVal val) const;
+      /// Narrow down an Action's parameter candidates using its static
+      /// pre-conditions and our constants.
+      bool narrow(const Action &ac, std::vector<objects> &cands) const;
+      /// @}
+
+      /// Not copyable.
+      CompiledDomain(const CompiledDomain&);
+      CompiledDomain &operator=(const CompiledDomain&);
+   };
+
+   /// An ActionSet expressed over the operator table of a CompiledDomain: a
+   /// mask of usable GroundActions and a preference multiplier per Action.
+   /// Agents that share an ActionSet should share one ActionOverlay, which
+   /// computes its heuristic tables once for all of them. Once constructed,
+   /// an ActionOverlay may be used by any number of Planners at once.
+   class ActionOverlay {
+   public:
+      /// Domain this overlay applies to.
+      const CompiledDomain *getDomain() const { return mDomain; }
+
+      /// May a GroundAction be used?
+      bool allows(const GroundAction &op) const
+      { return op.ID < mMask.size()? (bool)mMask[op.ID]: mPrefs[op.action] >= 0.0f; }
+
+      /// Cost of using a GroundAction, including preference.
+      float cost(const GroundAction &op) const { return op.cost * mPrefs[op.action]; }
+
+      /// Lowest cost of any usable GroundAction relevant to a Fact, or a
+      /// negative value if there are none. Only available for domains with
+      /// EagerGrounding.
+      float relevantCost(FactID id) const { return id < mRelevantCost.size()? mRelevantCost[id]: -1.0f; }
+
+      /// Estimate the cost of regressing from one WorldState to another using
+      /// only the GroundActions we allow.
+      /// @see CompiledDomain::heuristic
+      float heuristic(const WorldState &state, const WorldState &start) const
+      { return mDomain->heuristic(state, start, this); }
+      /// @see CompiledDomain::changeCost
+      float changeCost(const Fact &fact, PVal val) const
+      { return mDomain->changeCost(fact, val, this); }
+
+      /// Stop a single GroundAction from being used, for example because it
+      /// failed in practice. Must not be called while Planners are using us.
+      void veto(const GroundAction &op);
+
+      /// Value constructor.
+      /// @param[in] dom CompiledDomain to plan in. We hold a reference to it
+      ///                for as long as we exist.
+      /// @param[in] set Actions we may use and their preferences. Actions not
+      ///                in the domain are ignored.
+      ActionOverlay(const CompiledDomain *dom, const ActionSet &set);
+      /// Default destructor.
+      ~ActionOverlay();
+
+   private:
+      /// The domain we apply to.
+      const CompiledDomain *mDomain;
+      /// Preference for each of the domain's Actions.
+      std::vector<float> mPrefs;
+      /// Whether each GroundAction may be used. GroundActions added to a
+      /// lazily grounded domain after this was built are allowed if their
+      /// Action is.
+      std::vector<bool> mMask;
+      /// Cheapest usable relevant GroundAction for each Fact.
+      std::vector<float> mRelevantCost;
+
+      /// Recompute mRelevantCost after the mask changes.
+      void updateCosts();
+
+      /// Not copyable.
+      ActionOverlay(const ActionOverlay&);
+      ActionOverlay &operator=(const ActionOverlay&);
+   };
+
+   /// Publishes the current version of a CompiledDomain so that it can be
+   /// replaced while Planners are still using it. Planners that acquired the
+   /// old version keep it until they release it; everyone who acquires after
+   /// a publish gets the new one. A replaced version is freed as soon as
+   /// the last Planner using it releases it, whether or not anything is
+   /// published again. Neither side waits for the other beyond a short lock
+   /// taken while freeing replaced versions.
+   class SharedDomain {
+   public:
+      /// Make a CompiledDomain the current version.
+      /// @param[in] dom CompiledDomain to publish. The caller's reference to
+      ///                it is taken over by this SharedDomain.
+      void publish(const CompiledDomain *dom);
+
+      /// Get a reference to the current version.
+      /// @return The current CompiledDomain, or NULL if none was published.
+      ///         Drop it with CompiledDomain::release when done.
+      const CompiledDomain *acquire() const;
+
+      /// Version number of the current CompiledDomain, or zero.
+      unsigned long version() const;
+
+      /// Default constructor.
+      /// @param[in] dom Initial version, as for SharedDomain::publish.
+      SharedDomain(const CompiledDomain *dom = NULL);
+      /// Default destructor.
+      ~SharedDomain();
+
+   private:
+      /// The current version.
+      std::atomic<const CompiledDomain*> mCurrent;
+      /// Keeps replaced versions alive for readers that may still see them.
+      mutable EpochManager mEpochs;
+
+      /// Not copyable.
+      SharedDomain(const SharedDomain&);
+      SharedDomain &operator=(const SharedDomain&);
+   };
+};
+
+#endif
@@ -0,0 +1,105 @@
+/// @file AesopEpoch.h
+/// Defines RefCounted and EpochManager classes.
+
+#ifndef _AE_EPOCH_H_
+#define _AE_EPOCH_H_
+
+#include "AesopConfig.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+/// Readers that can each hold a slot of their own. Readers beyond this
+/// many still enter, but hold back every release until they leave.
+#ifndef AESOP_MAX_READERS
+#define AESOP_MAX_READERS 64
+#endif
+
+namespace Aesop {
+   /// Base class for immutable objects that are shared between threads and
+   /// destroyed when the last reference to them is released.
+   class RefCounted {
+   public:
+      /// Take another reference to this object.
+      void acquire() const { mRefs.fetch_add(1, std::memory_order_relaxed); }
+
+      /// Drop a reference to this object, deleting it if it was the last.
+      void release() const
+      {
+         if(mRefs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete this;
+      }
+
+   protected:
+      /// Objects start with a single reference owned by their creator.
+      RefCounted() : mRefs(1) {}
+      virtual ~RefCounted() {}
+
+   private:
+      /// Number of outstanding references.
+      mutable std::atomic<unsigned int> mRefs;
+
+      /// Not copyable.
+      RefCounted(const RefCounted&);
+      RefCounted &operator=(const RefCounted&);
+   };
+
+   /// Epoch-based reclamation for objects published through an atomic
+   /// pointer. Readers hold a Guard while they load the pointer and take a
+   /// reference; writers retire the object they replaced, and it is released
+   /// once every reader that might have seen it has left its Guard. That is
+   /// checked when an object is retired and when a reader leaves its Guard
+   /// while objects are waiting, so nothing waits for the next retire.
+   /// References that readers took are theirs to release as usual.
+   class EpochManager {
+   public:
+      /// Marks a reader as active for as long as it exists.
+      class Guard {
+      public:
+         Guard(EpochManager &em);
+         ~Guard();
+      private:
+         EpochManager &mEM;
+         unsigned int mSlot;
+      };
+
+      /// Release a reference to an object once no reader can still be
+      /// looking at it.
+      void retire(const RefCounted *obj);
+
+      /// Release every retired object that no reader can still see.
+      void reclaim();
+
+      /// Default constructor.
+      EpochManager();
+      /// Releases every retired object. No readers may be active.
+      ~EpochManager();
+
+   private:
+      /// Global epoch, advanced every time an object is retired.
+      std::atomic<unsigned long> mEpoch;
+      /// Epoch each active reader entered in, or zero for free slots.
+      std::atomic<unsigned long> mSlots[AESOP_MAX_READERS];
+      /// Active readers that found every slot taken.
+      std::atomic<unsigned int> mOverflow;
+      /// Protects mRetired. Only writers take this lock.
+      std::mutex mRetireLock;
+      /// Objects waiting to be released, with the epoch they were retired in.
+      std::vector<std::pair<unsigned long, const RefCounted*> > mRetired;
+      /// Size of mRetired, readable without the lock.
+      std::atomic<unsigned int> mPending;
+
+      /// Claim a reader slot.
+      /// @return AESOP_MAX_READERS if every slot was taken.
+      unsigned int enter();
+      /// Free a reader slot.
+      void leave(unsigned int slot);
+
+      /// Not copyable.
+      EpochManager(const EpochManager&);
+      EpochManager &operator=(const EpochManager&);
+   };
+};
+
+#endif
@@ -0,0 +1,186 @@
+/// @file AesopExternalPlanner.h
+/// Defines ExternalPlanner class.
+
+#ifndef _AE_EXTERNALPLANNER_H_
+#define _AE_EXTERNALPLANNER_H_
+
+#include "AesopTypes.h"
+#include "AesopAction.h"
+#include "AesopWorldState.h"
+#include "AesopContext.h"
+#include "AesopDomain.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Aesop {
+   /// Searches breadth-first from the start with its lists kept on disk
+   /// rather than in memory, for offline jobs whose state spaces do not fit
+   /// in RAM.
+   ///
+   /// Each depth of the search is a layer: a file of the states first
+   /// reached at that depth, sorted so they can be merged. Successors of a
+   /// layer are collected in memory up to a limit, then sorted and written
+   /// out as a run. Once the layer is expanded, the runs are merged with
+   /// each other and with the closed list (the union of every earlier
+   /// layer), dropping duplicates in one pass over each; this is delayed
+   /// duplicate detection. Files are read through memory maps, so only the
+   /// pages in use occupy memory.
+   ///
+   /// Without a goal, or with setExhaustive, every reachable state is
+   /// visited and the layers are kept for Visitors to walk afterwards.
+   ///
+   /// Like SymbolicPlanner, the start state is read as complete and every
+   /// Fact in the goal must hold at the end of the plan. Plans have the
+   /// fewest steps possible, but are not necessarily the cheapest.
+   /// Requires a CompiledDomain built with EagerGrounding.
+   class ExternalPlanner {
+   public:
+      /// Set our starting WorldState.
+      void setStart(const WorldState *start) { mStart = start; }
+
+      /// Set our goal state. Without one, the whole state space is searched.
+      void setGoal(const WorldState *goal) { mGoal = goal; }
+
+      /// Set the CompiledDomain to plan in.
+      void setDomain(const CompiledDomain *dom) { mDomain = dom; }
+
+      /// Only use the GroundActions an ActionOverlay allows. The overlay's
+      /// domain is used in place of setDomain's.
+      void setOverlay(const ActionOverlay *overlay) { mOverlay = overlay; }
+
+      /// Directory to keep our files in. It must exist; local disk is best.
+      void setDirectory(const std::string &dir) { mDirectory = dir; }
+
+      /// Bytes of successors to collect in memory before writing a run.
+      void setMemoryLimit(size_t bytes) { mMemoryLimit = bytes; }
+
+      /// Deepest layer to search to. Zero means no limit.
+      void setMaxDepth(unsigned int depth) { mMaxDepth = depth; }
+
+      /// Keep searching once the goal is found, until every reachable state
+      /// has been visited.
+      void setExhaustive(bool exhaustive) { mExhaustive = exhaustive; }
+
+      /// Search from the start, replacing the files of any earlier search.
+      /// @param[in] ctx Context object to record the planner's activity.
+      /// @return True iff a plan was found.
+      bool plan(Context *ctx = NULL);
+
+      /// Did the last search find a plan?
+      bool success() const { return mSuccess; }
+
+      /// Did the last search visit every reachable state?
+      bool exhausted() const { return mExhausted; }
+
+      /// The plan the last search found.
+      const Plan &getPlan() const { return mPlan; }
+
+      /// Number of layers the last search wrote, starting with the start.
+      unsigned int numLayers() const { return mLayers.size(); }
+
+      /// Number of states first reached at a depth.
+      unsigned long layerSize(unsigned int depth) const { return mLayers[depth]; }
+
+      /// Number of distinct states the last search reached.
+      unsigned long numStates() const;
+
+      /// Receives the states of a layer. Implemented by the user.
+      class Visitor {
+      public:
+         /// Called once for each state, in no particular order.
+         /// @param[in] state A state reached from the start.
+         /// @param[in] depth Fewest steps it takes to reach state.
+         virtual void visit(const WorldState &state, unsigned int depth) = 0;
+      };
+
+      /// Read every state of a layer back from disk.
+      /// @return False if the layer's file cannot be read.
+      bool visit(unsigned int depth, Visitor &v) const;
+
+      /// Delete every file the last search wrote.
+      void clear();
+
+      /// Default constructor.
+      ExternalPlanner(const CompiledDomain *dom = NULL, const WorldState *start = NULL, const WorldState *goal = NULL);
+      /// Default destructor. Deletes our files.
+      ~ExternalPlanner();
+
+   private:
+      /// A Fact whose value can change: where its code is in a record and
+      /// the values its codes stand for.
+      struct ExtFact {
+         Fact fact;
+         std::vector<int> values;
+      };
+      /// A GroundAction in terms of record slots and codes.
+      struct ExtOp {
+         const GroundAction *ga;
+         /// Codes of each slot the GroundAction's conditions allow.
+         std::vector<std::pair<unsigned int, std::vector<bool> > > pre;
+         /// Code of each slot after the GroundAction, for each code before.
+         std::vector<std::pair<unsigned int, std::vector<unsigned int> > > post;
+      };
+
+      const CompiledDomain *mDomain;
+      const ActionOverlay *mOverlay;
+      const WorldState *mStart;
+      const WorldState *mGoal;
+      std::string mDirectory;
+      size_t mMemoryLimit;
+      unsigned int mMaxDepth;
+      bool mExhaustive;
+      bool mSuccess;
+      bool mExhausted;
+      Plan mPlan;
+
+      /// The part of every state of the last search that never changes.
+      WorldState mFixed;
+      std::vector<ExtFact> mFacts;
+      std::vector<ExtOp> mOps;
+      /// Slots and codes the goal needs.
+      std::vector<std::pair<unsigned int, unsigned int> > mGoalCodes;
+      /// Bytes per code, and per record: codes followed by the operator
+      /// that reached the state.
+      unsigned int mCodeBytes, mRecordBytes;
+      /// Number of states in each layer written.
+      std::vector<unsigned long> mLayers;
+      /// Number used to tell our files apart from other searches'.
+      unsigned long mFileID;
+
+      /// Work out records and operators.
+      /// @return False if the goal can never be reached.
+      bool compile(const CompiledDomain &dom, Context *ctx);
+      /// Code of a value of one of mFacts, or -1.
+      int code(unsigned int slot, int value) const;
+      unsigned int getCode(const unsigned char *rec, unsigned int slot) const;
+      void putCode(unsigned char *rec, unsigned int slot, unsigned int c) const;
+      /// Does the record satisfy an operator's conditions?
+      bool applicable(const ExtOp &op, const unsigned char *rec) const;
+      /// Write the record an operator leads to.
+      void successor(const ExtOp &op, const unsigned char *rec, unsigned int o, unsigned char *out) const;
+      bool isGoal(const unsigned char *rec) const;
+      /// Fill in the WorldState a record stands for.
+      void decode(const unsigned char *rec, WorldState &state) const;
+
+      /// Name of one of our files.
+      std::string fileName(const char *kind, unsigned int n) const;
+      /// Sort a buffer of records and write them to a run, keeping the
+      /// first record of each state.
+      bool writeRun(std::vector<unsigned char> &buf, const std::string &name) const;
+      /// Merge runs into the next layer, dropping states in the closed list,
+      /// then merge the new layer into the closed list.
+      /// @param[out] goal The first goal record in the new layer, or empty.
+      bool merge(const std::vector<std::string> &runs, unsigned int depth,
+         std::vector<unsigned char> &goal);
+      /// Walk back from a goal record through the layers.
+      bool extract(unsigned int depth, const unsigned char *rec);
+
+      /// Not copyable.
+      ExternalPlanner(const ExternalPlanner&);
+      ExternalPlanner &operator=(const ExternalPlanner&);
+   };
+};
+
+#endif
@@ -0,0 +1,104 @@
+/// @file AesopGraphPlanner.h
+/// Defines GraphPlanner class.
+
+#ifndef _AE_GRAPHPLANNER_H_
+#define _AE_GRAPHPLANNER_H_
+
+#include "AesopTypes.h"
+#include "AesopAction.h"
+#include "AesopWorldState.h"
+#include "AesopContext.h"
+#include "AesopDomain.h"
+#include "AesopPlanningGraph.h"
+
+#include <set>
+#include <vector>
+
+namespace Aesop {
+   /// Plans in the style of Graphplan: grows a PlanningGraph until the goal
+   /// appears without mutexes, then searches backwards through it for a
+   /// set of non-mutex GroundActions at each level that achieves the goal.
+   /// If none is found, the graph grows another level and the search tries
+   /// again, remembering which sets of values failed at which levels.
+   ///
+   /// GroundActions taken at the same level may be done in any order; they
+   /// are listed in the Plan one after the other. Plans have the fewest
+   /// levels possible, but are not necessarily the cheapest.
+   ///
+   /// Like SymbolicPlanner, the start state is read as complete and every
+   /// Fact in the goal must hold at the end of the plan. The graph and the
+   /// failed sets are kept between plans with the same start.
+   /// Requires a CompiledDomain built with EagerGrounding.
+   class GraphPlanner {
+   public:
+      /// Set our starting WorldState.
+      void setStart(const WorldState *start) { mStart = start; }
+
+      /// Set our goal state.
+      void setGoal(const WorldState *goal) { mGoal = goal; }
+
+      /// Set the CompiledDomain to plan in.
+      void setDomain(const CompiledDomain *dom) { mDomain = dom; }
+
+      /// Only use the GroundActions an ActionOverlay allows. The overlay's
+      /// domain is used in place of setDomain's.
+      void setOverlay(const ActionOverlay *overlay) { mOverlay = overlay; }
+
+      /// Most levels to look for a plan in.
+      void setMaxLevels(unsigned int levels) { mMaxLevels = levels; }
+
+      /// Limit the size of the PlanningGraph. If it would have more nodes,
+      /// plan fails without searching. See PlanningGraph::setNodeLimit.
+      void setNodeLimit(unsigned int nodes) { mGraph.setNodeLimit(nodes); }
+
+      /// Find a plan.
+      /// @param[in] ctx Context object to record the planner's activity.
+      /// @return True iff a plan was found.
+      bool plan(Context *ctx = NULL);
+
+      /// Did the last search find a plan?
+      bool success() const { return mSuccess; }
+
+      /// Did the last search prove that there is no plan?
+      bool exhausted() const { return mExhausted; }
+
+      /// The plan the last search found.
+      const Plan &getPlan() const { return mPlan; }
+
+      /// The PlanningGraph searched in.
+      const PlanningGraph &getGraph() const { return mGraph; }
+
+      /// Default constructor.
+      GraphPlanner(const CompiledDomain *dom = NULL, const WorldState *start = NULL, const WorldState *goal = NULL);
+
+   private:
+      typedef std::vector<unsigned int> atomset;
+
+      const CompiledDomain *mDomain;
+      const ActionOverlay *mOverlay;
+      const WorldState *mStart;
+      const WorldState *mGoal;
+      unsigned int mMaxLevels;
+      bool mSuccess;
+      bool mExhausted;
+      Plan mPlan;
+
+      PlanningGraph mGraph;
+      /// Sets of atoms known not to be reachable by each level.
+      std::vector<std::set<atomset> > mNogoods;
+      /// Nodes chosen at each action level of the plan being extracted.
+      std::vector<std::vector<unsigned int> > mSteps;
+
+      /// Find non-mutex nodes reaching a set of atoms at a level.
+      bool extract(const atomset &goals, unsigned int lvl);
+      /// Choose a node for each goal from the i'th on.
+      bool assign(const atomset &goals, unsigned int i, unsigned int lvl,
+         std::vector<unsigned int> &chosen);
+
+      /// Not copyable.
+      GraphPlanner(const GraphPlanner&);
+      GraphPlanner &operator=(const GraphPlanner&);
+   };
+};
+
+#endif
@@ -0,0 +1,186 @@
+/// @file AesopPlanService.h
+/// Defines PlanService class.
+
+#ifndef _AE_PLANSERVICE_H_
+#define _AE_PLANSERVICE_H_
+
+#include "AesopTypes.h"
+#include "AesopAction.h"
+#include "AesopWorldState.h"
+#include "AesopDomain.h"
+#include "AesopPlanner.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Aesop {
+   /// Plans for every process on a machine with one pool of worker
+   /// processes, through named shared memory.
+   ///
+   /// One process starts the service with an ActionOverlay. The workers are
+   /// forked from it after that, so they share the pages of its
+   /// CompiledDomain and each keeps a warm Planner between requests. Any
+   /// process may then connect by name with a CompiledDomain built from the
+   /// same Domain, so that Actions and objects are numbered the same way.
+   ///
+   /// Requests are written into a free slot of the shared memory and its
+   /// number queued on a ring. A worker takes it, plans, and writes the
+   /// steps of the plan back into the slot, where the client reads them in
+   /// place until it releases the slot.
+   ///
+   /// Workers exit soon after the process that started them dies, and a
+   /// service whose owner has died is replaced by the next start under its
+   /// name. Requests are served with status Failed if their worker dies,
+   /// or if every worker does. A worker that gets stuck on a request is
+   /// killed by a client waiting for it, so it counts as dead.
+   ///
+   /// Needs POSIX shared memory, process-shared semaphores and robust
+   /// mutexes; elsewhere start and connect fail. Start the service before
+   /// starting any threads, since only the calling thread survives in the
+   /// workers.
+   class PlanService {
+   public:
+      /// Set the sizes of the shared memory. Only used by start.
+      /// @param[in] slots        Requests that may be in progress at once.
+      /// @param[in] requestBytes Room for each request's start and goal.
+      /// @param[in] resultBytes  Room for each plan.
+      void setLimits(unsigned int slots, unsigned int requestBytes, unsigned int resultBytes);
+
+      /// Give up on a request after planning it for this long, and serve it
+      /// with status TimedOut. A worker still on it after twice as long is
+      /// stuck, and is killed. Zero means no limit. Only used by start.
+      /// Defaults to 10000.
+      void setTimeLimit(unsigned int ms) { mTimeLimit = ms; }
+
+      /// Create the shared memory and fork the workers.
+      /// @param[in] name    Name of the shared memory, such as "/aesop".
+      /// @param[in] overlay GroundActions the workers may use. Must outlive
+      ///                    the service.
+      /// @param[in] workers Number of worker processes.
+      /// @return False if the shared memory or a worker cannot be created,
+      ///         or a service whose owner is alive already has the name.
+      bool start(const std::string &name, const ActionOverlay *overlay, unsigned int workers);
+
+      /// Use a service started by another process.
+      /// @param[in] name Name the service was started with.
+      /// @param[in] dom  CompiledDomain built the same way as the service's.
+      /// @return False if there is no such service, its owner has died or
+      ///         its domain differs.
+      bool connect(const std::string &name, const CompiledDomain *dom);
+
+      /// Stop the workers, if we started them, and let go of the shared
+      /// memory.
+      void stop();
+
+      /// Ask for a plan.
+      /// @return A ticket for the request, or -1 if every slot is in use,
+      ///         the queue of requests is full or the states do not fit in
+      ///         a slot.
+      int submit(const WorldState &start, const WorldState &goal,
+         PlannerHeuristic h = RelevantCostHeuristic);
+
+      /// Wait for a request to be served. A request whose worker has died,
+      /// or that is still queued once every worker has died, is served with
+      /// status Failed while we wait. So is one whose worker is stuck, once
+      /// we have killed it.
+      /// @param[in] ticket Ticket returned by submit.
+      /// @param[in] ms     Longest time to wait, or negative to wait until
+      ///                   the request is served.
+      /// @return False if the ticket is not ours or time ran out.
+      bool wait(int ticket, int ms = -1);
+
+      /// Has a request been served yet?
+      bool done(int ticket) const;
+
+      /// How a served request turned out.
+      enum Status {
+         /// A plan was found.
+         Planned,
+         /// There is no plan.
+         NoPlan,
+         /// The plan was too long for a slot.
+         TooLong,
+         /// The request could not be read.
+         BadRequest,
+         /// Planning took longer than the time limit.
+         TimedOut,
+         /// The worker serving the request, or the whole service, died.
+         Failed,
+      };
+      Status status(int ticket) const;
+
+      /// One step of a served plan, pointing into the shared memory.
+      struct Step {
+         /// Index of the Action in the CompiledDomain.
+         unsigned int action;
+         unsigned int numParams;
+         const unsigned int *params;
+      };
+      /// Number of steps in a served plan.
+      unsigned int numSteps(int ticket) const;
+      /// A step of a served plan. Valid until the ticket is released.
+      Step getStep(int ticket, unsigned int i) const;
+      /// Copy a served plan, with Actions from our CompiledDomain.
+      bool getPlan(int ticket, Plan &plan) const;
+
+      /// Give a slot back once its plan has been read.
+      void release(int ticket);
+
+      /// Default constructor.
+      PlanService();
+      /// Default destructor. Stops the service.
+      ~PlanService();
+
+   private:
+      struct Header;
+      struct Life;
+      struct Cell;
+      struct Slot;
+
+      std::string mName;
+      /// The shared memory, and its size.
+      unsigned char *mMemory;
+      size_t mSize;
+      /// Did we create the shared memory?
+      bool mOwner;
+      /// Process IDs of the workers we started.
+      std::vector<int> mWorkers;
+      /// Domain requests are planned in.
+      const CompiledDomain *mDomain;
+      unsigned int mSlots, mRequestBytes, mResultBytes, mTimeLimit;
+
+      Header *header() const { return (Header*)mMemory; }
+      Cell *cell(unsigned int i) const;
+      Slot *slot(unsigned int i) const;
+      /// Where a slot's request starts. Its result follows.
+      static unsigned char *request(Slot *s);
+      /// Is a ticket a slot we may use?
+      bool valid(int ticket) const;
+      /// Map the shared memory.
+      bool map(int fd, size_t size);
+      /// Serve requests until told to stop or our owner dies. Runs in each
+      /// worker.
+      void serve(const ActionOverlay *overlay, unsigned int worker);
+      /// Serve a request with status Failed if its worker, or every
+      /// worker, has died. Kill its worker if it is stuck.
+      void reap(Slot *s);
+      /// Mutex each worker holds while it lives.
+      Life *life(unsigned int i) const;
+      /// Bytes before the ring, for a number of workers.
+      static size_t ringOffset(unsigned int workers);
+      /// Is any worker still alive?
+      bool workersAlive() const;
+      /// Is there a service under this name whose owner has died?
+      static bool stale(const std::string &name);
+      /// Add a slot's number to the ring, or take one off it.
+      bool enqueue(unsigned int s);
+      bool dequeue(unsigned int &s);
+
+      /// Not copyable.
+      PlanService(const PlanService&);
+      PlanService &operator=(const PlanService&);
+   };
+};
+
+#endif
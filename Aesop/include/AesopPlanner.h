@@ -1,158 +1,545 @@
-/// @file AesopPlanner.h
-/// Defines Planner class.
-
-#ifndef _AE_PLANNER_H_
-#define _AE_PLANNER_H_
-
-#include "AesopTypes.h"
-#include "AesopWorldState.h"
-#include "AesopContext.h"
-
-namespace Aesop {
-   /// A context in which we can make plans.
-   class Planner {
-   public:
-      /// Set our starting WorldState.
-      /// @param[in] start Pointer to a WorldState.
-      void setStart(const WorldState *start);
-
-      /// Set our goal state.
-      /// @param[in] goal Pointer to a WorldState.
-      void setGoal(const WorldState *goal);
-
-      /// Set a WorldState representing constants for our problem.
-      /// @param[in] con Pointer to a WorldState.
-      void setConstants(const WorldState *con);
-
-      /// Create a plan.
-      /// @param[in] ctx Context object to record the Planner's activity.
-      /// @return True if the plan was successfully calculated, false if no
-      ///         plan exists or something went wrong in the planning process.
-      bool plan(Context *ctx = NULL);
-
-      /// Start a sliced plan.
-      /// @param[in] ctx Context object to record the Planner's activity.
-      /// @return True if the plan was successfully initialised, false if
-      ///         something went wrong in initialisation.
-      bool initSlicedPlan(Context *ctx = NULL);
-
-      /// Update a sliced plan.
-      /// @param[in] ctx Context object to record the Planner's activity.
-      /// @return False if planning should stop, true if it should continue.
-      bool updateSlicedPlan(Context *ctx = NULL);
-
-      /// Output the result of a computed plan to 
-      /// @param[in] ctx Context object to record the Planner's activity.
-      void finaliseSlicedPlan(Context *ctx = NULL);
-
-      /// US English spelling of finaliseSlicedPlan. 'Cause I'm a nice guy.
-      /// @see Planner::finaliseSlicedPlan
-      inline void finalizeSlicedPlan(Context *ctx = NULL)
-      { finaliseSlicedPlan(ctx); }
-
-      /// Did we plan successfully?
-      /// @return True iff a valid plan was found.
-      bool success() const { return mSuccess; }
-
-      /// Get the currently constructed plan.
-      /// @return A Plan.
-      const Plan& getPlan() const;
-
-      /// Set the ActionSet we can use.
-      /// @param[in] set The ActionSet to pull from.
-      void setActions(const ActionSet *set);
-
-      /// Add an object.
-      void addObject(Object obj) { mObjects.push_back(obj); }
-
-      /// Value constructor.
-      /// @param[in] start Starting world state.
-      /// @param[in] goal  Target world state.
-      /// @param[in] goal  Constants.
-      /// @param[in] set   ActionSet that defines the Actions we may perform.
-      Planner(const WorldState *start, const WorldState *goal, const WorldState *con, const ActionSet *set);
-
-      /// Default constructor.
-      Planner();
-      /// Default destructor.
-      ~Planner();
-
-   protected:
-
-   private:
-      /// A WorldState instance used during planning.
-      struct IntermediateState {
-         /// ID number of this IntermediateState within the current plan.
-         /// Not really used, except to identify states for debugging purposes.
-         unsigned int ID;
-         /// State of the world at this step.
-         WorldState state;
-         /// Current cost to get to this state from starting state.
-         float G;
-         /// Guess at cost to get from this state to goal.
-         float H;
-         /// The sum of G and H.
-         float F;
-         /// IntermediateState leading to this one.
-         unsigned int prev;
-         /// Action leading to this one.
-         const Action *ac;
-         /// Parameters to pass to our Action.
-         objects params;
-
-         /// Default constructor.
-         IntermediateState()
-         {
-            G = H = F = 0.0f;
-            prev = 0;
-            ac = NULL;
-            ID = 0;
-         }
-
-         /// Compare based on F score.
-         bool operator>(const IntermediateState s) const
-         { return F > s.F; }
-
-         /// Compare based on F score.
-         bool operator<(const IntermediateState s) const
-         { return F < s.F; }
-
-         /// Equality is based on the state represented, not auxiliary
-         ///        data.
-         bool operator==(const IntermediateState &s) const
-         { return state == s.state; }
-      };
-      typedef std::vector<IntermediateState> openlist;
-      typedef std::vector<IntermediateState> closedlist;
-
-      /// Starting state.
-      /// Not allowed to modify this.
-      const WorldState *mStart;
-      /// Goal state.
-      /// Not allowed to modify this.
-      const WorldState *mGoal;
-      /// Constants.
-      /// Not allowed to modify this.
-      const WorldState *mConstants;
-      /// Objects we're working with.
-      objects mObjects;
-      /// A* algorithm open list.
-      openlist mOpenList;
-      /// A* algorithm closed list.
-      closedlist mClosedList;
-      /// Did we find a valid plan?
-      bool mSuccess;
-      /// IntermediateState ID number for debug purposes.
-      /// @todo Find a better way to identify states!
-      unsigned int mId;
-      /// Current plan to get from mStart to mGoal.
-      Plan mPlan;
-      /// Set of Actions we are allowed to perform.
-      const ActionSet *mActions;
-
-      /// Internal function used by pathfinding.
-      void attemptIntermediate(Context *ctx, IntermediateState &s, const Action &ac, float pref, objects &plist);
-   };
-};
-
-#endif
+/// @file AesopPlanner.h
+/// Defines Planner class.
+
+#ifndef _AE_PLANNER_H_
+#define _AE_PLANNER_H_
+
+#include "AesopTypes.h"
+#include "AesopWorldState.h"
+#include "AesopContext.h"
+#include "AesopDomain.h"
+#include "AesopWorldStore.h"
+#include "AesopBeliefState.h"
+#include "AesopPlanningGraph.h"
+#include "AesopThreadPool.h"
+#include "AesopClosedSet.h"
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace Aesop {
+   /// How a Planner using a CompiledDomain estimates the cost of getting
+   /// from the start to a state.
+   enum PlannerHeuristic {
+      /// The most expensive of the cheapest GroundActions relevant to each
+      /// Fact that differs from the start. The default.
+      RelevantCostHeuristic,
+      /// h_max over a PlanningGraph grown from the start.
+      MaxCostHeuristic,
+      /// The PlanningGraph level at which the state's Facts first appear
+      /// together, times the cost of the cheapest GroundAction.
+      SetLevelHeuristic,
+   };
+
+   /// How a Planner explores the states between the goal and the start.
+   enum SearchMode {
+      /// A* with open and closed lists. The default.
+      AStarSearch,
+      /// Breadth-first heuristic search: states are expanded one depth at a
+      /// time, and any whose estimated total cost exceeds a bound are
+      /// dropped. The bound starts at the goal's estimate and is raised to
+      /// the cheapest dropped state whenever a search fails, so plans are
+      /// as cheap as with A*. Only the last, current and next depths are
+      /// kept, plus one relay depth halfway along; the plan is rebuilt by
+      /// searching again from the goal to the relay state and from the
+      /// relay state to the start, recursively. Memory grows with the width
+      /// of the search rather than its size, at the cost of more time.
+      FrontierSearch,
+      /// Beam search: states are expanded one depth at a time, and only the
+      /// few with the lowest F at each depth are kept. Memory and time are
+      /// bounded by the width of the beam and setMaxDepth, but plans may
+      /// cost more than they need to, or not be found at all. After a
+      /// failure the search can start again with a wider beam.
+      BeamSearch,
+   };
+
+   /// One query of Planner::planBatch.
+   struct BatchRequest {
+      /// Starting WorldState.
+      const WorldState *start;
+      /// Goal state.
+      const WorldState *goal;
+      /// Was a plan found? Set by Planner::planBatch.
+      bool success;
+      /// The plan found.
+      Plan plan;
+
+      /// Value constructor.
+      BatchRequest(const WorldState *s = NULL, const WorldState *g = NULL)
+         : start(s), goal(g), success(false) {}
+   };
+
+   /// A context in which we can make plans.
+   class Planner {
+   public:
+      /// Set our starting WorldState.
+      /// @param[in] start Pointer to a WorldState.
+      void setStart(const WorldState *start);
+
+      /// Start from one agent's BeliefState, reading it in place through
+      /// its own lookups instead of copying the world it shares. Only the
+      /// graph based heuristics and saveSlicedPlan flatten it.
+      /// Replaces any start given to Planner::setStart, and is replaced by
+      /// the next one.
+      /// @param[in] start Pointer to a BeliefState.
+      void setBeliefStart(const BeliefState *start);
+
+      /// Start each plan from whichever version of a WorldStore is current
+      /// when it starts. A sliced plan keeps reading that version until it
+      /// is finalised, however the store changes in the meantime.
+      /// Takes precedence over Planner::setStart.
+      /// @param[in] start WorldStore to read, or NULL to stop using one.
+      void setSharedStart(const WorldStore *start);
+
+      /// Set our goal state.
+      /// @param[in] goal Pointer to a WorldState.
+      void setGoal(const WorldState *goal);
+
+      /// Set a WorldState representing constants for our problem.
+      /// @param[in] con Pointer to a WorldState.
+      void setConstants(const WorldState *con);
+
+      /// Create a plan.
+      /// @param[in] ctx Context object to record the Planner's activity.
+      /// @return True if the plan was successfully calculated, false if no
+      ///         plan exists or something went wrong in the planning process.
+      bool plan(Context *ctx = NULL);
+
+      /// Start a sliced plan.
+      /// @param[in] ctx Context object to record the Planner's activity.
+      /// @return True if the plan was successfully initialised, false if
+      ///         something went wrong in initialisation.
+      bool initSlicedPlan(Context *ctx = NULL);
+
+      /// Update a sliced plan.
+      /// @param[in] ctx Context object to record the Planner's activity.
+      /// @return False if planning should stop, true if it should continue.
+      bool updateSlicedPlan(Context *ctx = NULL);
+
+      /// Output the result of a computed plan to 
+      /// @param[in] ctx Context object to record the Planner's activity.
+      void finaliseSlicedPlan(Context *ctx = NULL);
+
+      /// US English spelling of finaliseSlicedPlan. 'Cause I'm a nice guy.
+      /// @see Planner::finaliseSlicedPlan
+      inline void finalizeSlicedPlan(Context *ctx = NULL)
+      { finaliseSlicedPlan(ctx); }
+
+      /// Save a sliced plan between updateSlicedPlan calls, so that it can
+      /// be resumed later by this or another Planner, in this or another
+      /// process. The checkpoint holds the open and closed lists, the start
+      /// state, the heuristic and our objects. Actions are recorded by name,
+      /// so every Action must have a different name.
+      /// @param[out] out Buffer to append the checkpoint to.
+      /// @return False if no sliced plan is in progress, or it does not use
+      ///         AStarSearch.
+      bool saveSlicedPlan(std::vector<unsigned char> &out) const;
+
+      /// Carry on with a sliced plan saved by saveSlicedPlan, in place of
+      /// initSlicedPlan. Our ActionSet, domain or overlay must offer the same
+      /// Actions as the Planner that saved it; our start and goal are not
+      /// used.
+      /// @param[in] data Checkpoint to resume from.
+      /// @param[in] size Size of the checkpoint in bytes.
+      /// @param[in] ctx  Context object to record the Planner's activity.
+      /// @return False if the checkpoint cannot be read or names an Action
+      ///         we do not have.
+      bool resumeSlicedPlan(const unsigned char *data, size_t size, Context *ctx = NULL);
+
+      /// Plan for many starts and goals at once in our CompiledDomain,
+      /// using one ActionOverlay for all of them. Requests with the same
+      /// goal share a single A* search back from it, which stops at each of
+      /// their starts in turn and estimates costs from the nearest start not
+      /// yet reached; those plans are as cheap as separate ones would be.
+      /// Other requests are planned with our heuristic and search mode.
+      /// Groups are spread over our ThreadPool, if we have one, each thread
+      /// with a Planner of its own that keeps its caches between batches.
+      /// Without a CompiledDomain, each request is planned in turn.
+      /// Our own start, goal and plan are left alone.
+      /// @param[in,out] requests Queries to answer. Plans are written into
+      ///                         each one.
+      /// @param[in]     count    Number of requests.
+      /// @param[in]     ctx      Context object to record our activity.
+      /// @return Number of requests a plan was found for.
+      unsigned int planBatch(BatchRequest *requests, unsigned int count, Context *ctx = NULL);
+
+      /// Did we plan successfully?
+      /// @return True iff a valid plan was found.
+      bool success() const { return mSuccess; }
+
+      /// Get the currently constructed plan.
+      /// @return A Plan.
+      const Plan& getPlan() const;
+
+      /// Set the ActionSet we can use.
+      /// @param[in] set The ActionSet to pull from.
+      void setActions(const ActionSet *set);
+
+      /// Add an object.
+      void addObject(Object obj) { mObjects.push_back(obj); }
+
+      /// Plan using the grounded operators of a CompiledDomain instead of
+      /// grounding Actions for every node. Only GroundActions whose Action is
+      /// in our ActionSet are used, and our objects are ignored. An
+      /// ActionOverlay is built from our ActionSet for each version of the
+      /// domain we plan in.
+      /// @param[in] dom CompiledDomain to plan in, or NULL to stop using one.
+      void setDomain(const CompiledDomain *dom);
+
+      /// Plan using whichever CompiledDomain is current when each plan
+      /// starts. A sliced plan keeps the version it started with until it is
+      /// finalised, even if a new version is published in the meantime.
+      /// Takes precedence over Planner::setDomain.
+      /// @param[in] dom SharedDomain to plan in, or NULL to stop using one.
+      void setSharedDomain(const SharedDomain *dom);
+
+      /// Plan using an ActionOverlay in place of our ActionSet. The overlay's
+      /// domain is used, and may be shared with other Planners.
+      /// Takes precedence over Planner::setDomain and setSharedDomain.
+      /// @param[in] overlay ActionOverlay to plan with, or NULL.
+      void setOverlay(const ActionOverlay *overlay);
+
+      /// Choose how to estimate costs when planning in a CompiledDomain.
+      /// The graph based heuristics need EagerGrounding, and fall back to
+      /// RelevantCostHeuristic otherwise, or if the PlanningGraph would be
+      /// too large. The PlanningGraph is kept between plans that start from
+      /// the same state.
+      void setHeuristic(PlannerHeuristic h) { mHeuristic = h; }
+
+      /// Choose how to search. Defaults to AStarSearch.
+      void setSearchMode(SearchMode mode) { mSearchMode = mode; }
+
+      /// Most Actions FrontierSearch and BeamSearch consider in a plan.
+      /// Zero means no limit, which is only safe for FrontierSearch if no
+      /// cycle of Actions is free, and leaves BeamSearch unbounded.
+      void setMaxDepth(unsigned int depth) { mMaxDepth = depth; }
+
+      /// Set how many states BeamSearch keeps at each depth, and how many
+      /// times it starts again with twice as many after failing.
+      void setBeamWidth(unsigned int width, unsigned int restarts = 0)
+      { mBeamWidth = width? width: 1; mBeamRestarts = restarts; }
+
+      /// Search on a ThreadPool as well as the calling thread.
+      /// @param[in] pool ThreadPool to use, or NULL to search on the calling
+      ///                 thread alone.
+      void setThreadPool(ThreadPool *pool) { mPool = pool; }
+
+      /// Number of states AStarSearch takes from the open list at once.
+      /// Their successors are generated and estimated together, on the
+      /// ThreadPool if there is one, then added to the lists in the order
+      /// the states were taken, so plans do not depend on the number of
+      /// threads. Defaults to one.
+      /// States after the first in a batch may be expanded before their
+      /// cheapest path is known. They are opened again if a cheaper one is
+      /// found, and the start is only accepted at the head of a batch, so
+      /// plans stay optimal but more states may be expanded.
+      void setExpansionBatch(unsigned int k) { mExpansionBatch = k? k: 1; }
+
+      /// Split the work of expanding a single state between the threads of
+      /// our ThreadPool. Each thread tries its own share of the Actions and
+      /// parameters, or of the domain's GroundActions, and the states found
+      /// are put back together in the order one thread would find them.
+      /// Helps most with many Actions or objects. States AStarSearch takes
+      /// in batches are spread over the threads instead.
+      void setSplitExpansion(bool split) { mSplitExpansion = split; }
+
+      /// Value constructor.
+      /// @param[in] start Starting world state.
+      /// @param[in] goal  Target world state.
+      /// @param[in] goal  Constants.
+      /// @param[in] set   ActionSet that defines the Actions we may perform.
+      Planner(const WorldState *start, const WorldState *goal, const WorldState *con, const ActionSet *set);
+
+      /// Default constructor.
+      Planner();
+      /// Default destructor.
+      ~Planner();
+
+   protected:
+
+   private:
+      friend class ExpandTask;
+      friend class SplitTask;
+      friend class GroupTask;
+
+      /// A WorldState instance used during planning.
+      struct IntermediateState {
+         /// ID number of this IntermediateState within the current plan.
+         /// Not really used, except to identify states for debugging purposes.
+         unsigned int ID;
+         /// State of the world at this step.
+         WorldState state;
+         /// Current cost to get to this state from starting state.
+         float G;
+         /// Guess at cost to get from this state to goal.
+         float H;
+         /// The sum of G and H.
+         float F;
+         /// IntermediateState leading to this one.
+         unsigned int prev;
+         /// Action leading to this one.
+         const Action *ac;
+         /// Parameters to pass to our Action.
+         objects params;
+         /// GroundAction leading to this one, if planning in a CompiledDomain.
+         const GroundAction *op;
+
+         /// Default constructor.
+         IntermediateState()
+         {
+            G = H = F = 0.0f;
+            prev = 0;
+            ac = NULL;
+            op = NULL;
+            ID = 0;
+         }
+
+         /// Compare based on F score.
+         bool operator>(const IntermediateState &s) const
+         { return F > s.F; }
+
+         /// Compare based on F score.
+         bool operator<(const IntermediateState &s) const
+         { return F < s.F; }
+
+         /// Equality is based on the state represented, not auxiliary
+         ///        data.
+         bool operator==(const IntermediateState &s) const
+         { return state == s.state; }
+      };
+      typedef std::vector<IntermediateState> openlist;
+      /// States never move once closed, so mClosedSet can point to them.
+      typedef std::deque<IntermediateState> closedlist;
+
+      /// The states at one depth of a FrontierSearch, indexed by hash.
+      struct Layer {
+         std::vector<IntermediateState> nodes;
+         std::multimap<unsigned int, unsigned int> index;
+         /// Position of a state, or -1.
+         int find(const WorldState &state) const;
+         void add(const IntermediateState &n);
+         void clear();
+         void swap(Layer &other);
+      };
+      /// A FrontierSearch from one state to another. In each state, prev is
+      /// the position of its ancestor in the relay depth, once it has one.
+      struct Frontier {
+         IntermediateState root;
+         /// Stop at a state equal to this, or at the start if NULL.
+         const WorldState *target;
+         Layer last, cur, next;
+         /// States at the relay depth, or none.
+         std::vector<IntermediateState> relay;
+         unsigned int relayDepth;
+         /// Depth of cur, and position of the next state in it to expand.
+         unsigned int depth, pos;
+         /// Drop states whose F exceeds bound or whose G exceeds limit.
+         float bound, limit;
+         /// Cheapest F dropped so far.
+         float nextBound;
+         /// Raise the bound and start again when the search fails?
+         bool deepen;
+         /// The state the search stopped at, and its depth.
+         IntermediateState found;
+         unsigned int foundDepth;
+      };
+      enum FrontierStatus { FrontierRunning, FrontierFound, FrontierFailed };
+      /// An Action and parameters to try in reverse.
+      struct Attempt {
+         const Action *ac;
+         float pref;
+         objects params;
+      };
+      /// A BeamSearch in progress. In each state, prev is the position of
+      /// its parent in the depth before.
+      struct Beam {
+         /// Every depth kept so far, starting with the goal.
+         std::vector<Layer> layers;
+         /// Successors of the deepest layer found so far.
+         Layer next;
+         /// Position of the next state to expand in the deepest layer.
+         unsigned int pos;
+         /// Current width, and restarts left.
+         unsigned int width, restarts;
+         /// Depth and position of the state the search stopped at.
+         unsigned int foundDepth, found;
+      };
+
+      /// Starting state.
+      /// Not allowed to modify this.
+      const WorldState *mStart;
+      /// Source of starting states.
+      const WorldStore *mSharedStart;
+      /// Version of mSharedStart the current plan is using, if any. We hold
+      /// a reference to it until the plan is finalised.
+      const WorldSnapshot *mPlanStart;
+      /// Starting state of a plan resumed from a checkpoint.
+      WorldState mResumedStart;
+      /// Is the current plan resumed from a checkpoint?
+      bool mResumed;
+      /// Starting BeliefState, if setBeliefStart was used instead.
+      const BeliefState *mBeliefStart;
+      /// mBeliefStart flattened, for the graph based heuristics.
+      WorldState mFlatStart;
+      /// The BeliefState the current plan starts from, or NULL if it starts
+      /// from a WorldState.
+      const BeliefState *beliefStart() const
+      { return mResumed || mPlanStart? NULL: mBeliefStart; }
+      /// The starting state of the current plan. Only valid if the plan
+      /// does not start from a BeliefState.
+      const WorldState &start() const
+      { return mResumed? mResumedStart: mPlanStart? mPlanStart->state(): *mStart; }
+      /// Compare a state with the start of the current plan, as
+      /// WorldState::comp and WorldState::compStart would.
+      unsigned int compToStart(const WorldState &state) const;
+      unsigned int compStartToStart(const WorldState &state) const;
+      /// Goal state.
+      /// Not allowed to modify this.
+      const WorldState *mGoal;
+      /// Constants.
+      /// Not allowed to modify this.
+      const WorldState *mConstants;
+      /// Objects we're working with.
+      objects mObjects;
+      /// A* algorithm open list.
+      openlist mOpenList;
+      /// A* algorithm closed list.
+      closedlist mClosedList;
+      /// Index of the closed list, with each state's position as its
+      /// handle. Threads expanding states read it to drop closed states
+      /// before estimating them.
+      ClosedSet mClosedSet;
+      /// Did we find a valid plan?
+      bool mSuccess;
+      /// IntermediateState ID number for debug purposes.
+      /// @todo Find a better way to identify states!
+      unsigned int mId;
+      /// Current plan to get from mStart to mGoal.
+      Plan mPlan;
+      /// Set of Actions we are allowed to perform.
+      const ActionSet *mActions;
+      /// Grounded domain to plan in.
+      const CompiledDomain *mDomain;
+      /// Source of grounded domains to plan in.
+      const SharedDomain *mSharedDomain;
+      /// Domain the current plan is using, if any. We hold a reference to it
+      /// until the plan is finalised.
+      const CompiledDomain *mPlanDomain;
+      /// ActionOverlay given to us by the user.
+      const ActionOverlay *mOverlay;
+      /// ActionOverlay we built from mActions for the latest domain version.
+      ActionOverlay *mOwnOverlay;
+      /// Revision of mActions that mOwnOverlay was built from.
+      unsigned long mOwnOverlayRevision;
+      /// ActionOverlay the current plan is using.
+      const ActionOverlay *mPlanOverlay;
+      /// Scratch space for GroundActions relevant to the current node.
+      std::vector<const GroundAction*> mCandidates;
+      /// Scratch space for the states leading to the current node.
+      std::vector<IntermediateState> mSuccessors;
+      /// Heuristic chosen by the user.
+      PlannerHeuristic mHeuristic;
+      /// Heuristic the current plan is using.
+      PlannerHeuristic mPlanHeuristic;
+      /// How we search, and how deep FrontierSearch may go.
+      SearchMode mSearchMode;
+      unsigned int mMaxDepth;
+      /// Search mode of the current plan.
+      SearchMode mPlanMode;
+      /// State of a FrontierSearch from the goal to the start.
+      Frontier mFrontier;
+      /// BeamSearch settings, and the state of the current one.
+      unsigned int mBeamWidth, mBeamRestarts;
+      Beam mBeam;
+      /// Graph from the start, for the graph based heuristics.
+      PlanningGraph mGraph;
+      /// ThreadPool to expand states on, if any.
+      ThreadPool *mPool;
+      /// Number of states AStarSearch expands at once.
+      unsigned int mExpansionBatch;
+      /// States taken from the open list together, and the states leading
+      /// to each.
+      std::vector<IntermediateState> mBatch;
+      std::vector<std::vector<IntermediateState> > mBatchSuccessors;
+      /// Split the expansion of single states over mPool?
+      bool mSplitExpansion;
+      /// Work shared out by a split expansion: the state being expanded,
+      /// what to try in reverse without a domain, and the states each piece
+      /// found.
+      const IntermediateState *mSplitState;
+      std::vector<Attempt> mAttempts;
+      std::vector<std::vector<IntermediateState> > mPieces;
+      /// Starts a search shared by several requests has yet to reach, if it
+      /// is one. States are estimated from the nearest.
+      const std::vector<const WorldState*> *mGroupStarts;
+      /// Requests of the current planBatch with the same goal.
+      std::vector<std::vector<BatchRequest*> > mGroups;
+      /// Planners that work on groups, one per thread, and those not in use.
+      std::vector<Planner*> mBatchPlanners, mIdlePlanners;
+      std::mutex mBatchLock;
+
+      /// Find every state that may lead to a state, by applying each Action
+      /// we may use in reverse. The work is split over mPool if
+      /// setSplitExpansion asked for it.
+      /// @param[in]  s   State to regress from.
+      /// @param[out] out The states found, with costs and heuristics filled in.
+      void expand(const IntermediateState &s, std::vector<IntermediateState> &out);
+      /// As above, on the calling thread alone, with scratch space of the
+      /// caller's so that several states may be expanded at once.
+      void expand(const IntermediateState &s, std::vector<IntermediateState> &out,
+         std::vector<const GroundAction*> &candidates);
+      /// Every list of our objects an Action may take as parameters.
+      void groundings(const Action &ac, paramset &params) const;
+      /// Try one share of a split expansion: the candidates or Attempts
+      /// from begin up to end.
+      void expandRange(unsigned int begin, unsigned int end, std::vector<IntermediateState> &out);
+      /// Internal function used by pathfinding.
+      void attemptIntermediate(const IntermediateState &s, const Action &ac, float pref, objects &plist,
+         std::vector<IntermediateState> &out);
+      /// Internal function used by pathfinding in a CompiledDomain.
+      void attemptIntermediate(const IntermediateState &s, const GroundAction &op, float cost,
+         std::vector<IntermediateState> &out);
+      /// Estimated cost from the start to a state, or a negative value if it
+      /// can never be reached.
+      float estimate(const WorldState &state);
+      /// Read the plan leading to a closed state back to the goal.
+      void tracePlan(unsigned int i, Plan &plan) const;
+      /// Answer requests for one goal with a Planner of our own.
+      void planGroup(const Planner &owner, std::vector<BatchRequest*> &group,
+         const ActionOverlay *overlay);
+      /// Begin a FrontierSearch.
+      void frontierStart(Frontier &f, const IntermediateState &root, const WorldState *target,
+         float bound, float limit, unsigned int relayDepth, bool deepen);
+      /// Expand one state of a FrontierSearch.
+      FrontierStatus frontierStep(Context *ctx, Frontier &f);
+      /// Find the Actions leading from a FrontierSearch's target to its root
+      /// in a known number of steps, by divide and conquer.
+      /// @param[out] steps States along the way, nearest the target first.
+      ///                   Each holds the Action leading from it.
+      bool frontierPath(Context *ctx, const IntermediateState &root, const WorldState *target,
+         float bound, float limit, unsigned int depth, std::vector<IntermediateState> &steps);
+      /// Start a BeamSearch from the goal with the given width.
+      void beamStart(unsigned int width, unsigned int restarts);
+      /// Expand one state of the current BeamSearch.
+      FrontierStatus beamStep(Context *ctx);
+      /// Is the state closed at a cost no higher than its own?
+      bool closedAsCheap(const IntermediateState &n) const;
+      /// Add a new IntermediateState to the open list unless we have already
+      /// found it as cheaply.
+      /// @param[in] prev Position of the state it leads to in the closed list.
+      void pushIntermediate(Context *ctx, IntermediateState &n, unsigned int prev);
+      /// Write the states of the open or closed list to a checkpoint.
+      template<typename List>
+      static void saveStates(ByteWriter &w, const List &list);
+      /// Pin the domain version a new plan will use, and set up its overlay
+      /// and heuristic.
+      void preparePlan(Context *ctx, PlannerHeuristic h);
+      /// Drop our references to the domain and starting state the last plan
+      /// used.
+      void releasePlanVersions();
+   };
+};
+
+#endif
@@ -0,0 +1,206 @@
+/// @file AesopPlanningGraph.h
+/// Defines PlanningGraph class.
+
+#ifndef _AE_PLANNINGGRAPH_H_
+#define _AE_PLANNINGGRAPH_H_
+
+#include "AesopTypes.h"
+#include "AesopAction.h"
+#include "AesopWorldState.h"
+#include "AesopDomain.h"
+
+#include <vector>
+
+namespace Aesop {
+   /// A levelled graph of what can be reached from a start state. Fact
+   /// level 0 holds the start; each action level holds the GroundActions
+   /// whose conditions all appear in the fact level before it, and the next
+   /// fact level adds their effects. Pairs of values and of GroundActions
+   /// that cannot occur together at a level are marked mutually exclusive.
+   ///
+   /// The graph is built one level at a time as queries need it, and kept
+   /// until reset with a different start, so queries from the same start
+   /// share it.
+   ///
+   /// A Fact's values are atoms. Facts change atomically, so a GroundAction
+   /// that increments a Fact, or whose condition allows several values,
+   /// appears once for each value it can start from. One that increments
+   /// several Facts appears once per combination of their values, so the
+   /// number of nodes is limited; see PlanningGraph::setNodeLimit.
+   /// Requires a CompiledDomain built with EagerGrounding.
+   class PlanningGraph {
+   public:
+      /// How to treat Facts the start state does not set.
+      enum StartMode {
+         /// They have the value the domain's constants give them, or are
+         /// unset, as in SymbolicPlanner and SatPlanner.
+         ClosedWorld,
+         /// They may have any value, as in Planner. Conditions on them
+         /// always hold and effects on them are ignored.
+         OpenWorld,
+      };
+
+      /// Start the graph from a state, unless it already starts there in
+      /// the same domain, in which case the levels built so far are kept.
+      /// @param[in] dom     CompiledDomain to plan in.
+      /// @param[in] overlay Only use GroundActions this allows, at the costs
+      ///                    it gives them, if given.
+      /// @param[in] start   State to start from.
+      /// @param[in] mode    How to treat Facts start does not set.
+      /// @return True if the graph was rebuilt.
+      bool reset(const CompiledDomain &dom, const ActionOverlay *overlay,
+         const WorldState &start, StartMode mode = ClosedWorld);
+
+      /// Forget everything, so the next reset rebuilds the graph.
+      void clear();
+
+      /// Limit the number of nodes: one per GroundAction and set of values
+      /// it can start from, plus one no-op per atom. Each level takes memory
+      /// quadratic in the number of nodes. Defaults to 4096.
+      void setNodeLimit(unsigned int nodes);
+
+      /// Did the last reset give up because the graph would have more nodes
+      /// than the limit? The graph then has no levels, and the heuristics
+      /// return 0, which never rules a state out.
+      bool tooLarge() const { return mTooLarge; }
+
+      /// Add a fact level.
+      /// @return False if the graph has levelled off, so that every later
+      ///         level would be the same as the last.
+      bool expand();
+
+      /// Build every level and the costs maxCost reads. Afterwards the
+      /// heuristics only read the graph, so they may be used from several
+      /// threads at once.
+      void build();
+
+      /// Has the graph levelled off?
+      bool leveled() const { return mLeveled; }
+
+      /// Number of fact levels built. Once levelled off, levels past the
+      /// last are the same as the last.
+      unsigned int numLevels() const { return mLevels.size(); }
+
+      /// @name Heuristics
+      /// Estimates of the cost to reach a state from the start. Facts the
+      /// start does not set are ignored with OpenWorld. Builds the graph
+      /// until it levels off.
+      /// @{
+      /// Cost of the most expensive single Fact, each reached as cheaply as
+      /// possible (h_max).
+      /// @return The estimate, or a negative value if the state can never
+      ///         be reached.
+      float maxCost(const WorldState &state);
+      /// First level at which every Fact of a state appears and no two are
+      /// mutually exclusive.
+      /// @return The level, or -1 if there is none.
+      int setLevel(const WorldState &state);
+      /// Cost of the cheapest usable GroundAction.
+      float minCost() const { return mMinCost; }
+      /// @}
+
+      /// Default constructor.
+      PlanningGraph();
+      /// Default destructor.
+      ~PlanningGraph();
+
+   private:
+      friend class GraphPlanner;
+
+      /// A fixed-size set of small integers packed into words.
+      class Bits {
+      public:
+         void resize(unsigned int n) { mWords.assign((n + WordBits - 1) / WordBits, 0); }
+         void set(unsigned int i) { mWords[i / WordBits] |= 1ul << (i % WordBits); }
+         bool test(unsigned int i) const { return (mWords[i / WordBits] >> (i % WordBits)) & 1; }
+         /// Do we share any member with another set?
+         bool intersects(const Bits &o) const;
+         /// Does another set have a member we lack?
+         bool missing(const Bits &o) const;
+         Bits &operator|=(const Bits &o);
+         Bits &operator&=(const Bits &o);
+         bool operator==(const Bits &o) const { return mWords == o.mWords; }
+         bool operator!=(const Bits &o) const { return mWords != o.mWords; }
+         /// Next member at or after i, or -1.
+         int next(unsigned int i) const;
+      private:
+         enum { WordBits = sizeof(unsigned long) * 8 };
+         std::vector<unsigned long> mWords;
+      };
+
+      /// A GroundAction starting from particular values, or a no-op that
+      /// keeps an atom.
+      struct Node {
+         /// The GroundAction, or NULL for a no-op.
+         const GroundAction *ga;
+         float cost;
+         /// Atoms needed and added, sorted.
+         std::vector<unsigned int> pre, add;
+      };
+
+      /// A fact level and the action level that follows it.
+      struct Level {
+         /// Atoms that appear.
+         Bits atoms;
+         /// Atoms each atom is mutually exclusive with.
+         std::vector<Bits> mutex;
+         /// Nodes whose conditions appear, once the next level is built.
+         Bits nodes;
+         /// Nodes each node is mutually exclusive with.
+         std::vector<Bits> nodeMutex;
+      };
+
+      /// What the graph was built from. We hold a reference to mDomain.
+      const CompiledDomain *mDomain;
+      const ActionOverlay *mOverlay;
+      WorldState mStart;
+      StartMode mMode;
+
+      /// First atom of each Fact, with one more entry at the end. Facts
+      /// that OpenWorld leaves free have none.
+      std::vector<unsigned int> mFirst;
+      /// Value of each atom; -1 means unset.
+      std::vector<int> mValues;
+      /// Fact of each atom.
+      std::vector<FactID> mAtomFact;
+      /// Nodes, starting with one no-op per atom.
+      std::vector<Node> mNodes;
+      /// Nodes needing and adding each atom.
+      std::vector<Bits> mConsumers, mProducers;
+      /// Nodes each node interferes with, sorted: one changes a Fact the
+      /// other needs or changes to a different value. Only nodes that share
+      /// a Fact can interfere, so these lists are short.
+      std::vector<std::vector<unsigned int> > mInterferes;
+      float mMinCost;
+      unsigned int mNodeLimit;
+      bool mTooLarge;
+
+      std::vector<Level> mLevels;
+      bool mLeveled;
+      /// Cheapest known cost of each atom, or -1.
+      std::vector<float> mCost;
+      bool mCostSettled;
+
+      /// Level i, or the last level if the graph has levelled off before i.
+      const Level &level(unsigned int i) const
+      { return mLevels[i < mLevels.size()? i: mLevels.size() - 1]; }
+      /// Atom of a Fact having a value, or -1.
+      int atom(FactID id, int value) const;
+      /// Find the atoms a state needs.
+      /// @return False if it needs a value that can never be reached.
+      bool atoms(const WorldState &state, std::vector<unsigned int> &out) const;
+      /// Are all of a set of atoms present and not mutually exclusive?
+      bool reachable(unsigned int lvl, const std::vector<unsigned int> &atoms) const;
+      /// Build nodes and their interference.
+      /// @return False if there would be more than mNodeLimit nodes.
+      bool compile(const CompiledDomain &dom);
+      /// Relax mCost through every node until it stops changing.
+      void settle();
+
+      /// Not copyable.
+      PlanningGraph(const PlanningGraph&);
+      PlanningGraph &operator=(const PlanningGraph&);
+   };
+};
+
+#endif
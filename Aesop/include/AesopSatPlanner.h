@@ -0,0 +1,147 @@
+/// @file AesopSatPlanner.h
+/// Defines SatPlanner class.
+
+#ifndef _AE_SATPLANNER_H_
+#define _AE_SATPLANNER_H_
+
+#include "AesopTypes.h"
+#include "AesopAction.h"
+#include "AesopWorldState.h"
+#include "AesopContext.h"
+#include "AesopDomain.h"
+#include "AesopThreadPool.h"
+#include "AesopSatSolver.h"
+
+#include <atomic>
+#include <vector>
+
+namespace Aesop {
+   /// Plans by asking a SatSolver whether the goal can be reached in a
+   /// given number of steps. In each step any number of GroundActions may
+   /// be taken together, as long as taking them in any order has the same
+   /// result; they are listed in the Plan one after the other.
+   ///
+   /// Each number of steps (horizon) is a separate query. Given a
+   /// ThreadPool, several horizons are solved at once; the Plan always
+   /// comes from the smallest horizon that has one, so it does not depend
+   /// on the number of threads. Plans have the fewest steps possible, but
+   /// are not necessarily the cheapest.
+   ///
+   /// Like SymbolicPlanner, the start state is read as complete and every
+   /// Fact in the goal must hold at the end of the plan.
+   /// Requires a CompiledDomain built with EagerGrounding.
+   class SatPlanner {
+   public:
+      /// Set our starting WorldState.
+      void setStart(const WorldState *start) { mStart = start; }
+
+      /// Set our goal state.
+      void setGoal(const WorldState *goal) { mGoal = goal; }
+
+      /// Set the CompiledDomain to plan in.
+      void setDomain(const CompiledDomain *dom) { mDomain = dom; }
+
+      /// Only use the GroundActions an ActionOverlay allows. The overlay's
+      /// domain is used in place of setDomain's.
+      void setOverlay(const ActionOverlay *overlay) { mOverlay = overlay; }
+
+      /// Most steps to look for a plan in.
+      void setMaxHorizon(unsigned int steps) { mMaxHorizon = steps; }
+
+      /// Find a plan, trying one horizon after another on this thread.
+      /// @param[in] ctx Context object to record the planner's activity.
+      /// @return True iff a plan was found.
+      bool plan(Context *ctx = NULL);
+
+      /// Find a plan, solving several horizons at once on a ThreadPool.
+      /// @param[in] pool ThreadPool to solve on.
+      /// @param[in] ctx  Context object to record the planner's activity.
+      /// @return True iff a plan was found.
+      bool plan(ThreadPool &pool, Context *ctx = NULL);
+
+      /// Did the last search find a plan?
+      bool success() const { return mSuccess; }
+
+      /// Number of steps in the plan the last search found.
+      unsigned int getHorizon() const { return mHorizon; }
+
+      /// The plan the last search found.
+      const Plan &getPlan() const { return mPlan; }
+
+      /// Default constructor.
+      SatPlanner(const CompiledDomain *dom = NULL, const WorldState *start = NULL, const WorldState *goal = NULL);
+      /// Default destructor.
+      ~SatPlanner();
+
+   private:
+      friend class HorizonTask;
+
+      /// How a Fact is encoded at each step.
+      struct SatFact {
+         /// Values the Fact can take; -1 means unset.
+         std::vector<int> values;
+         /// Offset of its first variable within a step. Facts with a single
+         /// value have no variables.
+         unsigned int first;
+         /// Code of the Fact's value in the start state.
+         unsigned int start;
+         /// Operators that may be taken together in one step, when they
+         /// affect this Fact. Operators in different groups may not.
+         std::vector<std::vector<unsigned int> > groups;
+         /// Operators with a condition on the Fact and no effect on it.
+         std::vector<unsigned int> readers;
+         /// Operators that change the Fact from each code.
+         std::vector<std::vector<unsigned int> > changers;
+      };
+
+      /// A GroundAction's conditions and effects on Facts with variables.
+      struct SatOp {
+         const GroundAction *ga;
+         /// Codes allowed by each condition.
+         std::vector<std::pair<FactID, std::vector<unsigned int> > > pre;
+         /// Code after each effect, for every code before it.
+         std::vector<std::pair<FactID, std::vector<unsigned int> > > post;
+      };
+
+      /// Outcome of one horizon.
+      struct Horizon {
+         SatSolver::Result result;
+         unsigned long conflicts;
+         Plan plan;
+      };
+
+      const CompiledDomain *mDomain;
+      const ActionOverlay *mOverlay;
+      const WorldState *mStart;
+      const WorldState *mGoal;
+      unsigned int mMaxHorizon;
+      bool mSuccess;
+      unsigned int mHorizon;
+      Plan mPlan;
+
+      /// State of the current search, read-only once built.
+      std::vector<SatFact> mFacts;
+      std::vector<SatOp> mOps;
+      /// Required code of each goal Fact with variables.
+      std::vector<std::pair<FactID, unsigned int> > mGoalCodes;
+      /// Variables in each step.
+      unsigned int mStepVars;
+
+      /// Compile the problem. False if the goal can never be reached.
+      bool compile(const CompiledDomain &dom, Context *ctx);
+      /// Code of a value of a Fact, or -1 if it can never take that value.
+      int code(FactID id, int value) const;
+      /// Encode and solve one horizon. Safe to call from several threads.
+      void solve(unsigned int steps, const std::atomic<bool> *stop, Horizon &out) const;
+      /// Start a search; false if there is nothing to search for.
+      bool begin(Context *ctx);
+      /// Log what happened and keep the plan of the smallest solved horizon.
+      bool finish(std::vector<Horizon> &results, Context *ctx);
+
+      /// Not copyable.
+      SatPlanner(const SatPlanner&);
+      SatPlanner &operator=(const SatPlanner&);
+   };
+};
+
+#endif
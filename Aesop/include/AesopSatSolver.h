@@ -0,0 +1,182 @@
+/// @file AesopSatSolver.h
+/// Defines SatSolver class.
+
+#ifndef _AE_SATSOLVER_H_
+#define _AE_SATSOLVER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace Aesop {
+   /// A boolean variable or its negation, numbered 2 * variable for the
+   /// positive literal and 2 * variable + 1 for the negative one.
+   typedef unsigned int SatLit;
+
+   /// A conflict-driven clause learning solver for boolean formulas in
+   /// conjunctive normal form. Add every clause, then solve. More clauses
+   /// may be added after a solve and the formula solved again.
+   class SatSolver {
+   public:
+      /// Outcome of a solve.
+      enum Result {
+         Unsat,   ///< The clauses cannot all be satisfied.
+         Sat,     ///< Found an assignment satisfying every clause.
+         Unknown, ///< Stopped before finding out.
+      };
+
+      /// Make a new variable.
+      /// @return Index of the variable.
+      unsigned int newVar();
+      /// Make several new variables with consecutive indices.
+      /// @return Index of the first variable.
+      unsigned int newVars(unsigned int count);
+
+      /// A literal of a variable.
+      static SatLit lit(unsigned int v, bool positive = true)
+      { return v * 2 + (positive? 0: 1); }
+      /// The opposite of a literal.
+      static SatLit negate(SatLit l) { return l ^ 1; }
+
+      /// @name Clauses
+      /// @{
+      /// Require at least one of a set of literals to be true.
+      /// @return False if the clauses can no longer be satisfied.
+      bool addClause(const std::vector<SatLit> &lits);
+      bool addClause(SatLit a);
+      bool addClause(SatLit a, SatLit b);
+      bool addClause(SatLit a, SatLit b, SatLit c);
+      /// Require at most one of a set of literals to be true.
+      /// @return False if the clauses can no longer be satisfied.
+      bool addAtMostOne(const std::vector<SatLit> &lits);
+      /// @}
+
+      /// Search for an assignment satisfying every clause.
+      /// @param[in] stop If given, checked now and then; the search gives up
+      ///                 and returns Unknown once it is true.
+      Result solve(const std::atomic<bool> *stop = NULL);
+
+      /// Value of a variable in the assignment the last successful solve
+      /// found.
+      bool value(unsigned int v) const { return mModel[v]; }
+
+      /// Number of variables.
+      unsigned int numVars() const { return mAssign.size(); }
+      /// Number of clauses, including learnt ones.
+      unsigned int numClauses() const { return mClauses.size(); }
+      /// Number of conflicts met in every solve so far.
+      unsigned long numConflicts() const { return mConflicts; }
+
+      /// Default constructor.
+      SatSolver();
+
+   private:
+      /// Value of an unassigned variable in mAssign.
+      static const char Undef = 2;
+      /// Reason of a decision or a fact added as a single clause.
+      static const unsigned int NoClause = (unsigned int)-1;
+
+      struct Clause {
+         /// Position of the first literal in mLits. The first two literals
+         /// are the watched ones; a clause that is the reason for an
+         /// assignment has the assigned literal first.
+         unsigned int start;
+         unsigned int size;
+         bool learnt;
+         float activity;
+      };
+      /// A clause watching a literal, and one of its other literals which
+      /// lets us skip the clause when it is true.
+      struct Watch {
+         unsigned int clause;
+         SatLit blocker;
+      };
+      typedef std::vector<Watch> watches;
+
+      /// Is the formula still possibly satisfiable?
+      bool mOk;
+      std::vector<Clause> mClauses;
+      /// Literals of every clause, back to back.
+      std::vector<SatLit> mLits;
+      /// Clauses watching each literal.
+      std::vector<watches> mWatches;
+      unsigned int mNumLearnts;
+      unsigned int mMaxLearnts;
+
+      /// @name Assignment
+      /// @{
+      /// Value of each variable: 0, 1, or Undef.
+      std::vector<char> mAssign;
+      /// Decision level each variable was assigned at.
+      std::vector<unsigned int> mLevel;
+      /// Clause that forced each variable, or NoClause.
+      std::vector<unsigned int> mReason;
+      /// Assigned literals in order.
+      std::vector<SatLit> mTrail;
+      /// Start of each decision level in mTrail.
+      std::vector<unsigned int> mLevels;
+      /// Next trail entry to propagate.
+      unsigned int mHead;
+      /// @}
+
+      /// @name Branching
+      /// Variables are picked by activity (VSIDS); each is given the last
+      /// value it had.
+      /// @{
+      std::vector<double> mActivity;
+      double mVarInc;
+      float mClauseInc;
+      std::vector<bool> mPhase;
+      /// Binary max-heap of unassigned variables by activity.
+      std::vector<unsigned int> mHeap;
+      /// Position of each variable in mHeap, or -1.
+      std::vector<int> mHeapPos;
+      /// @}
+
+      /// Scratch space for conflict analysis.
+      std::vector<bool> mSeen;
+      std::vector<SatLit> mLearnt;
+      std::vector<bool> mModel;
+      unsigned long mConflicts;
+
+      /// Value of a literal: 0, 1, or Undef.
+      char litValue(SatLit l) const
+      {
+         char v = mAssign[l >> 1];
+         return v == Undef? Undef: v ^ (char)(l & 1);
+      }
+      unsigned int level() const { return mLevels.size(); }
+      void assign(SatLit l, unsigned int reason);
+      /// Add a clause of at least two literals and watch its first two.
+      unsigned int attach(const std::vector<SatLit> &lits, bool learnt);
+      /// Propagate every pending assignment.
+      /// @return A falsified clause, or NoClause.
+      unsigned int propagate();
+      /// Learn a clause from a conflict.
+      /// @param[in]  confl Falsified clause.
+      /// @param[out] back  Level to backtrack to.
+      void analyze(unsigned int confl, unsigned int &back);
+      /// Can a literal of a learnt clause be dropped, because its reason
+      /// only involves literals already in the clause?
+      bool redundant(SatLit l) const;
+      /// Undo assignments above a decision level.
+      void backtrack(unsigned int lvl);
+      /// Search until a result or a number of conflicts.
+      Result search(unsigned long conflicts, const std::atomic<bool> *stop);
+      /// Drop the less active half of the learnt clauses. Only at level 0.
+      void reduce();
+
+      void bumpVar(unsigned int v);
+      void bumpClause(unsigned int c);
+      void heapInsert(unsigned int v);
+      void heapUp(unsigned int i);
+      void heapDown(unsigned int i);
+      unsigned int heapPop();
+
+      /// Not copyable.
+      SatSolver(const SatSolver&);
+      SatSolver &operator=(const SatSolver&);
+   };
+};
+
+#endif
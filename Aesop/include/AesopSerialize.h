@@ -0,0 +1,114 @@
+/// @file AesopSerialize.h
+/// Defines ByteWriter and ByteReader classes.
+
+#ifndef _AE_SERIALIZE_H_
+#define _AE_SERIALIZE_H_
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace Aesop {
+   /// Appends values to a buffer in a fixed byte order, so that what one
+   /// process writes any other can read, whatever machine it runs on.
+   class ByteWriter {
+   public:
+      void putByte(unsigned char b) { mOut.push_back(b); }
+      void putInt(unsigned int v)
+      {
+         for(unsigned int i = 0; i < 4; i++)
+            mOut.push_back((unsigned char)(v >> (8 * i)));
+      }
+      void putFloat(float f)
+      {
+         unsigned int v;
+         memcpy(&v, &f, sizeof(v));
+         putInt(v);
+      }
+      void putString(const std::string &s)
+      {
+         putInt(s.size());
+         mOut.insert(mOut.end(), s.begin(), s.end());
+      }
+
+      /// Write to the end of a buffer.
+      ByteWriter(std::vector<unsigned char> &out) : mOut(out) {}
+
+   private:
+      std::vector<unsigned char> &mOut;
+   };
+
+   /// Reads values written by a ByteWriter. Reading past the end gives
+   /// zeroes and marks the reader as failed, so a run of reads needs only
+   /// one check at the end.
+   class ByteReader {
+   public:
+      unsigned char getByte()
+      {
+         if(mPos == mEnd)
+         {
+            mFailed = true;
+            return 0;
+         }
+         return *mPos++;
+      }
+      unsigned int getInt()
+      {
+         if(mEnd - mPos < 4)
+         {
+            mFailed = true;
+            mPos = mEnd;
+            return 0;
+         }
+         unsigned int v = 0;
+         for(unsigned int i = 0; i < 4; i++)
+            v |= (unsigned int)*mPos++ << (8 * i);
+         return v;
+      }
+      float getFloat()
+      {
+         unsigned int v = getInt();
+         float f;
+         memcpy(&f, &v, sizeof(f));
+         return f;
+      }
+      std::string getString()
+      {
+         unsigned int n = getCount(1);
+         std::string s((const char*)mPos, n);
+         mPos += n;
+         return s;
+      }
+      /// Read the length of a list whose items each take at least the
+      /// given number of bytes. Fails rather than return a length the rest
+      /// of the data cannot hold, so that corrupt data cannot make us
+      /// allocate huge lists.
+      unsigned int getCount(size_t itemBytes)
+      {
+         unsigned int n = getInt();
+         if(itemBytes && n > (size_t)(mEnd - mPos) / itemBytes)
+         {
+            mFailed = true;
+            mPos = mEnd;
+            return 0;
+         }
+         return n;
+      }
+
+      /// Has every read so far succeeded?
+      bool ok() const { return !mFailed; }
+      /// Have we read everything?
+      bool done() const { return mPos == mEnd; }
+
+      /// Read from a block of memory, which must outlive us.
+      ByteReader(const unsigned char *data, size_t size)
+         : mPos(data), mEnd(data + size), mFailed(false) {}
+
+   private:
+      const unsigned char *mPos, *mEnd;
+      bool mFailed;
+   };
+};
+
+#endif
@@ -0,0 +1,162 @@
+/// @file AesopSymbolic.h
+/// Defines SymbolicPlanner class.
+
+#ifndef _AE_SYMBOLIC_H_
+#define _AE_SYMBOLIC_H_
+
+#include "AesopTypes.h"
+#include "AesopAction.h"
+#include "AesopWorldState.h"
+#include "AesopContext.h"
+#include "AesopDomain.h"
+#include "AesopBdd.h"
+
+#include <map>
+
+namespace Aesop {
+   /// Plans by searching whole sets of states at once, stored as binary
+   /// decision diagrams. Searches forwards from the start and backwards
+   /// from the goal, a layer of equal cost at a time, until the two meet.
+   /// Suited to problems whose state spaces are huge but regular, and to
+   /// proving that no plan exists at all.
+   ///
+   /// Unlike Planner, the search runs forwards, so the start state is
+   /// read as complete: Facts it does not set (and that the domain's
+   /// constants do not set either) are taken to be unset. Every Fact in
+   /// the goal must hold at the end of the plan.
+   /// Requires a CompiledDomain built with EagerGrounding.
+   class SymbolicPlanner {
+   public:
+      /// Set our starting WorldState.
+      void setStart(const WorldState *start) { mStart = start; }
+
+      /// Set our goal state.
+      void setGoal(const WorldState *goal) { mGoal = goal; }
+
+      /// Set the CompiledDomain to plan in.
+      void setDomain(const CompiledDomain *dom) { mDomain = dom; }
+
+      /// Only use the GroundActions an ActionOverlay allows, at the costs it
+      /// gives them. The overlay's domain is used in place of setDomain's.
+      void setOverlay(const ActionOverlay *overlay) { mOverlay = overlay; }
+
+      /// Limit the number of BDD nodes a search may make.
+      void setNodeLimit(unsigned int nodes) { mNodeLimit = nodes; }
+
+      /// Find a cheapest plan.
+      /// @param[in] ctx Context object to record the planner's activity.
+      /// @return True iff a plan was found.
+      bool plan(Context *ctx = NULL);
+
+      /// Did the last search find a plan?
+      bool success() const { return mSuccess; }
+
+      /// Did the last search prove that there is no plan? False if it found
+      /// one, or gave up because it ran out of nodes.
+      bool exhausted() const { return mExhausted; }
+
+      /// The plan the last search found.
+      const Plan &getPlan() const { return mPlan; }
+
+      /// Default constructor.
+      SymbolicPlanner(const CompiledDomain *dom = NULL, const WorldState *start = NULL, const WorldState *goal = NULL);
+      /// Default destructor.
+      ~SymbolicPlanner();
+
+   private:
+      /// How a Fact's values are encoded in BDD variables.
+      struct FactVar {
+         /// First BDD variable.
+         unsigned int first;
+         /// Number of variables.
+         unsigned int bits;
+         /// Value of each code, in increasing order; -1 means unset.
+         std::vector<int> values;
+      };
+
+      /// A GroundAction expressed over the BDD variables.
+      struct SymOp {
+         const GroundAction *ga;
+         /// Cost in fixed point units.
+         unsigned long cost;
+         /// States the GroundAction can be applied in.
+         BddNode pre;
+         /// Variables of Facts the GroundAction sets or unsets.
+         BddNode setVars;
+         /// The codes it sets them to.
+         BddNode setCodes;
+         /// Valid codes of the Facts it sets or unsets.
+         BddNode setValid;
+         /// Facts it increments or decrements, and the Operation doing so.
+         std::vector<std::pair<FactID, const Operation*> > steps;
+      };
+
+      /// Two search frontiers meeting.
+      struct Meeting {
+         /// States where they meet.
+         BddNode states;
+         /// Layers of the forward and backward searches the meeting states
+         /// belong to. If op is set, one side only reaches them by applying
+         /// ops[op] to its layer, and its entry gives that parent layer.
+         unsigned long forward, backward;
+         /// Which side applied an operator to meet the other, if either:
+         /// 0 for neither, 1 for forwards, -1 for backwards.
+         int dir;
+         unsigned int op;
+      };
+      typedef std::map<unsigned long, BddNode> layers;
+
+      const CompiledDomain *mDomain;
+      const ActionOverlay *mOverlay;
+      const WorldState *mStart;
+      const WorldState *mGoal;
+      unsigned int mNodeLimit;
+      bool mSuccess;
+      bool mExhausted;
+      Plan mPlan;
+
+      /// State of the current search.
+      BddManager *mBdd;
+      std::vector<FactVar> mVars;
+      std::vector<SymOp> mOps;
+      layers mForward, mBackward;
+
+      /// Work out which values each Fact can take and assign variables.
+      void encode(const CompiledDomain &dom);
+      /// Code of a value of a Fact, or -1 if it can never take that value.
+      int code(FactID id, int value) const;
+      /// States where a Fact has the given code.
+      BddNode is(FactID id, unsigned int c);
+      /// States where a Fact has a valid code.
+      BddNode valid(FactID id);
+      /// Express each allowed GroundAction over our variables.
+      void compile(const CompiledDomain &dom);
+      /// The one state whose Facts are as in a WorldState, or unset.
+      BddNode state(const WorldState &ws, const CompiledDomain &dom);
+      /// States satisfying a goal, or BddFalse if it can never be satisfied.
+      BddNode goal(const WorldState &ws, const CompiledDomain &dom);
+
+      /// States reached by applying an operator in a set of states.
+      BddNode image(BddNode s, const SymOp &op);
+      /// States from which applying an operator reaches a set of states.
+      BddNode preimage(BddNode s, const SymOp &op);
+      /// A single state from a non-empty set.
+      BddNode pickState(BddNode s);
+
+      /// Expand the cheapest open layer of one side of the search.
+      void expand(layers &open, layers &closedLayers, BddNode &closed, const layers &other,
+         BddNode otherClosed, bool forwards, unsigned long &best, Meeting &meet);
+      /// Recover the plan through a Meeting.
+      void extract(const Meeting &meet);
+      /// Actions from the start to a state in a forward layer.
+      void chainForward(BddNode s, unsigned long g, Plan &plan);
+      /// Actions from a state in a backward layer to the goal.
+      void chainBackward(BddNode s, unsigned long g, Plan &plan);
+
+      /// Not copyable.
+      SymbolicPlanner(const SymbolicPlanner&);
+      SymbolicPlanner &operator=(const SymbolicPlanner&);
+   };
+};
+
+#endif
@@ -0,0 +1,80 @@
+/// @file AesopThreadPool.h
+/// Defines ThreadPool class.
+
+#ifndef _AE_THREADPOOL_H_
+#define _AE_THREADPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Aesop {
+   /// A fixed set of worker threads that split indexed work between them.
+   class ThreadPool {
+   public:
+      /// Work that can be split into independent, numbered pieces.
+      class Task {
+      public:
+         /// Do one piece of work. Called exactly once for each index, from
+         /// any thread.
+         /// @param[in] i Index of the piece to do.
+         virtual void run(unsigned int i) = 0;
+         virtual ~Task() {}
+      };
+
+      /// Run every piece of a Task and wait for them all to finish. The
+      /// calling thread does its share of the work too. Must not be called
+      /// from inside a Task running on the same ThreadPool.
+      /// @param[in] task  Task to run.
+      /// @param[in] count Number of pieces; task.run is called for each index
+      ///                  from 0 to count - 1.
+      void run(Task &task, unsigned int count);
+
+      /// Number of threads work is split over, including the caller.
+      unsigned int size() const { return mThreads.size() + 1; }
+
+      /// Default constructor.
+      /// @param[in] threads Number of threads to split work over, including
+      ///                    the caller. Zero means one per hardware thread.
+      ThreadPool(unsigned int threads = 0);
+      /// Default destructor.
+      ~ThreadPool();
+
+   private:
+      /// Worker threads.
+      std::vector<std::thread> mThreads;
+      /// Serialises calls to ThreadPool::run.
+      std::mutex mRunLock;
+      /// Protects the members below.
+      std::mutex mLock;
+      /// Signalled when there is new work or we are shutting down.
+      std::condition_variable mWake;
+      /// Signalled when the last worker finishes its share of a Task.
+      std::condition_variable mDone;
+      /// Task currently being run.
+      Task *mTask;
+      /// Number of pieces in mTask.
+      unsigned int mCount;
+      /// Next piece of mTask to hand out.
+      std::atomic<unsigned int> mNext;
+      /// Number of workers still working on mTask.
+      unsigned int mBusy;
+      /// Incremented for every Task, so workers can tell it is new.
+      unsigned long mGeneration;
+      /// Are we shutting down?
+      bool mQuit;
+
+      /// Main loop of each worker thread.
+      void work();
+      /// Run pieces of a Task until there are none left.
+      void drain(Task *task, unsigned int count);
+
+      /// Not copyable.
+      ThreadPool(const ThreadPool&);
+      ThreadPool &operator=(const ThreadPool&);
+   };
+};
+
+#endif
@@ -1,106 +1,341 @@
-/// @file Aesop.h
-/// Main file for Aesop open planning library.
-
-#ifndef _AE_WORLDSTATE_H_
-#define _AE_WORLDSTATE_H_
-
-#include "AesopTypes.h"
-#include "AesopAction.h"
-
-#include <string>
-
-namespace Aesop {
-   /// Knowledge about a state of the world, current or possible.
-   class WorldState {
-   public:
-      /// Do any of the Facts in this WorldState involve this predicate?
-      bool involves(PName pred) const;
-
-      /// Set the value of a Fact.
-      void set(const Fact &fact, PVal val = 0);
-
-      /// Unset all knowledge of a Fact.
-      void unset(const Fact &fact);
-
-      /// Get the value a Fact is set to.
-      bool get(const Fact &fact, PVal &val, PVal def = 0) const;
-
-      /// Do the given Action's pre-conditions match this world state?
-      /// @param[in] ac     Action instance to test against this world state.
-      /// @param[in] params Parameters to the Action instance if it takes any.
-      /// @return True iff the Action is valid under the current world state.
-      bool preMatch(const Action &ac, const objects &params) const;
-
-      /// Does the given Action, executed from an arbitrary world state,
-      ///        result in this world state?
-      /// @param[in]  ac     Action to compare.
-      /// @param[out] params Parameters the Action must use for it to result in
-      ///                    this world state.
-      /// @return True iff the Action results in the current world state.
-      bool postMatch(const Action &ac, const objects &params) const;
-
-      /// Apply the given Action to this WorldState in the forwards
-      ///        direction.
-      /// @param[in] ac     Action to apply to the current state of the world.
-      /// @param[in] params Parameters to the Action instance if it takes any.
-      void applyForward(const Action &ac, const objects &params);
-
-      /// Remove the effects of the given Action from the world.
-      /// @param[in] ac     Action to remove from the current state.
-      /// @param[in] params Parameters to the Action instance if it takes any.
-      void applyReverse(const Action &ac, const objects &params);
-
-      std::string str() const;
-
-      /// Compare two world states.
-      /// @param[in] ws1 First WorldState to compare.
-      /// @param[in] ws2 Another WorldState to compare.
-      /// @return Number of predicates that differ in value between states.
+/// @file Aesop.h
+/// Main file for Aesop open planning library.
+
+#ifndef _AE_WORLDSTATE_H_
+#define _AE_WORLDSTATE_H_
+
+#include "AesopTypes.h"
+#include "AesopAction.h"
+#include "AesopSerialize.h"
+
+#include <atomic>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Aesop {
+   struct WorldPatch;
+
+   /// Knowledge about a state of the world, current or possible.
+   class WorldState {
+   public:
+      /// Entry in the argument index: a Fact in this WorldState that has a
+      /// particular object at a particular argument position.
+      struct ArgRef {
+         /// Predicate of the Fact.
+         PName name;
+         /// Argument position the object appears at.
+         unsigned int pos;
+         /// Object at that position.
+         Object obj;
+         /// The Fact and its value. NULL only in search keys.
+         const worldrep::value_type *entry;
+      };
+      /// Orders ArgRefs by predicate, position and object, then by Fact.
+      struct ArgRefLess {
+         bool operator()(const ArgRef &a, const ArgRef &b) const;
+      };
+      typedef std::set<ArgRef, ArgRefLess> argindex;
+
+      /// Do any of the Facts in this WorldState involve this predicate?
+      bool involves(PName pred) const;
+
+      /// @name Indexed queries
+      /// Each query takes time logarithmic in the size of the WorldState plus
+      /// linear in the number of Facts it returns. The argument index they
+      /// use is built by the first query that needs it, so WorldStates that
+      /// are never queried, such as the planner's, never pay for it. That
+      /// first query takes time linear in the size of the WorldState; any
+      /// number of threads may make it at once.
+      /// @{
+      typedef argindex::const_iterator arg_iterator;
+      typedef std::pair<worldrep::const_iterator, worldrep::const_iterator> fact_range;
+      typedef std::pair<arg_iterator, arg_iterator> arg_range;
+
+      /// All Facts with the given predicate, in Fact order.
+      fact_range facts(PName pred) const;
+
+      /// All Facts with the given predicate that have obj as their argument
+      /// at position pos, in Fact order.
+      arg_range facts(PName pred, unsigned int pos, Object obj) const;
+
+      /// Walks the Facts matching a pattern. Created by WorldState::query.
+      class query_iterator {
+      public:
+         /// Have we run out of matches?
+         bool done() const { return mDone; }
+
+         /// The matching Fact and its value.
+         const worldrep::value_type &operator*() const { return *get(); }
+         const worldrep::value_type *operator->() const { return get(); }
+
+         /// Move to the next match.
+         query_iterator &operator++();
+         query_iterator operator++(int);
+
+         /// Fill in the objects the current match binds the pattern's
+         /// Parameters to. Parameters the pattern does not use are left
+         /// alone; params is grown if it is too short.
+         void bind(objects &params) const;
+
+         /// An iterator with no matches.
+         query_iterator();
+
+      private:
+         friend class WorldState;
+         /// Pattern we are matching. Owned by the caller.
+         const Fact *mPattern;
+         /// Are we walking the argument index or the predicate range?
+         bool mByArg;
+         /// No more matches?
+         bool mDone;
+         worldrep::const_iterator mFact, mFactEnd;
+         arg_iterator mArg, mArgEnd;
+
+         const worldrep::value_type *get() const
+         { return mByArg? mArg->entry: &*mFact; }
+         /// Step forwards until we find a match or run out.
+         void seek();
+      };
+
+      /// Find the Facts matching a pattern. Arguments given as Parameters
+      /// in the pattern match any object, but a Parameter used more than
+      /// once must match the same object each time. For example,
+      /// Fact(adjacent) % a % Parameter(0) matches every Fact saying
+      /// something is adjacent to a.
+      /// The pattern must outlive the iterator. No memory is allocated.
+      query_iterator query(const Fact &pattern) const;
+
+      /// Does a Fact match a pattern, as in WorldState::query?
+      static bool matches(const Fact &pattern, const Fact &fact);
+      /// @}
+
+      /// Set the value of a Fact.
+      void set(const Fact &fact, PVal val = 0);
+
+      /// Unset all knowledge of a Fact.
+      void unset(const Fact &fact);
+
+      /// Get the value a Fact is set to.
+      bool get(const Fact &fact, PVal &val, PVal def = 0) const;
+
+      /// A single change to a Fact: either set it to a value or unset it.
+      struct Change {
+         Fact fact;
+         /// Set the Fact, or unset it?
+         bool set;
+         /// Value to set the Fact to.
+         PVal val;
+      };
+
+      /// Collects changes to a WorldState and applies them all at once when
+      /// committed. Later changes to the same Fact override earlier ones.
+      class Batch {
+      public:
+         /// Queue setting the value of a Fact.
+         void set(const Fact &fact, PVal val = 0);
+         /// Queue unsetting a Fact.
+         void unset(const Fact &fact);
+         /// Apply every queued change to the WorldState and empty the Batch.
+         void commit();
+         /// Throw away every queued change.
+         void clear() { mChanges.clear(); }
+         /// Number of queued changes.
+         unsigned int size() const { return mChanges.size(); }
+
+         /// Queue changes to a WorldState. Nothing happens until commit.
+         Batch(WorldState &ws) : mWS(ws) {}
+
+      private:
+         WorldState &mWS;
+         std::vector<Change> mChanges;
+      };
+
+      /// Do the given Action's pre-conditions match this world state?
+      /// @param[in] ac     Action instance to test against this world state.
+      /// @param[in] params Parameters to the Action instance if it takes any.
+      /// @return True iff the Action is valid under the current world state.
+      bool preMatch(const Action &ac, const objects &params) const;
+
+      /// Do a GroundAction's pre-conditions match this world state?
+      bool preMatch(const GroundAction &ga) const;
+
+      /// Does the given Action, executed from an arbitrary world state,
+      ///        result in this world state?
+      /// @param[in]  ac     Action to compare.
+      /// @param[out] params Parameters the Action must use for it to result in
+      ///                    this world state.
+      /// @return True iff the Action results in the current world state.
+      bool postMatch(const Action &ac, const objects &params) const;
+
+      /// Does a GroundAction, executed from an arbitrary world state, result
+      /// in this world state?
+      bool postMatch(const GroundAction &ga) const;
+
+      /// Apply the given Action to this WorldState in the forwards
+      ///        direction.
+      /// @param[in] ac     Action to apply to the current state of the world.
+      /// @param[in] params Parameters to the Action instance if it takes any.
+      void applyForward(const Action &ac, const objects &params);
+
+      /// Apply a GroundAction's effects to this WorldState.
+      void applyForward(const GroundAction &ga);
+
+      /// Remove the effects of the given Action from the world.
+      /// @param[in] ac     Action to remove from the current state.
+      /// @param[in] params Parameters to the Action instance if it takes any.
+      void applyReverse(const Action &ac, const objects &params);
+
+      /// Remove the effects of a GroundAction from the world.
+      void applyReverse(const GroundAction &ga);
+
+      /// @name STL
+      /// @{
+      typedef worldrep::const_iterator const_iterator;
+      const_iterator begin() const { return mState.begin(); }
+      const_iterator end() const { return mState.end(); }
+      unsigned int size() const { return mState.size(); }
+      /// @}
+
+      std::string str() const;
+
+      /// @name Serialization
+      /// @{
+      /// Write our Facts and values in a form any process can read back.
+      void serialize(ByteWriter &out) const;
+      /// Replace our contents with a state written by serialize.
+      /// @return False, leaving us unchanged, if the data is cut short.
+      bool deserialize(ByteReader &in);
+      /// @}
+
+      /// Compare two world states.
+      /// @param[in] ws1 First WorldState to compare.
+      /// @param[in] ws2 Another WorldState to compare.
+      /// @return Number of predicates that differ in value between states.
       static unsigned int comp(const WorldState &ws1, const WorldState &ws2);
-      static unsigned int compStart(const WorldState &ws1, const WorldState &ws2);
-
-      /// Default constructor.
-      WorldState();
-      /// Default destructor.
-      ~WorldState();
-
-      /// Boolean equality test.
-      /// This equality test will compare WorldStates based on their hash codes,
-      /// providing a faster negative result. If their hash codes are equal, then
-      /// WorldState::comp is used to verify.
-      bool operator==(const WorldState &s) const
-      { return mHash != s.mHash? false: !comp(*this, s); }
-
-      /// Boolean inequality test.
-      bool operator!=(const WorldState &s) const
-      { return !this->operator==(s); }
-
-   protected:
-   private:
-      /// Get the predicate name from a world state entry.
-      static inline PName getPName(worldrep::const_iterator it)
-      { return it->first.name; }
-      /// Get the value from a world state entry.
-      static inline PVal getPVal(worldrep::const_iterator it)
-      { return it->second; }
-
-      /// Internal representation of world state.
-      worldrep mState;
-
-      /// Calculated hash value of this state.
-      unsigned int mHash;
-      /// Update our hash value.
-      void updateHash();
-
-      /// Internal method to set the value of a predicate.
-      /// @param[in] pred Name of predicate to set.
-      /// @param[in] val Value to set the predicate to.
-      void _set(const Fact &fact, PVal val);
-
-      /// Internal method to mark that a predicate is unset.
-      /// @param[in] pred Name of the predicate to clear.
-      void _unset(const Fact &fact);
-   };
-};
-
-#endif
+      static unsigned int compStart(const WorldState &ws1, const WorldState &ws2);
+
+      /// Find the changes that turn one WorldState into another. Takes time
+      /// linear in the size of both states.
+      /// @param[in]  from  State to start from.
+      /// @param[in]  to    State to end up at.
+      /// @param[out] patch Changes such that from.apply(patch) equals to.
+      static void diff(const WorldState &from, const WorldState &to, WorldPatch &patch);
+
+      /// Apply a set of changes, such as one made by WorldState::diff.
+      /// Changes out of order, or several to one Fact, are applied one
+      /// after the other, only more slowly.
+      void apply(const WorldPatch &patch);
+
+      /// Default constructor.
+      WorldState();
+      /// Build a WorldState from a range of (Fact, PVal) pairs. If a Fact
+      /// appears more than once, its last value is used.
+      template<typename InputIterator>
+      WorldState(InputIterator first, InputIterator last)
+      {
+         mHash = 0;
+         mArgs = NULL;
+         std::vector<std::pair<Fact, PVal> > entries(first, last);
+         build(entries);
+      }
+      /// Copy constructor. The argument index refers to the other state's
+      /// entries, so it is not copied; we build our own when it is needed.
+      WorldState(const WorldState &other);
+      /// Assignment; drops the argument index like the copy constructor.
+      WorldState &operator=(const WorldState &other);
+      /// Default destructor.
+      ~WorldState();
+
+      /// Hash of this state's Facts and values. Equal states have equal
+      /// hashes regardless of how they were built.
+      unsigned int hash() const { return mHash; }
+
+      /// Hash of a single Fact and its value. A WorldState's hash is the sum
+      /// of the hashes of its entries.
+      static unsigned int hashEntry(const Fact &fact, PVal val);
+
+      /// A 64-bit hash of this state, for tables big enough that hash would
+      /// often collide. Equal states have equal hashes. Takes time linear in
+      /// the size of the state.
+      unsigned long long hash64() const;
+
+      /// Boolean equality test.
+      /// This equality test will compare WorldStates based on their hash codes,
+      /// providing a faster negative result. If their hash codes are equal, then
+      /// WorldState::comp is used to verify.
+      bool operator==(const WorldState &s) const
+      { return mHash != s.mHash? false: !comp(*this, s); }
+
+      /// Boolean inequality test.
+      bool operator!=(const WorldState &s) const
+      { return !this->operator==(s); }
+
+   protected:
+   private:
+      /// Get the predicate name from a world state entry.
+      static inline PName getPName(worldrep::const_iterator it)
+      { return it->first.name; }
+      /// Get the value from a world state entry.
+      static inline PVal getPVal(worldrep::const_iterator it)
+      { return it->second; }
+
+      /// Internal representation of world state. Since Facts are ordered by
+      /// predicate first, this doubles as the index by predicate.
+      worldrep mState;
+      /// Index of every argument of every Fact in mState, or NULL if no
+      /// query has needed it yet. Once built, it is kept up to date.
+      mutable std::atomic<argindex*> mArgs;
+      /// The argument index, built if need be.
+      const argindex &args() const;
+      /// Add a new entry's arguments to mArgs, if it has been built.
+      void indexArgs(const worldrep::value_type &entry);
+      /// Remove an entry's arguments from mArgs, if it has been built.
+      void unindexArgs(const worldrep::value_type &entry);
+
+      /// Calculated hash value of this state: the sum of the hashes of each
+      /// entry, so _set and _unset can keep it up to date.
+      unsigned int mHash;
+      /// Fill an empty WorldState from unsorted entries.
+      void build(std::vector<std::pair<Fact, PVal> > &entries);
+
+      /// Internal method to set the value of a predicate.
+      /// @param[in] pred Name of predicate to set.
+      /// @param[in] val Value to set the predicate to.
+      void _set(const Fact &fact, PVal val);
+      /// Set a Fact, given the first entry not less than it.
+      /// @return The Fact's entry.
+      worldrep::iterator _set(worldrep::iterator pos, const Fact &fact, PVal val);
+
+      /// Internal method to mark that a predicate is unset.
+      /// @param[in] pred Name of the predicate to clear.
+      void _unset(const Fact &fact);
+      /// Unset the Fact at a given entry.
+      /// @return The entry after it.
+      worldrep::iterator _unset(worldrep::iterator it);
+
+      /// Check a single filled-in Operation for WorldState::preMatch.
+      bool preMatchOp(const Fact &f, const Operation &op) const;
+      /// Check a single filled-in Operation for WorldState::postMatch.
+      int postMatchOp(const Fact &f, const Operation &op) const;
+      /// Apply a single filled-in Operation in reverse.
+      void reverseOp(const Fact &f, const Operation &op);
+      /// Apply a single filled-in Operation's effect.
+      void forwardOp(const Fact &f, const Operation &op);
+   };
+
+   /// Changes to a WorldState, sorted by Fact with at most one per Fact.
+   /// Made by WorldState::diff or WorldState::Batch, and small enough to
+   /// send between threads or over the wire instead of a whole state.
+   /// Patches that break the ordering still apply correctly, in order.
+   struct WorldPatch {
+      std::vector<WorldState::Change> changes;
+
+      bool empty() const { return changes.empty(); }
+      unsigned int size() const { return changes.size(); }
+      void clear() { changes.clear(); }
+   };
+};
+
+#endif
@@ -0,0 +1,116 @@
+/// @file AesopWorldStore.h
+/// Defines WorldSnapshot and WorldStore classes.
+
+#ifndef _AE_WORLDSTORE_H_
+#define _AE_WORLDSTORE_H_
+
+#include "AesopEpoch.h"
+#include "AesopWorldState.h"
+
+#include <atomic>
+#include <mutex>
+#include <set>
+
+namespace Aesop {
+   /// One version of a WorldStore's state. Never changes once published, so
+   /// any number of threads may read it without locking.
+   ///
+   /// A version is either a full WorldState or, like a BeliefState, a small
+   /// set of changes to an earlier full version that it shares with other
+   /// versions.
+   class WorldSnapshot : public RefCounted {
+   public:
+      /// The state of the world in this version. A version made of changes
+      /// builds it the first time it is asked for, which takes time linear
+      /// in the size of the state; every later caller shares it.
+      const WorldState &state() const;
+
+      /// Get the value a Fact is set to, without building state.
+      bool get(const Fact &fact, PVal &val, PVal def = 0) const;
+
+      /// Hash of this version's Facts, equal to WorldState::hash of state.
+      unsigned int hash() const { return mHash; }
+
+      /// Number of Facts by which this version differs from the full
+      /// version it is based on, or zero if it is a full version.
+      unsigned int deltaSize() const { return mOverlay.size() + mRemoved.size(); }
+
+      /// Version number, increasing with each version a WorldStore
+      /// publishes.
+      unsigned long version() const { return mVersion; }
+
+   private:
+      friend class WorldStore;
+      /// A full version.
+      WorldSnapshot(const WorldState &state, unsigned long version);
+      /// A version made by applying a patch to another version.
+      WorldSnapshot(const WorldSnapshot *prev, const WorldPatch &patch, unsigned long version);
+      ~WorldSnapshot();
+
+      /// Full version we are based on, or NULL if we are one.
+      const WorldSnapshot *mBase;
+      /// Our state if we are a full version; otherwise empty.
+      WorldState mState;
+      /// Number of Facts in mState.
+      unsigned int mSize;
+      /// Facts set to a value different from the base, or that the base
+      /// does not have, and Facts the base has that are unset.
+      worldrep mOverlay;
+      std::set<Fact> mRemoved;
+      /// Full state of a version made of changes, once built.
+      mutable std::atomic<WorldState*> mFlat;
+      unsigned int mHash;
+      unsigned long mVersion;
+
+      /// Apply one change on top of the base.
+      void change(const WorldState::Change &c);
+   };
+
+   /// A WorldState that changes over time and is read by other threads.
+   /// Writers publish whole new versions or patch the current one; readers
+   /// pin whichever version is current and keep reading it, unaffected by
+   /// later writes, until they release it.
+   class WorldStore {
+   public:
+      /// Get a reference to the current version. Never blocks.
+      /// @return The current WorldSnapshot. Drop it with
+      ///         WorldSnapshot::release when done.
+      const WorldSnapshot *acquire() const;
+
+      /// Version number of the current WorldSnapshot.
+      unsigned long version() const;
+
+      /// Replace the current state with a new one.
+      void publish(const WorldState &state);
+
+      /// Make a new version by applying changes to the current one. Takes
+      /// time proportional to the changes made since the last full version
+      /// rather than to the size of the state. Once there are more of those
+      /// than about twice the square root of the state's size, a new full
+      /// version is made instead.
+      void update(const WorldPatch &patch);
+
+      /// Default constructor.
+      /// @param[in] state State of the first version.
+      WorldStore(const WorldState &state = WorldState());
+      /// Default destructor. No snapshots may be in use.
+      ~WorldStore();
+
+   private:
+      /// The current version.
+      std::atomic<const WorldSnapshot*> mCurrent;
+      /// Serialises writers, so that updates are not lost.
+      std::mutex mWriteLock;
+      /// Keeps replaced versions alive for readers that may still see them.
+      mutable EpochManager mEpochs;
+
+      /// Make a WorldSnapshot current.
+      void swap(const WorldSnapshot *snap);
+
+      /// Not copyable.
+      WorldStore(const WorldStore&);
+      WorldStore &operator=(const WorldStore&);
+   };
+};
+
+#endif
@@ -1,108 +1,207 @@
-/// @file AesopAction.cpp
-/// Implementation of Action class as defined in AesopAction.h
-
-#include "AesopAction.h"
-#include <sstream>
-
-namespace Aesop {
-   /// @class Action
-   ///
-   /// Based on the STRIPS concept of an action, an Action represents an atomic
-   /// change we can make to the world, and is the building block of all plans
-   /// made with Aesop.
-   /// An Action is essentially a change to the world state. To perform an
-   /// Action, the world must be in a certain state. After the Action is
-   /// performed, certain changes will be made to that world state.
-
-   Action::Action(std::string name, float cost)
-   {
-      mName = name;
-      if(cost < 0.0f)
-         cost = 0.0f;
-      mCost = cost;
-      mNumParams = 0;
-   }
-
-   Action::~Action()
-   {
-   }
-
-   void Action::condition(const Fact &fact, ConditionType type, PVal val)
-   {
-      Operation &op = mOperations[fact];
-      op.ctype = type;
-      op.cval = val;
-      op.cidx = -1;
-   }
-
-   void Action::condition(const Fact &fact, unsigned int param, ConditionType type)
-   {
-      Operation &op = mOperations[fact];
-      op.ctype = type;
-      op.cval = 0;
-      op.cidx = param;
-   }
-
-   void Action::condition(SpecialConditionType type)
-   {
-      mSpecialConditions.insert(type);
-   }
-
-   bool Action::checkSpecialConditions(const objects &params) const
-   {
-      std::set<SpecialConditionType>::const_iterator it;
-      for(it = mSpecialConditions.begin(); it != mSpecialConditions.end(); it++)
-      {
-         switch(*it)
-         {
-         case ArgsNotEqual:
-            if(params.size() > 1)
-            {
-               for(unsigned int i = 0; i < params.size() - 1; i++)
-               {
-                  if(params[i] == params[i+1])
-                     return false;
-               }
-            }
-            break;
-         }
-      }
-      return true;
-   }
-
-   void Action::effect(const Fact &fact, EffectType type, PVal val)
-   {
-      Operation &op = mOperations[fact];
-      op.etype = type;
-      op.eval = val;
-      op.eidx = -1;
-   }
-
-   void Action::effect(const Fact &fact, unsigned int param, EffectType type)
-   {
-      Operation &op = mOperations[fact];
-      op.etype = type;
-      op.eval = 0;
-      op.eidx = param;
-   }
-
-   void Action::parameters(unsigned int num)
-   {
-      mNumParams = num;
-   }
-
-   std::string Action::str(const objects &params) const
-   {
-      std::string rep = "(";
-      rep += getName();
-      objects::const_iterator it;
-      for(it = params.begin(); it != params.end(); it++)
-      {
-         std::stringstream s;
-         s << (char)*it;
-         rep += " " + s.str();
-      }
-      rep += ")";
-      return rep;
-   }
-};
+/// @file AesopAction.cpp
+/// Implementation of Action class as defined in AesopAction.h
+
+#include "AesopAction.h"
+#include <sstream>
+
+namespace Aesop {
+   /// @class Action
+   ///
+   /// Based on the STRIPS concept of an action, an Action represents an atomic
+   /// change we can make to the world, and is the building block of all plans
+   /// made with Aesop.
+   /// An Action is essentially a change to the world state. To perform an
+   /// Action, the world must be in a certain state. After the Action is
+   /// performed, certain changes will be made to that world state.
+
+   Action::Action(std::string name, float cost)
+   {
+      mName = name;
+      if(cost < 0.0f)
+         cost = 0.0f;
+      mCost = cost;
+      mNumParams = 0;
+   }
+
+   Action::~Action()
+   {
+   }
+
+   void Action::condition(const Fact &fact, ConditionType type, PVal val)
+   {
+      Operation &op = mOperations[fact];
+      op.ctype = type;
+      op.cval = val;
+      op.cidx = -1;
+   }
+
+   void Action::condition(const Fact &fact, unsigned int param, ConditionType type)
+   {
+      Operation &op = mOperations[fact];
+      op.ctype = type;
+      op.cval = 0;
+      op.cidx = param;
+   }
+
+   void Action::condition(SpecialConditionType type)
+   {
+      mSpecialConditions.insert(type);
+   }
+
+   bool Action::checkSpecialConditions(const objects &params) const
+   {
+      std::set<SpecialConditionType>::const_iterator it;
+      for(it = mSpecialConditions.begin(); it != mSpecialConditions.end(); it++)
+      {
+         switch(*it)
+         {
+         case ArgsNotEqual:
+            if(params.size() > 1)
+            {
+               for(unsigned int i = 0; i < params.size() - 1; i++)
+               {
+                  if(params[i] == params[i+1])
+                     return false;
+               }
+            }
+            break;
+         }
+      }
+      return true;
+   }
+
+   void Action::bind(const objects &params, Fact &f, Operation &op)
+   {
+      // Check condition index.
+      if(op.cidx > -1)
+         op.cval = params[op.cidx];
+      // Check effect index.
+      if(op.eidx > -1)
+         op.eval = params[op.eidx];
+      // Check whether the Fact needs to be completed.
+      unsigned int i = 0;
+      for(paramlist::const_iterator p = f.indices.begin(); p != f.indices.end(); p++, i++)
+      {
+         if(*p != -1)
+            f.args[i] = params[*p];
+      }
+   }
+
+   void Action::effect(const Fact &fact, EffectType type, PVal val)
+   {
+      Operation &op = mOperations[fact];
+      op.etype = type;
+      op.eval = val;
+      op.eidx = -1;
+   }
+
+   void Action::effect(const Fact &fact, unsigned int param, EffectType type)
+   {
+      Operation &op = mOperations[fact];
+      op.etype = type;
+      op.eval = 0;
+      op.eidx = param;
+   }
+
+   void Action::parameters(unsigned int num)
+   {
+      mNumParams = num;
+   }
+
+   std::string Action::str(const objects &params) const
+   {
+      std::string rep = "(";
+      rep += getName();
+      objects::const_iterator it;
+      for(it = params.begin(); it != params.end(); it++)
+      {
+         std::stringstream s;
+         s << (char)*it;
+         rep += " " + s.str();
+      }
+      rep += ")";
+      return rep;
+   }
+
+   void Action::serialize(ByteWriter &out) const
+   {
+      out.putString(mName);
+      out.putFloat(mCost);
+      out.putInt(mNumParams);
+      out.putInt(mSpecialConditions.size());
+      std::set<SpecialConditionType>::const_iterator sc;
+      for(sc = mSpecialConditions.begin(); sc != mSpecialConditions.end(); sc++)
+         out.putByte(*sc);
+      out.putInt(mOperations.size());
+      operations::const_iterator it;
+      for(it = mOperations.begin(); it != mOperations.end(); it++)
+      {
+         const Fact &f = it->first;
+         out.putInt(f.name);
+         out.putInt(f.args.size());
+         for(unsigned int i = 0; i < f.args.size(); i++)
+         {
+            out.putInt(f.args[i]);
+            out.putInt(f.indices[i]);
+         }
+         const Operation &op = it->second;
+         out.putByte(op.ctype);
+         out.putByte(op.cval);
+         out.putInt(op.cidx);
+         out.putByte(op.etype);
+         out.putByte(op.eval);
+         out.putInt(op.eidx);
+      }
+   }
+
+   bool Action::deserialize(ByteReader &in)
+   {
+      std::string name = in.getString();
+      float cost = in.getFloat();
+      unsigned int params = in.getInt();
+      bool ok = params <= AESOP_MAX_PARAMETERS;
+      std::set<SpecialConditionType> special;
+      unsigned int n = in.getCount(1);
+      for(unsigned int i = 0; i < n && in.ok(); i++)
+      {
+         unsigned char type = in.getByte();
+         ok = ok && type == ArgsNotEqual;
+         special.insert((SpecialConditionType)type);
+      }
+      // Each operation takes at least a name, an argument count and 12 bytes
+      // of condition and effect.
+      operations ops;
+      n = in.getCount(20);
+      for(unsigned int e = 0; e < n && ok && in.ok(); e++)
+      {
+         Fact f(in.getInt());
+         unsigned int args = in.getCount(8);
+         for(unsigned int i = 0; i < args; i++)
+         {
+            f.args.push_back(in.getInt());
+            f.indices.push_back((int)in.getInt());
+            ok = ok && f.indices.back() >= -1 && f.indices.back() < (int)params;
+         }
+         Operation op;
+         op.ctype = (ConditionType)in.getByte();
+         op.cval = in.getByte();
+         op.cidx = (int)in.getInt();
+         op.etype = (EffectType)in.getByte();
+         op.eval = in.getByte();
+         op.eidx = (int)in.getInt();
+         // Anything else could make bind read past the parameters.
+         ok = ok && op.ctype <= GreaterEqual && op.etype <= Decrement &&
+            op.cidx >= -1 && op.cidx < (int)params &&
+            op.eidx >= -1 && op.eidx < (int)params;
+         ops[f] = op;
+      }
+      if(!ok || !in.ok())
+         return false;
+      mName = name;
+      mCost = cost >= 0.0f? cost: 0.0f;
+      mNumParams = params;
+      mSpecialConditions.swap(special);
+      mOperations.swap(ops);
+      return true;
+   }
+};
@@ -0,0 +1,277 @@
+/// @file AesopBdd.cpp
+/// Implementation of BddManager class as defined in AesopBdd.h
+
+#include "AesopBdd.h"
+
+namespace Aesop {
+   /// @class BddManager
+   ///
+   /// A plain textbook implementation: a unique table so that equal
+   /// functions are the same node, and a lossy computed table so that
+   /// repeated sub-problems are only solved once. Nodes are not reference
+   /// counted or collected; planning searches are short-lived, so a
+   /// BddManager is made for each search and dropped afterwards.
+
+   BddManager::BddManager(unsigned int vars, unsigned int maxNodes)
+   {
+      mVars = vars;
+      mMaxNodes = maxNodes;
+      mFull = false;
+      // Terminals sort after every variable.
+      Node t;
+      t.var = vars;
+      t.lo = t.hi = BddFalse;
+      mNodes.push_back(t);
+      t.lo = t.hi = BddTrue;
+      mNodes.push_back(t);
+      mUnique.resize(1 << 12, 0);
+      CacheEntry e;
+      e.op = (unsigned int)-1;
+      e.a = e.b = e.c = e.result = 0;
+      mCache.resize(1 << 16, e);
+   }
+
+   unsigned int BddManager::hash(unsigned int a, unsigned int b, unsigned int c)
+   {
+      unsigned int h = a * 12582917u;
+      h = (h ^ b) * 4256249u;
+      h = (h ^ c) * 741457u;
+      return h ^ (h >> 15);
+   }
+
+   BddNode BddManager::mk(unsigned int v, BddNode lo, BddNode hi)
+   {
+      if(lo == hi)
+         return lo;
+      unsigned int mask = mUnique.size() - 1;
+      unsigned int i = hash(v, lo, hi) & mask;
+      while(mUnique[i])
+      {
+         const Node &n = mNodes[mUnique[i]];
+         if(n.var == v && n.lo == lo && n.hi == hi)
+            return mUnique[i];
+         i = (i + 1) & mask;
+      }
+      if(mNodes.size() >= mMaxNodes)
+      {
+         mFull = true;
+         return BddFalse;
+      }
+      Node n;
+      n.var = v;
+      n.lo = lo;
+      n.hi = hi;
+      BddNode id = mNodes.size();
+      mNodes.push_back(n);
+      mUnique[i] = id;
+      // Keep the table at most half full.
+      if(mNodes.size() * 2 > mUnique.size())
+         rehash();
+      return id;
+   }
+
+   void BddManager::rehash()
+   {
+      mUnique.assign(mUnique.size() * 2, 0);
+      unsigned int mask = mUnique.size() - 1;
+      for(BddNode id = 2; id < mNodes.size(); id++)
+      {
+         const Node &n = mNodes[id];
+         unsigned int i = hash(n.var, n.lo, n.hi) & mask;
+         while(mUnique[i])
+            i = (i + 1) & mask;
+         mUnique[i] = id;
+      }
+      // Let the computed table grow along with the nodes.
+      if(mCache.size() < mUnique.size() / 2)
+         mCache.resize(mUnique.size() / 2, mCache[0]);
+   }
+
+   bool BddManager::lookup(unsigned int op, BddNode a, BddNode b, BddNode c, BddNode &result) const
+   {
+      const CacheEntry &e = mCache[hash(a ^ (op << 28), b, c) & (mCache.size() - 1)];
+      if(e.op != op || e.a != a || e.b != b || e.c != c)
+         return false;
+      result = e.result;
+      return true;
+   }
+
+   void BddManager::store(unsigned int op, BddNode a, BddNode b, BddNode c, BddNode result)
+   {
+      CacheEntry &e = mCache[hash(a ^ (op << 28), b, c) & (mCache.size() - 1)];
+      e.op = op;
+      e.a = a;
+      e.b = b;
+      e.c = c;
+      e.result = result;
+   }
+
+   BddNode BddManager::literal(unsigned int v, bool positive)
+   {
+      return positive? mk(v, BddFalse, BddTrue): mk(v, BddTrue, BddFalse);
+   }
+
+   BddNode BddManager::conj(BddNode a, BddNode b)
+   {
+      return apply(OpAnd, a, b);
+   }
+
+   BddNode BddManager::disj(BddNode a, BddNode b)
+   {
+      return apply(OpOr, a, b);
+   }
+
+   BddNode BddManager::minus(BddNode a, BddNode b)
+   {
+      return apply(OpMinus, a, b);
+   }
+
+   BddNode BddManager::apply(Op op, BddNode a, BddNode b)
+   {
+      // Terminal cases.
+      switch(op)
+      {
+      case OpAnd:
+         if(a == BddFalse || b == BddFalse)
+            return BddFalse;
+         if(a == BddTrue || a == b)
+            return b;
+         if(b == BddTrue)
+            return a;
+         // Commutative, so share cache entries.
+         if(a > b)
+         {
+            BddNode t = a;
+            a = b;
+            b = t;
+         }
+         break;
+      case OpOr:
+         if(a == BddTrue || b == BddTrue)
+            return BddTrue;
+         if(a == BddFalse || a == b)
+            return b;
+         if(b == BddFalse)
+            return a;
+         if(a > b)
+         {
+            BddNode t = a;
+            a = b;
+            b = t;
+         }
+         break;
+      case OpMinus:
+         if(a == BddFalse || b == BddTrue || a == b)
+            return BddFalse;
+         if(b == BddFalse)
+            return a;
+         break;
+      default:
+         break;
+      }
+
+      BddNode result;
+      if(lookup(op, a, b, 0, result))
+         return result;
+
+      unsigned int va = var(a), vb = var(b);
+      unsigned int v = va < vb? va: vb;
+      BddNode a0 = va == v? mNodes[a].lo: a;
+      BddNode a1 = va == v? mNodes[a].hi: a;
+      BddNode b0 = vb == v? mNodes[b].lo: b;
+      BddNode b1 = vb == v? mNodes[b].hi: b;
+      BddNode lo = apply(op, a0, b0);
+      BddNode hi = apply(op, a1, b1);
+      result = mk(v, lo, hi);
+      store(op, a, b, 0, result);
+      return result;
+   }
+
+   BddNode BddManager::exists(BddNode a, BddNode vars)
+   {
+      return relprod(a, BddTrue, vars);
+   }
+
+   BddNode BddManager::relprod(BddNode a, BddNode b, BddNode vars)
+   {
+      if(a == BddFalse || b == BddFalse)
+         return BddFalse;
+      if(a == BddTrue && b == BddTrue)
+         return BddTrue;
+      unsigned int va = var(a), vb = var(b);
+      unsigned int v = va < vb? va: vb;
+      // Skip quantified variables neither side depends on.
+      while(vars != BddTrue && var(vars) < v)
+         vars = mNodes[vars].hi;
+      if(vars == BddTrue)
+         return conj(a, b);
+
+      BddNode result;
+      if(lookup(OpRelProd, a, b, vars, result))
+         return result;
+
+      BddNode a0 = va == v? mNodes[a].lo: a;
+      BddNode a1 = va == v? mNodes[a].hi: a;
+      BddNode b0 = vb == v? mNodes[b].lo: b;
+      BddNode b1 = vb == v? mNodes[b].hi: b;
+      if(var(vars) == v)
+      {
+         BddNode next = mNodes[vars].hi;
+         BddNode lo = relprod(a0, b0, next);
+         if(lo == BddTrue)
+            result = BddTrue;
+         else
+            result = disj(lo, relprod(a1, b1, next));
+      }
+      else
+         result = mk(v, relprod(a0, b0, vars), relprod(a1, b1, vars));
+      store(OpRelProd, a, b, vars, result);
+      return result;
+   }
+
+   BddNode BddManager::restrict(BddNode a, BddNode lits)
+   {
+      if(a == BddFalse || a == BddTrue)
+         return a;
+      unsigned int va = var(a);
+      while(lits != BddTrue && var(lits) < va)
+         lits = mNodes[lits].lo == BddFalse? mNodes[lits].hi: mNodes[lits].lo;
+      if(lits == BddTrue)
+         return a;
+
+      BddNode result;
+      if(lookup(OpRestrict, a, lits, 0, result))
+         return result;
+
+      if(var(lits) == va)
+      {
+         // A positive literal has a false low branch.
+         bool positive = mNodes[lits].lo == BddFalse;
+         BddNode next = positive? mNodes[lits].hi: mNodes[lits].lo;
+         result = restrict(positive? mNodes[a].hi: mNodes[a].lo, next);
+      }
+      else
+         result = mk(va, restrict(mNodes[a].lo, lits), restrict(mNodes[a].hi, lits));
+      store(OpRestrict, a, lits, 0, result);
+      return result;
+   }
+
+   bool BddManager::pick(BddNode a, std::vector<bool> &values) const
+   {
+      values.assign(mVars, false);
+      if(a == BddFalse)
+         return false;
+      while(a != BddTrue)
+      {
+         const Node &n = mNodes[a];
+         if(n.lo != BddFalse)
+            a = n.lo;
+         else
+         {
+            values[n.var] = true;
+            a = n.hi;
+         }
+      }
+      return true;
+   }
+};
@@ -0,0 +1,243 @@
+/// @file AesopBeliefState.cpp
+/// Implementation of BeliefState class as defined in AesopBeliefState.h
+
+#include "AesopBeliefState.h"
+
+namespace Aesop {
+   /// @class BeliefState
+   ///
+   /// Lookups check our own changes first and fall back to the base. We keep
+   /// our changes minimal: the overlay never holds a value the base already
+   /// has, and mRemoved only holds Facts the base actually has, so two
+   /// BeliefStates on the same base know the same things exactly when their
+   /// changes are equal.
+   /// Because WorldState hashes are sums of entry hashes, our hash is the
+   /// base's hash adjusted for each Fact we change.
+
+   BeliefState::BeliefState(const WorldSnapshot *base)
+   {
+      mBase = base;
+      mBase->acquire();
+      mHash = base->hash();
+   }
+
+   BeliefState::BeliefState(const BeliefState &other)
+   {
+      mBase = other.mBase;
+      mBase->acquire();
+      mOverlay = other.mOverlay;
+      mRemoved = other.mRemoved;
+      mHash = other.mHash;
+   }
+
+   BeliefState &BeliefState::operator=(const BeliefState &other)
+   {
+      other.mBase->acquire();
+      mBase->release();
+      mBase = other.mBase;
+      mOverlay = other.mOverlay;
+      mRemoved = other.mRemoved;
+      mHash = other.mHash;
+      return *this;
+   }
+
+   BeliefState::~BeliefState()
+   {
+      mBase->release();
+   }
+
+   bool BeliefState::get(const Fact &fact, PVal &val, PVal def) const
+   {
+      worldrep::const_iterator it = mOverlay.find(fact);
+      if(it != mOverlay.end())
+      {
+         val = it->second;
+         return true;
+      }
+      if(mRemoved.count(fact))
+      {
+         val = def;
+         return false;
+      }
+      return mBase->get(fact, val, def);
+   }
+
+   void BeliefState::unhash(const Fact &fact)
+   {
+      PVal val;
+      if(get(fact, val))
+         mHash -= WorldState::hashEntry(fact, val);
+   }
+
+   void BeliefState::set(const Fact &fact, PVal val)
+   {
+      unhash(fact);
+      mHash += WorldState::hashEntry(fact, val);
+      mRemoved.erase(fact);
+      PVal bval;
+      if(mBase->get(fact, bval) && bval == val)
+         mOverlay.erase(fact);
+      else
+         mOverlay[fact] = val;
+   }
+
+   void BeliefState::unset(const Fact &fact)
+   {
+      unhash(fact);
+      mOverlay.erase(fact);
+      PVal bval;
+      if(mBase->get(fact, bval))
+         mRemoved.insert(fact);
+   }
+
+   bool BeliefState::involves(PName pred) const
+   {
+      worldrep::const_iterator it = mOverlay.lower_bound(Fact(pred));
+      if(it != mOverlay.end() && it->first.name == pred)
+         return true;
+      // The base may have the predicate, but we may have unset all of it.
+      WorldState::fact_range r = base().facts(pred);
+      for(; r.first != r.second; r.first++)
+      {
+         if(!mRemoved.count(r.first->first))
+            return true;
+      }
+      return false;
+   }
+
+   void BeliefState::clear()
+   {
+      mOverlay.clear();
+      mRemoved.clear();
+      mHash = mBase->hash();
+   }
+
+   void BeliefState::rebase(const WorldSnapshot *base)
+   {
+      if(base == mBase)
+         return;
+      base->acquire();
+      const WorldSnapshot *old = mBase;
+      worldrep overlay;
+      std::set<Fact> removed;
+      overlay.swap(mOverlay);
+      removed.swap(mRemoved);
+      mBase = base;
+      mHash = base->hash();
+
+      // Re-apply our changes on top of the new base.
+      worldrep::const_iterator it;
+      for(it = overlay.begin(); it != overlay.end(); it++)
+         set(it->first, it->second);
+      std::set<Fact>::const_iterator f;
+      for(f = removed.begin(); f != removed.end(); f++)
+         unset(*f);
+      old->release();
+   }
+
+   void BeliefState::delta(WorldPatch &patch) const
+   {
+      patch.clear();
+      worldrep::const_iterator o = mOverlay.begin();
+      std::set<Fact>::const_iterator r = mRemoved.begin();
+      WorldState::Change c;
+      while(o != mOverlay.end() || r != mRemoved.end())
+      {
+         if(r == mRemoved.end() || (o != mOverlay.end() && o->first < *r))
+         {
+            c.fact = o->first;
+            c.set = true;
+            c.val = o->second;
+            o++;
+         }
+         else
+         {
+            c.fact = *r;
+            c.set = false;
+            c.val = 0;
+            r++;
+         }
+         patch.changes.push_back(c);
+      }
+   }
+
+   void BeliefState::flatten(WorldState &ws) const
+   {
+      WorldPatch patch;
+      delta(patch);
+      ws = base();
+      ws.apply(patch);
+   }
+
+   bool BeliefState::operator==(const BeliefState &b) const
+   {
+      if(mHash != b.mHash)
+         return false;
+      if(mBase == b.mBase)
+         return mOverlay == b.mOverlay && mRemoved == b.mRemoved;
+      const_iterator i = begin(), j = b.begin();
+      for(; i != end() && j != b.end(); i++, j++)
+      {
+         if(!(i->first == j->first) || i->second != j->second)
+            return false;
+      }
+      return i == end() && j == b.end();
+   }
+
+   BeliefState::const_iterator BeliefState::begin() const
+   {
+      const_iterator it;
+      it.mBS = this;
+      it.mBase = base().begin();
+      it.mBaseEnd = base().end();
+      it.mOver = mOverlay.begin();
+      it.mOverEnd = mOverlay.end();
+      it.skip();
+      return it;
+   }
+
+   BeliefState::const_iterator BeliefState::end() const
+   {
+      const_iterator it;
+      it.mBS = this;
+      it.mBase = it.mBaseEnd = base().end();
+      it.mOver = it.mOverEnd = mOverlay.end();
+      return it;
+   }
+
+   /// Overlay entries come first when they are for the same Fact as the
+   /// base entry, since they override it.
+   bool BeliefState::const_iterator::fromOverlay() const
+   {
+      if(mOver == mOverEnd)
+         return false;
+      return mBase == mBaseEnd || !(mBase->first < mOver->first);
+   }
+
+   void BeliefState::const_iterator::skip()
+   {
+      while(mBase != mBaseEnd && mBS->mRemoved.count(mBase->first))
+         mBase++;
+   }
+
+   BeliefState::const_iterator &BeliefState::const_iterator::operator++()
+   {
+      if(fromOverlay())
+      {
+         if(mBase != mBaseEnd && mBase->first == mOver->first)
+            mBase++;
+         mOver++;
+      }
+      else
+         mBase++;
+      skip();
+      return *this;
+   }
+
+   BeliefState::const_iterator BeliefState::const_iterator::operator++(int)
+   {
+      const_iterator old = *this;
+      ++*this;
+      return old;
+   }
+};
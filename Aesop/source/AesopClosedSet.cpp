@@ -0,0 +1,276 @@
+/// @file AesopClosedSet.cpp
+/// Implementation of ClosedSet class as defined in AesopClosedSet.h
+
+#include "AesopClosedSet.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace Aesop {
+   /// @class ClosedSet
+   ///
+   /// Slots only ever change from empty to a Node, from empty to MovedEmpty,
+   /// or from a Node to MovedFull, and a Node is copied to the next table
+   /// before its slot is marked, so it is always in one table or the other.
+   /// Every state's chain of slots runs from its hash to the first empty
+   /// one. Once a table has a next table, nothing new is put in it: a thread
+   /// adding a state moves every slot of its chain first, ending with the
+   /// empty one, and then looks in the next table. If another thread put the
+   /// state in the old chain first, it is moved along with the rest; if not,
+   /// the old chain is now closed to it. So the same state never ends up in
+   /// two Nodes.
+   /// All atomic operations are sequentially consistent.
+
+   /// Slots each thread moves at a time while a table is being moved.
+   static const unsigned int MoveChunk = 64;
+
+   ClosedSet::Node ClosedSet::MovedEmpty;
+   ClosedSet::Node ClosedSet::MovedFull;
+
+   static unsigned long long pack(float g, unsigned int handle)
+   {
+      unsigned int bits;
+      memcpy(&bits, &g, sizeof(bits));
+      return (unsigned long long)bits << 32 | handle;
+   }
+
+   static float costOf(unsigned long long value)
+   {
+      unsigned int bits = (unsigned int)(value >> 32);
+      float g;
+      memcpy(&g, &bits, sizeof(g));
+      return g;
+   }
+
+   ClosedSet::Table::Table(unsigned int cap)
+   {
+      capacity = cap;
+      slots = new std::atomic<Node*>[cap];
+      for(unsigned int i = 0; i < cap; i++)
+         slots[i].store(NULL);
+      count.store(0);
+      next.store(NULL);
+      claimed.store(0);
+      moved.store(0);
+   }
+
+   ClosedSet::Table::~Table()
+   {
+      delete[] slots;
+   }
+
+   ClosedSet::ClosedSet(unsigned int capacity)
+   {
+      mCapacity = 2;
+      while(mCapacity < capacity)
+         mCapacity *= 2;
+      mFirst = new Table(mCapacity);
+      mTable.store(mFirst);
+      mNodes.store(NULL);
+      mSize.store(0);
+   }
+
+   ClosedSet::~ClosedSet()
+   {
+      destroy();
+   }
+
+   void ClosedSet::destroy()
+   {
+      Node *n = mNodes.load();
+      while(n)
+      {
+         Node *older = n->older;
+         delete n;
+         n = older;
+      }
+      Table *t = mFirst;
+      while(t)
+      {
+         Table *next = t->next.load();
+         delete t;
+         t = next;
+      }
+   }
+
+   void ClosedSet::clear()
+   {
+      if(!mSize.load() && !mFirst->next.load())
+         return;
+      destroy();
+      mFirst = new Table(mCapacity);
+      mTable.store(mFirst);
+      mNodes.store(NULL);
+      mSize.store(0);
+   }
+
+   ClosedSet::Result ClosedSet::insert(const WorldState &state, float g, unsigned int handle, unsigned int *prev)
+   {
+      Node *n = new Node;
+      n->hash = state.hash64();
+      n->state = &state;
+      n->value.store(pack(g, handle));
+      Node *found = place(help(), n);
+      if(found == n)
+      {
+         n->older = mNodes.load();
+         while(!mNodes.compare_exchange_weak(n->older, n));
+         mSize.fetch_add(1);
+         return Inserted;
+      }
+
+      // Nobody else has seen our Node.
+      delete n;
+      unsigned long long v = found->value.load();
+      while(true)
+      {
+         if(prev)
+            *prev = (unsigned int)v;
+         if(costOf(v) <= g)
+            return Kept;
+         if(found->value.compare_exchange_weak(v, pack(g, handle)))
+            return Improved;
+      }
+   }
+
+   bool ClosedSet::find(const WorldState &state, float *g, unsigned int *handle) const
+   {
+      unsigned long long hash = state.hash64();
+      Table *t = mTable.load();
+      while(t)
+      {
+         unsigned int mask = t->capacity - 1;
+         unsigned int i = (unsigned int)hash & mask;
+         // Nodes from moved slots are in the next table.
+         bool moved = false;
+         unsigned int probes;
+         for(probes = 0; probes < t->capacity; probes++, i = (i + 1) & mask)
+         {
+            Node *v = t->slots[i].load();
+            if(!v)
+               break;
+            if(v == &MovedEmpty)
+            {
+               moved = true;
+               break;
+            }
+            if(v == &MovedFull)
+            {
+               moved = true;
+               continue;
+            }
+            if(v->hash == hash && *v->state == state)
+            {
+               unsigned long long value = v->value.load();
+               if(g) *g = costOf(value);
+               if(handle) *handle = (unsigned int)value;
+               return true;
+            }
+         }
+         if(!moved && probes < t->capacity)
+            return false;
+         t = t->next.load();
+      }
+      return false;
+   }
+
+   ClosedSet::Node *ClosedSet::place(Table *t, Node *n)
+   {
+      while(true)
+      {
+         unsigned int mask = t->capacity - 1;
+         unsigned int i = (unsigned int)n->hash & mask;
+         bool moving = t->next.load() != NULL;
+         unsigned int probes = 0;
+         while(probes < t->capacity)
+         {
+            if(moving)
+            {
+               // Close the chain to anyone else before looking in the next
+               // table.
+               if(!move(t, i))
+                  break;
+            }
+            else
+            {
+               Node *v = t->slots[i].load();
+               if(!v)
+               {
+                  // If someone beats us to the slot, look at it again.
+                  if(!t->slots[i].compare_exchange_strong(v, n))
+                     continue;
+                  if(2 * (t->count.fetch_add(1) + 1) > t->capacity)
+                     grow(t);
+                  return n;
+               }
+               if(v == n)
+                  return n;
+               if(v == &MovedEmpty)
+                  break;
+               if(v == &MovedFull)
+                  moving = true;
+               else if(v->hash == n->hash && *v->state == *n->state)
+                  return v;
+            }
+            probes++;
+            i = (i + 1) & mask;
+         }
+         t = grow(t);
+      }
+   }
+
+   ClosedSet::Node *ClosedSet::move(Table *t, unsigned int i)
+   {
+      Table *next = t->next.load();
+      while(true)
+      {
+         Node *v = t->slots[i].load();
+         if(v == &MovedEmpty)
+            return NULL;
+         if(v == &MovedFull)
+            return v;
+         if(!v)
+         {
+            if(t->slots[i].compare_exchange_strong(v, &MovedEmpty))
+               return NULL;
+            continue;
+         }
+         place(next, v);
+         // Only a mover changes a full slot, and all movers agree.
+         t->slots[i].compare_exchange_strong(v, &MovedFull);
+         return v;
+      }
+   }
+
+   ClosedSet::Table *ClosedSet::grow(Table *t)
+   {
+      Table *next = t->next.load();
+      if(next)
+         return next;
+      Table *bigger = new Table(2 * t->capacity);
+      if(t->next.compare_exchange_strong(next, bigger))
+         return bigger;
+      delete bigger;
+      return next;
+   }
+
+   ClosedSet::Table *ClosedSet::help()
+   {
+      Table *t = mTable.load();
+      Table *next = t->next.load();
+      if(!next || t->claimed.load() >= t->capacity)
+         return t;
+      unsigned int begin = t->claimed.fetch_add(MoveChunk);
+      if(begin >= t->capacity)
+         return t;
+      unsigned int end = std::min(begin + MoveChunk, t->capacity);
+      for(unsigned int i = begin; i < end; i++)
+         move(t, i);
+      if(t->moved.fetch_add(end - begin) + (end - begin) == t->capacity)
+      {
+         // Every slot has moved, so nobody need look at this table again.
+         mTable.compare_exchange_strong(t, next);
+      }
+      return mTable.load();
+   }
+};
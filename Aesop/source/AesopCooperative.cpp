@@ -0,0 +1,317 @@
+/// @file AesopCooperative.cpp
+/// Implementation of ReservationTable and CooperativePlanner classes as
+/// defined in AesopCooperative.h
+
+#include "AesopCooperative.h"
+
+#include <algorithm>
+#include <queue>
+
+namespace Aesop {
+   /// @class ReservationTable
+   ///
+   /// Claims are kept per Fact: a map from time step to agent for single
+   /// steps, plus at most one claim that lasts from some step on.
+
+   bool ReservationTable::isFree(const Fact &fact, unsigned int step, unsigned int agent) const
+   {
+      std::map<Fact, Claims>::const_iterator c = mClaims.find(fact);
+      if(c == mClaims.end())
+         return true;
+      const Claims &cl = c->second;
+      if(cl.forever && step >= cl.from && cl.owner != agent)
+         return false;
+      std::map<unsigned int, unsigned int>::const_iterator s = cl.steps.find(step);
+      return s == cl.steps.end() || s->second == agent;
+   }
+
+   bool ReservationTable::isFreeFrom(const Fact &fact, unsigned int step, unsigned int agent) const
+   {
+      std::map<Fact, Claims>::const_iterator c = mClaims.find(fact);
+      if(c == mClaims.end())
+         return true;
+      const Claims &cl = c->second;
+      // A claim that lasts forever overlaps every step from ours on.
+      if(cl.forever && cl.owner != agent)
+         return false;
+      std::map<unsigned int, unsigned int>::const_iterator s;
+      for(s = cl.steps.lower_bound(step); s != cl.steps.end(); s++)
+      {
+         if(s->second != agent)
+            return false;
+      }
+      return true;
+   }
+
+   bool ReservationTable::reserve(const Fact &fact, unsigned int step, unsigned int agent)
+   {
+      if(!isFree(fact, step, agent))
+         return false;
+      mClaims[fact].steps[step] = agent;
+      mLastStep = std::max(mLastStep, step);
+      return true;
+   }
+
+   bool ReservationTable::reserveFrom(const Fact &fact, unsigned int step, unsigned int agent)
+   {
+      if(!isFreeFrom(fact, step, agent))
+         return false;
+      Claims &cl = mClaims[fact];
+      if(!cl.forever || step < cl.from)
+         cl.from = step;
+      cl.forever = true;
+      cl.owner = agent;
+      mLastStep = std::max(mLastStep, step);
+      return true;
+   }
+
+   /// @class CooperativePlanner
+   ///
+   /// This is prioritised planning in the style of Cooperative A*: each
+   /// agent runs an A* search over pairs of state and time step, against
+   /// the reservations of the agents before it, then adds its own. Waiting
+   /// is only useful while claims can still change, so after the table's
+   /// last step states are told apart by their Facts alone and agents may
+   /// not wait; this keeps the search finite without a horizon, though one
+   /// is still applied.
+
+   CooperativePlanner::CooperativePlanner()
+   {
+      mTable = NULL;
+      mHorizon = 64;
+      mWaitCost = 1.0f;
+   }
+
+   unsigned int CooperativePlanner::addAgent(const WorldState *start, const WorldState *goal,
+      const ActionOverlay *overlay)
+   {
+      Agent a;
+      a.start = start;
+      a.goal = goal;
+      a.overlay = overlay;
+      a.found = false;
+      mAgents.push_back(a);
+      return mAgents.size() - 1;
+   }
+
+   void CooperativePlanner::clearAgents()
+   {
+      mAgents.clear();
+   }
+
+   bool CooperativePlanner::plan(Context *ctx)
+   {
+      if(!mTable)
+         mOwnTable.clear();
+      bool all = true;
+      for(unsigned int i = 0; i < mAgents.size(); i++)
+      {
+         Agent &a = mAgents[i];
+         a.found = false;
+         a.plan.clear();
+         a.times.clear();
+         if(!a.start || !a.goal || !a.overlay ||
+            a.overlay->getDomain()->getGrounding() != EagerGrounding)
+         {
+            if(ctx) ctx->logEvent("Agent %u has no start, goal or eagerly grounded overlay!", i);
+            all = false;
+            continue;
+         }
+         if(!search(i, ctx))
+         {
+            if(ctx) ctx->logEvent("No plan for agent %u.", i);
+            all = false;
+         }
+      }
+      return all;
+   }
+
+   bool CooperativePlanner::NodeOrder::operator()(unsigned int a, unsigned int b) const
+   {
+      // Lowest F first, then deepest, then oldest.
+      const Node &na = (*nodes)[a], &nb = (*nodes)[b];
+      if(na.F != nb.F)
+         return na.F > nb.F;
+      if(na.G != nb.G)
+         return na.G < nb.G;
+      return a > b;
+   }
+
+   bool CooperativePlanner::search(unsigned int agent, Context *ctx)
+   {
+      Agent &a = mAgents[agent];
+      const ActionOverlay &overlay = *a.overlay;
+      const CompiledDomain &dom = *overlay.getDomain();
+      ReservationTable &table = mTable? *mTable: mOwnTable;
+      // Time stops mattering once every claim has started.
+      unsigned int settled = table.lastStep() + 1;
+
+      std::deque<Node> nodes;
+      NodeOrder order;
+      order.nodes = &nodes;
+      std::priority_queue<unsigned int, std::vector<unsigned int>, NodeOrder> open(order);
+      // Best Node for each state, by settled time step and hash.
+      typedef std::map<std::pair<unsigned int, unsigned long long>, std::vector<unsigned int> > nodemap;
+      nodemap best;
+      // GroundActions that might apply in the Node being expanded.
+      std::vector<const GroundAction*> ops;
+
+      Node root;
+      root.state = *a.start;
+      WorldState::const_iterator c;
+      for(c = dom.getConstants().begin(); c != dom.getConstants().end(); c++)
+      {
+         PVal v;
+         if(!root.state.get(c->first, v))
+            root.state.set(c->first, c->second);
+      }
+      root.step = 0;
+      root.G = 0.0f;
+      root.F = overlay.heuristic(*a.goal, root.state);
+      root.prev = 0;
+      root.op = NULL;
+      if(root.F < 0.0f)
+         return false;
+      nodes.push_back(root);
+      best[std::make_pair(0u, root.state.hash64())].push_back(0);
+      open.push(0);
+
+      if(ctx) ctx->logEvent("Planning for agent %u.", agent);
+      while(!open.empty())
+      {
+         unsigned int i = open.top();
+         open.pop();
+         const Node &n = nodes[i];
+         std::vector<unsigned int> &same = best[std::make_pair(std::min(n.step, settled), n.state.hash64())];
+         // Skip Nodes that a cheaper path to the same state replaced.
+         if(std::find(same.begin(), same.end(), i) == same.end())
+            continue;
+
+         if(reached(n.state, *a.goal))
+         {
+            // Walk back to the root, then reserve in time order.
+            std::vector<unsigned int> path;
+            for(unsigned int j = i; j; j = nodes[j].prev)
+               path.push_back(j);
+            std::vector<unsigned int>::reverse_iterator p;
+            for(p = path.rbegin(); p != path.rend(); p++)
+            {
+               const Node &step = nodes[*p];
+               if(!step.op)
+                  continue;
+               unsigned int t = nodes[step.prev].step;
+               reserve(*step.op, t, agent);
+               ActionEntry e;
+               e.ac = step.op->ac;
+               e.params = step.op->params;
+               a.plan.push_back(e);
+               a.times.push_back(t);
+            }
+            a.found = true;
+            return true;
+         }
+         if(n.step >= mHorizon)
+            continue;
+
+         // After every GroundAction that might apply, try waiting a step.
+         unsigned int parent = i;
+         dom.applicable(n.state, ops);
+         unsigned int count = ops.size();
+         for(unsigned int k = 0; k <= count; k++)
+         {
+            const Node &from = nodes[parent];
+            const GroundAction *op = k < count? ops[k]: NULL;
+            float cost;
+            if(op)
+            {
+               if(!overlay.allows(*op) || !from.state.preMatch(*op) ||
+                  !allowed(*op, from.step, agent))
+                  continue;
+               cost = overlay.cost(*op);
+            }
+            else
+            {
+               // Only wait while someone else's claims might still change.
+               if(from.step >= settled)
+                  continue;
+               cost = mWaitCost;
+            }
+
+            Node next;
+            next.state = from.state;
+            if(op)
+               next.state.applyForward(*op);
+            next.step = from.step + 1;
+            next.G = from.G + cost;
+            next.prev = parent;
+            next.op = op;
+            float h = overlay.heuristic(*a.goal, next.state);
+            if(h < 0.0f)
+               continue;
+            next.F = next.G + h;
+
+            std::vector<unsigned int> &seen = best[std::make_pair(std::min(next.step, settled), next.state.hash64())];
+            std::vector<unsigned int>::iterator s;
+            for(s = seen.begin(); s != seen.end(); s++)
+            {
+               if(nodes[*s].state == next.state)
+                  break;
+            }
+            if(s != seen.end() && nodes[*s].G <= next.G)
+               continue;
+            unsigned int id = nodes.size();
+            nodes.push_back(next);
+            if(s != seen.end())
+               *s = id;
+            else
+               seen.push_back(id);
+            open.push(id);
+         }
+      }
+      return false;
+   }
+
+   bool CooperativePlanner::allowed(const GroundAction &op, unsigned int step, unsigned int agent) const
+   {
+      const ReservationTable &table = getReservations();
+      groundops::const_iterator o;
+      for(o = op.ops.begin(); o != op.ops.end(); o++)
+      {
+         if(!mShared.count(o->fact->name))
+            continue;
+         if(!table.isFree(*o->fact, step, agent))
+            return false;
+         // Nobody else may be counting on a Fact we change.
+         if(o->op.etype != NoEffect && !table.isFreeFrom(*o->fact, step, agent))
+            return false;
+      }
+      return true;
+   }
+
+   void CooperativePlanner::reserve(const GroundAction &op, unsigned int step, unsigned int agent)
+   {
+      ReservationTable &table = mTable? *mTable: mOwnTable;
+      groundops::const_iterator o;
+      for(o = op.ops.begin(); o != op.ops.end(); o++)
+      {
+         if(!mShared.count(o->fact->name))
+            continue;
+         if(o->op.etype != NoEffect)
+            table.reserveFrom(*o->fact, step, agent);
+         else
+            table.reserve(*o->fact, step, agent);
+      }
+   }
+
+   bool CooperativePlanner::reached(const WorldState &state, const WorldState &goal)
+   {
+      WorldState::const_iterator it;
+      for(it = goal.begin(); it != goal.end(); it++)
+      {
+         PVal v;
+         if(!state.get(it->first, v) || v != it->second)
+            return false;
+      }
+      return true;
+   }
+};
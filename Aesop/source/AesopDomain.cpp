@@ -0,0 +1,1171 @@
+/// @file AesopDomain.cpp
+/// Implementation of Domain and CompiledDomain classes as defined in
+/// AesopDomain.h
+
+#include "AesopDomain.h"
+
+#include <algorithm>
+#include <map>
+
+namespace Aesop {
+   /// @class Domain
+   ///
+   /// A Domain collects everything about a planning problem that does not
+   /// change between plan queries. Once it is set up, Domain::freeze grounds
+   /// every Action against every combination of objects and builds the
+   /// indexes that Planners use to find relevant Actions quickly.
+
+   Domain::Domain()
+   {
+      mGrounding = EagerGrounding;
+   }
+
+   Domain::~Domain()
+   {
+   }
+
+   void Domain::addAction(const Action *ac)
+   {
+      if(ac)
+         mActions.push_back(ac);
+   }
+
+   const CompiledDomain *Domain::freeze(unsigned int threads) const
+   {
+      if(mGrounding == LazyGrounding)
+         return new CompiledDomain(*this, NULL);
+      ThreadPool pool(threads);
+      return freeze(pool);
+   }
+
+   const CompiledDomain *Domain::freeze(ThreadPool &pool) const
+   {
+      return new CompiledDomain(*this, mGrounding == LazyGrounding? NULL: &pool);
+   }
+
+   void Domain::serialize(ByteWriter &out) const
+   {
+      out.putByte(mGrounding);
+      out.putInt(mActions.size());
+      for(unsigned int i = 0; i < mActions.size(); i++)
+         mActions[i]->serialize(out);
+      out.putInt(mObjects.size());
+      for(unsigned int i = 0; i < mObjects.size(); i++)
+         out.putInt(mObjects[i]);
+      mConstants.serialize(out);
+   }
+
+   bool Domain::deserialize(ByteReader &in, std::list<Action> &actions)
+   {
+      unsigned char grounding = in.getByte();
+      // Read into a list of our own, so that nothing is added on failure.
+      std::list<Action> read;
+      // Each Action takes at least a name, a cost and three counts.
+      unsigned int n = in.getCount(20);
+      for(unsigned int i = 0; i < n; i++)
+      {
+         read.push_back(Action());
+         if(!read.back().deserialize(in))
+            return false;
+      }
+      objects objs(in.getCount(4));
+      for(unsigned int i = 0; i < objs.size(); i++)
+         objs[i] = in.getInt();
+      WorldState con;
+      if(!con.deserialize(in) || grounding > LazyGrounding)
+         return false;
+
+      mGrounding = (GroundingMode)grounding;
+      mActions.clear();
+      std::list<Action>::iterator it;
+      for(it = read.begin(); it != read.end(); it++)
+         mActions.push_back(&*it);
+      actions.splice(actions.end(), read);
+      mObjects.swap(objs);
+      mConstants = con;
+      return true;
+   }
+
+   /// @class CompiledDomain
+   ///
+   /// A CompiledDomain holds the work that a Planner would otherwise repeat
+   /// on every node of every plan: permuting objects into Action parameters,
+   /// filling in parameterised Facts, and finding which Actions could affect
+   /// a given Fact. Facts are interned in sorted order, so a Fact's ID does
+   /// not depend on the order Actions were grounded in.
+   ///
+   /// Grounding is split into chunks, one per Action and value of its first
+   /// parameter, which are grounded in parallel into their own buffers.
+   /// Chunks are then combined in order, so the operator table is the same
+   /// no matter how many threads built it.
+
+   /// Source of CompiledDomain version numbers.
+   static std::atomic<unsigned long> sVersions(0);
+
+   /// Output of grounding one Action with one value of its first parameter.
+   struct GroundingChunk {
+      /// Index of the Action to ground.
+      unsigned int action;
+      /// Index of the object for the first parameter, or -1 if the Action
+      /// is grounded without parameters.
+      int first;
+      /// GroundActions, whose GroundOperation IDs index into facts until
+      /// they are interned.
+      std::vector<GroundAction> ops;
+      /// Filled-in Fact for each GroundOperation.
+      std::vector<Fact> facts;
+      /// Sorted, distinct copy of facts.
+      std::vector<Fact> unique;
+   };
+
+   /// Grounds each GroundingChunk.
+   class GroundingTask : public ThreadPool::Task {
+   public:
+      GroundingTask(const CompiledDomain &dom, std::vector<GroundingChunk> &chunks)
+         : mDom(dom), mChunks(chunks) {}
+
+      void run(unsigned int i)
+      {
+         GroundingChunk &c = mChunks[i];
+         const objects &objs = mDom.mObjects;
+         unsigned int nparams = mDom.mActions[c.action]->getNumParams();
+         if(c.first < 0)
+            add(c, objects());
+         else
+         {
+            // Permute objects into the remaining parameters in the same
+            // order the Planner does.
+            std::vector<unsigned int> idx(nparams, 0);
+            idx[0] = c.first;
+            objects params(nparams);
+            while(true)
+            {
+               for(unsigned int j = 0; j < nparams; j++)
+                  params[j] = objs[idx[j]];
+               add(c, params);
+               // Increment and overflow, leaving the first parameter alone.
+               unsigned int j = nparams;
+               while(j > 1 && ++idx[j-1] == objs.size())
+                  idx[--j] = 0;
+               if(j <= 1)
+                  break;
+            }
+         }
+         c.unique = c.facts;
+         std::sort(c.unique.begin(), c.unique.end());
+         c.unique.erase(std::unique(c.unique.begin(), c.unique.end()), c.unique.end());
+      }
+
+   private:
+      const CompiledDomain &mDom;
+      std::vector<GroundingChunk> &mChunks;
+
+      void add(GroundingChunk &c, const objects &params)
+      {
+         GroundAction ga;
+         if(mDom.ground(c.action, params, ga, c.facts))
+            c.ops.push_back(ga);
+      }
+   };
+
+   /// Replaces each GroundingChunk's local Fact indices with interned IDs.
+   class InterningTask : public ThreadPool::Task {
+   public:
+      InterningTask(const CompiledDomain &dom, std::vector<GroundingChunk> &chunks)
+         : mDom(dom), mChunks(chunks) {}
+
+      void run(unsigned int i)
+      {
+         GroundingChunk &c = mChunks[i];
+         std::vector<GroundAction>::iterator ga;
+         groundops::iterator gop;
+         for(ga = c.ops.begin(); ga != c.ops.end(); ga++)
+         {
+            for(gop = ga->ops.begin(); gop != ga->ops.end(); gop++)
+            {
+               gop->id = mDom.find(c.facts[gop->id]);
+               gop->fact = &mDom.mFacts[gop->id];
+            }
+         }
+      }
+
+   private:
+      const CompiledDomain &mDom;
+      std::vector<GroundingChunk> &mChunks;
+   };
+
+   /// Let stored elements know their own index.
+   static void setIndex(Fact &, unsigned int) {}
+   static void setIndex(GroundAction &ga, unsigned int i) { ga.ID = i; }
+
+   /// Append-only storage whose elements never move. Elements are added
+   /// under a lock, but may be read by index from any thread without one.
+   template<typename T>
+   class ChunkedStore {
+   public:
+      /// Number of elements added so far.
+      unsigned int size() const { return mSize.load(std::memory_order_acquire); }
+
+      /// Get an element. Only valid for indices below size().
+      const T &operator[](unsigned int i) const
+      { return mChunks[i >> ChunkBits].load(std::memory_order_acquire)[i & ChunkMask]; }
+
+      /// Add an element.
+      /// @return The new element's index.
+      unsigned int push(const T &item)
+      {
+         std::lock_guard<std::mutex> lock(mLock);
+         unsigned int i = mSize.load(std::memory_order_relaxed);
+         T *chunk = mChunks[i >> ChunkBits].load(std::memory_order_relaxed);
+         if(!chunk)
+         {
+            chunk = new T[1 << ChunkBits];
+            mChunks[i >> ChunkBits].store(chunk, std::memory_order_release);
+         }
+         chunk[i & ChunkMask] = item;
+         setIndex(chunk[i & ChunkMask], i);
+         mSize.store(i + 1, std::memory_order_release);
+         return i;
+      }
+
+      ChunkedStore() : mChunks(MaxChunks), mSize(0)
+      {
+         for(unsigned int i = 0; i < MaxChunks; i++)
+            mChunks[i] = NULL;
+      }
+
+      ~ChunkedStore()
+      {
+         for(unsigned int i = 0; i < MaxChunks; i++)
+            delete[] mChunks[i].load();
+      }
+
+   private:
+      static const unsigned int ChunkBits = 12;
+      static const unsigned int ChunkMask = (1 << ChunkBits) - 1;
+      static const unsigned int MaxChunks = 1 << 14;
+
+      std::vector<std::atomic<T*> > mChunks;
+      std::atomic<unsigned int> mSize;
+      std::mutex mLock;
+   };
+
+   /// Spread Facts over the shards of a LazyTables.
+   static unsigned int hashFact(const Fact &f)
+   {
+      unsigned int h = f.name;
+      for(unsigned int i = 0; i < f.args.size(); i++)
+         h = 31 * h + f.args[i];
+      return h;
+   }
+
+   /// Memo tables for LazyGrounding. Each table is split into shards with
+   /// their own locks so that threads rarely wait for each other, and no
+   /// lock is held while grounding: if two threads ground the same thing at
+   /// once, the first to finish wins and the other's work is discarded.
+   struct CompiledDomain::LazyTables {
+      static const unsigned int Shards = 16;
+
+      struct FactShard {
+         std::mutex lock;
+         std::map<Fact, FactID> ids;
+      };
+      typedef std::pair<unsigned int, objects> opkey;
+      struct OpShard {
+         std::mutex lock;
+         /// NULL for Action instances that can never be used.
+         std::map<opkey, const GroundAction*> ops;
+      };
+      typedef std::pair<Fact, PVal> relkey;
+      typedef std::vector<const GroundAction*> rellist;
+      struct RelevantShard {
+         std::mutex lock;
+         std::map<relkey, const rellist*> lists;
+      };
+
+      FactShard facts[Shards];
+      OpShard ops[Shards];
+      RelevantShard relevant[Shards];
+
+      /// Interned Facts by ID.
+      ChunkedStore<Fact> factStore;
+      /// GroundActions by ID.
+      ChunkedStore<GroundAction> opStore;
+
+      ~LazyTables()
+      {
+         for(unsigned int i = 0; i < Shards; i++)
+         {
+            std::map<relkey, const rellist*>::iterator it;
+            for(it = relevant[i].lists.begin(); it != relevant[i].lists.end(); it++)
+               delete it->second;
+         }
+      }
+   };
+
+   CompiledDomain::CompiledDomain(const Domain &dom, ThreadPool *pool)
+   {
+      init(dom);
+      if(pool)
+      {
+         mLazy = NULL;
+         groundAll(*pool);
+      }
+      else
+         mLazy = new LazyTables();
+   }
+
+   void CompiledDomain::init(const Domain &dom)
+   {
+      mVersion = ++sVersions;
+      mActions = dom.mActions;
+      mObjects = dom.mObjects;
+      mConstants = dom.mConstants;
+
+      operations::const_iterator o;
+      for(unsigned int a = 0; a < mActions.size(); a++)
+      {
+         for(o = mActions[a]->begin(); o != mActions[a]->end(); o++)
+         {
+            if(o->second.etype != NoEffect)
+               mFluents.insert(o->first.name);
+         }
+      }
+   }
+
+   void CompiledDomain::groundAll(ThreadPool &pool)
+   {
+      // Split grounding into chunks by Action and first parameter.
+      std::vector<GroundingChunk> chunks;
+      for(unsigned int a = 0; a < mActions.size(); a++)
+      {
+         GroundingChunk chunk;
+         chunk.action = a;
+         chunk.first = -1;
+         if(!mActions[a]->getNumParams() || !mObjects.size())
+         {
+            chunks.push_back(chunk);
+            continue;
+         }
+         for(unsigned int i = 0; i < mObjects.size(); i++)
+         {
+            chunk.first = i;
+            chunks.push_back(chunk);
+         }
+      }
+      GroundingTask grounding(*this, chunks);
+      pool.run(grounding, chunks.size());
+
+      // Intern Facts in sorted order.
+      unsigned int nops = 0;
+      for(unsigned int i = 0; i < chunks.size(); i++)
+      {
+         mFacts.insert(mFacts.end(), chunks[i].unique.begin(), chunks[i].unique.end());
+         std::vector<Fact>().swap(chunks[i].unique);
+         nops += chunks[i].ops.size();
+      }
+      std::sort(mFacts.begin(), mFacts.end());
+      mFacts.erase(std::unique(mFacts.begin(), mFacts.end()), mFacts.end());
+      InterningTask interning(*this, chunks);
+      pool.run(interning, chunks.size());
+
+      // Combine chunks into the operator table in order.
+      mOperators.reserve(nops);
+      for(unsigned int i = 0; i < chunks.size(); i++)
+      {
+         for(unsigned int j = 0; j < chunks[i].ops.size(); j++)
+         {
+            mOperators.push_back(GroundAction());
+            std::swap(mOperators.back(), chunks[i].ops[j]);
+            mOperators.back().ID = mOperators.size() - 1;
+         }
+         std::vector<GroundAction>().swap(chunks[i].ops);
+      }
+
+      index();
+   }
+
+   CompiledDomain::~CompiledDomain()
+   {
+      delete mLazy;
+   }
+
+   /// An operator is discarded if its special conditions fail, or if one of
+   /// its conditions is on a predicate that no Action ever changes and the
+   /// domain constants disagree with it. Constants are assumed to hold in
+   /// every starting state, so such an operator could never be part of a
+   /// plan.
+   bool CompiledDomain::ground(unsigned int action, const objects &params, GroundAction &ga, std::vector<Fact> &facts) const
+   {
+      const Action *ac = mActions[action];
+      if(!ac->checkSpecialConditions(params))
+         return false;
+
+      ga.action = action;
+      ga.ac = ac;
+      ga.params = params;
+      ga.cost = ac->getCost();
+
+      // Conditions on static predicates, to be checked against constants.
+      GroundAction statics;
+      std::vector<Fact> filled;
+      operations::const_iterator o;
+      for(o = ac->begin(); o != ac->end(); o++)
+      {
+         Fact f = o->first;
+         Operation op = o->second;
+         if(params.size())
+            Action::bind(params, f, op);
+         filled.push_back(f);
+         GroundOperation gop;
+         gop.id = NullFact;
+         gop.fact = NULL;
+         gop.op = op;
+         ga.ops.push_back(gop);
+      }
+
+      for(unsigned int i = 0; i < ga.ops.size(); i++)
+      {
+         const Operation &op = ga.ops[i].op;
+         if(op.ctype == NoCondition)
+            continue;
+         // Only trust the constants about predicates they mention at all.
+         PName pred = filled[i].name;
+         if(!isStaticPredicate(pred) || !mConstants.involves(pred))
+            continue;
+         GroundOperation gop = ga.ops[i];
+         gop.fact = &filled[i];
+         statics.ops.push_back(gop);
+      }
+      if(statics.ops.size() && !mConstants.preMatch(statics))
+         return false;
+
+      // Keep the operator, with its Facts waiting to be interned.
+      for(unsigned int i = 0; i < ga.ops.size(); i++)
+      {
+         ga.ops[i].id = facts.size();
+         facts.push_back(filled[i]);
+      }
+      return true;
+   }
+
+   /// Orders mAnchored entries by the value they need alone, so that a
+   /// stable sort keeps them in ID order otherwise.
+   static bool lessValue(const std::pair<int, const GroundAction*> &a,
+      const std::pair<int, const GroundAction*> &b)
+   {
+      return a.first < b.first;
+   }
+
+   void CompiledDomain::index()
+   {
+      std::vector<unsigned int> nrelevant(mFacts.size() + 1, 0);
+      std::vector<unsigned int> nachievers(mFacts.size() + 1, 0);
+      std::vector<unsigned int> nanchored(mFacts.size() + 1, 0);
+      std::vector<FactID> anchors(mOperators.size());
+      std::vector<int> values(mOperators.size());
+      std::vector<GroundAction>::iterator ga;
+      groundops::iterator gop;
+      for(ga = mOperators.begin(); ga != mOperators.end(); ga++)
+      {
+         unsigned int i = ga - mOperators.begin();
+         FactID a = anchors[i] = anchor(*ga, values[i]);
+         if(a != NullFact)
+            nanchored[a + 1]++;
+         else
+            mUnanchored.push_back(&*ga);
+         for(gop = ga->ops.begin(); gop != ga->ops.end(); gop++)
+         {
+            nrelevant[gop->id + 1]++;
+            if(gop->op.etype != NoEffect)
+               nachievers[gop->id + 1]++;
+         }
+      }
+
+      // Turn counts into offsets, then fill in each Fact's list.
+      for(unsigned int i = 0; i < mFacts.size(); i++)
+      {
+         nrelevant[i+1] += nrelevant[i];
+         nachievers[i+1] += nachievers[i];
+         nanchored[i+1] += nanchored[i];
+      }
+      mRelevant.offsets = nrelevant;
+      mAchievers.offsets = nachievers;
+      mAnchored.offsets = nanchored;
+      mRelevant.ops.resize(nrelevant.back());
+      mAchievers.ops.resize(nachievers.back());
+      std::vector<std::pair<int, const GroundAction*> > anchored(nanchored.back());
+      mRelevantCost.assign(mFacts.size(), -1.0f);
+      for(ga = mOperators.begin(); ga != mOperators.end(); ga++)
+      {
+         unsigned int i = ga - mOperators.begin();
+         if(anchors[i] != NullFact)
+            anchored[nanchored[anchors[i]]++] = std::make_pair(values[i], (const GroundAction*)&*ga);
+         for(gop = ga->ops.begin(); gop != ga->ops.end(); gop++)
+         {
+            FactID id = gop->id;
+            mRelevant.ops[nrelevant[id]++] = &*ga;
+            if(gop->op.etype != NoEffect)
+               mAchievers.ops[nachievers[id]++] = &*ga;
+            if(mRelevantCost[id] < 0.0f || ga->cost < mRelevantCost[id])
+               mRelevantCost[id] = ga->cost;
+         }
+      }
+
+      // Within each Fact's list, GroundActions are in ID order; sort them by
+      // value too, so that applicable can find a value's by bisection.
+      for(unsigned int i = 0; i < mFacts.size(); i++)
+      {
+         if(mAnchored.offsets[i] == mAnchored.offsets[i+1])
+            continue;
+         mAnchors.push_back(i);
+         std::stable_sort(anchored.begin() + mAnchored.offsets[i],
+            anchored.begin() + mAnchored.offsets[i+1], lessValue);
+      }
+      mAnchored.ops.resize(anchored.size());
+      mAnchorValues.resize(anchored.size());
+      for(unsigned int i = 0; i < anchored.size(); i++)
+      {
+         mAnchorValues[i] = anchored[i].first;
+         mAnchored.ops[i] = anchored[i].second;
+      }
+   }
+
+   FactID CompiledDomain::anchor(const GroundAction &ga, int &value) const
+   {
+      FactID a = NullFact;
+      int best = -1;
+      value = -1;
+      groundops::const_iterator gop;
+      for(gop = ga.ops.begin(); gop != ga.ops.end(); gop++)
+      {
+         const Operation &op = gop->op;
+         if(op.ctype == NoCondition || op.ctype == IsUnset)
+            continue;
+         int score = (isStaticPredicate(mFacts[gop->id].name)? 0: 2) + (op.ctype == Equals? 1: 0);
+         if(score > best)
+         {
+            best = score;
+            a = gop->id;
+            value = op.ctype == Equals? op.cval: -1;
+         }
+      }
+      return a;
+   }
+
+   FactID CompiledDomain::find(const Fact &fact) const
+   {
+      if(mLazy)
+      {
+         LazyTables::FactShard &shard = mLazy->facts[hashFact(fact) % LazyTables::Shards];
+         std::lock_guard<std::mutex> lock(shard.lock);
+         std::map<Fact, FactID>::const_iterator it = shard.ids.find(fact);
+         return it == shard.ids.end()? NullFact: it->second;
+      }
+      std::vector<Fact>::const_iterator it = std::lower_bound(mFacts.begin(), mFacts.end(), fact);
+      if(it == mFacts.end() || !(*it == fact))
+         return NullFact;
+      return it - mFacts.begin();
+   }
+
+   /// Ordering GroundActions by ID keeps the Planner's search deterministic.
+   static bool lessID(const GroundAction *a, const GroundAction *b)
+   {
+      return a->ID < b->ID;
+   }
+
+   void CompiledDomain::candidates(const WorldState &state, std::vector<const GroundAction*> &ops) const
+   {
+      ops.clear();
+      WorldState::const_iterator it;
+      for(it = state.begin(); it != state.end(); it++)
+      {
+         if(mLazy)
+         {
+            const std::vector<const GroundAction*> &r = lazyRelevant(it->first, it->second);
+            ops.insert(ops.end(), r.begin(), r.end());
+            continue;
+         }
+         FactID id = find(it->first);
+         if(id == NullFact)
+            continue;
+         oprange r = relevant(id);
+         ops.insert(ops.end(), r.first, r.second);
+      }
+      std::sort(ops.begin(), ops.end(), lessID);
+      ops.erase(std::unique(ops.begin(), ops.end()), ops.end());
+   }
+
+   void CompiledDomain::anchored(FactID id, PVal val, std::vector<const GroundAction*> &ops) const
+   {
+      // Entries that need any value sort first, then by the value needed.
+      std::vector<int>::const_iterator v = mAnchorValues.begin();
+      std::vector<int>::const_iterator first = v + mAnchored.offsets[id];
+      std::vector<int>::const_iterator last = v + mAnchored.offsets[id+1];
+      std::vector<int>::const_iterator any = std::upper_bound(first, last, -1);
+      std::pair<std::vector<int>::const_iterator, std::vector<int>::const_iterator> same =
+         std::equal_range(any, last, (int)val);
+      std::vector<const GroundAction*>::const_iterator o = mAnchored.ops.begin();
+      ops.insert(ops.end(), o + (first - v), o + (any - v));
+      ops.insert(ops.end(), o + (same.first - v), o + (same.second - v));
+   }
+
+   /// Each GroundAction is indexed under at most one Fact and value, so the
+   /// lists for the state's Facts never overlap and only need merging into
+   /// ID order. States often carry every constant, so we look up whichever
+   /// is shorter: the state's Facts in our index, or the Facts we index in
+   /// the state.
+   void CompiledDomain::applicable(const WorldState &state, std::vector<const GroundAction*> &ops) const
+   {
+      ops.clear();
+      if(mLazy)
+      {
+         unsigned int count = lazyNumOperators();
+         for(unsigned int i = 0; i < count; i++)
+            ops.push_back(&lazyOperator(i));
+         return;
+      }
+      ops.insert(ops.end(), mUnanchored.begin(), mUnanchored.end());
+      if(mAnchors.size() < state.size())
+      {
+         std::vector<FactID>::const_iterator a;
+         for(a = mAnchors.begin(); a != mAnchors.end(); a++)
+         {
+            PVal val;
+            if(state.get(mFacts[*a], val))
+               anchored(*a, val, ops);
+         }
+      }
+      else
+      {
+         WorldState::const_iterator it;
+         for(it = state.begin(); it != state.end(); it++)
+         {
+            FactID id = find(it->first);
+            if(id != NullFact)
+               anchored(id, it->second, ops);
+         }
+      }
+      std::sort(ops.begin(), ops.end(), lessID);
+   }
+
+   float CompiledDomain::heuristic(const WorldState &state, const WorldState &start, const ActionOverlay *overlay) const
+   {
+      float h = 0.0f;
+      WorldState::const_iterator it;
+      for(it = state.begin(); it != state.end(); it++)
+      {
+         PVal val;
+         if(!start.get(it->first, val) || val == it->second)
+            continue;
+         float cost = changeCost(it->first, it->second, overlay);
+         if(cost < 0.0f)
+            return -1.0f;
+         h = std::max(h, cost);
+      }
+      return h;
+   }
+
+   float CompiledDomain::changeCost(const Fact &fact, PVal val, const ActionOverlay *overlay) const
+   {
+      float cost = -1.0f;
+      if(mLazy)
+      {
+         // Find the cheapest GroundAction that this Fact and value could
+         // be regressed through.
+         const std::vector<const GroundAction*> &r = lazyRelevant(fact, val);
+         std::vector<const GroundAction*>::const_iterator op;
+         for(op = r.begin(); op != r.end(); op++)
+         {
+            if(overlay && !overlay->allows(**op))
+               continue;
+            float c = overlay? overlay->cost(**op): (*op)->cost;
+            if(cost < 0.0f || c < cost)
+               cost = c;
+         }
+      }
+      else
+      {
+         FactID id = find(fact);
+         if(id != NullFact)
+            cost = overlay? overlay->relevantCost(id): mRelevantCost[id];
+      }
+      return cost;
+   }
+
+   bool CompiledDomain::holds(const Operation &op, int value)
+   {
+      if(op.ctype == NoCondition)
+         return true;
+      if(value < 0)
+         return op.ctype == IsUnset;
+      PVal val = (PVal)value;
+      switch(op.ctype)
+      {
+      case IsSet:        return true;
+      case IsUnset:      return false;
+      case Equals:       return val == op.cval;
+      case NotEqual:     return val != op.cval;
+      case Less:         return val < op.cval;
+      case Greater:      return val > op.cval;
+      case LessEqual:    return val <= op.cval;
+      case GreaterEqual: return val >= op.cval;
+      default:           return true;
+      }
+   }
+
+   int CompiledDomain::apply(const Operation &op, int value)
+   {
+      switch(op.etype)
+      {
+      case Set:       return op.eval;
+      case Unset:     return -1;
+      case Increment: return (PVal)((value < 0? 0: value) + 1);
+      case Decrement: return (PVal)((value < 0? 0: value) - 1);
+      default:        return value;
+      }
+   }
+
+   void CompiledDomain::reachableValues(const WorldState &start, const ActionOverlay *overlay,
+      std::vector<std::vector<int> > &values) const
+   {
+      unsigned int n = numFacts();
+      std::vector<std::set<int> > vals(n);
+      for(FactID f = 0; f < n; f++)
+      {
+         PVal v;
+         if(start.get(getFact(f), v) || mConstants.get(getFact(f), v))
+            vals[f].insert(v);
+         else
+            vals[f].insert(-1);
+      }
+
+      bool changed = true;
+      while(changed)
+      {
+         changed = false;
+         for(unsigned int i = 0; i < numOperators(); i++)
+         {
+            const GroundAction &ga = getOperator(i);
+            if(overlay && !overlay->allows(ga))
+               continue;
+            groundops::const_iterator gop;
+            for(gop = ga.ops.begin(); gop != ga.ops.end(); gop++)
+            {
+               if(gop->op.etype == NoEffect)
+                  continue;
+               std::set<int> &fv = vals[gop->id];
+               unsigned int before = fv.size();
+               // Keep applying the effect until it gives nothing new, which
+               // closes the values under increments and decrements.
+               std::vector<int> todo(fv.begin(), fv.end());
+               while(!todo.empty())
+               {
+                  int v = apply(gop->op, todo.back());
+                  todo.pop_back();
+                  if(fv.insert(v).second)
+                     todo.push_back(v);
+               }
+               changed = changed || fv.size() != before;
+            }
+         }
+      }
+
+      values.resize(n);
+      for(FactID f = 0; f < n; f++)
+         values[f].assign(vals[f].begin(), vals[f].end());
+   }
+
+   unsigned int CompiledDomain::lazyNumFacts() const
+   {
+      return mLazy->factStore.size();
+   }
+
+   const Fact &CompiledDomain::lazyFact(FactID id) const
+   {
+      return mLazy->factStore[id];
+   }
+
+   unsigned int CompiledDomain::lazyNumOperators() const
+   {
+      return mLazy->opStore.size();
+   }
+
+   const GroundAction &CompiledDomain::lazyOperator(unsigned int i) const
+   {
+      return mLazy->opStore[i];
+   }
+
+   FactID CompiledDomain::lazyIntern(const Fact &fact) const
+   {
+      LazyTables::FactShard &shard = mLazy->facts[hashFact(fact) % LazyTables::Shards];
+      std::lock_guard<std::mutex> lock(shard.lock);
+      std::map<Fact, FactID>::const_iterator it = shard.ids.find(fact);
+      if(it != shard.ids.end())
+         return it->second;
+      FactID id = mLazy->factStore.push(fact);
+      shard.ids[fact] = id;
+      return id;
+   }
+
+   const GroundAction *CompiledDomain::lazyGround(unsigned int action, const objects &params) const
+   {
+      LazyTables::opkey key(action, params);
+      unsigned int h = action;
+      for(unsigned int i = 0; i < params.size(); i++)
+         h = 31 * h + params[i];
+      LazyTables::OpShard &shard = mLazy->ops[h % LazyTables::Shards];
+      {
+         std::lock_guard<std::mutex> lock(shard.lock);
+         std::map<LazyTables::opkey, const GroundAction*>::const_iterator it = shard.ops.find(key);
+         if(it != shard.ops.end())
+            return it->second;
+      }
+
+      // Ground without holding the lock.
+      GroundAction ga;
+      std::vector<Fact> facts;
+      bool usable = ground(action, params, ga, facts);
+
+      std::lock_guard<std::mutex> lock(shard.lock);
+      std::map<LazyTables::opkey, const GroundAction*>::const_iterator it = shard.ops.find(key);
+      if(it != shard.ops.end())
+         return it->second;
+      const GroundAction *result = NULL;
+      if(usable)
+      {
+         for(unsigned int i = 0; i < ga.ops.size(); i++)
+         {
+            FactID id = lazyIntern(facts[ga.ops[i].id]);
+            ga.ops[i].id = id;
+            ga.ops[i].fact = &mLazy->factStore[id];
+         }
+         result = &mLazy->opStore[mLazy->opStore.push(ga)];
+      }
+      shard.ops[key] = result;
+      return result;
+   }
+
+   /// Restrict a parameter to objects that become a given PVal.
+   static void restrict(objects &candidates, PVal val)
+   {
+      objects kept;
+      for(unsigned int i = 0; i < candidates.size(); i++)
+      {
+         if((PVal)candidates[i] == val)
+            kept.push_back(candidates[i]);
+      }
+      candidates.swap(kept);
+   }
+
+   /// Restrict a parameter to a single object, if it is allowed at all.
+   static void restrict(objects &candidates, Object obj)
+   {
+      bool found = std::find(candidates.begin(), candidates.end(), obj) != candidates.end();
+      candidates.clear();
+      if(found)
+         candidates.push_back(obj);
+   }
+
+   /// A Fact set to some value is consistent with an Operation if the
+   /// Operation's effect, or its condition if it has no effect, could leave
+   /// the Fact with that value. This binds whichever parameters the
+   /// Operation's Fact arguments and value refer to, and rules out the rest
+   /// of the Action's instances without grounding them.
+   /// Static pre-conditions must hold in the constants, so a parameter that
+   /// appears in one can only take objects that some matching constant Fact
+   /// has in its place. Parameters already narrowed to a single object are
+   /// fixed in the query, so this follows static relations like adjacency
+   /// outwards from the Fact being regressed.
+   /// @return False if some parameter has no candidates left.
+   bool CompiledDomain::narrow(const Action &ac, std::vector<objects> &cands) const
+   {
+      operations::const_iterator o;
+      for(o = ac.begin(); o != ac.end(); o++)
+      {
+         const Fact &f = o->first;
+         ConditionType c = o->second.ctype;
+         if(c == NoCondition || c == IsUnset ||
+            !isStaticPredicate(f.name) || !mConstants.involves(f.name))
+            continue;
+
+         Fact pattern(f.name);
+         std::vector<bool> open(cands.size(), false);
+         bool any = false;
+         for(unsigned int k = 0; k < f.args.size(); k++)
+         {
+            int idx = f.indices.size() > k? f.indices[k]: -1;
+            if(idx < 0)
+               pattern % f.args[k];
+            else if(cands[idx].size() == 1)
+               pattern % cands[idx][0];
+            else
+            {
+               pattern % Parameter(idx);
+               open[idx] = any = true;
+            }
+         }
+         // Fully bound conditions are checked when grounding.
+         if(!any)
+            continue;
+
+         std::vector<std::set<Object> > seen(cands.size());
+         WorldState::query_iterator q;
+         for(q = mConstants.query(pattern); !q.done(); q++)
+         {
+            for(unsigned int k = 0; k < pattern.args.size(); k++)
+            {
+               if(pattern.indices[k] >= 0)
+                  seen[pattern.indices[k]].insert(q->first.args[k]);
+            }
+         }
+         for(unsigned int i = 0; i < cands.size(); i++)
+         {
+            if(!open[i])
+               continue;
+            objects kept;
+            for(unsigned int j = 0; j < cands[i].size(); j++)
+            {
+               if(seen[i].count(cands[i][j]))
+                  kept.push_back(cands[i][j]);
+            }
+            if(kept.empty())
+               return false;
+            cands[i].swap(kept);
+         }
+      }
+      return true;
+   }
+
+   const std::vector<const GroundAction*> &CompiledDomain::lazyRelevant(const Fact &fact, PVal val) const
+   {
+      LazyTables::relkey key(fact, val);
+      LazyTables::RelevantShard &shard = mLazy->relevant[(hashFact(fact) * 257 + val) % LazyTables::Shards];
+      {
+         std::lock_guard<std::mutex> lock(shard.lock);
+         std::map<LazyTables::relkey, const LazyTables::rellist*>::const_iterator it = shard.lists.find(key);
+         if(it != shard.lists.end())
+            return *it->second;
+      }
+
+      LazyTables::rellist *list = new LazyTables::rellist();
+      for(unsigned int a = 0; a < mActions.size(); a++)
+      {
+         const Action *ac = mActions[a];
+         unsigned int nparams = mObjects.size()? ac->getNumParams(): 0;
+         operations::const_iterator o;
+         for(o = ac->begin(); o != ac->end(); o++)
+         {
+            const Fact &pattern = o->first;
+            const Operation &op = o->second;
+            if(pattern.name != fact.name || pattern.args.size() != fact.args.size())
+               continue;
+            if(!nparams)
+            {
+               // Nothing to bind; ground the one instance and compare.
+               const GroundAction *ga = lazyGround(a, objects());
+               if(!ga)
+                  continue;
+               groundops::const_iterator gop;
+               for(gop = ga->ops.begin(); gop != ga->ops.end(); gop++)
+               {
+                  if(*gop->fact == fact)
+                     list->push_back(ga);
+               }
+               continue;
+            }
+
+            // Candidate objects for each parameter.
+            std::vector<objects> cands(nparams, mObjects);
+            bool ok = true;
+            for(unsigned int k = 0; k < pattern.args.size() && ok; k++)
+            {
+               int idx = pattern.indices.size() > k? pattern.indices[k]: -1;
+               if(idx < 0)
+                  ok = pattern.args[k] == fact.args[k];
+               else
+                  restrict(cands[idx], fact.args[k]);
+            }
+            if(!ok)
+               continue;
+
+            // Bind or check the Operation's value.
+            switch(op.etype)
+            {
+            case NoEffect:
+               if(op.ctype == NoCondition || op.ctype == IsUnset)
+                  ok = false;
+               else if(op.ctype == Equals)
+               {
+                  if(op.cidx > -1)
+                     restrict(cands[op.cidx], val);
+                  else
+                     ok = op.cval == val;
+               }
+               // Other conditions are checked by WorldState::postMatch.
+               break;
+            case Set:
+               if(op.eidx > -1)
+                  restrict(cands[op.eidx], val);
+               else
+                  ok = op.eval == val;
+               break;
+            case Unset:
+               // A Fact that is set can't be the result of unsetting it.
+               ok = false;
+               break;
+            case Increment:
+               if(op.eidx > -1)
+                  restrict(cands[op.eidx], (PVal)(val - 1));
+               else
+                  ok = op.eval + 1 == val;
+               break;
+            case Decrement:
+               if(op.eidx > -1)
+                  restrict(cands[op.eidx], (PVal)(val + 1));
+               else
+                  ok = op.eval - 1 == val;
+               break;
+            }
+            for(unsigned int i = 0; i < nparams && ok; i++)
+               ok = !cands[i].empty();
+            if(!ok || !narrow(*ac, cands))
+               continue;
+
+            // Ground every remaining combination of candidates.
+            std::vector<unsigned int> idx(nparams, 0);
+            objects params(nparams);
+            while(true)
+            {
+               for(unsigned int j = 0; j < nparams; j++)
+                  params[j] = cands[j][idx[j]];
+               const GroundAction *ga = lazyGround(a, params);
+               if(ga)
+                  list->push_back(ga);
+               unsigned int j = nparams;
+               while(j > 0 && ++idx[j-1] == cands[j-1].size())
+                  idx[--j] = 0;
+               if(!j)
+                  break;
+            }
+         }
+      }
+      std::sort(list->begin(), list->end(), lessID);
+      list->erase(std::unique(list->begin(), list->end()), list->end());
+
+      std::lock_guard<std::mutex> lock(shard.lock);
+      std::map<LazyTables::relkey, const LazyTables::rellist*>::const_iterator it = shard.lists.find(key);
+      if(it != shard.lists.end())
+      {
+         delete list;
+         return *it->second;
+      }
+      shard.lists[key] = list;
+      return *list;
+   }
+
+   /// @class ActionOverlay
+   ///
+   /// Many agents plan with the same Actions but different preferences. An
+   /// ActionOverlay lets each of them use the same grounded operators: all
+   /// it stores is one bit per GroundAction, one float per Action, and one
+   /// float per Fact for the heuristic.
+
+   ActionOverlay::ActionOverlay(const CompiledDomain *dom, const ActionSet &set)
+   {
+      mDomain = dom;
+      mDomain->acquire();
+
+      // A negative preference marks an Action that is not in the set.
+      mPrefs.assign(mDomain->numActions(), -1.0f);
+      ActionSet::const_iterator it;
+      for(it = set.begin(); it != set.end(); it++)
+      {
+         for(unsigned int i = 0; i < mDomain->numActions(); i++)
+         {
+            if(mDomain->getAction(i) == it->first)
+               mPrefs[i] = it->second;
+         }
+      }
+
+      mMask.resize(mDomain->numOperators());
+      for(unsigned int i = 0; i < mDomain->numOperators(); i++)
+         mMask[i] = mPrefs[mDomain->getOperator(i).action] >= 0.0f;
+
+      updateCosts();
+   }
+
+   ActionOverlay::~ActionOverlay()
+   {
+      mDomain->release();
+   }
+
+   void ActionOverlay::veto(const GroundAction &op)
+   {
+      // Lazily grounded operators may be newer than our mask.
+      while(mMask.size() <= op.ID)
+         mMask.push_back(mPrefs[mDomain->getOperator(mMask.size()).action] >= 0.0f);
+      mMask[op.ID] = false;
+      updateCosts();
+   }
+
+   void ActionOverlay::updateCosts()
+   {
+      mRelevantCost.assign(mDomain->numFacts(), -1.0f);
+      for(FactID id = 0; id < mDomain->numFacts(); id++)
+      {
+         CompiledDomain::oprange r = mDomain->relevant(id);
+         for(; r.first != r.second; r.first++)
+         {
+            const GroundAction &op = **r.first;
+            if(!allows(op))
+               continue;
+            float c = cost(op);
+            if(mRelevantCost[id] < 0.0f || c < mRelevantCost[id])
+               mRelevantCost[id] = c;
+         }
+      }
+   }
+
+   /// @class SharedDomain
+   ///
+   /// Designers may change Actions while a game is running. After building a
+   /// new CompiledDomain, the game publishes it here; searches that are in
+   /// flight finish on the version they started with, and the old version
+   /// is freed when the last of them releases it.
+
+   SharedDomain::SharedDomain(const CompiledDomain *dom)
+   {
+      mCurrent = dom;
+   }
+
+   SharedDomain::~SharedDomain()
+   {
+      const CompiledDomain *dom = mCurrent.exchange(NULL);
+      if(dom)
+         dom->release();
+   }
+
+   void SharedDomain::publish(const CompiledDomain *dom)
+   {
+      // Readers may have loaded the old pointer but not yet referenced it,
+      // so our reference to it can only be dropped after a grace period.
+      mEpochs.retire(mCurrent.exchange(dom));
+   }
+
+   const CompiledDomain *SharedDomain::acquire() const
+   {
+      EpochManager::Guard guard(mEpochs);
+      const CompiledDomain *dom = mCurrent.load();
+      if(dom)
+         dom->acquire();
+      return dom;
+   }
+
+   unsigned long SharedDomain::version() const
+   {
+      EpochManager::Guard guard(mEpochs);
+      const CompiledDomain *dom = mCurrent.load();
+      return dom? dom->version(): 0;
+   }
+};
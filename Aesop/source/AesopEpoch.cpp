@@ -0,0 +1,116 @@
+/// @file AesopEpoch.cpp
+/// Implementation of EpochManager class as defined in AesopEpoch.h
+
+#include "AesopEpoch.h"
+
+#include <functional>
+#include <thread>
+
+namespace Aesop {
+   /// @class EpochManager
+   ///
+   /// Readers rarely block: entering a Guard is a single compare-and-swap on
+   /// a free slot, and leaving it is a store, unless objects are waiting to
+   /// be released, in which case the reader tries to release them. An object retired in epoch E may
+   /// only have been seen by readers that entered in epoch E or earlier, so
+   /// it is released once every active reader entered after E.
+   /// A reader that finds every slot taken counts itself in mOverflow
+   /// instead, rather than waiting for a slot, and nothing is released
+   /// while any such reader is active.
+   /// All atomic operations are sequentially consistent, which is what makes
+   /// that reasoning hold.
+
+   EpochManager::EpochManager()
+   {
+      mEpoch = 1;
+      mPending = 0;
+      mOverflow = 0;
+      for(unsigned int i = 0; i < AESOP_MAX_READERS; i++)
+         mSlots[i] = 0;
+   }
+
+   EpochManager::~EpochManager()
+   {
+      for(unsigned int i = 0; i < mRetired.size(); i++)
+         mRetired[i].second->release();
+   }
+
+   EpochManager::Guard::Guard(EpochManager &em) : mEM(em)
+   {
+      mSlot = mEM.enter();
+   }
+
+   EpochManager::Guard::~Guard()
+   {
+      mEM.leave(mSlot);
+   }
+
+   unsigned int EpochManager::enter()
+   {
+      // Start looking at a slot particular to this thread so that threads
+      // rarely contend for the same one.
+      unsigned int i = std::hash<std::thread::id>()(std::this_thread::get_id()) % AESOP_MAX_READERS;
+      for(unsigned int tries = 0; tries < AESOP_MAX_READERS; tries++)
+      {
+         unsigned long expected = 0;
+         if(mSlots[i].compare_exchange_strong(expected, mEpoch.load()))
+            return i;
+         i = (i + 1) % AESOP_MAX_READERS;
+      }
+      mOverflow.fetch_add(1);
+      return AESOP_MAX_READERS;
+   }
+
+   void EpochManager::leave(unsigned int slot)
+   {
+      if(slot < AESOP_MAX_READERS)
+         mSlots[slot].store(0);
+      else
+         mOverflow.fetch_sub(1);
+      // We may have been the last reader holding something back.
+      if(mPending.load())
+         reclaim();
+   }
+
+   void EpochManager::retire(const RefCounted *obj)
+   {
+      if(!obj)
+         return;
+      {
+         std::lock_guard<std::mutex> lock(mRetireLock);
+         mRetired.push_back(std::make_pair(mEpoch.fetch_add(1), obj));
+         mPending.store(mRetired.size());
+      }
+      reclaim();
+   }
+
+   void EpochManager::reclaim()
+   {
+      std::vector<const RefCounted*> dead;
+      {
+         std::lock_guard<std::mutex> lock(mRetireLock);
+         // Find the oldest epoch any reader is still in. We cannot tell
+         // when readers without a slot entered.
+         unsigned long oldest = mOverflow.load()? 0: mEpoch.load();
+         for(unsigned int i = 0; i < AESOP_MAX_READERS; i++)
+         {
+            unsigned long e = mSlots[i].load();
+            if(e && e < oldest)
+               oldest = e;
+         }
+         unsigned int kept = 0;
+         for(unsigned int i = 0; i < mRetired.size(); i++)
+         {
+            if(mRetired[i].first < oldest)
+               dead.push_back(mRetired[i].second);
+            else
+               mRetired[kept++] = mRetired[i];
+         }
+         mRetired.resize(kept);
+         mPending.store(kept);
+      }
+      // Release outside the lock; destructors may be slow.
+      for(unsigned int i = 0; i < dead.size(); i++)
+         dead[i]->release();
+   }
+};
@@ -0,0 +1,699 @@
+/// @file AesopExternalPlanner.cpp
+/// Implementation of ExternalPlanner class as defined in AesopExternalPlanner.h
+
+#include "AesopExternalPlanner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Aesop {
+   /// @class ExternalPlanner
+   ///
+   /// A state is stored as a fixed-size record: one code per Fact that can
+   /// change (see CompiledDomain::reachableValues), then the index of the
+   /// operator that first reached it, most significant byte first, so that
+   /// comparing whole records with memcmp orders them by state and then by
+   /// operator. Duplicates always keep the record with the lowest operator,
+   /// so the files and the plan do not depend on the memory limit.
+   ///
+   /// Only a state's operator is kept, not its parent. The plan is rebuilt
+   /// by scanning the layer before the goal for a state that the goal's
+   /// operator leads to the goal from, and so on back to the start.
+
+   /// Operator of the start record.
+   static const unsigned int NoOperator = 0xffffffff;
+
+   /// A file mapped read-only into memory.
+   class MappedFile {
+   public:
+      /// Map a whole file.
+      /// @return False if it cannot be opened or mapped.
+      bool open(const std::string &name);
+      /// Unmap the file.
+      void close();
+      const unsigned char *data() const { return mData; }
+      size_t size() const { return mSize; }
+
+      MappedFile() : mData(NULL), mSize(0) {}
+      ~MappedFile() { close(); }
+
+   private:
+      const unsigned char *mData;
+      size_t mSize;
+
+      /// Not copyable.
+      MappedFile(const MappedFile&);
+      MappedFile &operator=(const MappedFile&);
+   };
+
+#ifdef _WIN32
+   bool MappedFile::open(const std::string &name)
+   {
+      close();
+      HANDLE file = CreateFileA(name.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+         OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+      if(file == INVALID_HANDLE_VALUE)
+         return false;
+      LARGE_INTEGER size;
+      bool ok = GetFileSizeEx(file, &size) != 0;
+      // Empty files cannot be mapped, and need not be. The view keeps the
+      // mapping open once it is made.
+      if(ok && size.QuadPart)
+      {
+         HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+         if(mapping)
+         {
+            mData = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+         }
+         ok = mData != NULL;
+         if(ok)
+            mSize = (size_t)size.QuadPart;
+      }
+      CloseHandle(file);
+      return ok;
+   }
+
+   void MappedFile::close()
+   {
+      if(mData)
+         UnmapViewOfFile(mData);
+      mData = NULL;
+      mSize = 0;
+   }
+
+   static unsigned long processID() { return _getpid(); }
+#else
+   bool MappedFile::open(const std::string &name)
+   {
+      close();
+      int fd = ::open(name.c_str(), O_RDONLY);
+      if(fd < 0)
+         return false;
+      struct stat st;
+      if(fstat(fd, &st))
+      {
+         ::close(fd);
+         return false;
+      }
+      mSize = st.st_size;
+      if(mSize)
+      {
+         void *p = mmap(NULL, mSize, PROT_READ, MAP_SHARED, fd, 0);
+         if(p == MAP_FAILED)
+            mSize = 0;
+         else
+         {
+            mData = (const unsigned char*)p;
+            // Layers and runs are read front to back.
+            madvise(p, mSize, MADV_SEQUENTIAL);
+         }
+      }
+      ::close(fd);
+      return mData || !st.st_size;
+   }
+
+   void MappedFile::close()
+   {
+      if(mData)
+         munmap((void*)mData, mSize);
+      mData = NULL;
+      mSize = 0;
+   }
+
+   static unsigned long processID() { return getpid(); }
+#endif
+
+   /// Read the operator of a record of the given size.
+   static unsigned int getOp(const unsigned char *rec, unsigned int size)
+   {
+      const unsigned char *p = rec + size - 4;
+      return (unsigned int)p[0] << 24 | (unsigned int)p[1] << 16 | (unsigned int)p[2] << 8 | p[3];
+   }
+
+   static void putOp(unsigned char *rec, unsigned int size, unsigned int op)
+   {
+      unsigned char *p = rec + size - 4;
+      p[0] = op >> 24;
+      p[1] = op >> 16;
+      p[2] = op >> 8;
+      p[3] = op;
+   }
+
+   /// Orders records in a buffer by their offsets.
+   struct RecordLess {
+      const unsigned char *base;
+      unsigned int size;
+      bool operator()(size_t a, size_t b) const
+      { return memcmp(base + a, base + b, size) < 0; }
+   };
+
+   /// Orders runs by their current records, smallest on top of a heap.
+   struct RunGreater {
+      const std::vector<const unsigned char*> *pos;
+      unsigned int size;
+      bool operator()(unsigned int a, unsigned int b) const
+      { return memcmp((*pos)[a], (*pos)[b], size) > 0; }
+   };
+
+   /// Writes records to a file through a buffer.
+   class RecordWriter {
+   public:
+      bool open(const std::string &name)
+      {
+         mFile = std::fopen(name.c_str(), "wb");
+         mCount = 0;
+         return mFile != NULL;
+      }
+      void write(const unsigned char *rec, unsigned int size)
+      {
+         if(mFile && std::fwrite(rec, 1, size, mFile) != size)
+            mFailed = true;
+         mCount++;
+      }
+      /// @return False if anything could not be written.
+      bool close()
+      {
+         if(mFile && std::fclose(mFile))
+            mFailed = true;
+         mFile = NULL;
+         return !mFailed;
+      }
+      unsigned long count() const { return mCount; }
+
+      RecordWriter() : mFile(NULL), mCount(0), mFailed(false) {}
+      ~RecordWriter() { close(); }
+
+   private:
+      std::FILE *mFile;
+      unsigned long mCount;
+      bool mFailed;
+   };
+
+   ExternalPlanner::ExternalPlanner(const CompiledDomain *dom, const WorldState *start, const WorldState *goal)
+   {
+      mDomain = dom;
+      mOverlay = NULL;
+      mStart = start;
+      mGoal = goal;
+      mDirectory = ".";
+      mMemoryLimit = 64 << 20;
+      mMaxDepth = 0;
+      mExhaustive = false;
+      mSuccess = false;
+      mExhausted = false;
+      mCodeBytes = 1;
+      mRecordBytes = 4;
+      static std::atomic<unsigned long> serial(0);
+      mFileID = serial++;
+   }
+
+   ExternalPlanner::~ExternalPlanner()
+   {
+      clear();
+   }
+
+   std::string ExternalPlanner::fileName(const char *kind, unsigned int n) const
+   {
+      std::ostringstream name;
+      name << mDirectory << "/aesop-" << processID() << "-" << mFileID << "-" << kind << n << ".dat";
+      return name.str();
+   }
+
+   void ExternalPlanner::clear()
+   {
+      for(unsigned int d = 0; d < mLayers.size(); d++)
+         std::remove(fileName("layer", d).c_str());
+      std::remove(fileName("closed", 0).c_str());
+      std::remove(fileName("closed", 1).c_str());
+      mLayers.clear();
+   }
+
+   unsigned long ExternalPlanner::numStates() const
+   {
+      unsigned long n = 0;
+      for(unsigned int d = 0; d < mLayers.size(); d++)
+         n += mLayers[d];
+      return n;
+   }
+
+   int ExternalPlanner::code(unsigned int slot, int value) const
+   {
+      const std::vector<int> &vals = mFacts[slot].values;
+      for(unsigned int c = 0; c < vals.size(); c++)
+      {
+         if(vals[c] == value)
+            return c;
+      }
+      return -1;
+   }
+
+   unsigned int ExternalPlanner::getCode(const unsigned char *rec, unsigned int slot) const
+   {
+      if(mCodeBytes == 1)
+         return rec[slot];
+      return (unsigned int)rec[2*slot] << 8 | rec[2*slot+1];
+   }
+
+   void ExternalPlanner::putCode(unsigned char *rec, unsigned int slot, unsigned int c) const
+   {
+      if(mCodeBytes == 1)
+         rec[slot] = c;
+      else
+      {
+         rec[2*slot] = c >> 8;
+         rec[2*slot+1] = c;
+      }
+   }
+
+   bool ExternalPlanner::applicable(const ExtOp &op, const unsigned char *rec) const
+   {
+      for(unsigned int i = 0; i < op.pre.size(); i++)
+      {
+         if(!op.pre[i].second[getCode(rec, op.pre[i].first)])
+            return false;
+      }
+      return true;
+   }
+
+   void ExternalPlanner::successor(const ExtOp &op, const unsigned char *rec, unsigned int o, unsigned char *out) const
+   {
+      memcpy(out, rec, mRecordBytes - 4);
+      for(unsigned int i = 0; i < op.post.size(); i++)
+      {
+         unsigned int slot = op.post[i].first;
+         putCode(out, slot, op.post[i].second[getCode(rec, slot)]);
+      }
+      putOp(out, mRecordBytes, o);
+   }
+
+   bool ExternalPlanner::isGoal(const unsigned char *rec) const
+   {
+      if(!mGoal)
+         return false;
+      for(unsigned int i = 0; i < mGoalCodes.size(); i++)
+      {
+         if(getCode(rec, mGoalCodes[i].first) != mGoalCodes[i].second)
+            return false;
+      }
+      return true;
+   }
+
+   void ExternalPlanner::decode(const unsigned char *rec, WorldState &state) const
+   {
+      state = mFixed;
+      WorldState::Batch changes(state);
+      for(unsigned int s = 0; s < mFacts.size(); s++)
+      {
+         int value = mFacts[s].values[getCode(rec, s)];
+         if(value < 0)
+            changes.unset(mFacts[s].fact);
+         else
+            changes.set(mFacts[s].fact, value);
+      }
+      changes.commit();
+   }
+
+   bool ExternalPlanner::compile(const CompiledDomain &dom, Context *ctx)
+   {
+      std::vector<std::vector<int> > values;
+      dom.reachableValues(*mStart, mOverlay, values);
+      unsigned int n = values.size();
+      mFacts.clear();
+      mOps.clear();
+      mGoalCodes.clear();
+      mFixed = *mStart;
+      mCodeBytes = 1;
+
+      // Facts that can only take one value are left out of records.
+      std::vector<int> slots(n, -1);
+      std::vector<int> fixed(n, -1);
+      for(FactID f = 0; f < n; f++)
+      {
+         if(values[f].size() == 1)
+         {
+            fixed[f] = values[f][0];
+            continue;
+         }
+         slots[f] = mFacts.size();
+         mFacts.push_back(ExtFact());
+         mFacts.back().fact = dom.getFact(f);
+         mFacts.back().values.swap(values[f]);
+         if(mFacts.back().values.size() > 256)
+            mCodeBytes = 2;
+      }
+      mRecordBytes = mFacts.size() * mCodeBytes + 4;
+
+      for(unsigned int i = 0; i < dom.numOperators(); i++)
+      {
+         const GroundAction &ga = dom.getOperator(i);
+         if(mOverlay && !mOverlay->allows(ga))
+            continue;
+         ExtOp op;
+         op.ga = &ga;
+         bool possible = true;
+         groundops::const_iterator gop;
+         for(gop = ga.ops.begin(); gop != ga.ops.end() && possible; gop++)
+         {
+            int slot = slots[gop->id];
+            if(slot < 0)
+            {
+               possible = CompiledDomain::holds(gop->op, fixed[gop->id]);
+               continue;
+            }
+            const std::vector<int> &vals = mFacts[slot].values;
+            if(gop->op.ctype != NoCondition)
+            {
+               std::vector<bool> allowed(vals.size());
+               unsigned int count = 0;
+               for(unsigned int c = 0; c < vals.size(); c++)
+               {
+                  allowed[c] = CompiledDomain::holds(gop->op, vals[c]);
+                  count += allowed[c];
+               }
+               possible = count > 0;
+               if(count < vals.size())
+                  op.pre.push_back(std::make_pair((unsigned int)slot, allowed));
+            }
+            if(gop->op.etype != NoEffect)
+            {
+               std::vector<unsigned int> next(vals.size());
+               for(unsigned int c = 0; c < vals.size(); c++)
+                  next[c] = code(slot, CompiledDomain::apply(gop->op, vals[c]));
+               op.post.push_back(std::make_pair((unsigned int)slot, next));
+            }
+         }
+         if(possible)
+            mOps.push_back(op);
+      }
+
+      if(ctx) ctx->logEvent("Encoded %d Facts in %d-byte records, %d operators.",
+         (int)n, (int)mRecordBytes, (int)mOps.size());
+
+      if(!mGoal)
+         return true;
+      WorldState::const_iterator it;
+      for(it = mGoal->begin(); it != mGoal->end(); it++)
+      {
+         FactID id = dom.find(it->first);
+         if(id == NullFact || slots[id] < 0)
+         {
+            // Facts that never change must hold already.
+            PVal v;
+            if(!mStart->get(it->first, v) && !dom.getConstants().get(it->first, v))
+               return false;
+            if(v != it->second)
+               return false;
+            continue;
+         }
+         int c = code(slots[id], it->second);
+         if(c < 0)
+            return false;
+         mGoalCodes.push_back(std::make_pair((unsigned int)slots[id], (unsigned int)c));
+      }
+      return true;
+   }
+
+   bool ExternalPlanner::writeRun(std::vector<unsigned char> &buf, const std::string &name) const
+   {
+      unsigned int size = mRecordBytes, key = mRecordBytes - 4;
+      std::vector<size_t> order;
+      order.reserve(buf.size() / size);
+      for(size_t off = 0; off < buf.size(); off += size)
+         order.push_back(off);
+      RecordLess less = {&buf[0], size};
+      std::sort(order.begin(), order.end(), less);
+
+      RecordWriter out;
+      if(!out.open(name))
+         return false;
+      const unsigned char *last = NULL;
+      for(size_t i = 0; i < order.size(); i++)
+      {
+         const unsigned char *rec = &buf[order[i]];
+         if(last && !memcmp(last, rec, key))
+            continue;
+         out.write(rec, size);
+         last = rec;
+      }
+      buf.clear();
+      return out.close();
+   }
+
+   bool ExternalPlanner::merge(const std::vector<std::string> &runs, unsigned int depth,
+      std::vector<unsigned char> &goal)
+   {
+      unsigned int size = mRecordBytes, key = mRecordBytes - 4;
+      goal.clear();
+
+      std::vector<MappedFile> files(runs.size());
+      std::vector<const unsigned char*> pos(runs.size()), end(runs.size());
+      std::vector<unsigned int> heap;
+      for(unsigned int r = 0; r < runs.size(); r++)
+      {
+         if(!files[r].open(runs[r]))
+            return false;
+         pos[r] = files[r].data();
+         end[r] = pos[r] + files[r].size();
+         if(pos[r] != end[r])
+            heap.push_back(r);
+      }
+      RunGreater greater = {&pos, size};
+      std::make_heap(heap.begin(), heap.end(), greater);
+
+      MappedFile closed;
+      if(!closed.open(fileName("closed", (depth - 1) % 2)))
+         return false;
+      const unsigned char *cpos = closed.data(), *cend = cpos + closed.size();
+
+      RecordWriter layer, next;
+      if(!layer.open(fileName("layer", depth)) || !next.open(fileName("closed", depth % 2)))
+         return false;
+      mLayers.push_back(0);
+
+      std::vector<unsigned char> last;
+      while(!heap.empty())
+      {
+         std::pop_heap(heap.begin(), heap.end(), greater);
+         unsigned int r = heap.back();
+         const unsigned char *rec = pos[r];
+         pos[r] += size;
+         if(pos[r] != end[r])
+            std::push_heap(heap.begin(), heap.end(), greater);
+         else
+            heap.pop_back();
+
+         // Runs are free of duplicates, but may share states with each
+         // other; the lowest operator comes first.
+         if(!last.empty() && !memcmp(&last[0], rec, key))
+            continue;
+         last.assign(rec, rec + size);
+
+         int cmp = 1;
+         while(cpos != cend && (cmp = memcmp(cpos, rec, key)) < 0)
+         {
+            next.write(cpos, size);
+            cpos += size;
+         }
+         if(cpos != cend && !cmp)
+            continue;
+
+         layer.write(rec, size);
+         next.write(rec, size);
+         if(goal.empty() && isGoal(rec))
+            goal.assign(rec, rec + size);
+      }
+      for(; cpos != cend; cpos += size)
+         next.write(cpos, size);
+
+      mLayers.back() = layer.count();
+      return layer.close() && next.close();
+   }
+
+   bool ExternalPlanner::extract(unsigned int depth, const unsigned char *rec)
+   {
+      unsigned int size = mRecordBytes, key = mRecordBytes - 4;
+      std::vector<unsigned char> cur(rec, rec + size), tmp(size);
+      std::vector<const GroundAction*> steps;
+      for(unsigned int d = depth; d > 0; d--)
+      {
+         unsigned int o = getOp(&cur[0], size);
+         const ExtOp &op = mOps[o];
+         MappedFile prev;
+         if(!prev.open(fileName("layer", d - 1)))
+            return false;
+         const unsigned char *p = prev.data(), *end = p + prev.size();
+         for(; p != end; p += size)
+         {
+            if(!applicable(op, p))
+               continue;
+            successor(op, p, o, &tmp[0]);
+            if(!memcmp(&tmp[0], &cur[0], key))
+               break;
+         }
+         if(p == end)
+            return false;
+         steps.push_back(op.ga);
+         cur.assign(p, p + size);
+      }
+
+      mPlan.clear();
+      while(!steps.empty())
+      {
+         mPlan.push_back(ActionEntry());
+         mPlan.back().ac = steps.back()->ac;
+         mPlan.back().params = steps.back()->params;
+         steps.pop_back();
+      }
+      return true;
+   }
+
+   bool ExternalPlanner::plan(Context *ctx)
+   {
+      mSuccess = mExhausted = false;
+      mPlan.clear();
+      clear();
+      const CompiledDomain *dom = mOverlay? mOverlay->getDomain(): mDomain;
+      if(!dom || !mStart || dom->getGrounding() != EagerGrounding)
+      {
+         if(ctx) ctx->logEvent("External search needs a start and an eagerly grounded domain!");
+         return false;
+      }
+
+      if(ctx) ctx->logEvent("Starting new external search.");
+      if(!compile(*dom, ctx))
+      {
+         mExhausted = true;
+         if(ctx) ctx->logEvent("The goal can never be reached.");
+         return false;
+      }
+
+      unsigned int size = mRecordBytes;
+      std::vector<unsigned char> rec(size);
+      for(unsigned int s = 0; s < mFacts.size(); s++)
+      {
+         PVal v;
+         int value = -1;
+         if(mStart->get(mFacts[s].fact, v) || dom->getConstants().get(mFacts[s].fact, v))
+            value = v;
+         putCode(&rec[0], s, code(s, value));
+      }
+      putOp(&rec[0], size, NoOperator);
+
+      RecordWriter layer, closed;
+      bool ok = layer.open(fileName("layer", 0)) && closed.open(fileName("closed", 0));
+      if(ok)
+      {
+         layer.write(&rec[0], size);
+         closed.write(&rec[0], size);
+      }
+      ok = layer.close() && closed.close() && ok;
+      mLayers.push_back(1);
+      mSuccess = isGoal(&rec[0]);
+
+      std::vector<unsigned char> buf, next(size), goal;
+      std::vector<std::string> runs;
+      for(unsigned int depth = 0; ok; depth++)
+      {
+         if(mSuccess && !mExhaustive && mGoal)
+            break;
+         if(mMaxDepth && depth >= mMaxDepth)
+            break;
+
+         // Expand the layer, spilling sorted runs whenever the buffer fills.
+         MappedFile cur;
+         ok = cur.open(fileName("layer", depth));
+         const unsigned char *p = cur.data(), *end = p + cur.size();
+         for(; p != end && ok; p += size)
+         {
+            for(unsigned int o = 0; o < mOps.size() && ok; o++)
+            {
+               if(!applicable(mOps[o], p))
+                  continue;
+               successor(mOps[o], p, o, &next[0]);
+               buf.insert(buf.end(), next.begin(), next.end());
+               if(buf.size() + size > mMemoryLimit)
+               {
+                  runs.push_back(fileName("run", runs.size()));
+                  ok = writeRun(buf, runs.back());
+               }
+            }
+         }
+         cur.close();
+         if(ok && !buf.empty())
+         {
+            runs.push_back(fileName("run", runs.size()));
+            ok = writeRun(buf, runs.back());
+         }
+
+         ok = ok && merge(runs, depth + 1, goal);
+         for(unsigned int r = 0; r < runs.size(); r++)
+            std::remove(runs[r].c_str());
+         if(ctx) ctx->logEvent("Layer %d: %lu new states from %d runs.",
+            (int)depth + 1, ok? mLayers.back(): 0ul, (int)runs.size());
+         runs.clear();
+         std::vector<unsigned char>().swap(buf);
+         if(!ok)
+            break;
+
+         if(!mSuccess && !goal.empty())
+            ok = mSuccess = extract(depth + 1, &goal[0]);
+         if(!mLayers.back())
+         {
+            std::remove(fileName("layer", depth + 1).c_str());
+            mLayers.pop_back();
+            mExhausted = true;
+            break;
+         }
+      }
+
+      if(!ok)
+      {
+         mSuccess = false;
+         mPlan.clear();
+         if(ctx) ctx->logEvent("Could not read or write files in %s!", mDirectory.c_str());
+         return false;
+      }
+      if(ctx)
+      {
+         if(mSuccess)
+            ctx->logEvent("Found a plan of %d actions.", (int)mPlan.size());
+         else if(mExhausted && mGoal)
+            ctx->logEvent("No plan exists.");
+         else if(!mExhausted)
+            ctx->logEvent("No plan within %d steps.", (int)mMaxDepth);
+         ctx->logEvent("Reached %lu states in %d layers.", numStates(), (int)mLayers.size());
+      }
+      return mSuccess;
+   }
+
+   bool ExternalPlanner::visit(unsigned int depth, Visitor &v) const
+   {
+      if(depth >= mLayers.size())
+         return false;
+      MappedFile layer;
+      if(!layer.open(fileName("layer", depth)))
+         return false;
+      WorldState state;
+      const unsigned char *p = layer.data(), *end = p + layer.size();
+      for(; p != end; p += mRecordBytes)
+      {
+         decode(p, state);
+         v.visit(state, depth);
+      }
+      return true;
+   }
+};
@@ -0,0 +1,183 @@
+/// @file AesopGraphPlanner.cpp
+/// Implementation of GraphPlanner class as defined in AesopGraphPlanner.h
+
+#include "AesopGraphPlanner.h"
+
+#include <algorithm>
+
+namespace Aesop {
+   /// @class GraphPlanner
+   ///
+   /// The backward search prefers to keep a goal with a no-op, then tries
+   /// the GroundActions adding it in domain order. The search stops with no
+   /// plan once the graph has levelled off and a whole round of search adds
+   /// no new failed set at the level where it did, which is Graphplan's
+   /// test for an unsolvable problem.
+
+   GraphPlanner::GraphPlanner(const CompiledDomain *dom, const WorldState *start, const WorldState *goal)
+   {
+      mDomain = dom;
+      mOverlay = NULL;
+      mStart = start;
+      mGoal = goal;
+      mMaxLevels = 64;
+      mSuccess = false;
+      mExhausted = false;
+   }
+
+   bool GraphPlanner::plan(Context *ctx)
+   {
+      mSuccess = mExhausted = false;
+      mPlan.clear();
+      const CompiledDomain *dom = mOverlay? mOverlay->getDomain(): mDomain;
+      if(!dom || !mStart || !mGoal || dom->getGrounding() != EagerGrounding)
+      {
+         if(ctx) ctx->logEvent("Graphplan needs a start, a goal and an eagerly grounded domain!");
+         return false;
+      }
+
+      if(ctx) ctx->logEvent("Starting new Graphplan search.");
+      if(mGraph.reset(*dom, mOverlay, *mStart, PlanningGraph::ClosedWorld))
+         mNogoods.clear();
+      else if(ctx) ctx->logEvent("Reusing %d graph levels.", (int)mGraph.numLevels());
+      if(mGraph.tooLarge())
+      {
+         if(ctx) ctx->logEvent("The planning graph would have too many nodes!");
+         return false;
+      }
+
+      atomset goals;
+      if(!mGraph.atoms(*mGoal, goals))
+      {
+         mExhausted = true;
+         if(ctx) ctx->logEvent("The goal can never be reached.");
+         return false;
+      }
+
+      // Number of failed sets at the level the graph levelled off at, after
+      // the last round of search.
+      int lastNogoods = -1;
+      for(unsigned int lvl = 0; lvl <= mMaxLevels; lvl++)
+      {
+         while(lvl >= mGraph.numLevels() && mGraph.expand());
+         if(!mGraph.reachable(lvl, goals))
+         {
+            // Nothing changes after the graph levels off.
+            if(mGraph.leveled() && lvl + 1 >= mGraph.numLevels())
+            {
+               mExhausted = true;
+               break;
+            }
+            continue;
+         }
+
+         if(mNogoods.size() <= lvl)
+            mNogoods.resize(lvl + 1);
+         mSteps.assign(lvl, std::vector<unsigned int>());
+         if(extract(goals, lvl))
+         {
+            mSuccess = true;
+            for(unsigned int s = 0; s < lvl; s++)
+            {
+               std::sort(mSteps[s].begin(), mSteps[s].end());
+               for(unsigned int i = 0; i < mSteps[s].size(); i++)
+               {
+                  const GroundAction *ga = mGraph.mNodes[mSteps[s][i]].ga;
+                  mPlan.push_back(ActionEntry());
+                  mPlan.back().ac = ga->ac;
+                  mPlan.back().params = ga->params;
+               }
+            }
+            if(ctx) ctx->logEvent("Found a plan of %d actions in %d levels.", (int)mPlan.size(), (int)lvl);
+            break;
+         }
+
+         if(mGraph.leveled() && lvl >= mGraph.numLevels())
+         {
+            int n = mNogoods[mGraph.numLevels() - 1].size();
+            if(n == lastNogoods)
+            {
+               mExhausted = true;
+               break;
+            }
+            lastNogoods = n;
+         }
+      }
+
+      if(!mSuccess && ctx)
+      {
+         if(mExhausted)
+            ctx->logEvent("No plan exists.");
+         else
+            ctx->logEvent("No plan within %d levels.", (int)mMaxLevels);
+      }
+      mSteps.clear();
+      return mSuccess;
+   }
+
+   bool GraphPlanner::extract(const atomset &goals, unsigned int lvl)
+   {
+      if(!lvl)
+         return true;
+      if(mNogoods[lvl].count(goals))
+         return false;
+      std::vector<unsigned int> chosen;
+      if(assign(goals, 0, lvl, chosen))
+         return true;
+      mNogoods[lvl].insert(goals);
+      return false;
+   }
+
+   bool GraphPlanner::assign(const atomset &goals, unsigned int i, unsigned int lvl,
+      std::vector<unsigned int> &chosen)
+   {
+      const PlanningGraph::Level &layer = mGraph.level(lvl - 1);
+      if(i == goals.size())
+      {
+         // Every goal has a node; their conditions are the goals one level
+         // down.
+         atomset sub;
+         for(unsigned int c = 0; c < chosen.size(); c++)
+         {
+            const PlanningGraph::Node &n = mGraph.mNodes[chosen[c]];
+            sub.insert(sub.end(), n.pre.begin(), n.pre.end());
+         }
+         std::sort(sub.begin(), sub.end());
+         sub.erase(std::unique(sub.begin(), sub.end()), sub.end());
+         if(!extract(sub, lvl - 1))
+            return false;
+         for(unsigned int c = 0; c < chosen.size(); c++)
+         {
+            if(mGraph.mNodes[chosen[c]].ga)
+               mSteps[lvl-1].push_back(chosen[c]);
+         }
+         return true;
+      }
+
+      unsigned int g = goals[i];
+      for(unsigned int c = 0; c < chosen.size(); c++)
+      {
+         const std::vector<unsigned int> &add = mGraph.mNodes[chosen[c]].add;
+         if(std::binary_search(add.begin(), add.end(), g))
+            return assign(goals, i + 1, lvl, chosen);
+      }
+
+      // The no-op for an atom is the node with the same index.
+      const PlanningGraph::Bits &producers = mGraph.mProducers[g];
+      for(int n = producers.next(0); n >= 0; n = producers.next(n + 1))
+      {
+         if(!layer.nodes.test(n))
+            continue;
+         bool ok = true;
+         for(unsigned int c = 0; c < chosen.size() && ok; c++)
+            ok = !layer.nodeMutex[n].test(chosen[c]);
+         if(!ok)
+            continue;
+         chosen.push_back(n);
+         if(assign(goals, i + 1, lvl, chosen))
+            return true;
+         chosen.pop_back();
+      }
+      return false;
+   }
+};
@@ -0,0 +1,785 @@
+/// @file AesopPlanService.cpp
+/// Implementation of PlanService class as defined in AesopPlanService.h
+
+#include "AesopPlanService.h"
+
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <new>
+#include <thread>
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+#define AESOP_PLAN_SERVICE
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace Aesop {
+   /// @class PlanService
+   ///
+   /// The shared memory holds a Header, then a mutex for each worker, then
+   /// the ring, then the slots. Each
+   /// slot holds a Slot, then its request, then its result: a table of
+   /// where each step starts, then the steps, each an Action index, a count
+   /// of parameters and the parameters, all as native unsigned ints.
+   ///
+   /// A slot goes from Free to Filling when a client claims it, to Queued
+   /// once its request is written and its number is on the ring, to Running
+   /// when a worker takes it and to Served once the result is written. The
+   /// client gives it back by setting it Free. The ring is a bounded queue
+   /// in which each cell carries a sequence number saying whether it is
+   /// ready to be written or read, so any number of processes may use it
+   /// without locks. It has a cell for every slot, but numbers of slots
+   /// that were given up on stay there until a worker skips them, so it
+   /// can fill up, and then submit gives the slot back.
+   /// The work semaphore counts requests on the ring, and each slot's
+   /// semaphore is posted when it is served.
+   ///
+   /// Each worker holds its own robust mutex for as long as it lives, and a
+   /// slot's robust mutex while the slot is Running, so a client that finds
+   /// a mutex's owner dead knows the worker died. Unlike process IDs, this
+   /// works across processes and sees through zombies. The Header records
+   /// the owner's process ID: workers poll it while idle and exit once
+   /// their parent is someone else, and start and connect check it before
+   /// trusting a service. A client that gives up on a request claims it by
+   /// moving it to Filling, just as a worker claims it by moving it to
+   /// Running, so only one of them serves it.
+   ///
+   /// Workers plan a slice at a time and give up once a request's time
+   /// limit has passed. A worker still Running a slot after twice that is
+   /// stuck outside the Planner, so a waiting client kills it, which turns
+   /// it into a dead worker like any other.
+
+   static const unsigned int ServiceMagic = 0x56534541; // 'AESV'
+   static const unsigned int ServiceVersion = 3;
+   /// How often idle workers and waiting clients look for dead processes,
+   /// in milliseconds.
+   static const int PollInterval = 250;
+
+   enum SlotState { Free, Filling, Queued, Running, Served };
+
+   static size_t round64(size_t n) { return (n + 63) & ~(size_t)63; }
+
+   static unsigned int roundPow2(unsigned int n)
+   {
+      unsigned int p = 1;
+      while(p < n)
+         p *= 2;
+      return p;
+   }
+
+   /// Summary of a CompiledDomain that differs if Actions or objects are
+   /// numbered differently.
+   static unsigned int fingerprint(const CompiledDomain &dom)
+   {
+      unsigned int h = 2166136261u;
+      for(unsigned int i = 0; i < dom.numActions(); i++)
+      {
+         const std::string &name = dom.getAction(i)->getName();
+         for(unsigned int j = 0; j < name.size(); j++)
+            h = (h ^ (unsigned char)name[j]) * 16777619u;
+         h = (h ^ dom.getAction(i)->getNumParams()) * 16777619u;
+      }
+      for(unsigned int i = 0; i < dom.getObjects().size(); i++)
+         h = (h ^ dom.getObjects()[i]) * 16777619u;
+      return (h ^ dom.numOperators()) * 16777619u;
+   }
+
+   /// A cell of the ring.
+   struct PlanService::Cell {
+      std::atomic<unsigned int> seq;
+      unsigned int slot;
+   };
+
+#ifdef AESOP_PLAN_SERVICE
+   struct PlanService::Header {
+      unsigned int magic, version;
+      /// Process that started the service, and how many workers it forked.
+      pid_t owner;
+      unsigned int workers;
+      unsigned int slots, requestBytes, resultBytes;
+      /// Milliseconds to plan each request for, or zero.
+      unsigned int timeLimit;
+      size_t slotBytes;
+      unsigned int domain;
+      std::atomic<unsigned int> quit;
+      /// Where clients start looking for a free slot.
+      std::atomic<unsigned int> cursor;
+      /// Next cell of the ring to read and to write.
+      std::atomic<unsigned int> head, tail;
+      sem_t work;
+      /// Posted by each worker once it holds its mutex.
+      sem_t ready;
+   };
+
+   /// Held by a worker for as long as it lives.
+   struct PlanService::Life {
+      pthread_mutex_t mutex;
+      pid_t pid;
+   };
+
+   struct PlanService::Slot {
+      std::atomic<unsigned int> state;
+      sem_t done;
+      /// Held by the worker while the slot is Running.
+      pthread_mutex_t running;
+      /// Worker that last took the slot, and when, from monotonicTime.
+      unsigned int worker;
+      unsigned long long started;
+      unsigned int heuristic;
+      unsigned int requestSize;
+      unsigned int status;
+      unsigned int steps;
+   };
+
+#endif
+
+   PlanService::PlanService()
+   {
+      mMemory = NULL;
+      mSize = 0;
+      mOwner = false;
+      mDomain = NULL;
+      mSlots = 64;
+      mRequestBytes = 4096;
+      mResultBytes = 4096;
+      mTimeLimit = 10000;
+   }
+
+   PlanService::~PlanService()
+   {
+      stop();
+   }
+
+   void PlanService::setLimits(unsigned int slots, unsigned int requestBytes, unsigned int resultBytes)
+   {
+      // Ring positions wrap around cleanly only for powers of two.
+      mSlots = roundPow2(slots? slots: 1);
+      mRequestBytes = (requestBytes + 3) & ~3u;
+      mResultBytes = (resultBytes + 3) & ~3u;
+   }
+
+   bool PlanService::valid(int ticket) const
+   {
+      return mMemory && ticket >= 0 && (unsigned int)ticket < mSlots &&
+         slot(ticket)->state.load() != Free;
+   }
+
+#ifdef AESOP_PLAN_SERVICE
+   /// Is a process still there? Processes we may not signal are.
+   static bool alive(pid_t pid)
+   {
+      return pid > 0 && (!kill(pid, 0) || errno == EPERM);
+   }
+
+   /// Absolute time for sem_timedwait, some milliseconds from now.
+   static struct timespec deadline(int ms)
+   {
+      struct timespec t;
+      clock_gettime(CLOCK_REALTIME, &t);
+      t.tv_sec += ms / 1000;
+      t.tv_nsec += (long)(ms % 1000) * 1000000;
+      if(t.tv_nsec >= 1000000000)
+      {
+         t.tv_sec++;
+         t.tv_nsec -= 1000000000;
+      }
+      return t;
+   }
+
+   /// Milliseconds on a clock that every process shares, and that never
+   /// goes back.
+   static unsigned long long monotonicTime()
+   {
+      struct timespec t;
+      clock_gettime(CLOCK_MONOTONIC, &t);
+      return (unsigned long long)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+   }
+
+   /// Make a mutex that may be shared between processes, and that tells
+   /// the next process to lock it if its holder died.
+   static void initRobust(pthread_mutex_t *m)
+   {
+      pthread_mutexattr_t attr;
+      pthread_mutexattr_init(&attr);
+      pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+      pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+      pthread_mutex_init(m, &attr);
+      pthread_mutexattr_destroy(&attr);
+   }
+
+   size_t PlanService::ringOffset(unsigned int workers)
+   {
+      return round64(sizeof(Header)) + round64(workers * sizeof(Life));
+   }
+
+   PlanService::Life *PlanService::life(unsigned int i) const
+   {
+      return (Life*)(mMemory + round64(sizeof(Header))) + i;
+   }
+
+   bool PlanService::workersAlive() const
+   {
+      for(unsigned int i = 0; i < header()->workers; i++)
+      {
+         pthread_mutex_t *m = &life(i)->mutex;
+         int locked = pthread_mutex_trylock(m);
+         if(locked == EBUSY)
+            return true;
+         if(locked == EOWNERDEAD)
+            pthread_mutex_consistent(m);
+         if(locked == EOWNERDEAD || !locked)
+            pthread_mutex_unlock(m);
+      }
+      return false;
+   }
+
+   PlanService::Cell *PlanService::cell(unsigned int i) const
+   {
+      return (Cell*)(mMemory + ringOffset(header()->workers)) + i;
+   }
+
+   unsigned char *PlanService::request(Slot *s)
+   {
+      return (unsigned char*)s + round64(sizeof(Slot));
+   }
+
+   PlanService::Slot *PlanService::slot(unsigned int i) const
+   {
+      size_t first = ringOffset(header()->workers) + round64(mSlots * sizeof(Cell));
+      return (Slot*)(mMemory + first + i * header()->slotBytes);
+   }
+
+   bool PlanService::map(int fd, size_t size)
+   {
+      void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      close(fd);
+      if(p == MAP_FAILED)
+         return false;
+      mMemory = (unsigned char*)p;
+      mSize = size;
+      return true;
+   }
+
+   bool PlanService::start(const std::string &name, const ActionOverlay *overlay, unsigned int workers)
+   {
+      stop();
+      if(!overlay || !workers)
+         return false;
+      size_t slotBytes = round64(sizeof(Slot)) + round64(mRequestBytes + mResultBytes);
+      size_t size = ringOffset(workers) + round64(mSlots * sizeof(Cell)) + mSlots * slotBytes;
+
+      // Refuse to replace a service that is already running, but clear away
+      // one whose owner has died.
+      int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+      if(fd < 0 && errno == EEXIST && stale(name))
+      {
+         shm_unlink(name.c_str());
+         fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+      }
+      if(fd < 0)
+         return false;
+      if(ftruncate(fd, size))
+         close(fd);
+      // The mapping keeps the memory, and closes our handle to it.
+      else if(map(fd, size))
+         fd = -1;
+      if(fd >= 0)
+      {
+         shm_unlink(name.c_str());
+         return false;
+      }
+      mName = name;
+      mOwner = true;
+      mDomain = overlay->getDomain();
+
+      Header *h = new(mMemory) Header;
+      h->owner = getpid();
+      h->workers = workers;
+      h->version = ServiceVersion;
+      h->slots = mSlots;
+      h->requestBytes = mRequestBytes;
+      h->resultBytes = mResultBytes;
+      h->timeLimit = mTimeLimit;
+      h->slotBytes = slotBytes;
+      h->domain = fingerprint(*mDomain);
+      h->quit.store(0);
+      h->cursor.store(0);
+      h->head.store(0);
+      h->tail.store(0);
+      sem_init(&h->work, 1, 0);
+      sem_init(&h->ready, 1, 0);
+      for(unsigned int i = 0; i < workers; i++)
+         initRobust(&life(i)->mutex);
+      for(unsigned int i = 0; i < mSlots; i++)
+      {
+         Cell *c = new(cell(i)) Cell;
+         c->seq.store(i);
+         Slot *s = new(slot(i)) Slot;
+         s->state.store(Free);
+         sem_init(&s->done, 1, 0);
+         initRobust(&s->running);
+      }
+
+      for(unsigned int i = 0; i < workers; i++)
+      {
+         pid_t pid = fork();
+         if(pid < 0)
+         {
+            stop();
+            return false;
+         }
+         if(!pid)
+         {
+            pthread_mutex_lock(&life(i)->mutex);
+            life(i)->pid = getpid();
+            sem_post(&h->ready);
+            serve(overlay, i);
+            _exit(0);
+         }
+         mWorkers.push_back(pid);
+      }
+      // Until every worker holds its mutex, clients would take it for dead.
+      for(unsigned int i = 0; i < workers; i++)
+      {
+         while(sem_wait(&h->ready) && errno == EINTR);
+      }
+      // Clients only trust the rest once they see this.
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      h->magic = ServiceMagic;
+      return true;
+   }
+
+   bool PlanService::connect(const std::string &name, const CompiledDomain *dom)
+   {
+      stop();
+      if(!dom)
+         return false;
+      int fd = shm_open(name.c_str(), O_RDWR, 0);
+      if(fd < 0)
+         return false;
+      struct stat st;
+      if(fstat(fd, &st) || (size_t)st.st_size < sizeof(Header))
+      {
+         close(fd);
+         return false;
+      }
+      if(!map(fd, st.st_size))
+         return false;
+      const Header *h = header();
+      bool ok = h->magic == ServiceMagic && h->version == ServiceVersion && alive(h->owner) &&
+         h->domain == fingerprint(*dom) && h->slots && !(h->slots & (h->slots - 1));
+      if(ok)
+      {
+         mSlots = h->slots;
+         mRequestBytes = h->requestBytes;
+         mResultBytes = h->resultBytes;
+         ok = ringOffset(h->workers) + round64(mSlots * sizeof(Cell)) + mSlots * h->slotBytes <= mSize &&
+            h->slotBytes >= round64(sizeof(Slot)) + mRequestBytes + mResultBytes;
+      }
+      if(!ok)
+      {
+         munmap(mMemory, mSize);
+         mMemory = NULL;
+         return false;
+      }
+      mName = name;
+      mDomain = dom;
+      return true;
+   }
+
+   bool PlanService::stale(const std::string &name)
+   {
+      int fd = shm_open(name.c_str(), O_RDONLY, 0);
+      if(fd < 0)
+         return false;
+      struct stat st;
+      void *p = MAP_FAILED;
+      if(!fstat(fd, &st) && (size_t)st.st_size >= sizeof(Header))
+         p = mmap(NULL, sizeof(Header), PROT_READ, MAP_SHARED, fd, 0);
+      close(fd);
+      if(p == MAP_FAILED)
+         return false;
+      // A service still being set up has no magic yet; leave it be.
+      const Header *h = (const Header*)p;
+      bool dead = h->magic == ServiceMagic && !alive(h->owner);
+      munmap(p, sizeof(Header));
+      return dead;
+   }
+
+   void PlanService::stop()
+   {
+      if(!mMemory)
+         return;
+      if(mOwner)
+      {
+         Header *h = header();
+         h->quit.store(1);
+         for(unsigned int i = 0; i < mWorkers.size(); i++)
+            sem_post(&h->work);
+         for(unsigned int i = 0; i < mWorkers.size(); i++)
+            waitpid(mWorkers[i], NULL, 0);
+         shm_unlink(mName.c_str());
+      }
+      munmap(mMemory, mSize);
+      mMemory = NULL;
+      mSize = 0;
+      mOwner = false;
+      mWorkers.clear();
+   }
+
+   int PlanService::submit(const WorldState &start, const WorldState &goal, PlannerHeuristic h)
+   {
+      if(!mMemory)
+         return -1;
+      std::vector<unsigned char> req;
+      ByteWriter w(req);
+      start.serialize(w);
+      goal.serialize(w);
+      if(req.size() > mRequestBytes)
+         return -1;
+
+      Header *hdr = header();
+      unsigned int first = hdr->cursor.fetch_add(1);
+      for(unsigned int k = 0; k < mSlots; k++)
+      {
+         unsigned int i = (first + k) & (mSlots - 1);
+         Slot *s = slot(i);
+         unsigned int expected = Free;
+         if(!s->state.compare_exchange_strong(expected, Filling))
+            continue;
+         s->heuristic = h;
+         s->requestSize = req.size();
+         memcpy(request(s), &req[0], req.size());
+         s->state.store(Queued);
+         if(!enqueue(i))
+         {
+            // A worker may have taken it through an older entry for the
+            // slot, in which case it will be served after all.
+            unsigned int expected = Queued;
+            if(!s->state.compare_exchange_strong(expected, Filling))
+               return i;
+            s->state.store(Free);
+            return -1;
+         }
+         sem_post(&hdr->work);
+         return i;
+      }
+      return -1;
+   }
+
+   bool PlanService::wait(int ticket, int ms)
+   {
+      if(!valid(ticket))
+         return false;
+      Slot *s = slot(ticket);
+      // Wake up now and then to see whether anyone we depend on has died.
+      while(true)
+      {
+         int step = ms < 0 || ms > PollInterval? PollInterval: ms;
+         struct timespec t = deadline(step);
+         if(!sem_timedwait(&s->done, &t))
+            break;
+         if(errno == EINTR)
+            continue;
+         reap(s);
+         // Take the post it made, if it served the slot.
+         if(s->state.load() == Served)
+            continue;
+         if(!ms)
+            return false;
+         if(ms > 0)
+            ms -= step;
+      }
+      // Leave it posted, so that waiting again returns at once.
+      sem_post(&s->done);
+      return true;
+   }
+
+   void PlanService::reap(Slot *s)
+   {
+      unsigned int st = s->state.load();
+      if(st == Running)
+      {
+         // The mutex only comes back to us with its owner dead if the
+         // worker died before serving the slot. Otherwise either a live
+         // worker holds it, or nobody does.
+         int locked = pthread_mutex_trylock(&s->running);
+         if(locked != EOWNERDEAD)
+         {
+            if(!locked)
+               pthread_mutex_unlock(&s->running);
+            // The worker gives up after the time limit itself, so if it is
+            // still here well after, it is stuck. Once it is dead, the next
+            // look finds its mutex so.
+            unsigned int limit = header()->timeLimit;
+            if(locked == EBUSY && limit && monotonicTime() - s->started > 2ull * limit)
+               kill(life(s->worker)->pid, SIGKILL);
+            return;
+         }
+         pthread_mutex_consistent(&s->running);
+         unsigned int expected = Running;
+         bool claimed = s->state.compare_exchange_strong(expected, Filling);
+         pthread_mutex_unlock(&s->running);
+         if(!claimed)
+            return;
+      }
+      else if(st == Queued)
+      {
+         // Nobody will take it once every worker is gone.
+         unsigned int expected = Queued;
+         if(workersAlive() || !s->state.compare_exchange_strong(expected, Filling))
+            return;
+      }
+      else
+         return;
+      s->status = Failed;
+      s->steps = 0;
+      s->state.store(Served);
+      sem_post(&s->done);
+   }
+
+   void PlanService::release(int ticket)
+   {
+      if(!valid(ticket))
+         return;
+      Slot *s = slot(ticket);
+      if(s->state.load() != Served)
+         wait(ticket);
+      while(!sem_trywait(&s->done));
+      s->state.store(Free);
+   }
+
+   void PlanService::serve(const ActionOverlay *overlay, unsigned int worker)
+   {
+      Header *h = header();
+      const CompiledDomain *dom = overlay->getDomain();
+      std::map<const Action*, unsigned int> index;
+      for(unsigned int i = 0; i < dom->numActions(); i++)
+         index[dom->getAction(i)] = i;
+      // One Planner for every request, so that its caches stay warm.
+      Planner planner;
+      planner.setOverlay(overlay);
+      unsigned int room = mResultBytes / sizeof(unsigned int);
+
+      while(true)
+      {
+         struct timespec t = deadline(PollInterval);
+         if(sem_timedwait(&h->work, &t))
+         {
+            // Once our owner dies we are handed to another parent.
+            if(getppid() != h->owner)
+               break;
+            continue;
+         }
+         if(h->quit.load())
+            break;
+         // The request is on the ring before the semaphore is posted.
+         unsigned int i;
+         while(!dequeue(i))
+            std::this_thread::yield();
+         Slot *s = slot(i);
+         // A client may have given up on it already, and the ring may hold
+         // a slot more than once if it was given up and then reused.
+         // A worker may have died holding it after serving its last slot.
+         if(pthread_mutex_lock(&s->running) == EOWNERDEAD)
+            pthread_mutex_consistent(&s->running);
+         // Clients only look at these once they see the slot Running.
+         s->worker = worker;
+         s->started = monotonicTime();
+         unsigned int expected = Queued;
+         if(!s->state.compare_exchange_strong(expected, Running))
+         {
+            pthread_mutex_unlock(&s->running);
+            continue;
+         }
+         s->steps = 0;
+
+         WorldState start, goal;
+         ByteReader r(request(s), s->requestSize);
+         if(s->requestSize > mRequestBytes || s->heuristic > SetLevelHeuristic ||
+            !start.deserialize(r) || !goal.deserialize(r) || !r.done())
+            s->status = BadRequest;
+         else
+         {
+            planner.setStart(&start);
+            planner.setGoal(&goal);
+            planner.setHeuristic((PlannerHeuristic)s->heuristic);
+            bool late = false;
+            if(planner.initSlicedPlan())
+            {
+               while(planner.updateSlicedPlan())
+               {
+                  if(h->timeLimit && monotonicTime() - s->started >= h->timeLimit)
+                  {
+                     late = true;
+                     break;
+                  }
+               }
+               planner.finaliseSlicedPlan();
+            }
+            if(!planner.success())
+               s->status = late? TimedOut: NoPlan;
+            else
+            {
+               // Write the plan straight into the slot.
+               const Plan &plan = planner.getPlan();
+               unsigned int *out = (unsigned int*)(request(s) + mRequestBytes);
+               unsigned int pos = plan.size();
+               s->status = pos <= room? Planned: TooLong;
+               Plan::const_iterator it;
+               unsigned int j = 0;
+               for(it = plan.begin(); it != plan.end() && s->status == Planned; it++, j++)
+               {
+                  const objects &params = it->params;
+                  if(pos + 2 + params.size() > room)
+                  {
+                     s->status = TooLong;
+                     break;
+                  }
+                  out[j] = pos;
+                  out[pos++] = index[it->ac];
+                  out[pos++] = params.size();
+                  for(unsigned int k = 0; k < params.size(); k++)
+                     out[pos++] = params[k];
+               }
+               if(s->status == Planned)
+                  s->steps = plan.size();
+            }
+         }
+         s->state.store(Served);
+         pthread_mutex_unlock(&s->running);
+         sem_post(&s->done);
+      }
+   }
+
+   bool PlanService::enqueue(unsigned int s)
+   {
+      Header *h = header();
+      unsigned int pos = h->tail.load();
+      while(true)
+      {
+         Cell *c = cell(pos & (mSlots - 1));
+         int diff = (int)(c->seq.load() - pos);
+         if(!diff)
+         {
+            if(h->tail.compare_exchange_weak(pos, pos + 1))
+            {
+               c->slot = s;
+               c->seq.store(pos + 1);
+               return true;
+            }
+         }
+         else if(diff < 0)
+            return false;
+         else
+            pos = h->tail.load();
+      }
+   }
+
+   bool PlanService::dequeue(unsigned int &s)
+   {
+      Header *h = header();
+      unsigned int pos = h->head.load();
+      while(true)
+      {
+         Cell *c = cell(pos & (mSlots - 1));
+         int diff = (int)(c->seq.load() - (pos + 1));
+         if(!diff)
+         {
+            if(h->head.compare_exchange_weak(pos, pos + 1))
+            {
+               s = c->slot;
+               c->seq.store(pos + mSlots);
+               return true;
+            }
+         }
+         else if(diff < 0)
+            return false;
+         else
+            pos = h->head.load();
+      }
+   }
+#else
+   struct PlanService::Header {};
+   struct PlanService::Life {};
+   struct PlanService::Slot { std::atomic<unsigned int> state; unsigned int status, steps; };
+
+   PlanService::Cell *PlanService::cell(unsigned int i) const { return NULL; }
+   unsigned char *PlanService::request(Slot *s) { return (unsigned char*)s; }
+   PlanService::Slot *PlanService::slot(unsigned int i) const { return NULL; }
+   bool PlanService::map(int fd, size_t size) { return false; }
+   bool PlanService::start(const std::string &name, const ActionOverlay *overlay, unsigned int workers) { return false; }
+   bool PlanService::connect(const std::string &name, const CompiledDomain *dom) { return false; }
+   void PlanService::stop() {}
+   int PlanService::submit(const WorldState &start, const WorldState &goal, PlannerHeuristic h) { return -1; }
+   bool PlanService::wait(int ticket, int ms) { return false; }
+   void PlanService::reap(Slot *s) {}
+   PlanService::Life *PlanService::life(unsigned int i) const { return NULL; }
+   size_t PlanService::ringOffset(unsigned int workers) { return 0; }
+   bool PlanService::workersAlive() const { return false; }
+   bool PlanService::stale(const std::string &name) { return false; }
+   void PlanService::release(int ticket) {}
+   void PlanService::serve(const ActionOverlay *overlay, unsigned int worker) {}
+   bool PlanService::enqueue(unsigned int s) { return false; }
+   bool PlanService::dequeue(unsigned int &s) { return false; }
+#endif
+
+   bool PlanService::done(int ticket) const
+   {
+      return valid(ticket) && slot(ticket)->state.load() == Served;
+   }
+
+   PlanService::Status PlanService::status(int ticket) const
+   {
+      return done(ticket)? (Status)slot(ticket)->status: BadRequest;
+   }
+
+   unsigned int PlanService::numSteps(int ticket) const
+   {
+      return status(ticket) == Planned? slot(ticket)->steps: 0;
+   }
+
+   PlanService::Step PlanService::getStep(int ticket, unsigned int i) const
+   {
+      Step step;
+      step.action = 0;
+      step.numParams = 0;
+      step.params = NULL;
+      if(i >= numSteps(ticket))
+         return step;
+      Slot *s = slot(ticket);
+      const unsigned int *words = (const unsigned int*)(request(s) + mRequestBytes);
+      const unsigned int *at = words + words[i];
+      step.action = at[0];
+      step.numParams = at[1];
+      step.params = at + 2;
+      return step;
+   }
+
+   bool PlanService::getPlan(int ticket, Plan &plan) const
+   {
+      plan.clear();
+      if(status(ticket) != Planned)
+         return false;
+      for(unsigned int i = 0; i < numSteps(ticket); i++)
+      {
+         Step step = getStep(ticket, i);
+         if(step.action >= mDomain->numActions())
+            return false;
+         plan.push_back(ActionEntry());
+         plan.back().ac = mDomain->getAction(step.action);
+         plan.back().params.assign(step.params, step.params + step.numParams);
+      }
+      return true;
+   }
+};
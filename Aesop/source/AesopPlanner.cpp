@@ -1,277 +1,1423 @@
-/// @file AesopPlanner.cpp
-/// Implementation of Planner class as defined in AesopPlanner.h
-
-#include "AesopPlanner.h"
-
-#include <functional>
-#include <algorithm>
-#include <vector>
-#include <cmath>
-
-namespace Aesop {
-   /// @class Planner
-   ///
-   /// A Planner object actually performs plan queries on the world state.
-   /// It represents an entire planning state, with its own start and end
-   /// states and plan-specific data.
-   /// This will include, among other things, a set of vetoed Actions (for
-   /// example, Actions that we tried but failed in practis, and we now
-   /// want to exclude from our planning process temporarily).
-
-   Planner::Planner(const WorldState *start, const WorldState *goal, const WorldState *con, const ActionSet *set)
-   {
-      setStart(start);
-      setGoal(goal);
-      setActions(set);
-      setConstants(con);
-      mSuccess = false;
-      mId = 0;
-   }
-
-   Planner::Planner()
-   {
-      Planner(NULL, NULL, NULL, NULL);
-   }
-
-   Planner::~Planner()
-   {
-   }
-
-   void Planner::setStart(const WorldState *start)
-   {
-      mStart = start;
-   }
-
-   void Planner::setGoal(const WorldState *goal)
-   {
-      mGoal = goal;
-   }
-
-   void Planner::setConstants(const WorldState *con)
-   {
-      mConstants = con;
-   }
-
-   void Planner::setActions(const ActionSet *set)
-   {
-      mActions = set;
-   }
-
-   const Plan& Planner::getPlan() const
-   {
-      return mPlan;
-   }
-
-   /// This method is actually just a wrapper for a series of calls to the
-   /// sliced planning methods.
-   bool Planner::plan(Context *ctx)
-   {
-      // Try to start planning.
-      if(!initSlicedPlan(ctx))
-         return false;
-
-      while(updateSlicedPlan(ctx)) ;
-
-      finaliseSlicedPlan(ctx);
-
-      return success();
-   }
-
-   bool Planner::initSlicedPlan(Context *ctx)
-   {
-      // Validate pointers.
-      if(!mStart || !mGoal || !mActions)
-      {
-         if(ctx) ctx->logEvent("Planning failed due to unset start, goal or action set!");
-         return false;
-      }
-
-      if(ctx) ctx->logEvent("Starting new plan.");
-
-      // Reset intermediate data.
-      mSuccess = false;
-      mOpenList.clear();
-      mClosedList.clear();
-      mId = 0;
-
-      // Push initial state onto the open list.
-      mOpenList.push_back(IntermediateState());
-      mOpenList.back().state = *mGoal;
-      mOpenList.back().ID = mId++;
-
-      return true;
-   }
-
-   void Planner::finaliseSlicedPlan(Context *ctx)
-   {
-      if(ctx) ctx->logEvent("Finalising plan!");
-      // Work backwards up the closed list to get the final plan.
-      mPlan.clear();
-      if(success())
-      {
-         unsigned int i = mClosedList.size() - 1;
-         while(i)
-         {
-            // Extract the Action performed at this step.
-            mPlan.push_back(ActionEntry());
-            mPlan.back().ac = mClosedList[i].ac;
-            mPlan.back().params = mClosedList[i].params;
-            // Iterate.
-            i = mClosedList[i].prev;
-         }
-      }
-      // Purge intermediate results.
-      mOpenList.clear();
-      mClosedList.clear();
-   }
-
-   bool Planner::updateSlicedPlan(Context *ctx)
-   {
-      // Main loop of A* search.
-      if(!mOpenList.empty())
-      {
-         // Remove best IntermediateState from open list.
-         pop_heap(mOpenList.begin(), mOpenList.end(), std::greater<IntermediateState>());
-         IntermediateState s = mOpenList.back();
-         mOpenList.pop_back();
-
-         if(ctx) ctx->logEvent("Moving state %d from open to closed.", s.ID);
-
-         // Add to closed list.
-         mClosedList.push_back(s);
-
-         // Check for completeness.
-         //if(s.state == *mStart)
-         if(!WorldState::compStart(s.state,*mStart))
-         {
-            mSuccess = true;
-            return false;
-         }
-
-         // Find all actions we can use that may result in the current state.
-         ActionSet::const_iterator it;
-         for(it = mActions->begin(); it != mActions->end(); it++)
-         {
-            const Action *ac = it->first;
-            if(!ac)
-               continue;
-            paramset params;
-            // Get number of params and create a set of paramlists.
-            unsigned int nparams = ac->getNumParams();
-            if(nparams && mObjects.size())
-            {
-               // Permute defined objects to feed as parameters.
-               unsigned int permutations = (unsigned int)pow((float)mObjects.size(), (float)nparams);
-               // Number of argument permutations we can make with our objects.
-               params.resize(permutations);
-               // Keeps track of the current
-               std::vector<unsigned int> objs(nparams, 0);
-               for(unsigned int i = 0; i < permutations; i++)
-               {
-                  // Number of arguments in this permutation.
-                  params[i].resize(nparams);
-                  // Copy objects into permutation.
-                  unsigned int j;
-                  for(j = 0; j < nparams; j++)
-                     params[i][j] = mObjects[objs[j]];
-                  // Increment and overflow.
-                  unsigned int obj = ++objs[--j];
-                  while(obj == mObjects.size() && j > 0)
-                  {
-                     objs[j] = 0;
-                     j--;
-                     objs[j]++;
-                  }
-               }
-               // Loop on the parameter set and try all permutations.
-               paramset::iterator pit;
-               for(pit = params.begin(); pit != params.end(); pit++)
-                  attemptIntermediate(ctx, s, *ac, it->second, *pit);
-            }
-            else
-            {
-               objects temp;
-               attemptIntermediate(ctx, s, *ac, it->second, temp);
-            }
-         }
-      }
-      else
-         return false;
-
-      return true;
-   }
-
-   void Planner::attemptIntermediate(Context *ctx, IntermediateState &s, const Action &ac, float pref, objects &plist)
-   {
-      if(!s.state.postMatch(ac, plist))
-         return;
-
-      IntermediateState n;
-      // Copy the current state, then apply the Action to it in reverse to get
-      // the previous state.
-      n.state = s.state;
-      n.state.applyReverse(ac, plist);
-
-      closedlist::const_iterator cli;
-      // Check to see if the world state is in the closed list.
-      bool found = false;
-      for(cli = mClosedList.begin(); cli != mClosedList.end(); cli++)
-      {
-         if(n.state == cli->state)
-         {
-            found = true;
-            break;
-         }
-      }
-      if(found)
-         return;
-
-      // H (heuristic) cost is the estimated number of Actions to get from new
-      // state to start.
-      n.H = (float)WorldState::comp(n.state, *mStart);
-      // G cost is the total weight of all Actions we've taken to get to this
-      // state. By default, the cost of an Action is 1.
-      n.G = s.G + ac.getCost() * pref;
-      // Save this to avoid recalculating every time.
-      n.F = n.G + n.H;
-      // Remember Action we used to to this state.
-      n.ac = &ac;
-      n.params = plist;
-      // Predecessor is the last state to be added to the closed list.
-      n.prev = mClosedList.size() - 1;
-
-      openlist::iterator oli;
-      // Check to see if the world state is already in the open list.
-      for(oli = mOpenList.begin(); oli != mOpenList.end(); oli++)
-      {
-         if(n.state == oli->state)
-         {
-            if(n < *oli)
-            {
-               // We've found a more efficient way of getting here.
-               *oli = n;
-               // Reorder the heap.
-               make_heap(mOpenList.begin(), mOpenList.end(),
-                  std::greater<IntermediateState>());
-
-               if(ctx) ctx->logEvent("Updating state %d to F=%f",
-                  oli->ID, oli->G + oli->H);
-            }
-            break;
-         }
-      }
-      // No match found in open list.
-      if(oli == mOpenList.end())
-      {
-         // Give the state an ID.
-         n.ID = mId++;
-         // Add the new intermediate state to the open list.
-         mOpenList.push_back(n);
-         // Heapify open list.
-         push_heap(mOpenList.begin(), mOpenList.end(), std::greater<IntermediateState>());
-
-         if(ctx) ctx->logEvent("Pushing new state %d %s via action %s onto open list with score F=%.3f.",
-            n.ID, n.state.str().c_str(), ac.str(n.params).c_str(), n.G + n.H);
-      }
-   }
-};
+/// @file AesopPlanner.cpp
+/// Implementation of Planner class as defined in AesopPlanner.h
+
+#include "AesopPlanner.h"
+
+#include <functional>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <string>
+#include <cmath>
+
+namespace Aesop {
+   /// @class Planner
+   ///
+   /// A Planner object actually performs plan queries on the world state.
+   /// It represents an entire planning state, with its own start and end
+   /// states and plan-specific data.
+   /// This will include, among other things, a set of vetoed Actions (for
+   /// example, Actions that we tried but failed in practis, and we now
+   /// want to exclude from our planning process temporarily).
+
+   Planner::Planner(const WorldState *start, const WorldState *goal, const WorldState *con, const ActionSet *set)
+   {
+      setStart(start);
+      setGoal(goal);
+      setActions(set);
+      setConstants(con);
+      mDomain = NULL;
+      mSharedDomain = NULL;
+      mPlanDomain = NULL;
+      mSharedStart = NULL;
+      mPlanStart = NULL;
+      mOverlay = mPlanOverlay = NULL;
+      mOwnOverlay = NULL;
+      mOwnOverlayRevision = 0;
+      mHeuristic = mPlanHeuristic = RelevantCostHeuristic;
+      mSearchMode = mPlanMode = AStarSearch;
+      mMaxDepth = 0;
+      mBeamWidth = 16;
+      mBeamRestarts = 0;
+      mPool = NULL;
+      mExpansionBatch = 1;
+      mSplitExpansion = false;
+      mSplitState = NULL;
+      mGroupStarts = NULL;
+      mResumed = false;
+      mSuccess = false;
+      mId = 0;
+   }
+
+   Planner::Planner()
+   {
+      setStart(NULL);
+      setGoal(NULL);
+      setActions(NULL);
+      setConstants(NULL);
+      mDomain = NULL;
+      mSharedDomain = NULL;
+      mPlanDomain = NULL;
+      mSharedStart = NULL;
+      mPlanStart = NULL;
+      mOverlay = mPlanOverlay = NULL;
+      mOwnOverlay = NULL;
+      mOwnOverlayRevision = 0;
+      mHeuristic = mPlanHeuristic = RelevantCostHeuristic;
+      mSearchMode = mPlanMode = AStarSearch;
+      mMaxDepth = 0;
+      mBeamWidth = 16;
+      mBeamRestarts = 0;
+      mPool = NULL;
+      mExpansionBatch = 1;
+      mSplitExpansion = false;
+      mSplitState = NULL;
+      mGroupStarts = NULL;
+      mResumed = false;
+      mSuccess = false;
+      mId = 0;
+   }
+
+   Planner::~Planner()
+   {
+      releasePlanVersions();
+      delete mOwnOverlay;
+      for(unsigned int i = 0; i < mBatchPlanners.size(); i++)
+         delete mBatchPlanners[i];
+   }
+
+   void Planner::setStart(const WorldState *start)
+   {
+      mStart = start;
+      mBeliefStart = NULL;
+   }
+
+   void Planner::setBeliefStart(const BeliefState *start)
+   {
+      mStart = NULL;
+      mBeliefStart = start;
+   }
+
+   /// A BeliefState is compared through its iterator and lookups, so that
+   /// the world it shares is never copied.
+   unsigned int Planner::compToStart(const WorldState &state) const
+   {
+      const BeliefState *bs = beliefStart();
+      if(!bs)
+         return WorldState::comp(state, start());
+      if(state.hash() != bs->hash())
+         return 1;
+      WorldState::const_iterator a = state.begin();
+      BeliefState::const_iterator b = bs->begin();
+      for(; a != state.end() && b != bs->end(); a++, b++)
+      {
+         if(!(a->first == b->first) || a->second != b->second)
+            return 1;
+      }
+      return a == state.end() && b == bs->end()? 0: 1;
+   }
+
+   unsigned int Planner::compStartToStart(const WorldState &state) const
+   {
+      const BeliefState *bs = beliefStart();
+      if(!bs)
+         return WorldState::compStart(state, start());
+      unsigned int score = 0;
+      WorldState::const_iterator it;
+      for(it = state.begin(); it != state.end(); it++)
+      {
+         PVal val;
+         if(bs->get(it->first, val) && val != it->second)
+            score++;
+      }
+      return score;
+   }
+
+   void Planner::setSharedStart(const WorldStore *start)
+   {
+      mSharedStart = start;
+   }
+
+   void Planner::setGoal(const WorldState *goal)
+   {
+      mGoal = goal;
+   }
+
+   void Planner::setConstants(const WorldState *con)
+   {
+      mConstants = con;
+   }
+
+   void Planner::setActions(const ActionSet *set)
+   {
+      mActions = set;
+      mOwnOverlayRevision = 0;
+   }
+
+   void Planner::setDomain(const CompiledDomain *dom)
+   {
+      mDomain = dom;
+   }
+
+   void Planner::setSharedDomain(const SharedDomain *dom)
+   {
+      mSharedDomain = dom;
+   }
+
+   void Planner::setOverlay(const ActionOverlay *overlay)
+   {
+      mOverlay = overlay;
+   }
+
+   void Planner::releasePlanVersions()
+   {
+      if(mPlanDomain)
+         mPlanDomain->release();
+      mPlanDomain = NULL;
+      mPlanOverlay = NULL;
+      if(mPlanStart)
+         mPlanStart->release();
+      mPlanStart = NULL;
+      mResumed = false;
+   }
+
+   const Plan& Planner::getPlan() const
+   {
+      return mPlan;
+   }
+
+   /// This method is actually just a wrapper for a series of calls to the
+   /// sliced planning methods.
+   bool Planner::plan(Context *ctx)
+   {
+      // Try to start planning.
+      if(!initSlicedPlan(ctx))
+         return false;
+
+      while(updateSlicedPlan(ctx)) ;
+
+      finaliseSlicedPlan(ctx);
+
+      return success();
+   }
+
+   bool Planner::initSlicedPlan(Context *ctx)
+   {
+      // Validate pointers.
+      if((!mStart && !mBeliefStart && !mSharedStart) || !mGoal || (!mActions && !mOverlay))
+      {
+         if(ctx) ctx->logEvent("Planning failed due to unset start, goal or action set!");
+         return false;
+      }
+
+      if(ctx) ctx->logEvent("Starting new plan.");
+
+      releasePlanVersions();
+      if(mSharedStart)
+         mPlanStart = mSharedStart->acquire();
+      preparePlan(ctx, mHeuristic);
+
+      // Reset intermediate data.
+      mSuccess = false;
+      mOpenList.clear();
+      mClosedList.clear();
+      mClosedSet.clear();
+      mId = 0;
+
+      mPlanMode = mSearchMode;
+      if(mPlanMode == FrontierSearch)
+      {
+         // The first bound is the goal's own estimate.
+         IntermediateState root;
+         root.state = *mGoal;
+         root.ID = mId++;
+         root.H = mPlanDomain? estimate(root.state): (float)compToStart(root.state);
+         frontierStart(mFrontier, root, NULL, root.H, -1.0f, 0, true);
+         if(root.H < 0.0f)
+         {
+            mFrontier.cur.clear();
+            mFrontier.deepen = false;
+         }
+         return true;
+      }
+      if(mPlanMode == BeamSearch)
+      {
+         beamStart(mBeamWidth, mBeamRestarts);
+         return true;
+      }
+
+      // Push initial state onto the open list.
+      mOpenList.push_back(IntermediateState());
+      mOpenList.back().state = *mGoal;
+      mOpenList.back().ID = mId++;
+
+      return true;
+   }
+
+   /// The start must already be chosen, since the graph based heuristics
+   /// grow their graph from it.
+   void Planner::preparePlan(Context *ctx, PlannerHeuristic h)
+   {
+      // Pin the domain version this plan will use until it is finalised.
+      if(mOverlay)
+      {
+         mPlanDomain = mOverlay->getDomain();
+         mPlanDomain->acquire();
+      }
+      else if(mSharedDomain)
+         mPlanDomain = mSharedDomain->acquire();
+      else if(mDomain)
+      {
+         mPlanDomain = mDomain;
+         mPlanDomain->acquire();
+      }
+
+      // Express our ActionSet over the domain, unless we already have for
+      // this version of the domain and of the ActionSet.
+      if(mOverlay)
+         mPlanOverlay = mOverlay;
+      else if(mPlanDomain)
+      {
+         if(!mOwnOverlay || mOwnOverlay->getDomain()->version() != mPlanDomain->version() ||
+            mOwnOverlayRevision != mActions->revision())
+         {
+            delete mOwnOverlay;
+            mOwnOverlay = new ActionOverlay(mPlanDomain, *mActions);
+            mOwnOverlayRevision = mActions->revision();
+            // The new overlay may reuse the old one's address.
+            mGraph.clear();
+         }
+         mPlanOverlay = mOwnOverlay;
+      }
+
+      // Graph based heuristics start a new graph only if the start changed.
+      mPlanHeuristic = RelevantCostHeuristic;
+      if(mPlanDomain && h != RelevantCostHeuristic &&
+         mPlanDomain->getGrounding() == EagerGrounding)
+      {
+         mPlanHeuristic = h;
+         if(beliefStart())
+            beliefStart()->flatten(mFlatStart);
+         const WorldState &from = beliefStart()? mFlatStart: start();
+         if(!mGraph.reset(*mPlanDomain, mPlanOverlay, from, PlanningGraph::OpenWorld))
+         {
+            if(ctx) ctx->logEvent("Reusing planning graph.");
+         }
+         if(mGraph.tooLarge())
+         {
+            if(ctx) ctx->logEvent("Planning graph too large; using the relevant cost heuristic.");
+            mPlanHeuristic = RelevantCostHeuristic;
+         }
+      }
+   }
+
+   void Planner::finaliseSlicedPlan(Context *ctx)
+   {
+      if(ctx) ctx->logEvent("Finalising plan!");
+      // Work backwards up the closed list to get the final plan.
+      mPlan.clear();
+      if(success() && mPlanMode == FrontierSearch)
+      {
+         // Search again under the same bound, through relay states.
+         std::vector<IntermediateState> steps;
+         if(frontierPath(ctx, mFrontier.root, NULL, mFrontier.bound, -1.0f, mFrontier.foundDepth, steps))
+         {
+            for(unsigned int i = 0; i < steps.size(); i++)
+            {
+               mPlan.push_back(ActionEntry());
+               mPlan.back().ac = steps[i].ac;
+               mPlan.back().params = steps[i].params;
+            }
+         }
+         else
+         {
+            if(ctx) ctx->logEvent("Could not rebuild the plan!");
+            mSuccess = false;
+         }
+      }
+      else if(success() && mPlanMode == BeamSearch)
+      {
+         // Each state knows its parent in the depth before.
+         unsigned int i = mBeam.found;
+         for(unsigned int d = mBeam.foundDepth; d > 0; d--)
+         {
+            const IntermediateState &s = mBeam.layers[d].nodes[i];
+            mPlan.push_back(ActionEntry());
+            mPlan.back().ac = s.ac;
+            mPlan.back().params = s.params;
+            i = s.prev;
+         }
+      }
+      else if(success())
+         tracePlan(mClosedList.size() - 1, mPlan);
+      // Purge intermediate results.
+      mOpenList.clear();
+      mClosedList.clear();
+      mClosedSet.clear();
+      mFrontier = Frontier();
+      mBeam = Beam();
+      releasePlanVersions();
+   }
+
+   void Planner::tracePlan(unsigned int i, Plan &plan) const
+   {
+      plan.clear();
+      while(i)
+      {
+         // Extract the Action performed at this step.
+         plan.push_back(ActionEntry());
+         plan.back().ac = mClosedList[i].ac;
+         plan.back().params = mClosedList[i].params;
+         // Iterate.
+         i = mClosedList[i].prev;
+      }
+   }
+
+   /// First word of every checkpoint: 'AESP' when read as text.
+   static const unsigned int CheckpointMagic = 0x50534541;
+   /// Changes whenever the checkpoint layout does.
+   static const unsigned int CheckpointVersion = 1;
+   /// Written in place of a GroundAction ID for states reached without one.
+   static const unsigned int NoOperator = 0xffffffff;
+
+   /// A checkpoint holds a header, our objects and the start state, then
+   /// the open list in heap order and the closed list in order, so that a
+   /// resumed plan expands the same states as one that never stopped.
+   /// GroundActions are recorded by ID as well as by Action and parameters;
+   /// the ID is only trusted if it names the same Action and parameters in
+   /// the resuming Planner's domain.
+   bool Planner::saveSlicedPlan(std::vector<unsigned char> &out) const
+   {
+      if(mPlanMode != AStarSearch || (mOpenList.empty() && mClosedList.empty()))
+         return false;
+
+      ByteWriter w(out);
+      w.putInt(CheckpointMagic);
+      w.putInt(CheckpointVersion);
+      w.putByte(mPlanDomain != NULL);
+      w.putByte(mSuccess);
+      w.putInt(mPlanHeuristic);
+      w.putInt(mId);
+      w.putInt(mObjects.size());
+      for(unsigned int i = 0; i < mObjects.size(); i++)
+         w.putInt(mObjects[i]);
+      if(beliefStart())
+      {
+         WorldState flat;
+         beliefStart()->flatten(flat);
+         flat.serialize(w);
+      }
+      else
+         start().serialize(w);
+
+      saveStates(w, mOpenList);
+      saveStates(w, mClosedList);
+      return true;
+   }
+
+   template<typename List>
+   void Planner::saveStates(ByteWriter &w, const List &list)
+   {
+      w.putInt(list.size());
+      typename List::const_iterator s;
+      for(s = list.begin(); s != list.end(); s++)
+      {
+         w.putInt(s->ID);
+         w.putInt(s->prev);
+         w.putFloat(s->G);
+         w.putFloat(s->H);
+         w.putFloat(s->F);
+         w.putString(s->ac? s->ac->getName(): std::string());
+         w.putInt(s->params.size());
+         for(unsigned int i = 0; i < s->params.size(); i++)
+            w.putInt(s->params[i]);
+         w.putInt(s->op? s->op->ID: NoOperator);
+         s->state.serialize(w);
+      }
+   }
+
+   bool Planner::resumeSlicedPlan(const unsigned char *data, size_t size, Context *ctx)
+   {
+      if(!mActions && !mOverlay)
+      {
+         if(ctx) ctx->logEvent("Resuming failed due to unset action set!");
+         return false;
+      }
+
+      ByteReader r(data, size);
+      if(r.getInt() != CheckpointMagic || r.getInt() != CheckpointVersion)
+      {
+         if(ctx) ctx->logEvent("Resuming failed: not a plan checkpoint!");
+         return false;
+      }
+      bool grounded = r.getByte() != 0;
+      bool success = r.getByte() != 0;
+      PlannerHeuristic heuristic = (PlannerHeuristic)r.getInt();
+      unsigned int id = r.getInt();
+      objects objs(r.getCount(4));
+      for(unsigned int i = 0; i < objs.size(); i++)
+         objs[i] = r.getInt();
+      WorldState st;
+      if(!st.deserialize(r) || heuristic > SetLevelHeuristic)
+      {
+         if(ctx) ctx->logEvent("Resuming failed: checkpoint is damaged!");
+         return false;
+      }
+
+      if(ctx) ctx->logEvent("Resuming plan.");
+      releasePlanVersions();
+      mResumedStart = st;
+      mResumed = true;
+      preparePlan(ctx, heuristic);
+      if(grounded != (mPlanDomain != NULL))
+      {
+         if(ctx) ctx->logEvent("Resuming failed: checkpoint was made %s a CompiledDomain!",
+            grounded? "with": "without");
+         releasePlanVersions();
+         return false;
+      }
+
+      // Find Actions by name where the plan may have used them.
+      std::map<std::string, const Action*> names;
+      if(mPlanDomain)
+      {
+         for(unsigned int i = 0; i < mPlanDomain->numActions(); i++)
+            names[mPlanDomain->getAction(i)->getName()] = mPlanDomain->getAction(i);
+      }
+      else
+      {
+         ActionSet::const_iterator it;
+         for(it = mActions->begin(); it != mActions->end(); it++)
+         {
+            if(it->first)
+               names[it->first->getName()] = it->first;
+         }
+      }
+
+      // The smallest state takes this many bytes.
+      const size_t minState = 5 * 4 + 4 + 4 + 4 + 4;
+      std::vector<IntermediateState> lists[2];
+      bool ok = true;
+      for(unsigned int l = 0; l < 2 && ok && r.ok(); l++)
+      {
+         lists[l].resize(r.getCount(minState));
+         std::vector<IntermediateState>::iterator s;
+         for(s = lists[l].begin(); s != lists[l].end() && ok && r.ok(); s++)
+         {
+            s->ID = r.getInt();
+            s->prev = r.getInt();
+            s->G = r.getFloat();
+            s->H = r.getFloat();
+            s->F = r.getFloat();
+            std::string name = r.getString();
+            s->params.resize(r.getCount(4));
+            for(unsigned int i = 0; i < s->params.size(); i++)
+               s->params[i] = r.getInt();
+            unsigned int op = r.getInt();
+            ok = s->state.deserialize(r);
+            if(!ok || name.empty())
+               continue;
+            std::map<std::string, const Action*>::const_iterator n = names.find(name);
+            if(n == names.end())
+            {
+               if(ctx) ctx->logEvent("Resuming failed: checkpoint uses unknown action %s!", name.c_str());
+               releasePlanVersions();
+               return false;
+            }
+            s->ac = n->second;
+            if(mPlanDomain && op != NoOperator && op < mPlanDomain->numOperators())
+            {
+               const GroundAction &ga = mPlanDomain->getOperator(op);
+               if(ga.ac == s->ac && ga.params == s->params)
+                  s->op = &ga;
+            }
+         }
+      }
+      // Every state must lead back to one in the closed list.
+      for(unsigned int l = 0; l < 2 && ok; l++)
+      {
+         std::vector<IntermediateState>::const_iterator s;
+         for(s = lists[l].begin(); s != lists[l].end() && ok; s++)
+            ok = s->prev < lists[1].size() || (!s->prev && lists[1].empty());
+      }
+      if(!ok || !r.ok() || !r.done())
+      {
+         if(ctx) ctx->logEvent("Resuming failed: checkpoint is damaged!");
+         releasePlanVersions();
+         return false;
+      }
+
+      mOpenList.swap(lists[0]);
+      mClosedList.assign(lists[1].begin(), lists[1].end());
+      mClosedSet.clear();
+      for(unsigned int i = 0; i < mClosedList.size(); i++)
+         mClosedSet.insert(mClosedList[i].state, mClosedList[i].G, i);
+      mPlanMode = AStarSearch;
+      mSuccess = success;
+      mId = id;
+      mObjects = objs;
+      if(ctx) ctx->logEvent("Resumed plan with %d open and %d closed states.",
+         (int)mOpenList.size(), (int)mClosedList.size());
+      return true;
+   }
+
+   /// Answers the groups of a planBatch, each with whichever of the
+   /// Planner's batch Planners is free.
+   class GroupTask : public ThreadPool::Task {
+   public:
+      GroupTask(Planner &planner, const ActionOverlay *overlay)
+         : mPlanner(planner), mOverlay(overlay) {}
+
+      void run(unsigned int i)
+      {
+         Planner *p;
+         {
+            std::lock_guard<std::mutex> lock(mPlanner.mBatchLock);
+            p = mPlanner.mIdlePlanners.back();
+            mPlanner.mIdlePlanners.pop_back();
+         }
+         p->planGroup(mPlanner, mPlanner.mGroups[i], mOverlay);
+         {
+            std::lock_guard<std::mutex> lock(mPlanner.mBatchLock);
+            mPlanner.mIdlePlanners.push_back(p);
+         }
+      }
+
+   private:
+      Planner &mPlanner;
+      const ActionOverlay *mOverlay;
+   };
+
+   /// The domain and overlay are pinned here, once for the whole batch,
+   /// without touching those of a sliced plan that may be in progress.
+   unsigned int Planner::planBatch(BatchRequest *requests, unsigned int count, Context *ctx)
+   {
+      for(unsigned int i = 0; i < count; i++)
+      {
+         requests[i].success = false;
+         requests[i].plan.clear();
+      }
+      if(!mActions && !mOverlay)
+      {
+         if(ctx) ctx->logEvent("Batch planning failed due to unset action set!");
+         return 0;
+      }
+
+      const CompiledDomain *dom = NULL;
+      if(mOverlay)
+      {
+         dom = mOverlay->getDomain();
+         dom->acquire();
+      }
+      else if(mSharedDomain)
+         dom = mSharedDomain->acquire();
+      else if(mDomain)
+      {
+         dom = mDomain;
+         dom->acquire();
+      }
+      const ActionOverlay *overlay = mOverlay;
+      ActionOverlay *batchOverlay = NULL;
+      if(!overlay && dom)
+      {
+         if(mOwnOverlay && mOwnOverlay->getDomain()->version() == dom->version() &&
+            mOwnOverlayRevision == mActions->revision())
+            overlay = mOwnOverlay;
+         else
+            overlay = batchOverlay = new ActionOverlay(dom, *mActions);
+      }
+
+      // Requests for the same goal can share a search, if it uses a domain.
+      mGroups.clear();
+      std::multimap<unsigned long long, unsigned int> goals;
+      for(unsigned int i = 0; i < count; i++)
+      {
+         if(!requests[i].start || !requests[i].goal)
+            continue;
+         unsigned int g = mGroups.size();
+         if(overlay)
+         {
+            unsigned long long hash = requests[i].goal->hash64();
+            std::multimap<unsigned long long, unsigned int>::const_iterator it, end;
+            end = goals.upper_bound(hash);
+            for(it = goals.lower_bound(hash); it != end; it++)
+            {
+               if(*mGroups[it->second].front()->goal == *requests[i].goal)
+               {
+                  g = it->second;
+                  break;
+               }
+            }
+            if(g == mGroups.size())
+               goals.insert(std::make_pair(hash, g));
+         }
+         if(g == mGroups.size())
+            mGroups.push_back(std::vector<BatchRequest*>());
+         mGroups[g].push_back(&requests[i]);
+      }
+      if(ctx) ctx->logEvent("Planning %d requests in %d groups.", (int)count, (int)mGroups.size());
+
+      unsigned int threads = mPool? mPool->size(): 1;
+      while(mBatchPlanners.size() < threads)
+         mBatchPlanners.push_back(new Planner());
+      mIdlePlanners = mBatchPlanners;
+      GroupTask task(*this, overlay);
+      if(mPool && mGroups.size() > 1)
+         mPool->run(task, mGroups.size());
+      else
+      {
+         for(unsigned int i = 0; i < mGroups.size(); i++)
+            task.run(i);
+      }
+      mGroups.clear();
+
+      delete batchOverlay;
+      if(dom)
+         dom->release();
+      unsigned int found = 0;
+      for(unsigned int i = 0; i < count; i++)
+         found += requests[i].success;
+      return found;
+   }
+
+   void Planner::planGroup(const Planner &owner, std::vector<BatchRequest*> &group,
+      const ActionOverlay *overlay)
+   {
+      mHeuristic = owner.mHeuristic;
+      mSearchMode = owner.mSearchMode;
+      mMaxDepth = owner.mMaxDepth;
+      mBeamWidth = owner.mBeamWidth;
+      mBeamRestarts = owner.mBeamRestarts;
+      setOverlay(overlay);
+      if(!overlay)
+      {
+         setActions(owner.mActions);
+         setConstants(owner.mConstants);
+         mObjects = owner.mObjects;
+      }
+
+      if(group.size() == 1)
+      {
+         setStart(group[0]->start);
+         setGoal(group[0]->goal);
+         group[0]->success = plan();
+         group[0]->plan = mPlan;
+         return;
+      }
+
+      // One A* search back from the goal serves every start: a state's cost
+      // from the goal does not depend on which start we are heading for.
+      releasePlanVersions();
+      mPlanDomain = overlay->getDomain();
+      mPlanDomain->acquire();
+      mPlanOverlay = overlay;
+      mPlanHeuristic = RelevantCostHeuristic;
+      mPlanMode = AStarSearch;
+      std::vector<BatchRequest*> waiting(group);
+      std::vector<const WorldState*> starts;
+      for(unsigned int i = 0; i < waiting.size(); i++)
+         starts.push_back(waiting[i]->start);
+      mGroupStarts = &starts;
+
+      mOpenList.clear();
+      mClosedList.clear();
+      mClosedSet.clear();
+      mId = 0;
+      mOpenList.push_back(IntermediateState());
+      mOpenList.back().state = *group[0]->goal;
+      mOpenList.back().ID = mId++;
+
+      while(!waiting.empty() && !mOpenList.empty())
+      {
+         pop_heap(mOpenList.begin(), mOpenList.end(), std::greater<IntermediateState>());
+         mClosedList.push_back(mOpenList.back());
+         mOpenList.pop_back();
+         const IntermediateState &s = mClosedList.back();
+         unsigned int i = mClosedList.size() - 1;
+         mClosedSet.insert(s.state, s.G, i);
+
+         // Every start this state reaches has its plan.
+         for(unsigned int j = 0; j < waiting.size(); )
+         {
+            if(!WorldState::compStart(s.state, *starts[j]))
+            {
+               tracePlan(i, waiting[j]->plan);
+               waiting[j]->success = true;
+               waiting.erase(waiting.begin() + j);
+               starts.erase(starts.begin() + j);
+            }
+            else
+               j++;
+         }
+         if(waiting.empty())
+            break;
+
+         expand(s, mSuccessors);
+         for(unsigned int j = 0; j < mSuccessors.size(); j++)
+            pushIntermediate(NULL, mSuccessors[j], i);
+      }
+
+      mGroupStarts = NULL;
+      mOpenList.clear();
+      mClosedList.clear();
+      mClosedSet.clear();
+      releasePlanVersions();
+   }
+
+   /// Expands each of a Planner's batch of states into its own list.
+   class ExpandTask : public ThreadPool::Task {
+   public:
+      ExpandTask(Planner &planner) : mPlanner(planner) {}
+
+      void run(unsigned int i)
+      {
+         std::vector<const GroundAction*> candidates;
+         mPlanner.expand(mPlanner.mBatch[i], mPlanner.mBatchSuccessors[i], candidates);
+      }
+
+   private:
+      Planner &mPlanner;
+   };
+
+   bool Planner::updateSlicedPlan(Context *ctx)
+   {
+      if(mPlanMode == FrontierSearch)
+      {
+         FrontierStatus status = frontierStep(ctx, mFrontier);
+         mSuccess = status == FrontierFound;
+         return status == FrontierRunning;
+      }
+      if(mPlanMode == BeamSearch)
+      {
+         FrontierStatus status = beamStep(ctx);
+         mSuccess = status == FrontierFound;
+         return status == FrontierRunning;
+      }
+
+      // Main loop of A* search.
+      if(mOpenList.empty())
+         return false;
+
+      // Move the best IntermediateStates from the open list to the closed
+      // list.
+      unsigned int first = mClosedList.size();
+      mBatch.clear();
+      while(!mOpenList.empty() && mBatch.size() < mExpansionBatch)
+      {
+         pop_heap(mOpenList.begin(), mOpenList.end(), std::greater<IntermediateState>());
+         IntermediateState s = mOpenList.back();
+         mOpenList.pop_back();
+
+         // Check for completeness.
+         //if(s.state == start())
+         bool found = !compStartToStart(s.state);
+         if(found && !mBatch.empty())
+         {
+            // The states taken before it may lead here more cheaply, so
+            // finish expanding them first.
+            mOpenList.push_back(s);
+            push_heap(mOpenList.begin(), mOpenList.end(), std::greater<IntermediateState>());
+            break;
+         }
+
+         if(ctx) ctx->logEvent("Moving state %d from open to closed.", s.ID);
+
+         // Add to closed list.
+         mClosedList.push_back(s);
+         mClosedSet.insert(mClosedList.back().state, s.G, mClosedList.size() - 1);
+         if(found)
+         {
+            mSuccess = true;
+            return false;
+         }
+         mBatch.push_back(s);
+      }
+
+      // Queue every state that may lead to them.
+      mBatchSuccessors.resize(mBatch.size());
+      if(mPool && mBatch.size() > 1)
+      {
+         // Workers may only read the planning graph.
+         if(mPlanHeuristic != RelevantCostHeuristic)
+            mGraph.build();
+         ExpandTask task(*this);
+         mPool->run(task, mBatch.size());
+      }
+      else
+      {
+         for(unsigned int i = 0; i < mBatch.size(); i++)
+            expand(mBatch[i], mBatchSuccessors[i]);
+      }
+      for(unsigned int i = 0; i < mBatch.size(); i++)
+      {
+         std::vector<IntermediateState> &succ = mBatchSuccessors[i];
+         for(unsigned int j = 0; j < succ.size(); j++)
+            pushIntermediate(ctx, succ[j], first + i);
+      }
+
+      return true;
+   }
+
+   void Planner::expand(const IntermediateState &s, std::vector<IntermediateState> &out,
+      std::vector<const GroundAction*> &candidates)
+   {
+      out.clear();
+      // Find all GroundActions that may result in the current state.
+      if(mPlanDomain)
+      {
+         mPlanDomain->candidates(s.state, candidates);
+         std::vector<const GroundAction*>::const_iterator op;
+         for(op = candidates.begin(); op != candidates.end(); op++)
+         {
+            if(mPlanOverlay->allows(**op))
+               attemptIntermediate(s, **op, mPlanOverlay->cost(**op), out);
+         }
+         return;
+      }
+
+      // Find all actions we can use that may result in the current state.
+      ActionSet::const_iterator it;
+      paramset params;
+      for(it = mActions->begin(); it != mActions->end(); it++)
+      {
+         const Action *ac = it->first;
+         if(!ac)
+            continue;
+         // Loop on the parameter set and try all permutations.
+         groundings(*ac, params);
+         paramset::iterator pit;
+         for(pit = params.begin(); pit != params.end(); pit++)
+            attemptIntermediate(s, *ac, it->second, *pit, out);
+      }
+   }
+
+   void Planner::groundings(const Action &ac, paramset &params) const
+   {
+      params.clear();
+      // Get number of params and create a set of paramlists.
+      unsigned int nparams = ac.getNumParams();
+      if(!nparams || !mObjects.size())
+      {
+         params.resize(1);
+         return;
+      }
+      // Permute defined objects to feed as parameters.
+      unsigned int permutations = (unsigned int)pow((float)mObjects.size(), (float)nparams);
+      // Number of argument permutations we can make with our objects.
+      params.resize(permutations);
+      // Keeps track of the current
+      std::vector<unsigned int> objs(nparams, 0);
+      for(unsigned int i = 0; i < permutations; i++)
+      {
+         // Number of arguments in this permutation.
+         params[i].resize(nparams);
+         // Copy objects into permutation.
+         unsigned int j;
+         for(j = 0; j < nparams; j++)
+            params[i][j] = mObjects[objs[j]];
+         // Increment and overflow.
+         unsigned int obj = ++objs[--j];
+         while(obj == mObjects.size() && j > 0)
+         {
+            objs[j] = 0;
+            j--;
+            objs[j]++;
+         }
+      }
+   }
+
+   /// Tries one contiguous share of a Planner's split expansion.
+   class SplitTask : public ThreadPool::Task {
+   public:
+      SplitTask(Planner &planner, unsigned int items)
+         : mPlanner(planner), mItems(items) {}
+
+      void run(unsigned int i)
+      {
+         unsigned int pieces = mPlanner.mPieces.size();
+         unsigned int begin = (unsigned long)mItems * i / pieces;
+         unsigned int end = (unsigned long)mItems * (i + 1) / pieces;
+         mPlanner.expandRange(begin, end, mPlanner.mPieces[i]);
+      }
+
+   private:
+      Planner &mPlanner;
+      unsigned int mItems;
+   };
+
+   void Planner::expand(const IntermediateState &s, std::vector<IntermediateState> &out)
+   {
+      if(!mPool || !mSplitExpansion || mPool->size() < 2)
+      {
+         expand(s, out, mCandidates);
+         return;
+      }
+
+      // List everything to try, then share it out in contiguous ranges so
+      // that the pieces put back together are in the usual order.
+      unsigned int items;
+      if(mPlanDomain)
+      {
+         mPlanDomain->candidates(s.state, mCandidates);
+         items = mCandidates.size();
+      }
+      else
+      {
+         mAttempts.clear();
+         ActionSet::const_iterator it;
+         paramset params;
+         for(it = mActions->begin(); it != mActions->end(); it++)
+         {
+            if(!it->first)
+               continue;
+            groundings(*it->first, params);
+            for(unsigned int i = 0; i < params.size(); i++)
+            {
+               mAttempts.push_back(Attempt());
+               mAttempts.back().ac = it->first;
+               mAttempts.back().pref = it->second;
+               mAttempts.back().params.swap(params[i]);
+            }
+         }
+         items = mAttempts.size();
+      }
+
+      out.clear();
+      unsigned int pieces = std::min(items, 4 * mPool->size());
+      if(!pieces)
+         return;
+      // Workers may only read the planning graph.
+      if(mPlanHeuristic != RelevantCostHeuristic)
+         mGraph.build();
+      mSplitState = &s;
+      mPieces.resize(pieces);
+      SplitTask task(*this, items);
+      mPool->run(task, pieces);
+      for(unsigned int i = 0; i < pieces; i++)
+         out.insert(out.end(), mPieces[i].begin(), mPieces[i].end());
+   }
+
+   void Planner::expandRange(unsigned int begin, unsigned int end, std::vector<IntermediateState> &out)
+   {
+      out.clear();
+      for(unsigned int i = begin; i < end; i++)
+      {
+         if(mPlanDomain)
+         {
+            const GroundAction &op = *mCandidates[i];
+            if(mPlanOverlay->allows(op))
+               attemptIntermediate(*mSplitState, op, mPlanOverlay->cost(op), out);
+         }
+         else
+         {
+            Attempt &at = mAttempts[i];
+            attemptIntermediate(*mSplitState, *at.ac, at.pref, at.params, out);
+         }
+      }
+   }
+
+   /// Costs summed in a different order may differ in their last bits, so
+   /// bounds are given a little slack.
+   static float slack(float bound)
+   {
+      return 1e-4f * (bound > 1.0f? bound: 1.0f);
+   }
+
+   void Planner::attemptIntermediate(const IntermediateState &s, const Action &ac, float pref, objects &plist,
+      std::vector<IntermediateState> &out)
+   {
+      if(!s.state.postMatch(ac, plist))
+         return;
+
+      IntermediateState n;
+      // Copy the current state, then apply the Action to it in reverse to get
+      // the previous state.
+      n.state = s.state;
+      n.state.applyReverse(ac, plist);
+      // G cost is the total weight of all Actions we've taken to get to this
+      // state. By default, the cost of an Action is 1.
+      n.G = s.G + ac.getCost() * pref;
+      // Closed states would only be dropped later, so don't estimate them.
+      if(closedAsCheap(n))
+         return;
+
+      // H (heuristic) cost is the estimated number of Actions to get from new
+      // state to start.
+      n.H = (float)compToStart(n.state);
+      // Remember Action we used to to this state.
+      n.ac = &ac;
+      n.params = plist;
+
+      out.push_back(n);
+   }
+
+   void Planner::attemptIntermediate(const IntermediateState &s, const GroundAction &op, float cost,
+      std::vector<IntermediateState> &out)
+   {
+      if(!s.state.postMatch(op))
+         return;
+
+      IntermediateState n;
+      n.state = s.state;
+      n.state.applyReverse(op);
+      n.G = s.G + cost;
+      if(closedAsCheap(n))
+         return;
+
+      // A negative heuristic means the state can never reach the start.
+      n.H = estimate(n.state);
+      if(n.H < 0.0f)
+         return;
+      n.ac = op.ac;
+      n.params = op.params;
+      n.op = &op;
+
+      out.push_back(n);
+   }
+
+   float Planner::estimate(const WorldState &state)
+   {
+      switch(mPlanHeuristic)
+      {
+      case MaxCostHeuristic:
+         return mGraph.maxCost(state);
+      case SetLevelHeuristic:
+      {
+         int level = mGraph.setLevel(state);
+         return level < 0? -1.0f: level * mGraph.minCost();
+      }
+      default:
+         if(mGroupStarts)
+         {
+            // The nearest start bounds the cost to every other.
+            float best = -1.0f;
+            for(unsigned int i = 0; i < mGroupStarts->size(); i++)
+            {
+               float h = mPlanOverlay->heuristic(state, *(*mGroupStarts)[i]);
+               if(h >= 0.0f && (best < 0.0f || h < best))
+                  best = h;
+            }
+            return best;
+         }
+         if(beliefStart())
+         {
+            // As CompiledDomain::heuristic, with lookups in the BeliefState.
+            float h = 0.0f;
+            WorldState::const_iterator it;
+            for(it = state.begin(); it != state.end(); it++)
+            {
+               PVal val;
+               if(!beliefStart()->get(it->first, val) || val == it->second)
+                  continue;
+               float cost = mPlanOverlay->changeCost(it->first, it->second);
+               if(cost < 0.0f)
+                  return -1.0f;
+               h = std::max(h, cost);
+            }
+            return h;
+         }
+         return mPlanOverlay->heuristic(state, start());
+      }
+   }
+
+   bool Planner::closedAsCheap(const IntermediateState &n) const
+   {
+      float g;
+      return mClosedSet.find(n.state, &g) && g <= n.G + slack(n.G);
+   }
+
+   /// A closed state reached more cheaply than before is opened again, so
+   /// that its cheaper path reaches the states after it; this only happens
+   /// with expansion batches or heuristics that are not consistent.
+   void Planner::pushIntermediate(Context *ctx, IntermediateState &n, unsigned int prev)
+   {
+      // Check to see if the world state is in the closed list.
+      if(closedAsCheap(n))
+         return;
+
+      // Save this to avoid recalculating every time.
+      n.F = n.G + n.H;
+      n.prev = prev;
+
+      openlist::iterator oli;
+      // Check to see if the world state is already in the open list.
+      for(oli = mOpenList.begin(); oli != mOpenList.end(); oli++)
+      {
+         if(n.state == oli->state)
+         {
+            if(n < *oli)
+            {
+               // We've found a more efficient way of getting here.
+               *oli = n;
+               // Reorder the heap.
+               make_heap(mOpenList.begin(), mOpenList.end(),
+                  std::greater<IntermediateState>());
+
+               if(ctx) ctx->logEvent("Updating state %d to F=%f",
+                  oli->ID, oli->G + oli->H);
+            }
+            break;
+         }
+      }
+      // No match found in open list.
+      if(oli == mOpenList.end())
+      {
+         // Give the state an ID.
+         n.ID = mId++;
+         // Add the new intermediate state to the open list.
+         mOpenList.push_back(n);
+         // Heapify open list.
+         push_heap(mOpenList.begin(), mOpenList.end(), std::greater<IntermediateState>());
+
+         if(ctx) ctx->logEvent("Pushing new state %d %s via action %s onto open list with score F=%.3f.",
+            n.ID, n.state.str().c_str(), n.ac->str(n.params).c_str(), n.G + n.H);
+      }
+   }
+
+   int Planner::Layer::find(const WorldState &state) const
+   {
+      std::multimap<unsigned int, unsigned int>::const_iterator it, end;
+      end = index.upper_bound(state.hash());
+      for(it = index.lower_bound(state.hash()); it != end; it++)
+      {
+         if(nodes[it->second].state == state)
+            return it->second;
+      }
+      return -1;
+   }
+
+   void Planner::Layer::add(const IntermediateState &n)
+   {
+      index.insert(std::make_pair(n.state.hash(), (unsigned int)nodes.size()));
+      nodes.push_back(n);
+   }
+
+   void Planner::Layer::clear()
+   {
+      nodes.clear();
+      index.clear();
+   }
+
+   void Planner::Layer::swap(Layer &other)
+   {
+      nodes.swap(other.nodes);
+      index.swap(other.index);
+   }
+
+   void Planner::frontierStart(Frontier &f, const IntermediateState &root, const WorldState *target,
+      float bound, float limit, unsigned int relayDepth, bool deepen)
+   {
+      if(&f.root != &root)
+         f.root = root;
+      f.root.F = f.root.G + f.root.H;
+      f.root.prev = 0;
+      f.target = target;
+      f.bound = bound;
+      f.limit = limit;
+      f.relayDepth = relayDepth;
+      f.deepen = deepen;
+      f.last.clear();
+      f.cur.clear();
+      f.next.clear();
+      f.relay.clear();
+      f.cur.add(f.root);
+      f.depth = f.pos = 0;
+      f.nextBound = -1.0f;
+   }
+
+   /// States are only compared with the depths before, at and after their
+   /// own. In a regression graph a state can come round again at a deeper
+   /// depth, in which case it is expanded again; the bound keeps this
+   /// finite as long as no cycle of Actions is free.
+   Planner::FrontierStatus Planner::frontierStep(Context *ctx, Frontier &f)
+   {
+      if(f.pos == f.cur.nodes.size())
+      {
+         if(f.next.nodes.empty())
+         {
+            // Nothing is left under this bound.
+            if(!f.deepen || f.nextBound < 0.0f)
+               return FrontierFailed;
+            if(ctx) ctx->logEvent("Raising bound to F=%.3f.", f.nextBound);
+            frontierStart(f, f.root, f.target, f.nextBound, f.limit, f.relayDepth, true);
+            return FrontierRunning;
+         }
+         f.last.swap(f.cur);
+         f.cur.swap(f.next);
+         f.next.clear();
+         f.depth++;
+         f.pos = 0;
+         if(f.depth == f.relayDepth)
+            f.relay = f.cur.nodes;
+         return FrontierRunning;
+      }
+
+      const IntermediateState &s = f.cur.nodes[f.pos++];
+      if(ctx) ctx->logEvent("Expanding state %d at depth %d.", s.ID, f.depth);
+      if(f.target? s.state == *f.target: !compStartToStart(s.state))
+      {
+         f.found = s;
+         f.foundDepth = f.depth;
+         return FrontierFound;
+      }
+      if(mMaxDepth && f.depth >= mMaxDepth)
+         return FrontierRunning;
+
+      expand(s, mSuccessors);
+      bool relay = f.depth + 1 == f.relayDepth;
+      for(unsigned int i = 0; i < mSuccessors.size(); i++)
+      {
+         IntermediateState &n = mSuccessors[i];
+         n.F = n.G + n.H;
+         if(n.F > f.bound + slack(f.bound))
+         {
+            if(f.nextBound < 0.0f || n.F < f.nextBound)
+               f.nextBound = n.F;
+            continue;
+         }
+         if(f.limit >= 0.0f && n.G > f.limit + slack(f.limit))
+            continue;
+
+         // Skip states we have already reached as cheaply.
+         int j = f.last.find(n.state);
+         if(j >= 0 && f.last.nodes[j].G <= n.G)
+            continue;
+         j = f.cur.find(n.state);
+         if(j >= 0 && f.cur.nodes[j].G <= n.G)
+            continue;
+         n.prev = s.prev;
+         j = f.next.find(n.state);
+         if(j >= 0)
+         {
+            if(n.G < f.next.nodes[j].G)
+            {
+               if(relay)
+                  n.prev = j;
+               n.ID = f.next.nodes[j].ID;
+               f.next.nodes[j] = n;
+            }
+            continue;
+         }
+         if(relay)
+            n.prev = f.next.nodes.size();
+         n.ID = mId++;
+         f.next.add(n);
+      }
+      return FrontierRunning;
+   }
+
+   /// Each call searches from the root with the relay depth halfway to the
+   /// known depth, then solves the two halves on either side of the relay
+   /// state the same way, so the whole plan takes a number of searches
+   /// logarithmic in its length.
+   bool Planner::frontierPath(Context *ctx, const IntermediateState &root, const WorldState *target,
+      float bound, float limit, unsigned int depth, std::vector<IntermediateState> &steps)
+   {
+      if(!depth)
+         return true;
+      Frontier f;
+      frontierStart(f, root, target, bound, limit, depth / 2, false);
+      FrontierStatus status;
+      while((status = frontierStep(NULL, f)) == FrontierRunning) ;
+      if(status != FrontierFound)
+         return false;
+      if(f.foundDepth == 1)
+      {
+         steps.push_back(f.found);
+         return true;
+      }
+      // A shallower path than expected may have turned up.
+      if(f.foundDepth <= f.relayDepth)
+         return frontierPath(ctx, root, target, bound, limit, f.foundDepth, steps);
+
+      IntermediateState mid = f.relay[f.found.prev];
+      unsigned int below = f.relayDepth, above = f.foundDepth - f.relayDepth;
+      f = Frontier();
+      if(ctx) ctx->logEvent("Rebuilding plan through state %d at depth %d.", mid.ID, below);
+      return frontierPath(ctx, mid, target, bound, limit, above, steps) &&
+         frontierPath(ctx, root, &mid.state, bound, mid.G, below, steps);
+   }
+
+   void Planner::beamStart(unsigned int width, unsigned int restarts)
+   {
+      mBeam.layers.assign(1, Layer());
+      mBeam.next.clear();
+      mBeam.pos = 0;
+      mBeam.width = width;
+      mBeam.restarts = restarts;
+      IntermediateState root;
+      root.state = *mGoal;
+      root.ID = mId++;
+      mBeam.layers[0].add(root);
+   }
+
+   /// Successors are compared with the deepest two layers and with each
+   /// other, keeping the cheapest way to each state. Once a layer is
+   /// expanded, the successors are sorted by F, ties going to those found
+   /// first, and all but the best are dropped.
+   Planner::FrontierStatus Planner::beamStep(Context *ctx)
+   {
+      unsigned int depth = mBeam.layers.size() - 1;
+      Layer &cur = mBeam.layers[depth];
+      if(mBeam.pos == cur.nodes.size())
+      {
+         if(mBeam.next.nodes.empty() || (mMaxDepth && depth >= mMaxDepth))
+         {
+            if(!mBeam.restarts)
+               return FrontierFailed;
+            if(ctx) ctx->logEvent("Restarting beam with width %d.", 2 * mBeam.width);
+            beamStart(2 * mBeam.width, mBeam.restarts - 1);
+            return FrontierRunning;
+         }
+         std::vector<IntermediateState> best;
+         best.swap(mBeam.next.nodes);
+         mBeam.next.clear();
+         std::stable_sort(best.begin(), best.end());
+         if(best.size() > mBeam.width)
+            best.resize(mBeam.width);
+         mBeam.layers.push_back(Layer());
+         for(unsigned int i = 0; i < best.size(); i++)
+            mBeam.layers.back().add(best[i]);
+         mBeam.pos = 0;
+         return FrontierRunning;
+      }
+
+      unsigned int pos = mBeam.pos++;
+      const IntermediateState &s = cur.nodes[pos];
+      if(ctx) ctx->logEvent("Expanding state %d at depth %d.", s.ID, depth);
+      if(!compStartToStart(s.state))
+      {
+         mBeam.foundDepth = depth;
+         mBeam.found = pos;
+         return FrontierFound;
+      }
+      if(mMaxDepth && depth >= mMaxDepth)
+         return FrontierRunning;
+
+      expand(s, mSuccessors);
+      const Layer *last = depth? &mBeam.layers[depth-1]: NULL;
+      for(unsigned int i = 0; i < mSuccessors.size(); i++)
+      {
+         IntermediateState &n = mSuccessors[i];
+         n.prev = pos;
+         int j;
+         if(last && (j = last->find(n.state)) >= 0 && last->nodes[j].G <= n.G)
+            continue;
+         if((j = cur.find(n.state)) >= 0 && cur.nodes[j].G <= n.G)
+            continue;
+         j = mBeam.next.find(n.state);
+         if(j >= 0)
+         {
+            if(n.G < mBeam.next.nodes[j].G)
+            {
+               n.ID = mBeam.next.nodes[j].ID;
+               mBeam.next.nodes[j] = n;
+            }
+            continue;
+         }
+         n.ID = mId++;
+         mBeam.next.add(n);
+      }
+      return FrontierRunning;
+   }
+};
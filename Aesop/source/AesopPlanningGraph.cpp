@@ -0,0 +1,545 @@
+/// @file AesopPlanningGraph.cpp
+/// Implementation of PlanningGraph class as defined in AesopPlanningGraph.h
+
+#include "AesopPlanningGraph.h"
+
+#include <algorithm>
+
+namespace Aesop {
+   /// @class PlanningGraph
+   ///
+   /// Atoms, nodes and both kinds of mutex are kept as bitsets. Two nodes
+   /// are mutex if they interfere, or if any of their conditions are mutex
+   /// at their fact level (competing needs). Two atoms are mutex if every
+   /// pair of nodes adding them is. Atoms of the same Fact are always mutex.
+   /// Mutexes only ever disappear as levels are added, so only pairs that
+   /// were mutex before, or that involve new atoms, are checked again.
+
+   bool PlanningGraph::Bits::intersects(const Bits &o) const
+   {
+      for(unsigned int i = 0; i < mWords.size(); i++)
+      {
+         if(mWords[i] & o.mWords[i])
+            return true;
+      }
+      return false;
+   }
+
+   bool PlanningGraph::Bits::missing(const Bits &o) const
+   {
+      for(unsigned int i = 0; i < mWords.size(); i++)
+      {
+         if(o.mWords[i] & ~mWords[i])
+            return true;
+      }
+      return false;
+   }
+
+   PlanningGraph::Bits &PlanningGraph::Bits::operator|=(const Bits &o)
+   {
+      for(unsigned int i = 0; i < mWords.size(); i++)
+         mWords[i] |= o.mWords[i];
+      return *this;
+   }
+
+   PlanningGraph::Bits &PlanningGraph::Bits::operator&=(const Bits &o)
+   {
+      for(unsigned int i = 0; i < mWords.size(); i++)
+         mWords[i] &= o.mWords[i];
+      return *this;
+   }
+
+   int PlanningGraph::Bits::next(unsigned int i) const
+   {
+      unsigned int w = i / WordBits;
+      if(w >= mWords.size())
+         return -1;
+      unsigned long bits = mWords[w] & (~0ul << (i % WordBits));
+      while(!bits)
+      {
+         if(++w == mWords.size())
+            return -1;
+         bits = mWords[w];
+      }
+      unsigned int b = 0;
+      while(!((bits >> b) & 1))
+         b++;
+      return w * WordBits + b;
+   }
+
+   PlanningGraph::PlanningGraph()
+   {
+      mDomain = NULL;
+      mOverlay = NULL;
+      mMode = ClosedWorld;
+      mMinCost = 0.0f;
+      mLeveled = false;
+      mCostSettled = false;
+      mNodeLimit = 4096;
+      mTooLarge = false;
+   }
+
+   PlanningGraph::~PlanningGraph()
+   {
+      clear();
+   }
+
+   void PlanningGraph::clear()
+   {
+      if(mDomain)
+         mDomain->release();
+      mDomain = NULL;
+      mOverlay = NULL;
+      mFirst.clear();
+      mValues.clear();
+      mAtomFact.clear();
+      mNodes.clear();
+      mConsumers.clear();
+      mProducers.clear();
+      mInterferes.clear();
+      mLevels.clear();
+      mCost.clear();
+      mLeveled = false;
+      mCostSettled = false;
+      mTooLarge = false;
+   }
+
+   void PlanningGraph::setNodeLimit(unsigned int nodes)
+   {
+      if(nodes != mNodeLimit)
+         clear();
+      mNodeLimit = nodes;
+   }
+
+   int PlanningGraph::atom(FactID id, int value) const
+   {
+      for(unsigned int a = mFirst[id]; a < mFirst[id+1]; a++)
+      {
+         if(mValues[a] == value)
+            return a;
+      }
+      return -1;
+   }
+
+   bool PlanningGraph::reset(const CompiledDomain &dom, const ActionOverlay *overlay,
+      const WorldState &start, StartMode mode)
+   {
+      if(mDomain && mDomain->version() == dom.version() && mOverlay == overlay &&
+         mMode == mode && mStart == start)
+         return false;
+
+      clear();
+      mDomain = &dom;
+      mDomain->acquire();
+      mOverlay = overlay;
+      mStart = start;
+      mMode = mode;
+      if(!compile(dom))
+      {
+         // Keep what we were built from, so the same reset gives up at once.
+         mTooLarge = true;
+         mNodes.clear();
+         mConsumers.clear();
+         mProducers.clear();
+         mInterferes.clear();
+         return true;
+      }
+
+      // The first level holds the start, and no mutexes.
+      unsigned int na = mValues.size();
+      Level first;
+      first.atoms.resize(na);
+      Bits none;
+      none.resize(na);
+      first.mutex.assign(na, none);
+      for(FactID f = 0; f + 1 < mFirst.size(); f++)
+      {
+         if(mFirst[f] == mFirst[f+1])
+            continue;
+         PVal v;
+         int value = -1;
+         if(start.get(dom.getFact(f), v) || dom.getConstants().get(dom.getFact(f), v))
+            value = v;
+         first.atoms.set(atom(f, value));
+      }
+      mLevels.push_back(first);
+      return true;
+   }
+
+   bool PlanningGraph::compile(const CompiledDomain &dom)
+   {
+      std::vector<std::vector<int> > values;
+      dom.reachableValues(mStart, mOverlay, values);
+      unsigned int n = values.size();
+      mFirst.resize(n + 1);
+      for(FactID f = 0; f < n; f++)
+      {
+         mFirst[f] = mValues.size();
+         PVal v;
+         if(mMode == OpenWorld && !mStart.get(dom.getFact(f), v))
+            continue;
+         mValues.insert(mValues.end(), values[f].begin(), values[f].end());
+         mAtomFact.insert(mAtomFact.end(), values[f].size(), f);
+      }
+      mFirst[n] = mValues.size();
+      unsigned int na = mValues.size();
+
+      // One no-op per atom.
+      if(na > mNodeLimit)
+         return false;
+      mNodes.resize(na);
+      for(unsigned int a = 0; a < na; a++)
+      {
+         mNodes[a].ga = NULL;
+         mNodes[a].cost = 0.0f;
+         mNodes[a].pre.assign(1, a);
+         mNodes[a].add.assign(1, a);
+      }
+
+      mMinCost = -1.0f;
+      for(unsigned int i = 0; i < dom.numOperators(); i++)
+      {
+         const GroundAction &ga = dom.getOperator(i);
+         if(mOverlay && !mOverlay->allows(ga))
+            continue;
+         Node node;
+         node.ga = &ga;
+         node.cost = mOverlay? mOverlay->cost(ga): ga.cost;
+
+         // Facts whose starting value matters get one choice per value;
+         // fixed effects do not depend on any.
+         std::vector<const GroundOperation*> choices;
+         std::vector<std::vector<unsigned int> > options;
+         bool possible = true;
+         groundops::const_iterator gop;
+         for(gop = ga.ops.begin(); gop != ga.ops.end() && possible; gop++)
+         {
+            FactID f = gop->id;
+            if(mFirst[f] == mFirst[f+1])
+               continue;
+            std::vector<unsigned int> allowed;
+            for(unsigned int a = mFirst[f]; a < mFirst[f+1]; a++)
+            {
+               if(CompiledDomain::holds(gop->op, mValues[a]))
+                  allowed.push_back(a);
+            }
+            possible = !allowed.empty();
+            bool depends = gop->op.etype == Increment || gop->op.etype == Decrement;
+            if(depends || allowed.size() < mFirst[f+1] - mFirst[f])
+            {
+               choices.push_back(&*gop);
+               options.push_back(allowed);
+            }
+            else if(gop->op.etype != NoEffect)
+               node.add.push_back(atom(f, CompiledDomain::apply(gop->op, -1)));
+         }
+         if(!possible)
+            continue;
+         if(mMinCost < 0.0f || node.cost < mMinCost)
+            mMinCost = node.cost;
+
+         // Give up before making more nodes than the limit allows.
+         unsigned long long combinations = 1;
+         for(unsigned int c = 0; c < options.size() && combinations <= mNodeLimit; c++)
+            combinations *= options[c].size();
+         if(mNodes.size() + combinations > mNodeLimit)
+            return false;
+
+         // One node for every combination of choices.
+         std::vector<unsigned int> pick(choices.size(), 0);
+         while(true)
+         {
+            Node n = node;
+            for(unsigned int c = 0; c < choices.size(); c++)
+            {
+               unsigned int a = options[c][pick[c]];
+               n.pre.push_back(a);
+               if(choices[c]->op.etype != NoEffect)
+                  n.add.push_back(atom(choices[c]->id, CompiledDomain::apply(choices[c]->op, mValues[a])));
+            }
+            std::sort(n.pre.begin(), n.pre.end());
+            std::sort(n.add.begin(), n.add.end());
+            mNodes.push_back(n);
+            unsigned int c = choices.size();
+            while(c > 0 && ++pick[c-1] == options[c-1].size())
+               pick[--c] = 0;
+            if(!c)
+               break;
+         }
+      }
+      if(mMinCost < 0.0f)
+         mMinCost = 0.0f;
+
+      unsigned int nn = mNodes.size();
+      Bits none;
+      none.resize(nn);
+      mConsumers.assign(na, none);
+      mProducers.assign(na, none);
+      mInterferes.assign(nn, std::vector<unsigned int>());
+      // Per Fact, the nodes changing it and the nodes needing it.
+      std::vector<std::vector<std::pair<unsigned int, unsigned int> > > writers(n), readers(n);
+      for(unsigned int i = 0; i < nn; i++)
+      {
+         const Node &node = mNodes[i];
+         for(unsigned int j = 0; j < node.pre.size(); j++)
+         {
+            mConsumers[node.pre[j]].set(i);
+            readers[mAtomFact[node.pre[j]]].push_back(std::make_pair(i, node.pre[j]));
+         }
+         for(unsigned int j = 0; j < node.add.size(); j++)
+         {
+            mProducers[node.add[j]].set(i);
+            if(node.ga)
+               writers[mAtomFact[node.add[j]]].push_back(std::make_pair(i, node.add[j]));
+         }
+      }
+      for(FactID f = 0; f < n; f++)
+      {
+         for(unsigned int w = 0; w < writers[f].size(); w++)
+         {
+            unsigned int a = writers[f][w].first, value = writers[f][w].second;
+            for(unsigned int r = 0; r < readers[f].size(); r++)
+            {
+               unsigned int b = readers[f][r].first;
+               if(a != b && readers[f][r].second != value)
+               {
+                  mInterferes[a].push_back(b);
+                  mInterferes[b].push_back(a);
+               }
+            }
+            for(unsigned int r = 0; r < writers[f].size(); r++)
+            {
+               unsigned int b = writers[f][r].first;
+               if(a != b && writers[f][r].second != value)
+               {
+                  mInterferes[a].push_back(b);
+                  mInterferes[b].push_back(a);
+               }
+            }
+         }
+      }
+      // Nodes may share several Facts.
+      for(unsigned int i = 0; i < nn; i++)
+      {
+         std::vector<unsigned int> &v = mInterferes[i];
+         std::sort(v.begin(), v.end());
+         v.erase(std::unique(v.begin(), v.end()), v.end());
+      }
+      return true;
+   }
+
+   bool PlanningGraph::expand()
+   {
+      if(mLeveled || mLevels.empty())
+         return false;
+      unsigned int na = mValues.size(), nn = mNodes.size();
+      Level &cur = mLevels.back();
+
+      // Nodes whose conditions appear together.
+      cur.nodes.resize(nn);
+      for(unsigned int i = 0; i < nn; i++)
+      {
+         const std::vector<unsigned int> &pre = mNodes[i].pre;
+         bool ok = true;
+         for(unsigned int j = 0; j < pre.size() && ok; j++)
+         {
+            ok = cur.atoms.test(pre[j]);
+            for(unsigned int k = 0; k < j && ok; k++)
+               ok = !cur.mutex[pre[j]].test(pre[k]);
+         }
+         if(ok)
+            cur.nodes.set(i);
+      }
+      Bits noNodes;
+      noNodes.resize(nn);
+      cur.nodeMutex.assign(nn, noNodes);
+      Bits needs;
+      for(int i = cur.nodes.next(0); i >= 0; i = cur.nodes.next(i + 1))
+      {
+         const std::vector<unsigned int> &pre = mNodes[i].pre;
+         Bits &m = cur.nodeMutex[i];
+         for(unsigned int j = 0; j < mInterferes[i].size(); j++)
+            m.set(mInterferes[i][j]);
+         needs.resize(na);
+         for(unsigned int j = 0; j < pre.size(); j++)
+            needs |= cur.mutex[pre[j]];
+         for(int q = needs.next(0); q >= 0; q = needs.next(q + 1))
+            m |= mConsumers[q];
+         m &= cur.nodes;
+      }
+
+      // The next fact level.
+      Level next;
+      next.atoms = cur.atoms;
+      for(int i = cur.nodes.next(0); i >= 0; i = cur.nodes.next(i + 1))
+      {
+         for(unsigned int j = 0; j < mNodes[i].add.size(); j++)
+            next.atoms.set(mNodes[i].add[j]);
+      }
+      std::vector<Bits> achievers(na);
+      for(int p = next.atoms.next(0); p >= 0; p = next.atoms.next(p + 1))
+      {
+         achievers[p] = mProducers[p];
+         achievers[p] &= cur.nodes;
+      }
+      Bits noAtoms;
+      noAtoms.resize(na);
+      next.mutex.assign(na, noAtoms);
+      for(int p = next.atoms.next(0); p >= 0; p = next.atoms.next(p + 1))
+      {
+         for(int q = next.atoms.next(p + 1); q >= 0; q = next.atoms.next(q + 1))
+         {
+            if(cur.atoms.test(p) && cur.atoms.test(q) && !cur.mutex[p].test(q))
+               continue;
+            bool mutex = true;
+            const Bits &ap = achievers[p];
+            for(int a = ap.next(0); a >= 0 && mutex; a = ap.next(a + 1))
+               mutex = !cur.nodeMutex[a].missing(achievers[q]);
+            if(mutex)
+            {
+               next.mutex[p].set(q);
+               next.mutex[q].set(p);
+            }
+         }
+      }
+
+      if(next.atoms == cur.atoms && next.mutex == cur.mutex)
+      {
+         mLeveled = true;
+         return false;
+      }
+      mLevels.push_back(next);
+      mCostSettled = false;
+      return true;
+   }
+
+   bool PlanningGraph::atoms(const WorldState &state, std::vector<unsigned int> &out) const
+   {
+      out.clear();
+      WorldState::const_iterator it;
+      for(it = state.begin(); it != state.end(); it++)
+      {
+         PVal v;
+         bool defined = mStart.get(it->first, v) ||
+            (mMode == ClosedWorld && mDomain->getConstants().get(it->first, v));
+         FactID id = mDomain->find(it->first);
+         if(id == NullFact || mFirst[id] == mFirst[id+1])
+         {
+            // Nothing touches the Fact, or it is free.
+            if(mMode == ClosedWorld && (!defined || v != it->second))
+               return false;
+            if(mMode == OpenWorld && defined && v != it->second)
+               return false;
+            continue;
+         }
+         int a = atom(id, it->second);
+         if(a < 0)
+            return false;
+         out.push_back(a);
+      }
+      std::sort(out.begin(), out.end());
+      return true;
+   }
+
+   bool PlanningGraph::reachable(unsigned int lvl, const std::vector<unsigned int> &atoms) const
+   {
+      const Level &l = level(lvl);
+      for(unsigned int i = 0; i < atoms.size(); i++)
+      {
+         if(!l.atoms.test(atoms[i]))
+            return false;
+         for(unsigned int j = 0; j < i; j++)
+         {
+            if(l.mutex[atoms[i]].test(atoms[j]))
+               return false;
+         }
+      }
+      return true;
+   }
+
+   void PlanningGraph::settle()
+   {
+      if(mCostSettled)
+         return;
+      const Level &first = mLevels.front();
+      const Level &last = mLevels.back();
+      mCost.assign(mValues.size(), -1.0f);
+      for(int a = first.atoms.next(0); a >= 0; a = first.atoms.next(a + 1))
+         mCost[a] = 0.0f;
+      bool changed = true;
+      while(changed)
+      {
+         changed = false;
+         for(int i = last.nodes.next(0); i >= 0; i = last.nodes.next(i + 1))
+         {
+            const Node &node = mNodes[i];
+            if(!node.ga)
+               continue;
+            float c = 0.0f;
+            bool ok = true;
+            for(unsigned int j = 0; j < node.pre.size() && ok; j++)
+            {
+               ok = mCost[node.pre[j]] >= 0.0f;
+               c = std::max(c, mCost[node.pre[j]]);
+            }
+            if(!ok)
+               continue;
+            c += node.cost;
+            for(unsigned int j = 0; j < node.add.size(); j++)
+            {
+               float &old = mCost[node.add[j]];
+               if(old < 0.0f || c < old)
+               {
+                  old = c;
+                  changed = true;
+               }
+            }
+         }
+      }
+      mCostSettled = true;
+   }
+
+   void PlanningGraph::build()
+   {
+      if(mLevels.empty())
+         return;
+      while(expand());
+      settle();
+   }
+
+   float PlanningGraph::maxCost(const WorldState &state)
+   {
+      if(mTooLarge)
+         return 0.0f;
+      std::vector<unsigned int> need;
+      if(mLevels.empty() || !atoms(state, need))
+         return -1.0f;
+      while(expand());
+      settle();
+      float h = 0.0f;
+      for(unsigned int i = 0; i < need.size(); i++)
+      {
+         if(mCost[need[i]] < 0.0f)
+            return -1.0f;
+         h = std::max(h, mCost[need[i]]);
+      }
+      return h;
+   }
+
+   int PlanningGraph::setLevel(const WorldState &state)
+   {
+      if(mTooLarge)
+         return 0;
+      std::vector<unsigned int> need;
+      if(mLevels.empty() || !atoms(state, need))
+         return -1;
+      for(unsigned int l = 0; ; l++)
+      {
+         while(l >= mLevels.size() && expand());
+         if(l >= mLevels.size())
+            return -1;
+         if(reachable(l, need))
+            return l;
+      }
+   }
+};
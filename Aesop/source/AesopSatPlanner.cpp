@@ -0,0 +1,446 @@
+/// @file AesopSatPlanner.cpp
+/// Implementation of SatPlanner class as defined in AesopSatPlanner.h
+
+#include "AesopSatPlanner.h"
+
+#include <map>
+#include <set>
+
+namespace Aesop {
+   /// @class SatPlanner
+   ///
+   /// Each Fact gets one variable per value it can take (see
+   /// CompiledDomain::reachableValues) at every step, exactly one of which
+   /// is true. Facts that can only take one value get none. Each allowed
+   /// GroundAction gets one variable per step.
+   ///
+   /// A GroundAction at step t needs its conditions to hold at t and makes
+   /// its effects hold at t + 1. A Fact only changes between steps if some
+   /// GroundAction taken at that step changes it (explanatory frame
+   /// axioms). Two GroundActions are only taken in the same step if neither
+   /// affects a Fact the other uses, which makes every ordering of a step
+   /// equivalent (the 'for all' step semantics). The exception is
+   /// GroundActions that set a Fact to the same value without a condition
+   /// on it, which may share a step.
+
+   SatPlanner::SatPlanner(const CompiledDomain *dom, const WorldState *start, const WorldState *goal)
+   {
+      mDomain = dom;
+      mOverlay = NULL;
+      mStart = start;
+      mGoal = goal;
+      mMaxHorizon = 32;
+      mSuccess = false;
+      mHorizon = 0;
+      mStepVars = 0;
+   }
+
+   SatPlanner::~SatPlanner()
+   {
+   }
+
+   int SatPlanner::code(FactID id, int value) const
+   {
+      const std::vector<int> &vals = mFacts[id].values;
+      for(unsigned int c = 0; c < vals.size(); c++)
+      {
+         if(vals[c] == value)
+            return c;
+      }
+      return -1;
+   }
+
+   bool SatPlanner::compile(const CompiledDomain &dom, Context *ctx)
+   {
+      std::vector<std::vector<int> > values;
+      dom.reachableValues(*mStart, mOverlay, values);
+      unsigned int n = values.size();
+      mFacts.clear();
+      mFacts.resize(n);
+      mOps.clear();
+      mGoalCodes.clear();
+      mStepVars = 0;
+      for(FactID f = 0; f < n; f++)
+      {
+         SatFact &sf = mFacts[f];
+         sf.values.swap(values[f]);
+         sf.first = mStepVars;
+         if(sf.values.size() > 1)
+            mStepVars += sf.values.size();
+         PVal v;
+         int value = -1;
+         if(mStart->get(dom.getFact(f), v) || dom.getConstants().get(dom.getFact(f), v))
+            value = v;
+         sf.start = code(f, value);
+         sf.changers.resize(sf.values.size());
+      }
+
+      for(unsigned int i = 0; i < dom.numOperators(); i++)
+      {
+         const GroundAction &ga = dom.getOperator(i);
+         if(mOverlay && !mOverlay->allows(ga))
+            continue;
+         SatOp op;
+         op.ga = &ga;
+         bool possible = true;
+         groundops::const_iterator gop;
+         for(gop = ga.ops.begin(); gop != ga.ops.end() && possible; gop++)
+         {
+            const SatFact &sf = mFacts[gop->id];
+            if(gop->op.ctype != NoCondition)
+            {
+               std::vector<unsigned int> allowed;
+               for(unsigned int c = 0; c < sf.values.size(); c++)
+               {
+                  if(CompiledDomain::holds(gop->op, sf.values[c]))
+                     allowed.push_back(c);
+               }
+               possible = !allowed.empty();
+               if(allowed.size() < sf.values.size())
+                  op.pre.push_back(std::make_pair(gop->id, allowed));
+            }
+            // A Fact with one value is never changed.
+            if(gop->op.etype != NoEffect && sf.values.size() > 1)
+            {
+               std::vector<unsigned int> next(sf.values.size());
+               for(unsigned int c = 0; c < sf.values.size(); c++)
+                  next[c] = code(gop->id, CompiledDomain::apply(gop->op, sf.values[c]));
+               op.post.push_back(std::make_pair(gop->id, next));
+            }
+         }
+         if(possible)
+            mOps.push_back(op);
+      }
+
+      // Work out which operators interfere through each Fact. Operators
+      // that set a Fact to the same code without a condition on it share a
+      // group; every other operator affecting it has a group of its own.
+      std::vector<std::map<unsigned int, unsigned int> > shared(n);
+      for(unsigned int o = 0; o < mOps.size(); o++)
+      {
+         const SatOp &op = mOps[o];
+         std::set<FactID> changed;
+         for(unsigned int i = 0; i < op.post.size(); i++)
+         {
+            FactID f = op.post[i].first;
+            const std::vector<unsigned int> &next = op.post[i].second;
+            SatFact &sf = mFacts[f];
+            changed.insert(f);
+            bool constant = true;
+            for(unsigned int c = 0; c < next.size(); c++)
+            {
+               if(next[c] != c)
+                  sf.changers[c].push_back(o);
+               constant = constant && next[c] == next[0];
+            }
+            bool conditional = false;
+            for(unsigned int j = 0; j < op.pre.size(); j++)
+               conditional = conditional || op.pre[j].first == f;
+            if(constant && !conditional)
+            {
+               std::map<unsigned int, unsigned int>::iterator g = shared[f].find(next[0]);
+               if(g != shared[f].end())
+               {
+                  sf.groups[g->second].push_back(o);
+                  continue;
+               }
+               shared[f][next[0]] = sf.groups.size();
+            }
+            sf.groups.push_back(std::vector<unsigned int>(1, o));
+         }
+         for(unsigned int j = 0; j < op.pre.size(); j++)
+         {
+            if(!changed.count(op.pre[j].first))
+               mFacts[op.pre[j].first].readers.push_back(o);
+         }
+      }
+
+      // Goal Facts no operator touches must hold already.
+      WorldState::const_iterator it;
+      for(it = mGoal->begin(); it != mGoal->end(); it++)
+      {
+         FactID id = dom.find(it->first);
+         if(id == NullFact)
+         {
+            PVal v;
+            if(!mStart->get(it->first, v) && !dom.getConstants().get(it->first, v))
+               return false;
+            if(v != it->second)
+               return false;
+            continue;
+         }
+         int c = code(id, it->second);
+         if(c < 0)
+            return false;
+         if(mFacts[id].values.size() > 1)
+            mGoalCodes.push_back(std::make_pair(id, (unsigned int)c));
+      }
+
+      if(ctx) ctx->logEvent("Encoded %d Facts in %d variables per step, %d operators.",
+         (int)n, (int)mStepVars, (int)mOps.size());
+      return true;
+   }
+
+   /// The entry in a Plan for a GroundAction.
+   static ActionEntry entry(const GroundAction &ga)
+   {
+      ActionEntry e;
+      e.ac = ga.ac;
+      e.params = ga.params;
+      return e;
+   }
+
+   void SatPlanner::solve(unsigned int steps, const std::atomic<bool> *stop, Horizon &out) const
+   {
+      SatSolver s;
+      unsigned int nops = mOps.size();
+      // Fact f has code c at step t iff variable facts + t * mStepVars +
+      // mFacts[f].first + c is true; operator o is taken at step t iff
+      // variable ops + t * nops + o is.
+      unsigned int facts = s.newVars(mStepVars * (steps + 1));
+      unsigned int ops = s.newVars(nops * steps);
+
+      for(FactID f = 0; f < mFacts.size(); f++)
+      {
+         const SatFact &sf = mFacts[f];
+         if(sf.values.size() < 2)
+            continue;
+         for(unsigned int t = 0; t <= steps; t++)
+         {
+            std::vector<SatLit> one;
+            for(unsigned int c = 0; c < sf.values.size(); c++)
+               one.push_back(SatSolver::lit(facts + t * mStepVars + sf.first + c));
+            s.addClause(one);
+            s.addAtMostOne(one);
+         }
+         s.addClause(SatSolver::lit(facts + sf.first + sf.start));
+      }
+      for(unsigned int i = 0; i < mGoalCodes.size(); i++)
+      {
+         const SatFact &sf = mFacts[mGoalCodes[i].first];
+         s.addClause(SatSolver::lit(facts + steps * mStepVars + sf.first + mGoalCodes[i].second));
+      }
+
+      for(unsigned int t = 0; t < steps; t++)
+      {
+         unsigned int now = facts + t * mStepVars, next = now + mStepVars;
+         for(unsigned int o = 0; o < nops; o++)
+         {
+            const SatOp &op = mOps[o];
+            SatLit a = SatSolver::lit(ops + t * nops + o, false);
+            for(unsigned int i = 0; i < op.pre.size(); i++)
+            {
+               const SatFact &sf = mFacts[op.pre[i].first];
+               const std::vector<unsigned int> &allowed = op.pre[i].second;
+               std::vector<SatLit> cl(1, a);
+               for(unsigned int j = 0; j < allowed.size(); j++)
+                  cl.push_back(SatSolver::lit(now + sf.first + allowed[j]));
+               s.addClause(cl);
+            }
+            for(unsigned int i = 0; i < op.post.size(); i++)
+            {
+               const SatFact &sf = mFacts[op.post[i].first];
+               const std::vector<unsigned int> &codes = op.post[i].second;
+               bool constant = true;
+               for(unsigned int c = 1; c < codes.size(); c++)
+                  constant = constant && codes[c] == codes[0];
+               if(constant)
+                  s.addClause(a, SatSolver::lit(next + sf.first + codes[0]));
+               else
+               {
+                  for(unsigned int c = 0; c < codes.size(); c++)
+                     s.addClause(a, SatSolver::lit(now + sf.first + c, false),
+                        SatSolver::lit(next + sf.first + codes[c]));
+               }
+            }
+         }
+
+         for(FactID f = 0; f < mFacts.size(); f++)
+         {
+            const SatFact &sf = mFacts[f];
+            if(sf.values.size() < 2)
+               continue;
+            // A Fact keeps its code unless something changes it.
+            for(unsigned int c = 0; c < sf.values.size(); c++)
+            {
+               std::vector<SatLit> cl;
+               cl.push_back(SatSolver::lit(now + sf.first + c, false));
+               cl.push_back(SatSolver::lit(next + sf.first + c));
+               for(unsigned int i = 0; i < sf.changers[c].size(); i++)
+                  cl.push_back(SatSolver::lit(ops + t * nops + sf.changers[c][i]));
+               s.addClause(cl);
+            }
+
+            // At most one group of operators affects the Fact, and then
+            // nothing else reads it.
+            std::vector<SatLit> groups;
+            for(unsigned int g = 0; g < sf.groups.size(); g++)
+            {
+               const std::vector<unsigned int> &group = sf.groups[g];
+               if(group.size() == 1)
+               {
+                  groups.push_back(SatSolver::lit(ops + t * nops + group[0]));
+                  continue;
+               }
+               unsigned int any = s.newVar();
+               for(unsigned int i = 0; i < group.size(); i++)
+                  s.addClause(SatSolver::lit(ops + t * nops + group[i], false), SatSolver::lit(any));
+               groups.push_back(SatSolver::lit(any));
+            }
+            s.addAtMostOne(groups);
+            if(groups.empty() || sf.readers.empty())
+               continue;
+            SatLit written = groups[0];
+            if(groups.size() > 1)
+            {
+               written = SatSolver::lit(s.newVar());
+               for(unsigned int g = 0; g < groups.size(); g++)
+                  s.addClause(SatSolver::negate(groups[g]), written);
+            }
+            for(unsigned int i = 0; i < sf.readers.size(); i++)
+               s.addClause(SatSolver::lit(ops + t * nops + sf.readers[i], false), SatSolver::negate(written));
+         }
+      }
+
+      out.result = s.solve(stop);
+      out.conflicts = s.numConflicts();
+      out.plan.clear();
+      if(out.result != SatSolver::Sat)
+         return;
+      for(unsigned int t = 0; t < steps; t++)
+      {
+         for(unsigned int o = 0; o < nops; o++)
+         {
+            if(s.value(ops + t * nops + o))
+               out.plan.push_back(entry(*mOps[o].ga));
+         }
+      }
+   }
+
+   bool SatPlanner::begin(Context *ctx)
+   {
+      mSuccess = false;
+      mHorizon = 0;
+      mPlan.clear();
+      const CompiledDomain *dom = mOverlay? mOverlay->getDomain(): mDomain;
+      if(!dom || !mStart || !mGoal || dom->getGrounding() != EagerGrounding)
+      {
+         if(ctx) ctx->logEvent("SAT planning needs a start, a goal and an eagerly grounded domain!");
+         return false;
+      }
+
+      if(ctx) ctx->logEvent("Starting new SAT plan.");
+      if(!compile(*dom, ctx))
+      {
+         if(ctx) ctx->logEvent("The goal can never be reached.");
+         return false;
+      }
+      bool done = true;
+      for(unsigned int i = 0; i < mGoalCodes.size() && done; i++)
+         done = mFacts[mGoalCodes[i].first].start == mGoalCodes[i].second;
+      if(done)
+      {
+         mSuccess = true;
+         if(ctx) ctx->logEvent("Start state already satisfies the goal.");
+         return false;
+      }
+      return true;
+   }
+
+   bool SatPlanner::finish(std::vector<Horizon> &results, Context *ctx)
+   {
+      for(unsigned int i = 0; i < results.size() && !mSuccess; i++)
+      {
+         if(results[i].result == SatSolver::Unknown)
+            continue;
+         if(ctx) ctx->logEvent("Horizon %d is %s after %d conflicts.", (int)i + 1,
+            results[i].result == SatSolver::Sat? "satisfiable": "unsatisfiable",
+            (int)results[i].conflicts);
+         if(results[i].result == SatSolver::Sat)
+         {
+            mSuccess = true;
+            mHorizon = i + 1;
+            mPlan.swap(results[i].plan);
+         }
+      }
+      if(ctx)
+      {
+         if(mSuccess)
+            ctx->logEvent("Found a plan of %d actions in %d steps.", (int)mPlan.size(), (int)mHorizon);
+         else
+            ctx->logEvent("No plan within %d steps.", (int)mMaxHorizon);
+      }
+      mFacts.clear();
+      mOps.clear();
+      mGoalCodes.clear();
+      return mSuccess;
+   }
+
+   bool SatPlanner::plan(Context *ctx)
+   {
+      if(!begin(ctx))
+         return mSuccess;
+      std::vector<Horizon> results(mMaxHorizon);
+      for(unsigned int i = 0; i < mMaxHorizon; i++)
+      {
+         results[i].result = SatSolver::Unknown;
+         results[i].conflicts = 0;
+      }
+      for(unsigned int i = 0; i < mMaxHorizon; i++)
+      {
+         solve(i + 1, NULL, results[i]);
+         if(results[i].result == SatSolver::Sat)
+            break;
+      }
+      return finish(results, ctx);
+   }
+
+   /// Solves each horizon of a SatPlanner. Once a horizon is satisfiable,
+   /// larger ones are stopped or skipped.
+   class HorizonTask : public ThreadPool::Task {
+   public:
+      HorizonTask(const SatPlanner &planner, std::vector<SatPlanner::Horizon> &results)
+         : mPlanner(planner), mResults(results), mStop(results.size())
+      {
+         mBest.store(results.size());
+         for(unsigned int i = 0; i < mStop.size(); i++)
+            mStop[i].store(false);
+      }
+
+      void run(unsigned int i)
+      {
+         if(mBest.load() < i)
+            return;
+         mPlanner.solve(i + 1, &mStop[i], mResults[i]);
+         if(mResults[i].result != SatSolver::Sat)
+            return;
+         unsigned int best = mBest.load();
+         while(i < best && !mBest.compare_exchange_weak(best, i));
+         for(unsigned int j = i + 1; j < mStop.size(); j++)
+            mStop[j].store(true);
+      }
+
+   private:
+      const SatPlanner &mPlanner;
+      std::vector<SatPlanner::Horizon> &mResults;
+      /// Tells each horizon's solver to give up.
+      std::vector<std::atomic<bool> > mStop;
+      /// Smallest satisfiable horizon index so far.
+      std::atomic<unsigned int> mBest;
+   };
+
+   bool SatPlanner::plan(ThreadPool &pool, Context *ctx)
+   {
+      if(!begin(ctx))
+         return mSuccess;
+      std::vector<Horizon> results(mMaxHorizon);
+      for(unsigned int i = 0; i < mMaxHorizon; i++)
+      {
+         results[i].result = SatSolver::Unknown;
+         results[i].conflicts = 0;
+      }
+      HorizonTask task(*this, results);
+      pool.run(task, mMaxHorizon);
+      return finish(results, ctx);
+   }
+};
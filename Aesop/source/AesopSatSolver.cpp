@@ -0,0 +1,573 @@
+/// @file AesopSatSolver.cpp
+/// Implementation of SatSolver class as defined in AesopSatSolver.h
+
+#include "AesopSatSolver.h"
+
+#include <algorithm>
+
+namespace Aesop {
+   /// @class SatSolver
+   ///
+   /// Follows the usual recipe: two watched literals per clause, first-UIP
+   /// clause learning with simple minimisation, VSIDS branching with phase
+   /// saving, and restarts on the Luby sequence. At each restart, if there
+   /// are too many learnt clauses the less active half is thrown away and
+   /// the clause store compacted.
+
+   const char SatSolver::Undef;
+   const unsigned int SatSolver::NoClause;
+
+   /// Conflicts between restarts, times the Luby sequence.
+   static const unsigned long RestartUnit = 100;
+
+   /// The i'th term (from 0) of the Luby sequence 1 1 2 1 1 2 4 ...
+   static unsigned long luby(unsigned long i)
+   {
+      unsigned long size = 1, seq = 0;
+      while(size < i + 1)
+      {
+         seq++;
+         size = size * 2 + 1;
+      }
+      while(size - 1 != i)
+      {
+         size = (size - 1) / 2;
+         seq--;
+         i = i % size;
+      }
+      return 1ul << seq;
+   }
+
+   SatSolver::SatSolver()
+   {
+      mOk = true;
+      mNumLearnts = 0;
+      mMaxLearnts = 0;
+      mHead = 0;
+      mVarInc = 1.0;
+      mClauseInc = 1.0f;
+      mConflicts = 0;
+   }
+
+   unsigned int SatSolver::newVar()
+   {
+      unsigned int v = mAssign.size();
+      mAssign.push_back(Undef);
+      mLevel.push_back(0);
+      mReason.push_back(NoClause);
+      mActivity.push_back(0.0);
+      mPhase.push_back(false);
+      mSeen.push_back(false);
+      mHeapPos.push_back(-1);
+      mWatches.resize(mWatches.size() + 2);
+      heapInsert(v);
+      return v;
+   }
+
+   unsigned int SatSolver::newVars(unsigned int count)
+   {
+      unsigned int first = mAssign.size();
+      for(unsigned int i = 0; i < count; i++)
+         newVar();
+      return first;
+   }
+
+   bool SatSolver::addClause(const std::vector<SatLit> &lits)
+   {
+      if(!mOk)
+         return false;
+      // Sort so that duplicates and complementary pairs are neighbours.
+      std::vector<SatLit> c(lits);
+      std::sort(c.begin(), c.end());
+      unsigned int n = 0;
+      for(unsigned int i = 0; i < c.size(); i++)
+      {
+         char v = litValue(c[i]);
+         if(v == 1 || (n && c[i] == negate(c[n-1])))
+            return true;
+         if(v == 0 || (n && c[i] == c[n-1]))
+            continue;
+         c[n++] = c[i];
+      }
+      c.resize(n);
+
+      if(c.empty())
+         mOk = false;
+      else if(c.size() == 1)
+      {
+         assign(c[0], NoClause);
+         mOk = propagate() == NoClause;
+      }
+      else
+         attach(c, false);
+      return mOk;
+   }
+
+   bool SatSolver::addClause(SatLit a)
+   {
+      std::vector<SatLit> c(1, a);
+      return addClause(c);
+   }
+
+   bool SatSolver::addClause(SatLit a, SatLit b)
+   {
+      std::vector<SatLit> c(2);
+      c[0] = a;
+      c[1] = b;
+      return addClause(c);
+   }
+
+   bool SatSolver::addClause(SatLit a, SatLit b, SatLit c)
+   {
+      std::vector<SatLit> cl(3);
+      cl[0] = a;
+      cl[1] = b;
+      cl[2] = c;
+      return addClause(cl);
+   }
+
+   bool SatSolver::addAtMostOne(const std::vector<SatLit> &lits)
+   {
+      unsigned int n = lits.size();
+      if(n <= 5)
+      {
+         // Every pair.
+         for(unsigned int i = 0; i < n; i++)
+            for(unsigned int j = i + 1; j < n; j++)
+               addClause(negate(lits[i]), negate(lits[j]));
+         return mOk;
+      }
+      // Sequential counter: s[i] is true if any of lits[0..i] is.
+      unsigned int s = newVars(n - 1);
+      for(unsigned int i = 0; i < n; i++)
+      {
+         if(i < n - 1)
+            addClause(negate(lits[i]), lit(s + i));
+         if(i > 0)
+         {
+            addClause(negate(lits[i]), lit(s + i - 1, false));
+            if(i < n - 1)
+               addClause(lit(s + i - 1, false), lit(s + i));
+         }
+      }
+      return mOk;
+   }
+
+   void SatSolver::assign(SatLit l, unsigned int reason)
+   {
+      unsigned int v = l >> 1;
+      mAssign[v] = (char)!(l & 1);
+      mLevel[v] = level();
+      mReason[v] = reason;
+      mTrail.push_back(l);
+   }
+
+   unsigned int SatSolver::attach(const std::vector<SatLit> &lits, bool learnt)
+   {
+      Clause c;
+      c.start = mLits.size();
+      c.size = lits.size();
+      c.learnt = learnt;
+      c.activity = 0.0f;
+      unsigned int id = mClauses.size();
+      mClauses.push_back(c);
+      mLits.insert(mLits.end(), lits.begin(), lits.end());
+      Watch w;
+      w.clause = id;
+      w.blocker = lits[1];
+      mWatches[lits[0]].push_back(w);
+      w.blocker = lits[0];
+      mWatches[lits[1]].push_back(w);
+      if(learnt)
+         mNumLearnts++;
+      return id;
+   }
+
+   unsigned int SatSolver::propagate()
+   {
+      unsigned int confl = NoClause;
+      while(mHead < mTrail.size() && confl == NoClause)
+      {
+         SatLit f = negate(mTrail[mHead++]);
+         watches &ws = mWatches[f];
+         unsigned int i = 0, j = 0;
+         while(i < ws.size())
+         {
+            Watch w = ws[i++];
+            SatLit blocker = w.blocker;
+            if(litValue(blocker) == 1)
+            {
+               ws[j++] = w;
+               continue;
+            }
+            SatLit *lits = &mLits[mClauses[w.clause].start];
+            unsigned int size = mClauses[w.clause].size;
+            // Keep the false literal second.
+            if(lits[0] == f)
+            {
+               lits[0] = lits[1];
+               lits[1] = f;
+            }
+            w.blocker = lits[0];
+            if(lits[0] != blocker && litValue(lits[0]) == 1)
+            {
+               ws[j++] = w;
+               continue;
+            }
+            // Look for another literal to watch.
+            bool moved = false;
+            for(unsigned int k = 2; k < size; k++)
+            {
+               if(litValue(lits[k]) != 0)
+               {
+                  lits[1] = lits[k];
+                  lits[k] = f;
+                  mWatches[lits[1]].push_back(w);
+                  moved = true;
+                  break;
+               }
+            }
+            if(moved)
+               continue;
+            ws[j++] = w;
+            if(litValue(lits[0]) == 0)
+            {
+               confl = w.clause;
+               while(i < ws.size())
+                  ws[j++] = ws[i++];
+            }
+            else
+               assign(lits[0], w.clause);
+         }
+         ws.resize(j);
+      }
+      return confl;
+   }
+
+   void SatSolver::analyze(unsigned int confl, unsigned int &back)
+   {
+      mLearnt.clear();
+      // Room for the asserting literal.
+      mLearnt.push_back(0);
+      unsigned int paths = 0;
+      SatLit p = 0;
+      bool first = true;
+      unsigned int index = mTrail.size();
+      do {
+         bumpClause(confl);
+         const Clause &c = mClauses[confl];
+         for(unsigned int i = first? 0: 1; i < c.size; i++)
+         {
+            SatLit q = mLits[c.start + i];
+            unsigned int v = q >> 1;
+            if(mSeen[v] || !mLevel[v])
+               continue;
+            mSeen[v] = true;
+            bumpVar(v);
+            if(mLevel[v] >= level())
+               paths++;
+            else
+               mLearnt.push_back(q);
+         }
+         // Walk back to the next literal of the conflict on this level.
+         while(!mSeen[mTrail[--index] >> 1]);
+         p = mTrail[index];
+         confl = mReason[p >> 1];
+         mSeen[p >> 1] = false;
+         paths--;
+         first = false;
+      } while(paths);
+      mLearnt[0] = negate(p);
+
+      // Drop literals implied by the others, remembering every literal that
+      // was marked so the marks can be cleared.
+      std::vector<SatLit> marked(mLearnt.begin() + 1, mLearnt.end());
+      unsigned int n = 1;
+      for(unsigned int i = 1; i < mLearnt.size(); i++)
+      {
+         if(!redundant(mLearnt[i]))
+            mLearnt[n++] = mLearnt[i];
+      }
+      mLearnt.resize(n);
+      for(unsigned int i = 0; i < marked.size(); i++)
+         mSeen[marked[i] >> 1] = false;
+
+      // Backtrack to the second highest level, and watch a literal from it.
+      back = 0;
+      if(mLearnt.size() > 1)
+      {
+         unsigned int best = 1;
+         for(unsigned int i = 2; i < mLearnt.size(); i++)
+         {
+            if(mLevel[mLearnt[i] >> 1] > mLevel[mLearnt[best] >> 1])
+               best = i;
+         }
+         SatLit t = mLearnt[1];
+         mLearnt[1] = mLearnt[best];
+         mLearnt[best] = t;
+         back = mLevel[mLearnt[1] >> 1];
+      }
+   }
+
+   bool SatSolver::redundant(SatLit l) const
+   {
+      unsigned int r = mReason[l >> 1];
+      if(r == NoClause)
+         return false;
+      const Clause &c = mClauses[r];
+      for(unsigned int i = 1; i < c.size; i++)
+      {
+         unsigned int v = mLits[c.start + i] >> 1;
+         if(!mSeen[v] && mLevel[v])
+            return false;
+      }
+      return true;
+   }
+
+   void SatSolver::backtrack(unsigned int lvl)
+   {
+      if(level() <= lvl)
+         return;
+      for(unsigned int i = mTrail.size(); i > mLevels[lvl]; i--)
+      {
+         unsigned int v = mTrail[i-1] >> 1;
+         mPhase[v] = !(mTrail[i-1] & 1);
+         mAssign[v] = Undef;
+         mReason[v] = NoClause;
+         heapInsert(v);
+      }
+      mTrail.resize(mLevels[lvl]);
+      mHead = mTrail.size();
+      mLevels.resize(lvl);
+   }
+
+   SatSolver::Result SatSolver::solve(const std::atomic<bool> *stop)
+   {
+      if(!mOk)
+         return Unsat;
+      if(propagate() != NoClause)
+      {
+         mOk = false;
+         return Unsat;
+      }
+      if(mMaxLearnts < mClauses.size() / 3 + 1000)
+         mMaxLearnts = mClauses.size() / 3 + 1000;
+      for(unsigned long restarts = 0; ; restarts++)
+      {
+         Result r = search(luby(restarts) * RestartUnit, stop);
+         if(r != Unknown || (stop && stop->load(std::memory_order_relaxed)))
+            return r;
+         if(mNumLearnts > mMaxLearnts)
+         {
+            reduce();
+            mMaxLearnts += mMaxLearnts / 10;
+         }
+      }
+   }
+
+   SatSolver::Result SatSolver::search(unsigned long conflicts, const std::atomic<bool> *stop)
+   {
+      for(;;)
+      {
+         unsigned int confl = propagate();
+         if(confl != NoClause)
+         {
+            mConflicts++;
+            if(!level())
+            {
+               mOk = false;
+               return Unsat;
+            }
+            unsigned int back;
+            analyze(confl, back);
+            backtrack(back);
+            if(mLearnt.size() == 1)
+               assign(mLearnt[0], NoClause);
+            else
+            {
+               unsigned int c = attach(mLearnt, true);
+               bumpClause(c);
+               assign(mLearnt[0], c);
+            }
+            mVarInc /= 0.95;
+            mClauseInc /= 0.999f;
+            if(conflicts)
+               conflicts--;
+            continue;
+         }
+
+         if(!conflicts || (stop && stop->load(std::memory_order_relaxed)))
+         {
+            backtrack(0);
+            return Unknown;
+         }
+
+         // Pick the most active unassigned variable.
+         unsigned int v = (unsigned int)-1;
+         while(!mHeap.empty())
+         {
+            v = heapPop();
+            if(mAssign[v] == Undef)
+               break;
+            v = (unsigned int)-1;
+         }
+         if(v == (unsigned int)-1)
+         {
+            mModel.resize(mAssign.size());
+            for(unsigned int i = 0; i < mAssign.size(); i++)
+               mModel[i] = mAssign[i] == 1;
+            backtrack(0);
+            return Sat;
+         }
+         mLevels.push_back(mTrail.size());
+         assign(lit(v, mPhase[v]), NoClause);
+      }
+   }
+
+   /// Orders learnt clauses by activity for SatSolver::reduce.
+   struct ClauseActivity {
+      const std::vector<float> *activity;
+      bool operator()(unsigned int a, unsigned int b) const
+      { return (*activity)[a] < (*activity)[b]; }
+   };
+
+   void SatSolver::reduce()
+   {
+      // Find the less active half of the learnt clauses, sparing binary
+      // ones, which are cheap and strong.
+      std::vector<unsigned int> learnts;
+      std::vector<float> activity(mClauses.size());
+      for(unsigned int i = 0; i < mClauses.size(); i++)
+      {
+         activity[i] = mClauses[i].activity;
+         if(mClauses[i].learnt && mClauses[i].size > 2)
+            learnts.push_back(i);
+      }
+      ClauseActivity order;
+      order.activity = &activity;
+      std::sort(learnts.begin(), learnts.end(), order);
+      std::vector<bool> drop(mClauses.size(), false);
+      for(unsigned int i = 0; i < learnts.size() / 2; i++)
+         drop[learnts[i]] = true;
+
+      // Compact the clauses and rebuild every watch list. We are at level
+      // 0, so no assignment has a reason that needs keeping.
+      std::vector<Clause> clauses;
+      std::vector<SatLit> lits;
+      for(unsigned int i = 0; i < mClauses.size(); i++)
+      {
+         if(drop[i])
+            continue;
+         Clause c = mClauses[i];
+         c.start = lits.size();
+         lits.insert(lits.end(), mLits.begin() + mClauses[i].start,
+            mLits.begin() + mClauses[i].start + c.size);
+         clauses.push_back(c);
+      }
+      mClauses.swap(clauses);
+      mLits.swap(lits);
+      for(unsigned int i = 0; i < mReason.size(); i++)
+         mReason[i] = NoClause;
+      for(unsigned int i = 0; i < mWatches.size(); i++)
+         mWatches[i].clear();
+      mNumLearnts = 0;
+      for(unsigned int i = 0; i < mClauses.size(); i++)
+      {
+         const Clause &c = mClauses[i];
+         Watch w;
+         w.clause = i;
+         w.blocker = mLits[c.start + 1];
+         mWatches[mLits[c.start]].push_back(w);
+         w.blocker = mLits[c.start];
+         mWatches[mLits[c.start + 1]].push_back(w);
+         if(c.learnt)
+            mNumLearnts++;
+      }
+   }
+
+   void SatSolver::bumpVar(unsigned int v)
+   {
+      mActivity[v] += mVarInc;
+      if(mActivity[v] > 1e100)
+      {
+         for(unsigned int i = 0; i < mActivity.size(); i++)
+            mActivity[i] *= 1e-100;
+         mVarInc *= 1e-100;
+      }
+      if(mHeapPos[v] >= 0)
+         heapUp(mHeapPos[v]);
+   }
+
+   void SatSolver::bumpClause(unsigned int c)
+   {
+      if(!mClauses[c].learnt)
+         return;
+      mClauses[c].activity += mClauseInc;
+      if(mClauses[c].activity > 1e20f)
+      {
+         for(unsigned int i = 0; i < mClauses.size(); i++)
+            mClauses[i].activity *= 1e-20f;
+         mClauseInc *= 1e-20f;
+      }
+   }
+
+   void SatSolver::heapInsert(unsigned int v)
+   {
+      if(mHeapPos[v] >= 0)
+         return;
+      mHeapPos[v] = mHeap.size();
+      mHeap.push_back(v);
+      heapUp(mHeap.size() - 1);
+   }
+
+   void SatSolver::heapUp(unsigned int i)
+   {
+      unsigned int v = mHeap[i];
+      while(i)
+      {
+         unsigned int parent = (i - 1) / 2;
+         if(mActivity[mHeap[parent]] >= mActivity[v])
+            break;
+         mHeap[i] = mHeap[parent];
+         mHeapPos[mHeap[i]] = i;
+         i = parent;
+      }
+      mHeap[i] = v;
+      mHeapPos[v] = i;
+   }
+
+   void SatSolver::heapDown(unsigned int i)
+   {
+      unsigned int v = mHeap[i];
+      for(;;)
+      {
+         unsigned int child = i * 2 + 1;
+         if(child >= mHeap.size())
+            break;
+         if(child + 1 < mHeap.size() && mActivity[mHeap[child+1]] > mActivity[mHeap[child]])
+            child++;
+         if(mActivity[mHeap[child]] <= mActivity[v])
+            break;
+         mHeap[i] = mHeap[child];
+         mHeapPos[mHeap[i]] = i;
+         i = child;
+      }
+      mHeap[i] = v;
+      mHeapPos[v] = i;
+   }
+
+   unsigned int SatSolver::heapPop()
+   {
+      unsigned int v = mHeap[0];
+      mHeapPos[v] = -1;
+      unsigned int last = mHeap.back();
+      mHeap.pop_back();
+      if(!mHeap.empty())
+      {
+         mHeap[0] = last;
+         mHeapPos[last] = 0;
+         heapDown(0);
+      }
+      return v;
+   }
+};
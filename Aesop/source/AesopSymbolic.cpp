@@ -0,0 +1,490 @@
+/// @file AesopSymbolic.cpp
+/// Implementation of SymbolicPlanner class as defined in AesopSymbolic.h
+
+#include "AesopSymbolic.h"
+
+#include <set>
+
+namespace Aesop {
+   /// @class SymbolicPlanner
+   ///
+   /// Each Fact gets a small finite domain: the values it can ever take,
+   /// found by closing its starting value under every effect on it, plus
+   /// 'unset' if it can be unset. Codes into that domain are stored in as
+   /// few BDD variables as will hold them, so Facts that never change cost
+   /// nothing.
+   /// Operators are not turned into transition relations over primed
+   /// variables. Setting a Fact is quantifying its variables out and
+   /// conjoining its new code; undoing it is restricting to that code.
+   /// Increments and decrements are handled one code at a time.
+   /// Costs are rounded to fixed point so that layers can be looked up
+   /// exactly, and every GroundAction costs at least one unit.
+
+   /// Fixed point units per unit of GroundAction cost.
+   static const float CostUnits = 1000.0f;
+   /// No meeting found yet.
+   static const unsigned long NoCost = (unsigned long)-1;
+
+   SymbolicPlanner::SymbolicPlanner(const CompiledDomain *dom, const WorldState *start, const WorldState *goal)
+   {
+      mDomain = dom;
+      mOverlay = NULL;
+      mStart = start;
+      mGoal = goal;
+      mNodeLimit = 1 << 22;
+      mSuccess = false;
+      mExhausted = false;
+      mBdd = NULL;
+   }
+
+   SymbolicPlanner::~SymbolicPlanner()
+   {
+      delete mBdd;
+   }
+
+   void SymbolicPlanner::encode(const CompiledDomain &dom)
+   {
+      std::vector<std::vector<int> > values;
+      dom.reachableValues(*mStart, mOverlay, values);
+      unsigned int n = values.size();
+      mVars.resize(n);
+      unsigned int next = 0;
+      for(FactID f = 0; f < n; f++)
+      {
+         FactVar &fv = mVars[f];
+         fv.values.swap(values[f]);
+         fv.first = next;
+         fv.bits = 0;
+         while((1u << fv.bits) < fv.values.size())
+            fv.bits++;
+         next += fv.bits;
+      }
+   }
+
+   int SymbolicPlanner::code(FactID id, int value) const
+   {
+      const std::vector<int> &vals = mVars[id].values;
+      for(unsigned int c = 0; c < vals.size(); c++)
+      {
+         if(vals[c] == value)
+            return c;
+      }
+      return -1;
+   }
+
+   BddNode SymbolicPlanner::is(FactID id, unsigned int c)
+   {
+      const FactVar &fv = mVars[id];
+      BddNode r = BddTrue;
+      // Build from the bottom variable up, so each step is a single node.
+      for(unsigned int b = fv.bits; b > 0; b--)
+         r = mBdd->conj(mBdd->literal(fv.first + b - 1, (c >> (b - 1)) & 1), r);
+      return r;
+   }
+
+   BddNode SymbolicPlanner::valid(FactID id)
+   {
+      const FactVar &fv = mVars[id];
+      if(fv.values.size() == (1u << fv.bits))
+         return BddTrue;
+      BddNode r = BddFalse;
+      for(unsigned int c = 0; c < fv.values.size(); c++)
+         r = mBdd->disj(r, is(id, c));
+      return r;
+   }
+
+   void SymbolicPlanner::compile(const CompiledDomain &dom)
+   {
+      mOps.clear();
+      for(unsigned int i = 0; i < dom.numOperators(); i++)
+      {
+         const GroundAction &ga = dom.getOperator(i);
+         if(mOverlay && !mOverlay->allows(ga))
+            continue;
+         SymOp op;
+         op.ga = &ga;
+         float cost = mOverlay? mOverlay->cost(ga): ga.cost;
+         op.cost = (unsigned long)(cost * CostUnits + 0.5f);
+         if(!op.cost)
+            op.cost = 1;
+         op.pre = op.setVars = op.setCodes = op.setValid = BddTrue;
+
+         groundops::const_iterator gop;
+         for(gop = ga.ops.begin(); gop != ga.ops.end() && op.pre != BddFalse; gop++)
+         {
+            FactID f = gop->id;
+            const FactVar &fv = mVars[f];
+            if(gop->op.ctype != NoCondition)
+            {
+               BddNode allowed = BddFalse;
+               for(unsigned int c = 0; c < fv.values.size(); c++)
+               {
+                  if(CompiledDomain::holds(gop->op, fv.values[c]))
+                     allowed = mBdd->disj(allowed, is(f, c));
+               }
+               op.pre = mBdd->conj(op.pre, allowed);
+            }
+            switch(gop->op.etype)
+            {
+            case Set:
+            case Unset:
+            {
+               int c = code(f, gop->op.etype == Set? gop->op.eval: -1);
+               for(unsigned int b = 0; b < fv.bits; b++)
+                  op.setVars = mBdd->conj(op.setVars, mBdd->literal(fv.first + b));
+               op.setCodes = mBdd->conj(op.setCodes, is(f, c));
+               op.setValid = mBdd->conj(op.setValid, valid(f));
+               break;
+            }
+            case Increment:
+            case Decrement:
+               op.steps.push_back(std::make_pair(f, &gop->op));
+               break;
+            default:
+               break;
+            }
+         }
+         if(op.pre != BddFalse)
+            mOps.push_back(op);
+      }
+   }
+
+   BddNode SymbolicPlanner::state(const WorldState &ws, const CompiledDomain &dom)
+   {
+      BddNode r = BddTrue;
+      for(FactID f = mVars.size(); f > 0; f--)
+      {
+         PVal v;
+         int value = -1;
+         if(ws.get(dom.getFact(f-1), v) || dom.getConstants().get(dom.getFact(f-1), v))
+            value = v;
+         r = mBdd->conj(is(f-1, code(f-1, value)), r);
+      }
+      return r;
+   }
+
+   BddNode SymbolicPlanner::goal(const WorldState &ws, const CompiledDomain &dom)
+   {
+      BddNode r = BddTrue;
+      for(FactID f = 0; f < mVars.size(); f++)
+         r = mBdd->conj(r, valid(f));
+      WorldState::const_iterator it;
+      for(it = ws.begin(); it != ws.end(); it++)
+      {
+         FactID id = dom.find(it->first);
+         if(id == NullFact)
+         {
+            // No GroundAction touches this Fact, so it must hold already.
+            PVal v;
+            if(!mStart->get(it->first, v) && !dom.getConstants().get(it->first, v))
+               return BddFalse;
+            if(v != it->second)
+               return BddFalse;
+            continue;
+         }
+         int c = code(id, it->second);
+         if(c < 0)
+            return BddFalse;
+         r = mBdd->conj(r, is(id, c));
+      }
+      return r;
+   }
+
+   BddNode SymbolicPlanner::image(BddNode s, const SymOp &op)
+   {
+      BddNode t = mBdd->conj(s, op.pre);
+      if(t == BddFalse)
+         return t;
+      if(op.setVars != BddTrue)
+         t = mBdd->conj(mBdd->exists(t, op.setVars), op.setCodes);
+      for(unsigned int i = 0; i < op.steps.size(); i++)
+      {
+         FactID f = op.steps[i].first;
+         const FactVar &fv = mVars[f];
+         BddNode r = BddFalse;
+         for(unsigned int c = 0; c < fv.values.size(); c++)
+         {
+            BddNode part = mBdd->restrict(t, is(f, c));
+            if(part == BddFalse)
+               continue;
+            int nc = code(f, CompiledDomain::apply(*op.steps[i].second, fv.values[c]));
+            r = mBdd->disj(r, mBdd->conj(part, is(f, nc)));
+         }
+         t = r;
+      }
+      return t;
+   }
+
+   BddNode SymbolicPlanner::preimage(BddNode s, const SymOp &op)
+   {
+      BddNode t = s;
+      for(unsigned int i = 0; i < op.steps.size(); i++)
+      {
+         FactID f = op.steps[i].first;
+         const FactVar &fv = mVars[f];
+         BddNode r = BddFalse;
+         for(unsigned int c = 0; c < fv.values.size(); c++)
+         {
+            int nc = code(f, CompiledDomain::apply(*op.steps[i].second, fv.values[c]));
+            BddNode part = mBdd->restrict(t, is(f, nc));
+            if(part == BddFalse)
+               continue;
+            r = mBdd->disj(r, mBdd->conj(part, is(f, c)));
+         }
+         t = r;
+      }
+      if(op.setVars != BddTrue)
+      {
+         // Whatever the Facts were before, the GroundAction sets them to
+         // its codes, so only that part of s matters.
+         t = mBdd->conj(mBdd->restrict(t, op.setCodes), op.setValid);
+      }
+      return mBdd->conj(t, op.pre);
+   }
+
+   BddNode SymbolicPlanner::pickState(BddNode s)
+   {
+      std::vector<bool> values;
+      mBdd->pick(s, values);
+      BddNode r = BddTrue;
+      for(unsigned int v = values.size(); v > 0; v--)
+         r = mBdd->conj(mBdd->literal(v - 1, values[v-1]), r);
+      return r;
+   }
+
+   bool SymbolicPlanner::plan(Context *ctx)
+   {
+      mSuccess = mExhausted = false;
+      mPlan.clear();
+      const CompiledDomain *dom = mOverlay? mOverlay->getDomain(): mDomain;
+      if(!dom || !mStart || !mGoal || dom->getGrounding() != EagerGrounding)
+      {
+         if(ctx) ctx->logEvent("Symbolic planning needs a start, a goal and an eagerly grounded domain!");
+         return false;
+      }
+
+      if(ctx) ctx->logEvent("Starting new symbolic plan.");
+      encode(*dom);
+      unsigned int nvars = mVars.empty()? 0: mVars.back().first + mVars.back().bits;
+      delete mBdd;
+      mBdd = new BddManager(nvars, mNodeLimit);
+      compile(*dom);
+      BddNode start = state(*mStart, *dom);
+      BddNode target = goal(*mGoal, *dom);
+      if(ctx) ctx->logEvent("Encoded %d Facts in %d variables, %d operators.",
+         (int)mVars.size(), (int)nvars, (int)mOps.size());
+
+      layers openF, openB;
+      mForward.clear();
+      mBackward.clear();
+      BddNode closedF = BddFalse, closedB = BddFalse;
+      unsigned long best = NoCost;
+      Meeting meet;
+      meet.dir = 0;
+      meet.op = 0;
+      if(mBdd->conj(start, target) != BddFalse)
+      {
+         best = 0;
+         meet.states = mBdd->conj(start, target);
+         meet.forward = meet.backward = 0;
+         mForward[0] = start;
+         mBackward[0] = meet.states;
+      }
+      else
+      {
+         if(start != BddFalse)
+            openF[0] = start;
+         if(target != BddFalse)
+            openB[0] = target;
+      }
+
+      while(best && !mBdd->full())
+      {
+         bool fdone = openF.empty(), bdone = openB.empty();
+         // With one side exhausted, every meeting has been seen.
+         if((fdone || bdone) && best == NoCost)
+            break;
+         if(fdone && bdone)
+            break;
+         unsigned long f = fdone? 0: openF.begin()->first;
+         unsigned long b = bdone? 0: openB.begin()->first;
+         if(best != NoCost && f + b >= best)
+            break;
+         if(!fdone && (bdone || f <= b))
+            expand(openF, mForward, closedF, mBackward, closedB, true, best, meet);
+         else
+            expand(openB, mBackward, closedB, mForward, closedF, false, best, meet);
+      }
+
+      if(mBdd->full())
+      {
+         if(ctx) ctx->logEvent("Symbolic planning ran out of nodes.");
+      }
+      else if(best != NoCost)
+      {
+         extract(meet);
+         mSuccess = true;
+         if(ctx) ctx->logEvent("Found a plan of cost %f.", best / CostUnits);
+      }
+      else
+      {
+         mExhausted = true;
+         if(ctx) ctx->logEvent("No plan exists.");
+      }
+
+      if(ctx) ctx->logEvent("Used %d BDD nodes.", (int)mBdd->numNodes());
+      delete mBdd;
+      mBdd = NULL;
+      mOps.clear();
+      mForward.clear();
+      mBackward.clear();
+      return mSuccess;
+   }
+
+   void SymbolicPlanner::expand(layers &open, layers &mine, BddNode &closed, const layers &other,
+      BddNode otherClosed, bool forwards, unsigned long &best, Meeting &meet)
+   {
+      layers::iterator top = open.begin();
+      unsigned long g = top->first;
+      BddNode s = mBdd->minus(top->second, closed);
+      open.erase(top);
+      if(s == BddFalse)
+         return;
+      closed = mBdd->disj(closed, s);
+      mine[g] = s;
+
+      layers::const_iterator l;
+      if(mBdd->conj(s, otherClosed) != BddFalse)
+      {
+         for(l = other.begin(); l != other.end() && g + l->first < best; l++)
+         {
+            BddNode m = mBdd->conj(s, l->second);
+            if(m == BddFalse)
+               continue;
+            best = g + l->first;
+            meet.states = m;
+            meet.forward = forwards? g: l->first;
+            meet.backward = forwards? l->first: g;
+            meet.dir = 0;
+         }
+      }
+
+      for(unsigned int i = 0; i < mOps.size(); i++)
+      {
+         const SymOp &op = mOps[i];
+         BddNode n = forwards? image(s, op): preimage(s, op);
+         n = mBdd->minus(n, closed);
+         if(n == BddFalse)
+            continue;
+         unsigned long ng = g + op.cost;
+         open[ng] = mBdd->disj(open[ng], n);
+         if(mBdd->conj(n, otherClosed) == BddFalse)
+            continue;
+         for(l = other.begin(); l != other.end() && ng + l->first < best; l++)
+         {
+            BddNode m = mBdd->conj(n, l->second);
+            if(m == BddFalse)
+               continue;
+            best = ng + l->first;
+            meet.states = m;
+            meet.forward = forwards? g: l->first;
+            meet.backward = forwards? l->first: g;
+            meet.dir = forwards? 1: -1;
+            meet.op = i;
+         }
+      }
+   }
+
+   /// The entry in a Plan for a GroundAction.
+   static ActionEntry entry(const GroundAction &ga)
+   {
+      ActionEntry e;
+      e.ac = ga.ac;
+      e.params = ga.params;
+      return e;
+   }
+
+   void SymbolicPlanner::extract(const Meeting &meet)
+   {
+      BddNode m = pickState(meet.states);
+      Plan back;
+      if(meet.dir > 0)
+      {
+         const SymOp &op = mOps[meet.op];
+         BddNode p = pickState(mBdd->conj(preimage(m, op), mForward[meet.forward]));
+         chainForward(p, meet.forward, mPlan);
+         mPlan.push_back(entry(*op.ga));
+         chainBackward(m, meet.backward, back);
+      }
+      else if(meet.dir < 0)
+      {
+         const SymOp &op = mOps[meet.op];
+         BddNode q = pickState(mBdd->conj(image(m, op), mBackward[meet.backward]));
+         chainForward(m, meet.forward, mPlan);
+         mPlan.push_back(entry(*op.ga));
+         chainBackward(q, meet.backward, back);
+      }
+      else
+      {
+         chainForward(m, meet.forward, mPlan);
+         chainBackward(m, meet.backward, back);
+      }
+      mPlan.splice(mPlan.end(), back);
+   }
+
+   /// Every state in a forward layer was reached from an earlier layer by
+   /// some operator, so we can always find a predecessor.
+   void SymbolicPlanner::chainForward(BddNode s, unsigned long g, Plan &plan)
+   {
+      Plan chain;
+      while(g)
+      {
+         unsigned int i;
+         for(i = 0; i < mOps.size(); i++)
+         {
+            const SymOp &op = mOps[i];
+            if(op.cost > g)
+               continue;
+            layers::const_iterator l = mForward.find(g - op.cost);
+            if(l == mForward.end())
+               continue;
+            BddNode p = mBdd->conj(preimage(s, op), l->second);
+            if(p == BddFalse)
+               continue;
+            chain.push_front(entry(*op.ga));
+            s = pickState(p);
+            g = l->first;
+            break;
+         }
+         if(i == mOps.size())
+            break;
+      }
+      plan.splice(plan.end(), chain);
+   }
+
+   void SymbolicPlanner::chainBackward(BddNode s, unsigned long g, Plan &plan)
+   {
+      while(g)
+      {
+         unsigned int i;
+         for(i = 0; i < mOps.size(); i++)
+         {
+            const SymOp &op = mOps[i];
+            if(op.cost > g)
+               continue;
+            layers::const_iterator l = mBackward.find(g - op.cost);
+            if(l == mBackward.end())
+               continue;
+            BddNode q = mBdd->conj(image(s, op), l->second);
+            if(q == BddFalse)
+               continue;
+            plan.push_back(entry(*op.ga));
+            s = pickState(q);
+            g = l->first;
+            break;
+         }
+         if(i == mOps.size())
+            break;
+      }
+   }
+};
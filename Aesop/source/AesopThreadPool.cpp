@@ -0,0 +1,101 @@
+/// @file AesopThreadPool.cpp
+/// Implementation of ThreadPool class as defined in AesopThreadPool.h
+
+#include "AesopThreadPool.h"
+
+namespace Aesop {
+   /// @class ThreadPool
+   ///
+   /// Pieces of a Task are handed out through an atomic counter, so threads
+   /// that finish early simply take more pieces. Which thread runs which
+   /// piece is not deterministic; Tasks that need deterministic output
+   /// should write each piece's results to its own buffer and combine the
+   /// buffers in index order afterwards.
+
+   ThreadPool::ThreadPool(unsigned int threads)
+   {
+      mTask = NULL;
+      mCount = 0;
+      mNext = 0;
+      mBusy = 0;
+      mGeneration = 0;
+      mQuit = false;
+
+      if(!threads)
+         threads = std::thread::hardware_concurrency();
+      for(unsigned int i = 1; i < threads; i++)
+         mThreads.push_back(std::thread(&ThreadPool::work, this));
+   }
+
+   ThreadPool::~ThreadPool()
+   {
+      {
+         std::lock_guard<std::mutex> lock(mLock);
+         mQuit = true;
+      }
+      mWake.notify_all();
+      for(unsigned int i = 0; i < mThreads.size(); i++)
+         mThreads[i].join();
+   }
+
+   void ThreadPool::run(Task &task, unsigned int count)
+   {
+      if(!count)
+         return;
+      std::lock_guard<std::mutex> running(mRunLock);
+      // Not worth waking anyone up for.
+      if(mThreads.empty() || count == 1)
+      {
+         for(unsigned int i = 0; i < count; i++)
+            task.run(i);
+         return;
+      }
+
+      {
+         std::lock_guard<std::mutex> lock(mLock);
+         mTask = &task;
+         mCount = count;
+         mNext = 0;
+         mBusy = mThreads.size();
+         mGeneration++;
+      }
+      mWake.notify_all();
+
+      drain(&task, count);
+
+      std::unique_lock<std::mutex> lock(mLock);
+      while(mBusy)
+         mDone.wait(lock);
+      mTask = NULL;
+   }
+
+   void ThreadPool::drain(Task *task, unsigned int count)
+   {
+      unsigned int i;
+      while((i = mNext.fetch_add(1)) < count)
+         task->run(i);
+   }
+
+   void ThreadPool::work()
+   {
+      unsigned long seen = 0;
+      std::unique_lock<std::mutex> lock(mLock);
+      while(true)
+      {
+         while(!mQuit && mGeneration == seen)
+            mWake.wait(lock);
+         if(mQuit)
+            return;
+         seen = mGeneration;
+         Task *task = mTask;
+         unsigned int count = mCount;
+
+         lock.unlock();
+         drain(task, count);
+         lock.lock();
+
+         if(!--mBusy)
+            mDone.notify_all();
+      }
+   }
+};
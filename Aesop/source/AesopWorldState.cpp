@@ -1,10 +1,10 @@
-/// @file AesopWorldState.cpp
-/// Implementation of WorldState class as defined in AesopWorldState.h
-
-#include "AesopWorldState.h"
-
-#include <algorithm>
-#include <sstream>
+/// @file AesopWorldState.cpp
+/// Implementation of WorldState class as defined in AesopWorldState.h
+
+#include "AesopWorldState.h"
+
+#include <algorithm>
+#include <sstream>
 using namespace std;
 
 
@@ -30,362 +30,883 @@ map<KeyType, pair<LeftValue, RightValue> > IntersectMaps(const map<KeyType, Left
     return result;
 }
 
-
-namespace Aesop {
-   /// @class WorldState
-   ///
-   /// This class represents a set of knowledge (facts, or predicates) about
-   /// the state of the world that we are planning within. A WorldState can be
-   /// used by individual characters as a representation of their knowledge,
-   /// but is also used internally in planning.
-
-   WorldState::WorldState()
-   {
-      mHash = 0;
-   }
-
-   WorldState::~WorldState()
-   {
-   }
-
-   bool WorldState::involves(PName pred) const
-   {
-      return false;
-   }
-
-   void WorldState::set(const Fact &fact, PVal val)
-   {
-      _set(fact, val);
-      updateHash();
-   }
-
-   void WorldState::_set(const Fact &fact, PVal val)
-   {
-      mState[fact] = val;
-   }
-
-   void WorldState::unset(const Fact &fact)
-   {
-      _unset(fact);
-      updateHash();
-   }
-
-   void WorldState::_unset(const Fact &fact)
-   {
-      mState.erase(fact);
-   }
-
-   bool WorldState::get(const Fact &fact, PVal &val, PVal def) const
-   {
-      worldrep::const_iterator it = mState.find(fact);
-      if(it == mState.end())
-      {
-         val = def;
-         return false;
-      }
-      val = getPVal(it);
-      return true;
-   }
-
-   /// Is the given PVal consistent with an Operation of the given condition
-   /// and specified value?
-   static bool consistent(PVal val, ConditionType cond, PVal cval)
-   {
-      switch(cond)
-      {
-      case IsUnset:
-         // We have a mapping and we're not supposed to, so we fail.
-         return false;
-      case Equals:
-         // If the value is not what it's supposed to be, fail.
-         if(val != cval)
-            return false;
-         break;
-      case NotEqual:
-         // If the value is what it's not supposed to be, fail.
-         if(val != cval)
-            return false;
-         break;
-      case Less:
-         if(val >= cval)
-            return false;
-         break;
-      case Greater:
-         if(val <= cval)
-            return false;
-         break;
-      case LessEqual:
-         if(val > cval)
-            return false;
-         break;
-      case GreaterEqual:
-         if(val < cval)
-            return false;
-         break;
-      }
-      return true;
-   }
-
-   /// Is the given PVal consistent with following an Operation with the effect
-   /// type and value given?
-   static bool consistent(PVal val, EffectType eff, PVal eval)
-   {
-      switch(eff)
-      {
-      case Set:
-         // Fact must be set to the same value.
-         return val == eval;
-      case Unset:
-         // Fact is clearly set, so no.
-         return false;
-      case Increment:
-         // Value must have been incremented, so it should be eval+1
-         if(val != eval + 1)
-            return false;
-         break;
-      case Decrement:
-         // Value was decremented.
-         if(val != eval - 1)
-            return false;
-         break;
-      }
-      return true;
-   }
-
-   static void fillOp(Operation &op, const objects &params)
-   {
-      // Check condition index.
-      if(op.cidx > -1)
-         op.cval = params[op.cidx];
-      // Check effect index.
-      if(op.eidx > -1)
-         op.eval = params[op.eidx];
-   }
-
-   static void fillFact(Fact &f, const objects &params)
-   {
-      // Check whether the Fact needs to be completed.
-      unsigned int i = 0;
-      for(paramlist::const_iterator p = f.indices.begin(); p != f.indices.end(); p++, i++)
-      {
-         if(*p != -1)
-            f.args[i] = params[*p];
-      }
-   }
-
-   /// For a 'pre-match' to be valid, we compare the Action's required
-   /// predicates to the values in the current world state. All values must
-   /// match for the Action to be valid.
-   bool WorldState::preMatch(const Action &ac, const objects &params) const
-   {
-      if(!ac.checkSpecialConditions(params))
-         return false;
-      operations::const_iterator o;
-      Operation op;
-      Fact f;
-      for(o = ac.begin(); o != ac.end(); o++)
-      {
-         // If there's no condition, just carry merrily on.
-         if(o->second.ctype == NoCondition)
-            continue;
-         // Copy Operation and Fact for modification.
-         op = o->second;
-         f = o->first;
-         // Check whether we need to set target value based on parameter.
-         if(params.size())
-         {
-            fillOp(op, params);
-            fillFact(f, params);
-         }
-         PVal val;
-         if(get(f, val))
-         {
-            // We have a mapping for this Fact. Check for consistency.
-            if(!consistent(val, op.ctype, op.cval))
-               return false;
-         }
-         else
-         {
-            // No mapping for this Fact. Only escape is if we don't want it to.
-            if(op.ctype != IsUnset)
-               return false;
-         }
-      }
-
-      // No inconsistencies, so we pass.
-      return true;
-   }
-
-   /// This method compares a desired world state with an action's results. The
-   /// comparison returns true if each predicate in our current state is either
-   /// set by the Action, or required by it and not changed.
-   /// In this method, params is an output argument. The method fills in the
-   /// values of each parameter required for the Action to result in the given
-   /// world state.
-   /// @todo This method seems to be giving false positives.
-   bool WorldState::postMatch(const Action &ac, const objects &params) const
-   {
-      if(!ac.checkSpecialConditions(params))
-         return false;
-      operations::const_iterator o;
-      Operation op;
-      Fact f;
-      int consistencies = 0;
-      for(o = ac.begin(); o != ac.end(); o++)
-      {
-         // Construct a new operation based on the parameters passed.
-         op = o->second;
-         f = o->first;
-         if(params.size())
-         {
-            fillOp(op, params);
-            fillFact(f, params);
-         }
-         // If there's no effect, look at the conditions.
-         if(op.etype == NoEffect)
-         {
-            // Check that there's actually a condition.
-            if(op.ctype != NoCondition)
-            {
-               PVal val;
-               if(get(f, val))
-               {
-                  // We have a mapping for this Fact. Check for consistency.
-                  if(!consistent(val, op.ctype, op.cval))
-                     return false;
-                  else
-                     consistencies++;
-               }
-               else
-               {
-                  // No mapping for this Fact. If that's not desired, bail.
-                  //if(op.ctype != IsUnset)
-                     //return false;
-               }
-            }
-         }
-         else
-         {
-            PVal val;
-            if(get(f, val))
-            {
-               // Check for consistency.
-               if(!consistent(val, op.etype, op.eval))
-                  return false;
-               else
-                  consistencies++;
-            }
-            else
-            {
-               // No mapping. If that's not what's desired, bail.
-               //if(op.etype != Unset)
-                  //return false;
-            }
-         }
-      }
-
-      return consistencies > 0;
-   }
-
-   /// Apply an Action to the current world state. The Action's effects are
-   /// applied to the current set of predicates.
-   void WorldState::applyForward(const Action &ac, const objects &params)
-   {
-
-      updateHash();
-   }
-
-   /// This method applies an Action to a WorldState in reverse. In effect,
-   /// it determines the state of the world required that when this Action is
-   /// applied to it, the result is the current state.
-   /// This involves making sure that the new state's predicates match the
-   /// Action's prerequisites, and clearing any predicates that the Action
-   /// sets.
-   void WorldState::applyReverse(const Action &ac, const objects &params)
-   {
-      operations::const_iterator o;
-      Operation op;
-      Fact f;
-      for(o = ac.begin(); o != ac.end(); o++)
-      {
-         op = o->second;
-         f = o->first;
-         if(params.size())
-         {
-            fillOp(op, params);
-            fillFact(f, params);
-         }
-         // If there's no condition, check the effects.
-         if(op.ctype == NoCondition)
-         {
-            switch(op.etype)
-            {
-            case Set:
-                //_set(f,op.eval);
-               _unset(f);
-               break;
-            case Unset:
-               _set(f,op.eval);
-               break;
-            case Increment:
-               _set(f, op.eval - 1);
-               break;
-            case Decrement:
-               _set(f, op.eval + 1);
-               break;
-            }
-         }
-         else
-         {
-            switch(op.ctype)
-            {
-            case IsSet:
-               _set(f, 0);
-               break;
-            case Equals:
-               _set(f, op.cval);
-               break;
-            case IsUnset:
-               _unset(f);
-               break;
-            }
-         }
-      }
-
-      updateHash();
-   }
-
-   std::string WorldState::str() const
-   {
-      worldrep::const_iterator it;
-      std::string rep = "{\n";
-      for(it = mState.begin(); it != mState.end(); it++)
-      {
-         std::stringstream s;
-         s << "    " << it->first << " -> " << it->second;
-         rep += s.str() + "\n";
-      }
-      rep += "}";
-      return rep;
-   }
-
-   /// This hash method sums the string hashes of all the predicate names in
-   /// this state, XORing certain bits based on the values of each predicate.
-   /// @todo Is there a better hash func to use? Should do some unit testing.
-   void WorldState::updateHash()
-   {
-      mHash = 0;
-      worldrep::const_iterator it;
-      for(it = mState.begin(); it != mState.end(); it++)
-      {
-         //unsigned int l = getPName(it).length();
-         //while(l)
-         //   mHash = 31 * mHash + getPName(it)[--l];
-         //mHash ^= getPVal(it) << getPName(it).length() % (sizeof(unsigned int) - sizeof(PVal));
-         mHash = 31 * mHash + (getPVal(it) << getPName(it));
-      }
-   }
 
+namespace Aesop {
+   /// @class WorldState
+   ///
+   /// This class represents a set of knowledge (facts, or predicates) about
+   /// the state of the world that we are planning within. A WorldState can be
+   /// used by individual characters as a representation of their knowledge,
+   /// but is also used internally in planning.
+
+   WorldState::WorldState()
+   {
+      mHash = 0;
+      mArgs = NULL;
+   }
+
+   WorldState::WorldState(const WorldState &other)
+   {
+      mState = other.mState;
+      mHash = other.mHash;
+      mArgs = NULL;
+   }
+
+   WorldState &WorldState::operator=(const WorldState &other)
+   {
+      if(this == &other)
+         return *this;
+      delete mArgs.exchange(NULL, std::memory_order_relaxed);
+      mState = other.mState;
+      mHash = other.mHash;
+      return *this;
+   }
+
+   WorldState::~WorldState()
+   {
+      delete mArgs.load(std::memory_order_relaxed);
+   }
+
+   /// Readers may race to build the index. Each builds its own, and all but
+   /// the first to install theirs throw it away.
+   const WorldState::argindex &WorldState::args() const
+   {
+      argindex *idx = mArgs.load(std::memory_order_acquire);
+      if(idx)
+         return *idx;
+      argindex *built = new argindex();
+      ArgRef ref;
+      worldrep::const_iterator it;
+      for(it = mState.begin(); it != mState.end(); it++)
+      {
+         ref.name = it->first.name;
+         ref.entry = &*it;
+         for(unsigned int i = 0; i < it->first.args.size(); i++)
+         {
+            ref.pos = i;
+            ref.obj = it->first.args[i];
+            built->insert(ref);
+         }
+      }
+      if(mArgs.compare_exchange_strong(idx, built, std::memory_order_acq_rel))
+         return *built;
+      delete built;
+      return *idx;
+   }
+
+   bool WorldState::ArgRefLess::operator()(const ArgRef &a, const ArgRef &b) const
+   {
+      if(a.name != b.name)
+         return a.name < b.name;
+      if(a.pos != b.pos)
+         return a.pos < b.pos;
+      if(a.obj != b.obj)
+         return a.obj < b.obj;
+      // Search keys come before every real entry.
+      if(!a.entry || !b.entry)
+         return !a.entry && b.entry;
+      return a.entry->first < b.entry->first;
+   }
+
+   void WorldState::indexArgs(const worldrep::value_type &entry)
+   {
+      argindex *idx = mArgs.load(std::memory_order_relaxed);
+      if(!idx)
+         return;
+      ArgRef ref;
+      ref.name = entry.first.name;
+      ref.entry = &entry;
+      for(unsigned int i = 0; i < entry.first.args.size(); i++)
+      {
+         ref.pos = i;
+         ref.obj = entry.first.args[i];
+         idx->insert(ref);
+      }
+   }
+
+   void WorldState::unindexArgs(const worldrep::value_type &entry)
+   {
+      argindex *idx = mArgs.load(std::memory_order_relaxed);
+      if(!idx)
+         return;
+      ArgRef ref;
+      ref.name = entry.first.name;
+      ref.entry = &entry;
+      for(unsigned int i = 0; i < entry.first.args.size(); i++)
+      {
+         ref.pos = i;
+         ref.obj = entry.first.args[i];
+         idx->erase(ref);
+      }
+   }
+
+   /// Facts are ordered by predicate before arguments, and a Fact with no
+   /// arguments comes before any other with the same predicate, so the
+   /// first Fact not less than Fact(pred) tells us the answer.
+   bool WorldState::involves(PName pred) const
+   {
+      worldrep::const_iterator it = mState.lower_bound(Fact(pred));
+      return it != mState.end() && getPName(it) == pred;
+   }
+
+   WorldState::fact_range WorldState::facts(PName pred) const
+   {
+      fact_range r;
+      r.first = r.second = mState.lower_bound(Fact(pred));
+      while(r.second != mState.end() && getPName(r.second) == pred)
+         r.second++;
+      return r;
+   }
+
+   WorldState::arg_range WorldState::facts(PName pred, unsigned int pos, Object obj) const
+   {
+      ArgRef key;
+      key.name = pred;
+      key.pos = pos;
+      key.obj = obj;
+      key.entry = NULL;
+      const argindex &index = args();
+      arg_range r;
+      r.first = r.second = index.lower_bound(key);
+      while(r.second != index.end() &&
+            r.second->name == pred && r.second->pos == pos && r.second->obj == obj)
+         r.second++;
+      return r;
+   }
+
+   /// Is argument i of a pattern a Parameter rather than a fixed object?
+   static inline int patternIndex(const Fact &pattern, unsigned int i)
+   {
+      return i < pattern.indices.size()? pattern.indices[i]: -1;
+   }
+
+   bool WorldState::matches(const Fact &pattern, const Fact &fact)
+   {
+      if(pattern.name != fact.name || pattern.args.size() != fact.args.size())
+         return false;
+      for(unsigned int i = 0; i < fact.args.size(); i++)
+      {
+         int idx = patternIndex(pattern, i);
+         if(idx < 0)
+         {
+            if(pattern.args[i] != fact.args[i])
+               return false;
+            continue;
+         }
+         // A repeated Parameter must be bound to the same object each time.
+         for(unsigned int j = 0; j < i; j++)
+         {
+            if(patternIndex(pattern, j) == idx && fact.args[j] != fact.args[i])
+               return false;
+         }
+      }
+      return true;
+   }
+
+   /// A pattern with no Parameters is a plain lookup. Otherwise we walk
+   /// the Facts sharing the pattern's first fixed argument, or the whole
+   /// predicate if it has none, and filter them with WorldState::matches.
+   WorldState::query_iterator WorldState::query(const Fact &pattern) const
+   {
+      query_iterator q;
+      q.mPattern = &pattern;
+      int bound = -1;
+      bool exact = true;
+      for(unsigned int i = 0; i < pattern.args.size(); i++)
+      {
+         if(patternIndex(pattern, i) < 0)
+         {
+            if(bound < 0)
+               bound = i;
+         }
+         else
+            exact = false;
+      }
+
+      if(exact)
+      {
+         q.mFact = q.mFactEnd = mState.find(pattern);
+         if(q.mFact != mState.end())
+            q.mFactEnd++;
+      }
+      else if(bound < 0)
+      {
+         fact_range r = facts(pattern.name);
+         q.mFact = r.first;
+         q.mFactEnd = r.second;
+      }
+      else
+      {
+         arg_range r = facts(pattern.name, bound, pattern.args[bound]);
+         q.mByArg = true;
+         q.mArg = r.first;
+         q.mArgEnd = r.second;
+      }
+      q.seek();
+      return q;
+   }
+
+   WorldState::query_iterator::query_iterator()
+   {
+      mPattern = NULL;
+      mByArg = false;
+      mDone = true;
+   }
+
+   void WorldState::query_iterator::seek()
+   {
+      if(mByArg)
+      {
+         while(mArg != mArgEnd && !matches(*mPattern, mArg->entry->first))
+            mArg++;
+         mDone = mArg == mArgEnd;
+      }
+      else
+      {
+         while(mFact != mFactEnd && !matches(*mPattern, mFact->first))
+            mFact++;
+         mDone = mFact == mFactEnd;
+      }
+   }
+
+   WorldState::query_iterator &WorldState::query_iterator::operator++()
+   {
+      if(mDone)
+         return *this;
+      if(mByArg)
+         mArg++;
+      else
+         mFact++;
+      seek();
+      return *this;
+   }
+
+   WorldState::query_iterator WorldState::query_iterator::operator++(int)
+   {
+      query_iterator old = *this;
+      ++*this;
+      return old;
+   }
+
+   void WorldState::query_iterator::bind(objects &params) const
+   {
+      const Fact &f = get()->first;
+      for(unsigned int i = 0; i < f.args.size(); i++)
+      {
+         int idx = patternIndex(*mPattern, i);
+         if(idx < 0)
+            continue;
+         if(params.size() <= (unsigned int)idx)
+            params.resize(idx + 1, NullObject);
+         params[idx] = f.args[i];
+      }
+   }
+
+   void WorldState::set(const Fact &fact, PVal val)
+   {
+      _set(fact, val);
+   }
+
+   void WorldState::_set(const Fact &fact, PVal val)
+   {
+      _set(mState.lower_bound(fact), fact, val);
+   }
+
+   /// pos is only a hint: if it is wrong and the Fact is already set, the
+   /// insertion finds the existing entry, which we then update.
+   worldrep::iterator WorldState::_set(worldrep::iterator pos, const Fact &fact, PVal val)
+   {
+      if(pos == mState.end() || !(pos->first == fact))
+      {
+         size_t size = mState.size();
+         pos = mState.insert(pos, std::make_pair(fact, val));
+         if(mState.size() != size)
+         {
+            indexArgs(*pos);
+            mHash += hashEntry(fact, val);
+            return pos;
+         }
+      }
+      mHash -= hashEntry(pos->first, pos->second);
+      pos->second = val;
+      mHash += hashEntry(fact, val);
+      return pos;
+   }
+
+   void WorldState::unset(const Fact &fact)
+   {
+      _unset(fact);
+   }
+
+   void WorldState::_unset(const Fact &fact)
+   {
+      worldrep::iterator it = mState.find(fact);
+      if(it != mState.end())
+         _unset(it);
+   }
+
+   worldrep::iterator WorldState::_unset(worldrep::iterator it)
+   {
+      mHash -= hashEntry(it->first, it->second);
+      unindexArgs(*it);
+      worldrep::iterator next = it;
+      next++;
+      mState.erase(it);
+      return next;
+   }
+
+   /// Orders Changes and entries by Fact only, so that stable sorting keeps
+   /// changes to the same Fact in the order they were made.
+   namespace {
+      struct lessFact {
+         bool operator()(const WorldState::Change &a, const WorldState::Change &b) const
+         { return a.fact < b.fact; }
+         bool operator()(const std::pair<Fact, PVal> &a, const std::pair<Fact, PVal> &b) const
+         { return a.first < b.first; }
+      };
+   };
+
+   /// Entries are sorted once and then appended to the map, which takes
+   /// amortised constant time per entry when each goes at the end.
+   void WorldState::build(std::vector<std::pair<Fact, PVal> > &entries)
+   {
+      std::stable_sort(entries.begin(), entries.end(), lessFact());
+      for(unsigned int i = 0; i < entries.size(); i++)
+      {
+         // Only the last of several entries for a Fact counts.
+         if(i + 1 < entries.size() && entries[i].first == entries[i+1].first)
+            continue;
+         worldrep::iterator it = mState.insert(mState.end(), entries[i]);
+         indexArgs(*it);
+         mHash += hashEntry(it->first, it->second);
+      }
+   }
+
+   /// Changes are sorted, so each one is usually a short step on from the
+   /// last. We walk a few entries forward before giving up and searching,
+   /// which makes dense patches linear and sparse ones logarithmic.
+   /// If a change comes before the last one, as in a patch built by hand,
+   /// we search for it from scratch instead.
+   void WorldState::apply(const WorldPatch &patch)
+   {
+      const unsigned int maxSteps = 8;
+      worldrep::iterator pos = mState.begin();
+      std::vector<Change>::const_iterator c;
+      for(c = patch.changes.begin(); c != patch.changes.end(); c++)
+      {
+         if(pos != mState.begin())
+         {
+            worldrep::iterator prev = pos;
+            prev--;
+            if(!(prev->first < c->fact))
+               pos = mState.lower_bound(c->fact);
+         }
+         unsigned int steps = 0;
+         while(pos != mState.end() && pos->first < c->fact && steps < maxSteps)
+         {
+            pos++;
+            steps++;
+         }
+         if(pos != mState.end() && pos->first < c->fact)
+            pos = mState.lower_bound(c->fact);
+
+         if(c->set)
+         {
+            pos = _set(pos, c->fact, c->val);
+            pos++;
+         }
+         else if(pos != mState.end() && pos->first == c->fact)
+            pos = _unset(pos);
+      }
+   }
+
+   void WorldState::diff(const WorldState &from, const WorldState &to, WorldPatch &patch)
+   {
+      patch.clear();
+      worldrep::const_iterator a = from.mState.begin();
+      worldrep::const_iterator b = to.mState.begin();
+      Change c;
+      while(a != from.mState.end() || b != to.mState.end())
+      {
+         if(b == to.mState.end() || (a != from.mState.end() && a->first < b->first))
+         {
+            // Only in the old state.
+            c.fact = a->first;
+            c.set = false;
+            c.val = 0;
+            patch.changes.push_back(c);
+            a++;
+         }
+         else if(a == from.mState.end() || b->first < a->first)
+         {
+            // Only in the new state.
+            c.fact = b->first;
+            c.set = true;
+            c.val = b->second;
+            patch.changes.push_back(c);
+            b++;
+         }
+         else
+         {
+            if(a->second != b->second)
+            {
+               c.fact = b->first;
+               c.set = true;
+               c.val = b->second;
+               patch.changes.push_back(c);
+            }
+            a++;
+            b++;
+         }
+      }
+   }
+
+   void WorldState::Batch::set(const Fact &fact, PVal val)
+   {
+      Change c;
+      c.fact = fact;
+      c.set = true;
+      c.val = val;
+      mChanges.push_back(c);
+   }
+
+   void WorldState::Batch::unset(const Fact &fact)
+   {
+      Change c;
+      c.fact = fact;
+      c.set = false;
+      c.val = 0;
+      mChanges.push_back(c);
+   }
+
+   void WorldState::Batch::commit()
+   {
+      std::stable_sort(mChanges.begin(), mChanges.end(), lessFact());
+      // Keep only the last change to each Fact.
+      unsigned int kept = 0;
+      for(unsigned int i = 0; i < mChanges.size(); i++)
+      {
+         if(i + 1 < mChanges.size() && mChanges[i].fact == mChanges[i+1].fact)
+            continue;
+         if(kept != i)
+            mChanges[kept] = mChanges[i];
+         kept++;
+      }
+      mChanges.resize(kept);
+      WorldPatch patch;
+      patch.changes.swap(mChanges);
+      mWS.apply(patch);
+   }
+
+   bool WorldState::get(const Fact &fact, PVal &val, PVal def) const
+   {
+      worldrep::const_iterator it = mState.find(fact);
+      if(it == mState.end())
+      {
+         val = def;
+         return false;
+      }
+      val = getPVal(it);
+      return true;
+   }
+
+   /// Is the given PVal consistent with an Operation of the given condition
+   /// and specified value?
+   static bool consistent(PVal val, ConditionType cond, PVal cval)
+   {
+      switch(cond)
+      {
+      case IsUnset:
+         // We have a mapping and we're not supposed to, so we fail.
+         return false;
+      case Equals:
+         // If the value is not what it's supposed to be, fail.
+         if(val != cval)
+            return false;
+         break;
+      case NotEqual:
+         // If the value is what it's not supposed to be, fail.
+         if(val == cval)
+            return false;
+         break;
+      case Less:
+         if(val >= cval)
+            return false;
+         break;
+      case Greater:
+         if(val <= cval)
+            return false;
+         break;
+      case LessEqual:
+         if(val > cval)
+            return false;
+         break;
+      case GreaterEqual:
+         if(val < cval)
+            return false;
+         break;
+      }
+      return true;
+   }
+
+   /// Is the given PVal consistent with following an Operation with the effect
+   /// type and value given?
+   static bool consistent(PVal val, EffectType eff, PVal eval)
+   {
+      switch(eff)
+      {
+      case Set:
+         // Fact must be set to the same value.
+         return val == eval;
+      case Unset:
+         // Fact is clearly set, so no.
+         return false;
+      case Increment:
+         // Value must have been incremented, so it should be eval+1
+         if(val != eval + 1)
+            return false;
+         break;
+      case Decrement:
+         // Value was decremented.
+         if(val != eval - 1)
+            return false;
+         break;
+      }
+      return true;
+   }
+
+   /// A Fact's pre-condition holds if the Fact is set to a value consistent
+   /// with it, or if the Fact is unset and required to be.
+   bool WorldState::preMatchOp(const Fact &f, const Operation &op) const
+   {
+      // If there's no condition, just carry merrily on.
+      if(op.ctype == NoCondition)
+         return true;
+      PVal val;
+      if(get(f, val))
+      {
+         // We have a mapping for this Fact. Check for consistency.
+         return consistent(val, op.ctype, op.cval);
+      }
+      // No mapping for this Fact. Only escape is if we don't want it to.
+      return op.ctype == IsUnset;
+   }
+
+   /// Facts that are set must be consistent with the Operation's effect, or
+   /// with its condition if it has no effect. Unset Facts are ignored.
+   /// @return -1 if the Fact is inconsistent, 1 if it is set and consistent,
+   ///         0 if it has no bearing on the match.
+   int WorldState::postMatchOp(const Fact &f, const Operation &op) const
+   {
+      PVal val;
+      // If there's no effect, look at the conditions.
+      if(op.etype == NoEffect)
+      {
+         // Check that there's actually a condition.
+         if(op.ctype == NoCondition || !get(f, val))
+            return 0;
+         // We have a mapping for this Fact. Check for consistency.
+         return consistent(val, op.ctype, op.cval)? 1: -1;
+      }
+      if(!get(f, val))
+         return 0;
+      // Check for consistency.
+      return consistent(val, op.etype, op.eval)? 1: -1;
+   }
+
+   /// Carry out a single Operation's effect, as CompiledDomain::apply does.
+   void WorldState::forwardOp(const Fact &f, const Operation &op)
+   {
+      PVal val = 0;
+      switch(op.etype)
+      {
+      case Set:
+         _set(f, op.eval);
+         break;
+      case Unset:
+         _unset(f);
+         break;
+      case Increment:
+         get(f, val);
+         _set(f, val + 1);
+         break;
+      case Decrement:
+         get(f, val);
+         _set(f, val - 1);
+         break;
+      default:
+         break;
+      }
+   }
+
+   /// Undo a single Operation: clear whatever it sets and restore whatever it
+   /// requires.
+   void WorldState::reverseOp(const Fact &f, const Operation &op)
+   {
+      // If there's no condition, check the effects.
+      if(op.ctype == NoCondition)
+      {
+         switch(op.etype)
+         {
+         case Set:
+             //_set(f,op.eval);
+            _unset(f);
+            break;
+         case Unset:
+            _set(f,op.eval);
+            break;
+         case Increment:
+            _set(f, op.eval - 1);
+            break;
+         case Decrement:
+            _set(f, op.eval + 1);
+            break;
+         }
+      }
+      else
+      {
+         switch(op.ctype)
+         {
+         case IsSet:
+            _set(f, 0);
+            break;
+         case Equals:
+            _set(f, op.cval);
+            break;
+         case IsUnset:
+            _unset(f);
+            break;
+         }
+      }
+   }
+
+   /// For a 'pre-match' to be valid, we compare the Action's required
+   /// predicates to the values in the current world state. All values must
+   /// match for the Action to be valid.
+   bool WorldState::preMatch(const Action &ac, const objects &params) const
+   {
+      if(!ac.checkSpecialConditions(params))
+         return false;
+      operations::const_iterator o;
+      Operation op;
+      Fact f;
+      for(o = ac.begin(); o != ac.end(); o++)
+      {
+         // If there's no condition, just carry merrily on.
+         if(o->second.ctype == NoCondition)
+            continue;
+         // Copy Operation and Fact for modification.
+         op = o->second;
+         f = o->first;
+         // Check whether we need to set target value based on parameter.
+         if(params.size())
+            Action::bind(params, f, op);
+         if(!preMatchOp(f, op))
+            return false;
+      }
+
+      // No inconsistencies, so we pass.
+      return true;
+   }
+
+   /// Special conditions were checked when the GroundAction was created, so
+   /// only the filled-in Operations are compared.
+   bool WorldState::preMatch(const GroundAction &ga) const
+   {
+      groundops::const_iterator o;
+      for(o = ga.ops.begin(); o != ga.ops.end(); o++)
+      {
+         if(!preMatchOp(*o->fact, o->op))
+            return false;
+      }
+      return true;
+   }
+
+   /// This method compares a desired world state with an action's results. The
+   /// comparison returns true if each predicate in our current state is either
+   /// set by the Action, or required by it and not changed.
+   /// In this method, params is an output argument. The method fills in the
+   /// values of each parameter required for the Action to result in the given
+   /// world state.
+   /// @todo This method seems to be giving false positives.
+   bool WorldState::postMatch(const Action &ac, const objects &params) const
+   {
+      if(!ac.checkSpecialConditions(params))
+         return false;
+      operations::const_iterator o;
+      Operation op;
+      Fact f;
+      int consistencies = 0;
+      for(o = ac.begin(); o != ac.end(); o++)
+      {
+         // Construct a new operation based on the parameters passed.
+         op = o->second;
+         f = o->first;
+         if(params.size())
+            Action::bind(params, f, op);
+         int m = postMatchOp(f, op);
+         if(m < 0)
+            return false;
+         consistencies += m;
+      }
+
+      return consistencies > 0;
+   }
+
+   bool WorldState::postMatch(const GroundAction &ga) const
+   {
+      groundops::const_iterator o;
+      int consistencies = 0;
+      for(o = ga.ops.begin(); o != ga.ops.end(); o++)
+      {
+         int m = postMatchOp(*o->fact, o->op);
+         if(m < 0)
+            return false;
+         consistencies += m;
+      }
+      return consistencies > 0;
+   }
+
+   /// Apply an Action to the current world state. The Action's effects are
+   /// applied to the current set of predicates.
+   void WorldState::applyForward(const Action &ac, const objects &params)
+   {
+      operations::const_iterator o;
+      Operation op;
+      Fact f;
+      for(o = ac.begin(); o != ac.end(); o++)
+      {
+         if(o->second.etype == NoEffect)
+            continue;
+         op = o->second;
+         f = o->first;
+         if(params.size())
+            Action::bind(params, f, op);
+         forwardOp(f, op);
+      }
+   }
+
+   void WorldState::applyForward(const GroundAction &ga)
+   {
+      groundops::const_iterator o;
+      for(o = ga.ops.begin(); o != ga.ops.end(); o++)
+         forwardOp(*o->fact, o->op);
+   }
+
+   /// This method applies an Action to a WorldState in reverse. In effect,
+   /// it determines the state of the world required that when this Action is
+   /// applied to it, the result is the current state.
+   /// This involves making sure that the new state's predicates match the
+   /// Action's prerequisites, and clearing any predicates that the Action
+   /// sets.
+   void WorldState::applyReverse(const Action &ac, const objects &params)
+   {
+      operations::const_iterator o;
+      Operation op;
+      Fact f;
+      for(o = ac.begin(); o != ac.end(); o++)
+      {
+         op = o->second;
+         f = o->first;
+         if(params.size())
+            Action::bind(params, f, op);
+         reverseOp(f, op);
+      }
+   }
+
+   void WorldState::applyReverse(const GroundAction &ga)
+   {
+      groundops::const_iterator o;
+      for(o = ga.ops.begin(); o != ga.ops.end(); o++)
+         reverseOp(*o->fact, o->op);
+   }
+
+   std::string WorldState::str() const
+   {
+      worldrep::const_iterator it;
+      std::string rep = "{\n";
+      for(it = mState.begin(); it != mState.end(); it++)
+      {
+         std::stringstream s;
+         s << "    " << it->first << " -> " << it->second;
+         rep += s.str() + "\n";
+      }
+      rep += "}";
+      return rep;
+   }
+
+   void WorldState::serialize(ByteWriter &out) const
+   {
+      out.putInt(mState.size());
+      worldrep::const_iterator it;
+      for(it = mState.begin(); it != mState.end(); it++)
+      {
+         out.putInt(it->first.name);
+         out.putInt(it->first.args.size());
+         for(unsigned int i = 0; i < it->first.args.size(); i++)
+            out.putInt(it->first.args[i]);
+         out.putByte(it->second);
+      }
+   }
+
+   bool WorldState::deserialize(ByteReader &in)
+   {
+      // Each entry takes at least a name, an argument count and a value.
+      unsigned int n = in.getCount(9);
+      std::vector<std::pair<Fact, PVal> > entries(n);
+      for(unsigned int e = 0; e < n && in.ok(); e++)
+      {
+         Fact &f = entries[e].first;
+         f.name = in.getInt();
+         unsigned int args = in.getCount(4);
+         for(unsigned int i = 0; i < args; i++)
+            f % (Object)in.getInt();
+         entries[e].second = in.getByte();
+      }
+      if(!in.ok())
+         return false;
+      *this = WorldState(entries.begin(), entries.end());
+      return true;
+   }
+
+   /// Each entry is hashed on its own and the results summed, so that the
+   /// hash does not depend on the order entries were added in and can be
+   /// updated in constant time as they come and go.
+   unsigned int WorldState::hashEntry(const Fact &fact, PVal val)
+   {
+      unsigned int h = 2166136261u ^ fact.name;
+      for(unsigned int i = 0; i < fact.args.size(); i++)
+         h = (h * 16777619u) ^ fact.args[i];
+      h = (h * 16777619u) ^ val;
+      // Mix the bits so that sums of similar entries don't collide.
+      h ^= h >> 16;
+      h *= 0x85ebca6bu;
+      h ^= h >> 13;
+      h *= 0xc2b2ae35u;
+      h ^= h >> 16;
+      return h;
+   }
+
+   unsigned long long WorldState::hash64() const
+   {
+      unsigned long long h = 0;
+      worldrep::const_iterator it;
+      for(it = mState.begin(); it != mState.end(); it++)
+      {
+         unsigned long long e = 14695981039346656037ull ^ it->first.name;
+         for(unsigned int i = 0; i < it->first.args.size(); i++)
+            e = (e * 1099511628211ull) ^ it->first.args[i];
+         e = (e * 1099511628211ull) ^ it->second;
+         // Mix the bits, then sum like hash does.
+         e ^= e >> 33;
+         e *= 0xff51afd7ed558ccdull;
+         e ^= e >> 33;
+         e *= 0xc4ceb9fe1a85ec53ull;
+         e ^= e >> 33;
+         h += e;
+      }
+      return h;
+   }
 
    unsigned int WorldState::compStart(const WorldState &ws1, const WorldState &ws2)
     {
@@ -400,61 +921,61 @@ namespace Aesop {
         return score;
     }
 
-
-   /// The difference score between two WorldStates is equal to the number of
-   /// predicates which they both have defined, but to different values.
-   /// Predicates that are not defined in one state, or are flagged as unset
+
+   /// The difference score between two WorldStates is equal to the number of
+   /// predicates which they both have defined, but to different values.
+   /// Predicates that are not defined in one state, or are flagged as unset
    /// in either, are not considered.
-
-   unsigned int WorldState::comp(const WorldState &ws1, const WorldState &ws2)
-   {
-      int score = 0;
-      return ws1.mState == ws2.mState ? 0 : 1;
-
-      // Iterators run from lowest to highest key values.
-      worldrep::const_iterator p1 = ws1.mState.begin();
-      worldrep::const_iterator p2 = ws2.mState.begin();
-
-      while(p1 != ws1.mState.end() || p2 != ws2.mState.end())
-      {
-         // One state may have run out of keys.
-         if(p1 == ws1.mState.end())
-         {
-            score++;
-            p2++;
-            continue;
-         }
-         if(p2 == ws2.mState.end())
-         {
-            score++;
-            p1++;
-            continue;
-         }
-
-         // Compare names of predicates (keys).
-         int cmp = getPName(p1) != getPName(p2);
-         if(cmp == 0)
-         {
-            // Names are equal. Check for different values.
-            if(getPVal(p1) != getPVal(p2))
-               score++;
-            p1++;
-            p2++;
-         }
-         else if(cmp > 0)
-         {
-            // Key 1 is greater.
-            score++;
-            p2++;
-         }
-         else // if(cmp < 0)
-         {
-            // Key 2 is greater.
-            score++;
-            p1++;
-         }
-      }
-
-      return score;
-   }
-};
+
+   unsigned int WorldState::comp(const WorldState &ws1, const WorldState &ws2)
+   {
+      int score = 0;
+      return ws1.mState == ws2.mState ? 0 : 1;
+
+      // Iterators run from lowest to highest key values.
+      worldrep::const_iterator p1 = ws1.mState.begin();
+      worldrep::const_iterator p2 = ws2.mState.begin();
+
+      while(p1 != ws1.mState.end() || p2 != ws2.mState.end())
+      {
+         // One state may have run out of keys.
+         if(p1 == ws1.mState.end())
+         {
+            score++;
+            p2++;
+            continue;
+         }
+         if(p2 == ws2.mState.end())
+         {
+            score++;
+            p1++;
+            continue;
+         }
+
+         // Compare names of predicates (keys).
+         int cmp = getPName(p1) != getPName(p2);
+         if(cmp == 0)
+         {
+            // Names are equal. Check for different values.
+            if(getPVal(p1) != getPVal(p2))
+               score++;
+            p1++;
+            p2++;
+         }
+         else if(cmp > 0)
+         {
+            // Key 1 is greater.
+            score++;
+            p2++;
+         }
+         else // if(cmp < 0)
+         {
+            // Key 2 is greater.
+            score++;
+            p1++;
+         }
+      }
+
+      return score;
+   }
+};
@@ -0,0 +1,188 @@
+/// @file AesopWorldStore.cpp
+/// Implementation of WorldStore class as defined in AesopWorldStore.h
+
+#include "AesopWorldStore.h"
+
+#include <cmath>
+
+namespace Aesop {
+   /// @class WorldSnapshot
+   ///
+   /// Versions made of changes keep them minimal, as BeliefState does: the
+   /// overlay never holds a value the base already has, and mRemoved only
+   /// holds Facts the base has. A version made from another version of
+   /// changes copies its changes and shares its base, so no chain of
+   /// versions is ever longer than one step.
+
+   WorldSnapshot::WorldSnapshot(const WorldState &state, unsigned long version)
+      : mBase(NULL), mState(state), mFlat(NULL), mHash(state.hash()), mVersion(version)
+   {
+      mSize = 0;
+      WorldState::const_iterator it;
+      for(it = mState.begin(); it != mState.end(); it++)
+         mSize++;
+   }
+
+   WorldSnapshot::WorldSnapshot(const WorldSnapshot *prev, const WorldPatch &patch, unsigned long version)
+      : mSize(0), mFlat(NULL), mHash(prev->mHash), mVersion(version)
+   {
+      mBase = prev->mBase? prev->mBase: prev;
+      mBase->acquire();
+      mOverlay = prev->mOverlay;
+      mRemoved = prev->mRemoved;
+      std::vector<WorldState::Change>::const_iterator c;
+      for(c = patch.changes.begin(); c != patch.changes.end(); c++)
+         change(*c);
+   }
+
+   WorldSnapshot::~WorldSnapshot()
+   {
+      delete mFlat.load(std::memory_order_relaxed);
+      if(mBase)
+         mBase->release();
+   }
+
+   void WorldSnapshot::change(const WorldState::Change &c)
+   {
+      PVal val;
+      if(get(c.fact, val))
+         mHash -= WorldState::hashEntry(c.fact, val);
+      PVal bval;
+      bool inBase = mBase->mState.get(c.fact, bval);
+      if(c.set)
+      {
+         mHash += WorldState::hashEntry(c.fact, c.val);
+         mRemoved.erase(c.fact);
+         if(inBase && bval == c.val)
+            mOverlay.erase(c.fact);
+         else
+            mOverlay[c.fact] = c.val;
+      }
+      else
+      {
+         mOverlay.erase(c.fact);
+         if(inBase)
+            mRemoved.insert(c.fact);
+      }
+   }
+
+   bool WorldSnapshot::get(const Fact &fact, PVal &val, PVal def) const
+   {
+      if(!mBase)
+         return mState.get(fact, val, def);
+      worldrep::const_iterator it = mOverlay.find(fact);
+      if(it != mOverlay.end())
+      {
+         val = it->second;
+         return true;
+      }
+      if(mRemoved.count(fact))
+      {
+         val = def;
+         return false;
+      }
+      return mBase->mState.get(fact, val, def);
+   }
+
+   /// Readers may race to build the full state, as with WorldState's
+   /// argument index; the first to install theirs wins.
+   const WorldState &WorldSnapshot::state() const
+   {
+      if(!mBase)
+         return mState;
+      WorldState *flat = mFlat.load(std::memory_order_acquire);
+      if(flat)
+         return *flat;
+      WorldPatch patch;
+      WorldState::Change c;
+      worldrep::const_iterator o = mOverlay.begin();
+      std::set<Fact>::const_iterator r = mRemoved.begin();
+      while(o != mOverlay.end() || r != mRemoved.end())
+      {
+         if(r == mRemoved.end() || (o != mOverlay.end() && o->first < *r))
+         {
+            c.fact = o->first;
+            c.set = true;
+            c.val = o->second;
+            o++;
+         }
+         else
+         {
+            c.fact = *r;
+            c.set = false;
+            c.val = 0;
+            r++;
+         }
+         patch.changes.push_back(c);
+      }
+      WorldState *built = new WorldState(mBase->mState);
+      built->apply(patch);
+      if(mFlat.compare_exchange_strong(flat, built, std::memory_order_acq_rel))
+         return *built;
+      delete built;
+      return *flat;
+   }
+
+   /// @class WorldStore
+   ///
+   /// Works like SharedDomain: the current WorldSnapshot is an atomic
+   /// pointer, readers take a reference to it inside an EpochManager::Guard,
+   /// and replaced versions are retired until no reader can still be
+   /// loading them. publish copies the state it is given; update only
+   /// copies the changes since the last full version, and compacts them
+   /// into a new full version every so often.
+
+   WorldStore::WorldStore(const WorldState &state)
+   {
+      mCurrent = new WorldSnapshot(state, 1);
+   }
+
+   WorldStore::~WorldStore()
+   {
+      mCurrent.exchange(NULL)->release();
+   }
+
+   const WorldSnapshot *WorldStore::acquire() const
+   {
+      EpochManager::Guard guard(mEpochs);
+      const WorldSnapshot *snap = mCurrent.load();
+      snap->acquire();
+      return snap;
+   }
+
+   unsigned long WorldStore::version() const
+   {
+      EpochManager::Guard guard(mEpochs);
+      return mCurrent.load()->version();
+   }
+
+   void WorldStore::publish(const WorldState &state)
+   {
+      std::lock_guard<std::mutex> lock(mWriteLock);
+      swap(new WorldSnapshot(state, mCurrent.load()->version() + 1));
+   }
+
+   void WorldStore::update(const WorldPatch &patch)
+   {
+      std::lock_guard<std::mutex> lock(mWriteLock);
+      // Only writers replace mCurrent, so it can't go away while we hold
+      // the lock.
+      const WorldSnapshot *cur = mCurrent.load();
+      WorldSnapshot *snap = new WorldSnapshot(cur, patch, cur->version() + 1);
+      // Each update copies the delta, and compacting copies the whole state,
+      // so compacting once the delta reaches about the square root of the
+      // state's size keeps the total cost of updates lowest.
+      if(snap->deltaSize() > 2 * (unsigned int)std::sqrt((float)snap->mBase->mSize) + 16)
+      {
+         WorldSnapshot *full = new WorldSnapshot(snap->state(), snap->version());
+         snap->release();
+         snap = full;
+      }
+      swap(snap);
+   }
+
+   void WorldStore::swap(const WorldSnapshot *snap)
+   {
+      mEpochs.retire(mCurrent.exchange(snap));
+   }
+};
@@ -0,0 +1,234 @@
+/// @file AesopServer.h
+/// Defines the aesopd planning server and its protocol.
+
+#ifndef _AESOPSERVER_H_
+#define _AESOPSERVER_H_
+
+#include "Aesop.h"
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace Aesop;
+
+/// @defgroup AesopServer Planning server
+/// Every message, in either direction, is a frame: the number of bytes that
+/// follow as a 4-byte little-endian integer, a one-byte message type, a
+/// 4-byte request ID chosen by the client and echoed in the reply, and then
+/// the body. Integers, floats, strings, WorldStates and Domains are written
+/// as by ByteWriter, WorldState::serialize and Domain::serialize.
+///
+/// A client first defines its domain with DefineDomain and is given a
+/// handle for it. Identical definitions share one handle, so every client
+/// of a domain shares its grounding and heuristic tables. The server keeps
+/// a limited number of domains, forgetting the least recently used, so a
+/// client told its handle is unknown should define the domain again. It
+/// then sends
+/// PlanRequests naming that handle, and may send many before reading any
+/// reply. Replies to PlanRequests come back in the order their batches
+/// finish, so match them up by ID.
+/// @{
+
+/// Types of message a client sends.
+enum ClientMessage {
+   /// Body: a Domain. Reply: DomainDefined or Error.
+   DefineDomain = 1,
+   /// Body: 4-byte domain handle, 1-byte PlannerHeuristic, start WorldState,
+   /// goal WorldState. Reply: PlanResult or Error.
+   PlanRequest = 2,
+};
+
+/// Types of message the server sends.
+enum ServerMessage {
+   /// Body: 4-byte domain handle.
+   DomainDefined = 1,
+   /// Body: 1-byte PlanStatus. If a plan was found, a 4-byte step count, then
+   /// for each step a 4-byte index of the Action in the domain definition,
+   /// a 4-byte parameter count and the 4-byte parameters.
+   PlanResult = 2,
+   /// Body: string describing what was wrong with the request.
+   Error = 3,
+};
+
+/// How a PlanRequest turned out.
+enum PlanStatus {
+   Planned = 0,
+   NoPlan = 1,
+   /// The search ran out of time.
+   TimedOut = 2,
+};
+
+/// Serves plans to clients on a Unix domain socket.
+///
+/// Requests are collected into batches: everything that has arrived by the
+/// time the server runs out of input, or by the end of the batch window.
+/// Requests in a batch with the same domain, heuristic, start and goal are
+/// planned only once. The rest are sorted by domain and split over a
+/// ThreadPool, each thread using a Planner of its own. Sockets are only
+/// read and written between batches, by the thread that calls run.
+///
+/// Anyone who can open the socket can make the server ground their domain,
+/// so only let trusted users near it.
+class PlanServer {
+public:
+   /// Start listening.
+   /// @param[in] path Path of the socket. A stale socket left there by a
+   ///                 server that has exited is replaced.
+   /// @return False if the socket cannot be created, or another server is
+   ///         listening on it.
+   bool listen(const std::string &path);
+
+   /// Serve clients until stop is called.
+   void run();
+
+   /// Make run return once the current batch is done. Safe to call from a
+   /// signal handler.
+   void stop() { mQuit.store(true); }
+
+   /// Wait up to this long after the first request of a batch for others
+   /// to join it. Defaults to 0: run a batch as soon as input stops.
+   void setBatchWindow(unsigned int ms) { mWindow = ms; }
+
+   /// Start a batch once this many requests are waiting, however soon.
+   /// Defaults to 1024.
+   void setMaxBatch(unsigned int n) { mMaxBatch = n ? n : 1; }
+
+   /// Drop clients that send a frame larger than this. Defaults to 16MB.
+   /// Frames are checked as soon as their length arrives.
+   void setMaxFrame(unsigned int bytes) { mMaxFrame = bytes; }
+
+   /// Refuse domains whose Actions could be grounded more than this many
+   /// ways in all, counting every choice of objects for their parameters.
+   /// Defaults to 1048576.
+   void setMaxGroundActions(unsigned long n) { mMaxGround = n; }
+
+   /// Keep at most this many domains, forgetting the least recently used
+   /// one that no request in the current batch needs. Defaults to 256.
+   void setMaxDomains(unsigned int n) { mMaxDomains = n ? n : 1; }
+
+   /// Give up on a plan once it has searched for this long, which is checked
+   /// between slices of the search. Zero means no limit. Defaults to 10000.
+   void setPlanTimeLimit(unsigned int ms) { mPlanTime = ms; }
+
+   /// Default constructor.
+   /// @param[in] threads Threads to plan with. Zero means one per hardware
+   ///                    thread.
+   PlanServer(unsigned int threads = 0);
+   /// Default destructor. Closes every socket.
+   ~PlanServer();
+
+private:
+   /// A connected client.
+   struct Client {
+      int fd;
+      /// Bytes read but not yet handled, and bytes waiting to be sent.
+      std::vector<unsigned char> in, out;
+      /// Has the client shut down its side? We still answer what it sent.
+      bool eof;
+      /// Its PlanRequests in the current batch.
+      unsigned int pending;
+
+      Client() : fd(-1), eof(false), pending(0) {}
+   };
+   /// A domain defined by a client.
+   struct ServedDomain {
+      /// Owns the Actions of the domain.
+      std::list<Action> actions;
+      const CompiledDomain *compiled;
+      /// Allows every Action at its own cost.
+      ActionOverlay *overlay;
+      /// Index of each Action in the definition.
+      std::map<const Action*, unsigned int> index;
+      /// Its entry in mDefinitions.
+      std::map<std::vector<unsigned char>, unsigned int>::iterator definition;
+      /// Value of mUses when it was last defined or asked for.
+      unsigned long used;
+   };
+   /// A distinct plan to make in the current batch.
+   struct Job {
+      const ServedDomain *domain;
+      PlannerHeuristic heuristic;
+      WorldState start, goal;
+      PlanStatus status;
+      Plan plan;
+   };
+   /// A PlanRequest waiting for its batch to finish.
+   struct Request {
+      /// Serial number of the client that sent it.
+      unsigned long client;
+      unsigned int id;
+      /// Index of its Job in the current batch.
+      unsigned int job;
+   };
+   class BatchTask;
+   friend class BatchTask;
+
+   int mListen;
+   std::string mPath;
+   std::atomic<bool> mQuit;
+   unsigned int mWindow, mMaxBatch, mMaxFrame, mMaxDomains, mPlanTime;
+   unsigned long mMaxGround;
+
+   /// Clients, by serial number.
+   std::map<unsigned long, Client> mClients;
+   unsigned long mNextClient;
+
+   /// Domains by handle. Handles are never reused.
+   std::map<unsigned int, ServedDomain*> mDomains;
+   unsigned int mNextDomain;
+   /// Handle of each distinct domain definition.
+   std::map<std::vector<unsigned char>, unsigned int> mDefinitions;
+   /// Counts domain definitions and requests, to find the least recently
+   /// used domain.
+   unsigned long mUses;
+
+   /// The current batch. Jobs are found by the body of their request.
+   std::vector<Request> mRequests;
+   std::vector<Job> mJobs;
+   std::map<std::vector<unsigned char>, unsigned int> mJobIndex;
+
+   ThreadPool mPool;
+   /// Planners not in use by a thread, and the lock that guards the list.
+   std::vector<Planner*> mPlanners;
+   std::mutex mPlannerLock;
+
+   /// Take a new connection.
+   void accept();
+   /// Read some of what a client has sent and handle every complete frame.
+   /// @return False if the client should be dropped.
+   bool receive(unsigned long serial, Client &c);
+   /// Handle every complete frame a client has sent.
+   /// @return False if the client should be dropped.
+   bool parse(unsigned long serial, Client &c);
+   /// Has a client shut down, with every reply to it sent?
+   static bool finished(const Client &c)
+   { return c.eof && !c.pending && c.out.empty(); }
+   /// Handle one frame.
+   /// @return False if the client should be dropped.
+   bool handle(unsigned long serial, Client &c, unsigned char type, unsigned int id,
+      const unsigned char *body, unsigned int size);
+   /// Send what we can of a client's pending output.
+   /// @return False if the client should be dropped.
+   bool flush(Client &c);
+   /// Make room for another domain.
+   /// @return False if every domain is needed by the current batch.
+   bool evictDomain();
+   /// Plan every Job and reply to every Request in the batch.
+   void runBatch();
+   /// Add a frame to a client's output.
+   static void reply(Client &c, unsigned char type, unsigned int id,
+      const std::vector<unsigned char> &body);
+   void close(unsigned long serial);
+
+   /// Not copyable.
+   PlanServer(const PlanServer&);
+   PlanServer &operator=(const PlanServer&);
+};
+
+/// @}
+
+#endif
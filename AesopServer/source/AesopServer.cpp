@@ -0,0 +1,548 @@
+/// @file AesopServer.cpp
+/// Implements PlanServer from AesopServer.h
+
+#include "AesopServer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/// @class PlanServer
+/// @ingroup AesopServer
+///
+/// The server is one loop over poll: accept clients, read whatever they have
+/// sent, and once nothing more is waiting (or the batch window has passed)
+/// plan everything that was asked for and queue up the replies. Replies are
+/// written as the sockets will take them, so a slow client never holds up
+/// the others. Each client is read a bounded amount at a time, and frames
+/// are handled as they arrive, so at most one partial frame is ever held.
+/// A client that shuts down its side is still answered, and closed once
+/// its replies are sent.
+///
+/// What one request can cost is bounded too: Domains are refused before
+/// grounding if they could be grounded too many ways, plans are made a
+/// slice at a time against a deadline, and the least recently used domain
+/// is forgotten once there are too many.
+
+/// Bytes to read from a socket at a time.
+static const unsigned int ReadChunk = 65536;
+/// Most chunks to read from one client before looking at the others.
+static const unsigned int ReadChunks = 16;
+/// Bytes in a frame's length, type and ID.
+static const unsigned int FrameHeader = 9;
+
+/// Plans the Jobs of a batch, each with whichever Planner is free.
+class PlanServer::BatchTask : public ThreadPool::Task {
+public:
+   BatchTask(PlanServer &server) : mServer(server) {}
+
+   void run(unsigned int i)
+   {
+      typedef std::chrono::steady_clock clock;
+      Planner *p;
+      {
+         std::lock_guard<std::mutex> lock(mServer.mPlannerLock);
+         p = mServer.mPlanners.back();
+         mServer.mPlanners.pop_back();
+      }
+      Job &job = mServer.mJobs[i];
+      p->setOverlay(job.domain->overlay);
+      p->setStart(&job.start);
+      p->setGoal(&job.goal);
+      p->setHeuristic(job.heuristic);
+      job.status = NoPlan;
+      clock::time_point deadline = clock::now() + std::chrono::milliseconds(mServer.mPlanTime);
+      if(p->initSlicedPlan())
+      {
+         // Reading the clock costs far less than any slice.
+         while(p->updateSlicedPlan())
+         {
+            if(mServer.mPlanTime && clock::now() >= deadline)
+            {
+               job.status = TimedOut;
+               break;
+            }
+         }
+         p->finaliseSlicedPlan();
+         if(p->success())
+         {
+            job.status = Planned;
+            job.plan = p->getPlan();
+         }
+      }
+      {
+         std::lock_guard<std::mutex> lock(mServer.mPlannerLock);
+         mServer.mPlanners.push_back(p);
+      }
+   }
+
+private:
+   PlanServer &mServer;
+};
+
+/// Sort Jobs so that those of one domain are planned together.
+static bool byDomain(const std::pair<const void*, unsigned int> &a,
+                     const std::pair<const void*, unsigned int> &b)
+{
+   return a.first < b.first || (a.first == b.first && a.second < b.second);
+}
+
+static unsigned int readInt(const unsigned char *p)
+{
+   return p[0] | p[1] << 8 | p[2] << 16 | (unsigned int)p[3] << 24;
+}
+
+/// Number of ways a Domain's Actions could be grounded, counting up to
+/// no more than limit + 1.
+static unsigned long groundings(const Domain &dom, unsigned long limit)
+{
+   unsigned long objs = dom.getObjects().size();
+   unsigned long total = 0;
+   for(unsigned int i = 0; i < dom.numActions() && total <= limit; i++)
+   {
+      unsigned long n = 1;
+      for(unsigned int p = 0; p < dom.getAction(i)->getNumParams() && n <= limit; p++)
+         n = objs && n > limit / objs? limit + 1: n * objs;
+      total += n < limit + 1 - total? n: limit + 1 - total;
+   }
+   return total;
+}
+
+PlanServer::PlanServer(unsigned int threads)
+   : mQuit(false), mPool(threads)
+{
+   mListen = -1;
+   mWindow = 0;
+   mMaxBatch = 1024;
+   mMaxFrame = 16 << 20;
+   mMaxDomains = 256;
+   mPlanTime = 10000;
+   mMaxGround = 1 << 20;
+   mNextClient = 0;
+   mNextDomain = 0;
+   mUses = 0;
+   // Every thread of the pool, including ours, may need one at once.
+   for(unsigned int i = 0; i < mPool.size(); i++)
+      mPlanners.push_back(new Planner());
+}
+
+PlanServer::~PlanServer()
+{
+   while(!mClients.empty())
+      close(mClients.begin()->first);
+   if(mListen >= 0)
+   {
+      ::close(mListen);
+      unlink(mPath.c_str());
+   }
+   for(unsigned int i = 0; i < mPlanners.size(); i++)
+      delete mPlanners[i];
+   std::map<unsigned int, ServedDomain*>::iterator d;
+   for(d = mDomains.begin(); d != mDomains.end(); d++)
+   {
+      delete d->second->overlay;
+      d->second->compiled->release();
+      delete d->second;
+   }
+}
+
+bool PlanServer::listen(const std::string &path)
+{
+   sockaddr_un addr;
+   if(mListen >= 0 || path.size() >= sizeof(addr.sun_path))
+      return false;
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   memcpy(addr.sun_path, path.c_str(), path.size());
+
+   int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if(fd < 0)
+      return false;
+   // Only replace the socket if nobody answers on it.
+   if(!connect(fd, (sockaddr*)&addr, sizeof(addr)))
+   {
+      ::close(fd);
+      return false;
+   }
+   unlink(path.c_str());
+   if(bind(fd, (sockaddr*)&addr, sizeof(addr)) || ::listen(fd, 64) ||
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK))
+   {
+      ::close(fd);
+      return false;
+   }
+   mListen = fd;
+   mPath = path;
+   return true;
+}
+
+void PlanServer::run()
+{
+   typedef std::chrono::steady_clock clock;
+   clock::time_point batchStart;
+   std::vector<pollfd> fds;
+   std::vector<unsigned long> serials;
+   mQuit.store(false);
+
+   while(!mQuit.load())
+   {
+      fds.clear();
+      serials.clear();
+      pollfd p;
+      p.fd = mListen;
+      p.events = POLLIN;
+      p.revents = 0;
+      fds.push_back(p);
+      std::map<unsigned long, Client>::iterator it;
+      for(it = mClients.begin(); it != mClients.end(); it++)
+      {
+         p.fd = it->second.fd;
+         p.events = (it->second.eof? 0: POLLIN) | (it->second.out.empty()? 0: POLLOUT);
+         fds.push_back(p);
+         serials.push_back(it->first);
+      }
+
+      // Wake now and then to notice stop being called.
+      int timeout = 250;
+      if(!mRequests.empty())
+      {
+         long waited = std::chrono::duration_cast<std::chrono::milliseconds>(
+            clock::now() - batchStart).count();
+         timeout = waited < (long)mWindow? (int)(mWindow - waited): 0;
+      }
+      int ready = poll(&fds[0], fds.size(), timeout);
+      if(ready < 0 && errno != EINTR)
+         break;
+
+      bool input = false;
+      if(ready > 0)
+      {
+         if(fds[0].revents & POLLIN)
+         {
+            accept();
+            input = true;
+         }
+         for(unsigned int i = 1; i < fds.size(); i++)
+         {
+            unsigned long serial = serials[i-1];
+            Client &c = mClients[serial];
+            bool keep = true;
+            if(fds[i].revents & POLLOUT)
+               keep = flush(c);
+            if(c.eof)
+            {
+               // Replies can't reach a client that has gone completely.
+               if(fds[i].revents & (POLLHUP | POLLERR))
+                  keep = false;
+            }
+            else if(keep && fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+            {
+               bool wasEmpty = mRequests.empty();
+               keep = receive(serial, c);
+               input = true;
+               if(wasEmpty && !mRequests.empty())
+                  batchStart = clock::now();
+            }
+            if(!keep || finished(c))
+               close(serial);
+         }
+      }
+
+      if(mRequests.empty())
+         continue;
+      long waited = std::chrono::duration_cast<std::chrono::milliseconds>(
+         clock::now() - batchStart).count();
+      if(mRequests.size() >= mMaxBatch || (mWindow? waited >= (long)mWindow: !input))
+      {
+         runBatch();
+         // Start sending straight away rather than waiting for poll.
+         for(it = mClients.begin(); it != mClients.end(); )
+         {
+            unsigned long serial = it->first;
+            bool keep = it->second.out.empty() || flush(it->second);
+            keep = keep && !finished(it->second);
+            it++;
+            if(!keep)
+               close(serial);
+         }
+      }
+   }
+}
+
+void PlanServer::accept()
+{
+   while(true)
+   {
+      int fd = ::accept(mListen, NULL, NULL);
+      if(fd < 0)
+         return;
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+      Client &c = mClients[mNextClient++];
+      c.fd = fd;
+   }
+}
+
+bool PlanServer::receive(unsigned long serial, Client &c)
+{
+   unsigned char buf[ReadChunk];
+   // Stop once a batch is full, or poll will bring us back for the rest.
+   for(unsigned int i = 0; i < ReadChunks && mRequests.size() < mMaxBatch; i++)
+   {
+      ssize_t n = read(c.fd, buf, sizeof(buf));
+      if(n > 0)
+      {
+         c.in.insert(c.in.end(), buf, buf + n);
+         if(!parse(serial, c))
+            return false;
+         continue;
+      }
+      if(!n)
+      {
+         // Whatever is left is a frame that will never be finished.
+         c.eof = true;
+         c.in.clear();
+         break;
+      }
+      if(errno == EINTR)
+         continue;
+      if(errno == EAGAIN || errno == EWOULDBLOCK)
+         break;
+      return false;
+   }
+   return true;
+}
+
+bool PlanServer::parse(unsigned long serial, Client &c)
+{
+   size_t pos = 0;
+   while(c.in.size() - pos >= 4)
+   {
+      unsigned int size = readInt(&c.in[pos]);
+      if(size < FrameHeader - 4 || size > mMaxFrame)
+         return false;
+      if(c.in.size() - pos - 4 < size)
+         break;
+      const unsigned char *frame = &c.in[pos + 4];
+      if(!handle(serial, c, frame[0], readInt(frame + 1), frame + 5, size - 5))
+         return false;
+      pos += 4 + size;
+   }
+   c.in.erase(c.in.begin(), c.in.begin() + pos);
+   return true;
+}
+
+bool PlanServer::handle(unsigned long serial, Client &c, unsigned char type, unsigned int id,
+   const unsigned char *body, unsigned int size)
+{
+   std::vector<unsigned char> out;
+   ByteWriter w(out);
+   ByteReader r(body, size);
+
+   if(type == DefineDomain)
+   {
+      std::vector<unsigned char> def(body, body + size);
+      std::map<std::vector<unsigned char>, unsigned int>::iterator known = mDefinitions.find(def);
+      if(known == mDefinitions.end())
+      {
+         ServedDomain *sd = new ServedDomain();
+         Domain dom;
+         const char *error = NULL;
+         if(!dom.deserialize(r, sd->actions) || !r.done())
+            error = "malformed domain";
+         else if(groundings(dom, mMaxGround) > mMaxGround)
+            error = "domain too large";
+         else if(mDomains.size() >= mMaxDomains && !evictDomain())
+            error = "too many domains";
+         if(error)
+         {
+            delete sd;
+            w.putString(error);
+            reply(c, Error, id, out);
+            return true;
+         }
+         sd->compiled = dom.freeze(mPool);
+         ActionSet set;
+         unsigned int i = 0;
+         std::list<Action>::const_iterator ac;
+         for(ac = sd->actions.begin(); ac != sd->actions.end(); ac++, i++)
+         {
+            set.add(&*ac);
+            sd->index[&*ac] = i;
+         }
+         sd->overlay = new ActionOverlay(sd->compiled, set);
+         known = mDefinitions.insert(std::make_pair(def, mNextDomain)).first;
+         sd->definition = known;
+         mDomains[mNextDomain++] = sd;
+      }
+      mDomains[known->second]->used = mUses++;
+      w.putInt(known->second);
+      reply(c, DomainDefined, id, out);
+      return true;
+   }
+
+   if(type == PlanRequest)
+   {
+      unsigned int domain = r.getInt();
+      unsigned int heuristic = r.getByte();
+      Job job;
+      std::map<unsigned int, ServedDomain*>::iterator sd = mDomains.find(domain);
+      if(!job.start.deserialize(r) || !job.goal.deserialize(r) || !r.done() ||
+         sd == mDomains.end() || heuristic > SetLevelHeuristic)
+      {
+         w.putString(sd == mDomains.end()? "unknown domain": "malformed request");
+         reply(c, Error, id, out);
+         return true;
+      }
+      sd->second->used = mUses++;
+      // The same body means the same plan.
+      std::vector<unsigned char> key(body, body + size);
+      std::map<std::vector<unsigned char>, unsigned int>::iterator known = mJobIndex.find(key);
+      if(known == mJobIndex.end())
+      {
+         job.domain = sd->second;
+         job.heuristic = (PlannerHeuristic)heuristic;
+         job.status = NoPlan;
+         known = mJobIndex.insert(std::make_pair(key, (unsigned int)mJobs.size())).first;
+         mJobs.push_back(job);
+      }
+      Request req;
+      req.client = serial;
+      req.id = id;
+      req.job = known->second;
+      mRequests.push_back(req);
+      c.pending++;
+      return true;
+   }
+
+   w.putString("unknown message type");
+   reply(c, Error, id, out);
+   return true;
+}
+
+bool PlanServer::evictDomain()
+{
+   std::map<unsigned int, ServedDomain*>::iterator d, oldest = mDomains.end();
+   for(d = mDomains.begin(); d != mDomains.end(); d++)
+   {
+      if(oldest != mDomains.end() && d->second->used >= oldest->second->used)
+         continue;
+      bool busy = false;
+      for(unsigned int i = 0; i < mJobs.size() && !busy; i++)
+         busy = mJobs[i].domain == d->second;
+      if(!busy)
+         oldest = d;
+   }
+   if(oldest == mDomains.end())
+      return false;
+   ServedDomain *sd = oldest->second;
+   mDefinitions.erase(sd->definition);
+   mDomains.erase(oldest);
+   delete sd->overlay;
+   sd->compiled->release();
+   delete sd;
+   return true;
+}
+
+void PlanServer::runBatch()
+{
+   // Plan each domain's Jobs together, which keeps its tables in cache.
+   std::vector<std::pair<const void*, unsigned int> > order(mJobs.size());
+   for(unsigned int i = 0; i < mJobs.size(); i++)
+      order[i] = std::make_pair((const void*)mJobs[i].domain, i);
+   std::sort(order.begin(), order.end(), byDomain);
+   std::vector<Job> sorted(mJobs.size());
+   std::vector<unsigned int> where(mJobs.size());
+   for(unsigned int i = 0; i < order.size(); i++)
+   {
+      sorted[i].domain = mJobs[order[i].second].domain;
+      sorted[i].heuristic = mJobs[order[i].second].heuristic;
+      sorted[i].start = mJobs[order[i].second].start;
+      sorted[i].goal = mJobs[order[i].second].goal;
+      where[order[i].second] = i;
+   }
+   mJobs.swap(sorted);
+
+   BatchTask task(*this);
+   mPool.run(task, mJobs.size());
+
+   // Each Job's reply is encoded once, however many asked for it.
+   std::vector<std::vector<unsigned char> > bodies(mJobs.size());
+   for(unsigned int i = 0; i < mJobs.size(); i++)
+   {
+      const Job &job = mJobs[i];
+      ByteWriter w(bodies[i]);
+      w.putByte(job.status);
+      if(job.status != Planned)
+         continue;
+      w.putInt(job.plan.size());
+      Plan::const_iterator step;
+      for(step = job.plan.begin(); step != job.plan.end(); step++)
+      {
+         w.putInt(job.domain->index.find(step->ac)->second);
+         w.putInt(step->params.size());
+         for(unsigned int k = 0; k < step->params.size(); k++)
+            w.putInt(step->params[k]);
+      }
+   }
+   for(unsigned int i = 0; i < mRequests.size(); i++)
+   {
+      std::map<unsigned long, Client>::iterator c = mClients.find(mRequests[i].client);
+      // Clients that have gone away get no reply.
+      if(c == mClients.end())
+         continue;
+      reply(c->second, PlanResult, mRequests[i].id, bodies[where[mRequests[i].job]]);
+      c->second.pending--;
+   }
+
+   mRequests.clear();
+   mJobs.clear();
+   mJobIndex.clear();
+}
+
+void PlanServer::reply(Client &c, unsigned char type, unsigned int id,
+   const std::vector<unsigned char> &body)
+{
+   ByteWriter w(c.out);
+   w.putInt(FrameHeader - 4 + body.size());
+   w.putByte(type);
+   w.putInt(id);
+   c.out.insert(c.out.end(), body.begin(), body.end());
+}
+
+bool PlanServer::flush(Client &c)
+{
+   size_t sent = 0;
+   while(sent < c.out.size())
+   {
+      ssize_t n = send(c.fd, &c.out[sent], c.out.size() - sent, MSG_NOSIGNAL);
+      if(n > 0)
+         sent += n;
+      else if(n < 0 && errno == EINTR)
+         continue;
+      else if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+         break;
+      else
+         return false;
+   }
+   c.out.erase(c.out.begin(), c.out.begin() + sent);
+   return true;
+}
+
+void PlanServer::close(unsigned long serial)
+{
+   std::map<unsigned long, Client>::iterator it = mClients.find(serial);
+   if(it == mClients.end())
+      return;
+   ::close(it->second.fd);
+   mClients.erase(it);
+}
@@ -0,0 +1,43 @@
+/// @file AesopServerMain.cpp
+/// Entry point of aesopd, the Aesop planning server.
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+
+#include "AesopServer.h"
+
+static PlanServer *gServer = NULL;
+
+static void onSignal(int)
+{
+   if(gServer)
+      gServer->stop();
+}
+
+int main(int argc, char **argv)
+{
+   if(argc < 2)
+   {
+      fprintf(stderr, "usage: %s socket [threads] [batch window ms]\n", argv[0]);
+      return 1;
+   }
+
+   PlanServer server(argc > 2? atoi(argv[2]): 0);
+   if(argc > 3)
+      server.setBatchWindow(atoi(argv[3]));
+   if(!server.listen(argv[1]))
+   {
+      fprintf(stderr, "%s: cannot listen on %s\n", argv[0], argv[1]);
+      return 1;
+   }
+
+   // Clients that hang up should not take us with them.
+   signal(SIGPIPE, SIG_IGN);
+   gServer = &server;
+   signal(SIGINT, onSignal);
+   signal(SIGTERM, onSignal);
+   server.run();
+   gServer = NULL;
+   return 0;
+}